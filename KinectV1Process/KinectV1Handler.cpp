@@ -12,23 +12,7 @@
 
  void KinectV1Handler::initOpenGL() {
     LOG(INFO) << "Attempted to initialise OpenGL";
-    int width = 0, height = 0;
-    if (kVersion == KinectVersion::Version1) {
-        width = KinectSettings::kinectWidth;
-        height = KinectSettings::kinectHeight;
-    }
-    else if (kVersion == KinectVersion::Version2) {
-        width = KinectSettings::kinectV2Width;
-        height = KinectSettings::kinectV2Height;
-    }   // REMOVE THIS INTO KINECT V2 IMPL
-        // Initialize textures
-    glGenTextures(1, &kinectTextureId);
-    glBindTexture(GL_TEXTURE_2D, kinectTextureId);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height,
-        0, GL_BGRA_EXT, GL_UNSIGNED_BYTE, (GLvoid*)kinectImageData.get());
-    glBindTexture(GL_TEXTURE_2D, 0);
+    // The image preview is drawn through SFML (see KVR::KinectPreview), so there's no texture to set up here
 
     // OpenGL setup
     glClearColor(1, 0, 0, 0);
@@ -85,7 +69,12 @@
     if (isInitialised()) {
         HRESULT kinectStatus = kinectSensor->NuiStatus();
         if (kinectStatus == S_OK) {
-            getKinectRGBData();
+            if (streams.generation() != appliedStreamGeneration)
+                applyStreamSubscriptions();
+            if (colorStreamWanted)
+                getKinectRGBData();
+            if (depthStreamWanted)
+                getKinectDepthData();
             updateSkeletalData();
         }
     }
@@ -100,24 +89,6 @@
             drawTrackedSkeletons(drawingWindow);
         }
     }
-};
- void KinectV1Handler::drawKinectImageData(sf::RenderWindow &drawingWindow) {
-
-    glBindTexture(GL_TEXTURE_2D, kinectTextureId);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, SFMLsettings::m_window_width, SFMLsettings::m_window_height, GL_BGRA_EXT, GL_UNSIGNED_BYTE, (GLvoid*)kinectImageData.get());
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    glBegin(GL_QUADS);
-    glTexCoord2f(0.0f, 0.0f);
-    glVertex3f(0, 0, 0);
-    glTexCoord2f(1.0f, 0.0f);
-    glVertex3f(SFMLsettings::m_window_width, 0, 0);
-    glTexCoord2f(1.0f, 1.0f);
-    glVertex3f(SFMLsettings::m_window_width, SFMLsettings::m_window_height, 0.0f);
-    glTexCoord2f(0.0f, 1.0f);
-    glVertex3f(0, SFMLsettings::m_window_height, 0.0f);
-
-    glEnd();
 };
  void KinectV1Handler::drawTrackedSkeletons(sf::RenderWindow &drawingWindow) {
     for (int i = 0; i < NUI_SKELETON_POSITION_COUNT; ++i) {
@@ -194,7 +165,7 @@
 }
  
 
-bool KinectV1Handler::getFilteredJoint(KVR::KinectTrackedDevice device, vr::HmdVector3d_t& position, vr::HmdQuaternion_t &rotation) {
+bool KinectV1Handler::getFilteredJoint(const KVR::KinectTrackedDevice & device, vr::HmdVector3d_t& position, vr::HmdQuaternion_t &rotation) {
     for (int i = 0; i < NUI_SKELETON_COUNT; ++i) {
         NUI_SKELETON_TRACKING_STATE trackingState = skeletonFrame.SkeletonData[i].eTrackingState;
 
@@ -344,26 +315,11 @@ bool KinectV1Handler::initKinect() {
     }
     //Initialise Sensor
     HRESULT hr = kinectSensor->NuiInitialize(NUI_INITIALIZE_FLAG_USES_DEPTH_AND_PLAYER_INDEX
-        | NUI_INITIALIZE_FLAG_USES_SKELETON);
+        | NUI_INITIALIZE_FLAG_USES_SKELETON
+        | NUI_INITIALIZE_FLAG_USES_COLOR);
     LOG_IF(FAILED(hr), ERROR) << "Kinect sensor failed to initialise!";
     else LOG(INFO) << "Kinect sensor opened successfully.";
-    /*
-    kinectSensor->NuiImageStreamOpen(
-        NUI_IMAGE_TYPE_COLOR,               //Depth Camera or RGB Camera?
-        NUI_IMAGE_RESOLUTION_640x480,       //Image Resolution
-        0,                                  //Image stream flags, e.g. near mode
-        2,                                  //Number of frames to buffer
-        NULL,                               //Event handle
-        &kinectRGBStream);
-    
-    */
-    kinectSensor->NuiImageStreamOpen(
-        NUI_IMAGE_TYPE_DEPTH_AND_PLAYER_INDEX,               //Depth Camera or RGB Camera?
-        NUI_IMAGE_RESOLUTION_320x240,       //Image Resolution
-        0,                                  //Image stream flags, e.g. near mode
-        2,                                  //Number of frames to buffer
-        NULL,                               //Event handle
-        &kinectDepthStream);
+    // The color and depth streams are opened once something subscribes to them, see applyStreamSubscriptions
     kinectSensor->NuiSkeletonTrackingEnable(
         NULL,
         NUI_SKELETON_TRACKING_FLAG_ENABLE_IN_NEAR_RANGE
@@ -371,17 +327,91 @@ bool KinectV1Handler::initKinect() {
     
     return kinectSensor;
 }
+void KinectV1Handler::applyStreamSubscriptions() {
+    // The v1 api has no way to close an image stream again, so once opened, an unwanted stream just isn't read
+    appliedStreamGeneration = streams.generation();
+
+    colorStreamWanted = streams.wanted(KVR::KinectStream::Color);
+    colorRequest = streams.combined(KVR::KinectStream::Color);
+    if (colorStreamWanted && !kinectRGBStream) {
+        HRESULT hr = kinectSensor->NuiImageStreamOpen(
+            NUI_IMAGE_TYPE_COLOR,               //Depth Camera or RGB Camera?
+            NUI_IMAGE_RESOLUTION_640x480,       //Image Resolution
+            0,                                  //Image stream flags, e.g. near mode
+            2,                                  //Number of frames to buffer
+            NULL,                               //Event handle
+            &kinectRGBStream);
+        LOG_IF(FAILED(hr), ERROR) << "Kinect color stream could not be opened! HRESULT " << hr;
+        colorWidth = 640;
+        colorHeight = 480;
+        colorBytesPerPixel = 4;
+    }
+
+    depthStreamWanted = streams.wanted(KVR::KinectStream::Depth);
+    depthRequest = streams.combined(KVR::KinectStream::Depth);
+    if (depthStreamWanted && !kinectDepthStream) {
+        HRESULT hr = kinectSensor->NuiImageStreamOpen(
+            NUI_IMAGE_TYPE_DEPTH_AND_PLAYER_INDEX,               //Depth Camera or RGB Camera?
+            NUI_IMAGE_RESOLUTION_320x240,       //Image Resolution
+            0,                                  //Image stream flags, e.g. near mode
+            2,                                  //Number of frames to buffer
+            NULL,                               //Event handle
+            &kinectDepthStream);
+        LOG_IF(FAILED(hr), ERROR) << "Kinect depth stream could not be opened! HRESULT " << hr;
+        depthWidth = 320;
+        depthHeight = 240;
+        depthBytesPerPixel = 2;
+        depthBuffer.resize(depthWidth * depthHeight);
+        depthStagingBuffer.resize(depthBuffer.size());
+    }
+}
 void KinectV1Handler::getKinectRGBData() {
+    // Only at 640x480, small enough that the requested resolution isn't applied
     NUI_IMAGE_FRAME imageFrame{};
     NUI_LOCKED_RECT LockedRect{};
     if (acquireKinectFrame(imageFrame, kinectRGBStream, kinectSensor)) {
         return;
     }
     INuiFrameTexture* texture = lockKinectPixelData(imageFrame, LockedRect);
-    copyKinectPixelData(LockedRect, kinectImageData.get());
+    colorMat = cv::Mat(colorHeight, colorWidth, CV_8UC4, kinectImageData.get());
+    if (colorRequest.smoothed && LockedRect.Pitch != 0) {
+        // Smoothed straight from the locked frame into the image data, rather than copying it in first
+        cv::Mat lockedMat(colorHeight, colorWidth, CV_8UC4, LockedRect.pBits, LockedRect.Pitch);
+        cv::medianBlur(lockedMat, colorMat, 5);
+    }
+    else
+        copyKinectPixelData(LockedRect, kinectImageData.get());
     unlockKinectPixelData(texture);
+    if (KinectSettings::isKinectDrawn)
+        preview.submitFrame(colorMat.data, colorMat.cols, colorMat.rows, colorMat.step);
 
     releaseKinectFrame(imageFrame, kinectRGBStream, kinectSensor);
+}
+void KinectV1Handler::getKinectDepthData() {
+    NUI_IMAGE_FRAME imageFrame{};
+    NUI_LOCKED_RECT LockedRect{};
+    if (acquireKinectFrame(imageFrame, kinectDepthStream, kinectSensor)) {
+        return;
+    }
+    INuiFrameTexture* texture = lockKinectPixelData(imageFrame, LockedRect);
+    if (LockedRect.Pitch != 0) {
+        // Unpacked into millimetres, the player index in the low bits isn't wanted
+        UINT16* dest = depthRequest.smoothed ? &depthStagingBuffer[0] : &depthBuffer[0];
+        for (int y = 0; y < depthHeight; ++y) {
+            const USHORT* row = reinterpret_cast<const USHORT*>(LockedRect.pBits + y * LockedRect.Pitch);
+            for (int x = 0; x < depthWidth; ++x) {
+                *dest++ = NuiDepthPixelToDepth(row[x]);
+            }
+        }
+        depthMat = cv::Mat(depthHeight, depthWidth, CV_16U, &depthBuffer[0]);
+        if (depthRequest.smoothed) {
+            cv::Mat stagedMat(depthHeight, depthWidth, CV_16U, &depthStagingBuffer[0]);
+            cv::medianBlur(stagedMat, depthMat, 5);
+        }
+    }
+    unlockKinectPixelData(texture);
+
+    releaseKinectFrame(imageFrame, kinectDepthStream, kinectSensor);
 }
     bool KinectV1Handler::acquireKinectFrame(NUI_IMAGE_FRAME &imageFrame, HANDLE & rgbStream, INuiSensor* &sensor)
     {
@@ -416,6 +446,7 @@ void KinectV1Handler::getKinectRGBData() {
 
     void KinectV1Handler::updateSkeletalData() {
         if (kinectSensor->NuiSkeletonGetNextFrame(0, &skeletonFrame) >= 0) {
+            skeletonCaptureTimestamp = KVR::monotonicNanoseconds();
             NUI_TRANSFORM_SMOOTH_PARAMETERS params;
             /*
             params.fCorrection = .25f;
@@ -433,6 +464,7 @@ void KinectV1Handler::getKinectRGBData() {
             //*/
             kinectSensor->NuiTransformSmooth(&skeletonFrame, &params);   //Smooths jittery tracking
 
+            int trackedSkeletonIndex = -1;
             for (int i = 0; i < NUI_SKELETON_COUNT; ++i) {
                 NUI_SKELETON_TRACKING_STATE trackingState = skeletonFrame.SkeletonData[i].eTrackingState;
 
@@ -443,9 +475,12 @@ void KinectV1Handler::getKinectRGBData() {
                     }
                     NuiSkeletonCalculateBoneOrientations(&skeletonFrame.SkeletonData[i], boneOrientations);
                     rotFilter.update(boneOrientations);
+                    trackedSkeletonIndex = i;
                     break;
                 }
             }
+            skeletonFilteredTimestamp = KVR::monotonicNanoseconds();
+            updateLatestSkeleton(trackedSkeletonIndex);
             
             //DEBUG
             /*
@@ -588,6 +623,21 @@ void KinectV1Handler::getKinectRGBData() {
     }
 
 
+    void KinectV1Handler::updateLatestSkeleton(int trackedSkeletonIndex) {
+        latestSkeleton.captureTimestamp = skeletonCaptureTimestamp;
+        latestSkeleton.isTracking = trackedSkeletonIndex >= 0;
+        if (trackedSkeletonIndex < 0)
+            return;
+        const NUI_SKELETON_DATA & data = skeletonFrame.SkeletonData[trackedSkeletonIndex];
+        for (int i = 0; i < KVR::KinectJointCount; ++i) {
+            NUI_SKELETON_POSITION_INDEX j = convertJoint(KVR::KinectJointType(i));
+            latestSkeleton.setJoint(i, KVR::JointTrackingState(data.eSkeletonPositionTrackingState[j]),
+                jointPositions[j].x, jointPositions[j].y, jointPositions[j].z);
+            Vector4 raw = boneOrientations[j].absoluteRotation.rotationQuaternion;
+            Vector4 filtered = rotFilter.GetFilteredJoints()[j];
+            latestSkeleton.setOrientations(i, raw.w, raw.x, raw.y, raw.z, filtered.w, filtered.x, filtered.y, filtered.z);
+        }
+    }
     bool KinectV1Handler::jointsUntracked(KVR::KinectJoint joint0, KVR::KinectJoint joint1, NUI_SKELETON_DATA data) {
         NUI_SKELETON_POSITION_TRACKING_STATE joint0State = data.eSkeletonPositionTrackingState[convertJoint(joint0)];
         NUI_SKELETON_POSITION_TRACKING_STATE joint1State = data.eSkeletonPositionTrackingState[convertJoint(joint1)];
@@ -16,9 +16,16 @@ public:
     HANDLE kinectDepthStream = nullptr;
     INuiSensor* kinectSensor = nullptr;
     RotationalSmoothingFilter rotFilter;
-    GLuint kinectTextureId;    // ID of the texture to contain Kinect RGB Data
     NUI_SKELETON_FRAME skeletonFrame = { 0 };
 
+    // Streams as last read from the subscriptions
+    uint64_t appliedStreamGeneration = 0;
+    bool colorStreamWanted = false;
+    bool depthStreamWanted = false;
+    KVR::KinectStreamRequest colorRequest;
+    KVR::KinectStreamRequest depthRequest;
+    std::vector<UINT16> depthStagingBuffer; // Unpacked depth, when it's smoothed on the way into depthBuffer
+
     Vector4 jointPositions[NUI_SKELETON_POSITION_COUNT];
     NUI_SKELETON_BONE_ORIENTATION boneOrientations[NUI_SKELETON_POSITION_COUNT];
 
@@ -34,7 +41,6 @@ public:
     virtual std::string statusResultString(HRESULT stat);
 
     virtual void drawKinectData(sf::RenderWindow &win);
-    virtual void drawKinectImageData(sf::RenderWindow &win);
     virtual void drawTrackedSkeletons(sf::RenderWindow &win);
 
     virtual bool putRGBDataIntoMatrix(cv::Mat& image) override {
@@ -46,11 +52,13 @@ public:
     virtual void updateTrackersWithSkeletonPosition(
         std::vector<KVR::KinectTrackedDevice> & trackers);
 
-    virtual bool getFilteredJoint(KVR::KinectTrackedDevice device, vr::HmdVector3d_t& position, vr::HmdQuaternion_t &rotation);
+    virtual bool getFilteredJoint(const KVR::KinectTrackedDevice & device, vr::HmdVector3d_t& position, vr::HmdQuaternion_t &rotation);
     NUI_SKELETON_POSITION_INDEX convertJoint(KVR::KinectJoint joint);
 private:
     bool initKinect();
+    void applyStreamSubscriptions();
     void getKinectRGBData();
+    void getKinectDepthData();
     bool acquireKinectFrame(NUI_IMAGE_FRAME &imageFrame, HANDLE & rgbStream, INuiSensor* &sensor);
     INuiFrameTexture* lockKinectPixelData(NUI_IMAGE_FRAME &imageFrame, NUI_LOCKED_RECT &LockedRect);
     void copyKinectPixelData(NUI_LOCKED_RECT &LockedRect, GLubyte* dest);
@@ -58,6 +66,7 @@ private:
     void releaseKinectFrame(NUI_IMAGE_FRAME &imageFrame, HANDLE& rgbStream, INuiSensor* &sensor);
 
     void updateSkeletalData();
+    void updateLatestSkeleton(int trackedSkeletonIndex);
     void DrawSkeleton(const NUI_SKELETON_DATA & skel, sf::RenderWindow &window);
     sf::Vector2f SkeletonToScreen(Vector4 skeletonPoint, int _width, int _height);
     void DrawBone(const NUI_SKELETON_DATA & skel, NUI_SKELETON_POSITION_INDEX joint0,
@@ -3,41 +3,39 @@
 
 
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include "Kinect.h"
 #include "SmoothingParameters.h"
 #include "openvr.h"
 #include "openvr_math.h"
 #include "VectorMath.h"
-
-#define max(a,b)            (((a) > (b)) ? (a) : (b))
-#define QuaternionIdentity Vector4{0,0,0,1}
+#include "QuaternionMath.h"
 
 //Copyright credited to Microsoft, and source code found at https://github.com/zwang87/MixedRealitywithLaserWhiteboard/blob/master/Assets/Scripts/KinectScripts/Filters/BoneOrientationsFilter.cs
 // Converted into C++
 
 class DoubleExpBoneOrientationsFilter
 {
+public:
+    // JointType_Count, rounded up to whole SSE registers. The padding joints just sit at identity
+    static const int jointLanes = 28;
 private:
-
-    // Historical Filter Data.  
-    struct FilterDoubleExponentialData
-    {
-        // Gets or sets Historical Position.  
-        Vector4 RawBoneOrientation = QuaternionIdentity;
-
-        // Gets or sets Historical Filtered Position.  
-        Vector4 FilteredBoneOrientation = QuaternionIdentity;
-
-        // Gets or sets Historical Trend.  
-        Vector4 Trend = QuaternionIdentity;
-
-        // Gets or sets Historical FrameCount.  
-        unsigned int FrameCount = 0;
-    };
-
-    // The previous filtered orientation data.
-    FilterDoubleExponentialData history[JointType_Count];
-
+    // Historical Filter Data, an array per field so four joints at a time can go into KMath's Quaternion4
+    // Historical Position.
+    KMath::Quaternion historyRaw[jointLanes];
+    // Historical Filtered Position.
+    KMath::Quaternion historyFiltered[jointLanes];
+    // Historical Trend.
+    KMath::Quaternion historyTrend[jointLanes];
+    // Historical FrameCount. 0, 1, or 2 once the filter's warmed up
+    int32_t historyFrameCount[jointLanes];
+
+    // This frame's input and output for each joint
+    KMath::Quaternion rawOrientations[jointLanes];
+    float jitterRadii[jointLanes];
+    float maxDeviationRadii[jointLanes];
+    KMath::Quaternion predictedOrientations[jointLanes];
 
     // The transform smoothing parameters for this filter.
 
@@ -86,455 +84,240 @@ public:
     /// Resets the filter to default values.
     void Reset()
     {
-        for (int i = 0; i < JointType_Count; ++i) {
-            FilterDoubleExponentialData d;
-            d.FilteredBoneOrientation = QuaternionIdentity;
-            d.FrameCount = 0;
-            d.RawBoneOrientation = QuaternionIdentity;
-            d.Trend = QuaternionIdentity;
-            history[i] = d;
+        for (int i = 0; i < jointLanes; ++i) {
+            historyRaw[i] = KMath::identityQuaternion();
+            historyFiltered[i] = KMath::identityQuaternion();
+            historyTrend[i] = KMath::identityQuaternion();
+            historyFrameCount[i] = 0;
+            rawOrientations[i] = KMath::identityQuaternion();
+            jitterRadii[i] = smoothParameters.jitterRadius;
+            maxDeviationRadii[i] = smoothParameters.maxDeviationRadius;
+            predictedOrientations[i] = KMath::identityQuaternion();
         }
+        for (int i = 0; i < JointType_Count; ++i)
+            filteredOrientations[i] = KMath::fromQuaternion<Vector4>(KMath::identityQuaternion());
     }
 
     // Implements a double exponential smoothing filter on the skeleton bone orientation quaternions.
+    // Four joints at a time with SSE, or FilterJoint for each joint without it
     void UpdateFilter(IBody* const pBody, JointOrientation* jointsOrientations)
     {
-        //        if (null == skeleton)
-        //        {
-        //            return;
-        //        }
+        PrepareJoints(pBody, jointsOrientations);
+#ifdef KVR_QUATERNION_SSE
+        FilterJointsSSE();
+#else
+        for (int jointIndex = 0; jointIndex < JointType_Count; jointIndex++)
+            FilterJoint(jointIndex);
+#endif
+        StoreFilteredJoints();
+    }
+
+    // The same filter one joint at a time, as the reference the SSE path is checked and timed against
+    void UpdateFilterPerJoint(IBody* const pBody, JointOrientation* jointsOrientations)
+    {
+        PrepareJoints(pBody, jointsOrientations);
+        for (int jointIndex = 0; jointIndex < JointType_Count; jointIndex++)
+            FilterJoint(jointIndex);
+        StoreFilteredJoints();
+    }
+private:
+    bool jointPositionIsValid(sf::Vector3f vJointPosition)
+    {
+        return (vJointPosition.x != 0.0f ||
+            vJointPosition.y != 0.0f ||
+            vJointPosition.z != 0.0f);
+    }
+    bool isTrackedOrInferred(Joint joints[], int index) {
+        return (joints[index].TrackingState == TrackingState_Inferred || joints[index].TrackingState == TrackingState_Tracked);
+    }
+    bool rotationIsValid(const KMath::Quaternion & q) {
+        return !(std::isnan(q.x) || std::isnan(q.y) || std::isnan(q.z) || std::isnan(q.w));
+    }
+
+    // Picks up this frame's orientation and filter radii for each joint, and restarts the filter on invalid ones
+    void PrepareJoints(IBody* const pBody, JointOrientation* jointsOrientations)
+    {
         Joint joints[JointType_Count];
         pBody->GetJoints(JointType_Count, joints);
 
-
         if (init == false)
         {
             Init(); // initialize with default parameters                
         }
 
-        SmoothingParameters tempSmoothingParams = getRotationSmoothingParams();
-
         // Check for divide by zero. Use an epsilon of a 10th of a millimeter
-        smoothParameters.jitterRadius = max(0.0001f, smoothParameters.jitterRadius);
+        smoothParameters.jitterRadius = std::max(0.0001f, smoothParameters.jitterRadius);
 
-        tempSmoothingParams.smoothing = smoothParameters.smoothing;
-        tempSmoothingParams.correction = smoothParameters.correction;
-        tempSmoothingParams.prediction = smoothParameters.prediction;
-
-        
         for (int jointIndex = 0; jointIndex < JointType_Count; jointIndex++)
         {
-            //KinectWrapper.NuiSkeletonPositionIndex jt = (KinectWrapper.NuiSkeletonPositionIndex)jointIndex;
-
             // If not tracked, we smooth a bit more by using a bigger jitter radius
             // Always filter feet highly as they are so noisy
-            
             if (joints[jointIndex].TrackingState != TrackingState::TrackingState_Tracked ||
                 jointIndex == JointType_FootLeft || jointIndex == JointType_FootRight)
             {
-                tempSmoothingParams.jitterRadius = smoothParameters.jitterRadius * 2.0f;
-                tempSmoothingParams.maxDeviationRadius = smoothParameters.maxDeviationRadius * 2.0f;
+                jitterRadii[jointIndex] = smoothParameters.jitterRadius * 2.0f;
+                maxDeviationRadii[jointIndex] = smoothParameters.maxDeviationRadius * 2.0f;
             }
             else
             {
-                tempSmoothingParams.jitterRadius = smoothParameters.jitterRadius;
-                tempSmoothingParams.maxDeviationRadius = smoothParameters.maxDeviationRadius;
+                jitterRadii[jointIndex] = smoothParameters.jitterRadius;
+                maxDeviationRadii[jointIndex] = smoothParameters.maxDeviationRadius;
             }
 
-            FilterJoint(joints, jointIndex, tempSmoothingParams, jointsOrientations);
-        }
-    }
-private:
-    // Update the filter for one joint.  
-    bool jointPositionIsValid(sf::Vector3f vJointPosition)
-    {
-        return (vJointPosition.x != 0.0f ||
-            vJointPosition.y != 0.0f ||
-            vJointPosition.z != 0.0f);
-    }
-    sf::Vector3f normalise(sf::Vector3f v) {
-        float  vecLength = v.x*v.x + v.y*v.y + v.z*v.z;
-        if (vecLength == 0)
-            return v;
-        vecLength = 1.0 / sqrt(vecLength);
-
-        return {
-            v.x * vecLength,
-            v.y * vecLength,
-            v.z * vecLength };
-    }
-    bool equal(const Vector4& lhs, const Vector4& rhs) {
-        return
-            lhs.w == rhs.w
-            && lhs.x == rhs.x
-            && lhs.y == rhs.y
-            && lhs.z == rhs.z
-            ;
-    }
-    float length(Vector4 v) {
-        return sqrt(v.w*v.w + v.x *v.x + v.y*v.y + v.z*v.z);
-    }
-    Vector4 normalisedQ(Vector4 a) {
-        Vector4 v = a;
-        float magnitude = pow(length(v), 2);
-        v.w /= magnitude;
-        v.x /= magnitude;
-        v.y /= magnitude;
-        v.z /= magnitude;
-        return v;
-    }
-    Vector4 fromToRotation(const sf::Vector3f &from, const sf::Vector3f &to) {
-        sf::Vector3f v0 = from;
-        sf::Vector3f v1 = to;
-        v0 = normalise(v0);
-        v1 = normalise(v1);
-
-        float d = KMath::dot(v0, v1);
-        if (d >= 1.0f) {
-            Vector4 r;
-            r.w = 1;
-            return r;
-        }
-        else if (d <= -1.0f) //Exactly opposite
-        {
-            sf::Vector3f axis(1.f, 0.f, 0.f);
-            axis = KMath::cross(axis, v0);
-            if (KMath::length(axis) == 0) {
-                axis = { 0.f, 1.f, 0.f };
-                axis = KMath::cross(axis, v0);
-            }
-            return normalisedQ({ axis.x, axis.y, axis.z, 0 });
-        }
+            KMath::Quaternion rawOrientation = KMath::toQuaternion(jointsOrientations[jointIndex].Orientation);
+            if (KMath::equal(rawOrientation, { 0,0,0,0 }))
+                rawOrientation = KMath::identityQuaternion();
 
-        const float s = sqrtf((1 + d) * 2);
-        const float invs = 1.f / s;
-        const sf::Vector3f c = KMath::cross(v0, v1)*invs;
-        return normalisedQ({ c.x, c.y, c.z, s * .5f });
-    }
-    Vector4 lerp(const Vector4& a, const Vector4& b, const float t)
-    {
-        Vector4 r;
-        float t_ = 1 - t;
-        r.x = t_ * a.x + t * b.x;
-        r.y = t_ * a.y + t * b.y;
-        r.z = t_ * a.z + t * b.z;
-        r.w = t_ * a.w + t * b.w;
-        r = normalisedQ(r);
-        return r;
-    }
-    Vector4 divide(const Vector4 x, const Vector4 y) {
-        return product(x, inverse(y));
-    }
-    Vector4 divide(const Vector4& x, float k) {
-        Vector4 q;
-        q.w = x.w / k;
-        q.x = x.x / k;
-        q.y = x.y / k;
-        q.z = x.z / k;
-        return q;
-    }
-    Vector4 subtract(Vector4 left, Vector4 right) 
-    {
-        return Vector4{ left.x - right.x, left.y - right.y, left.z - right.z, left.w - right.w };
-    }
-    Vector4 add(Vector4 left, Vector4 right) 
-    {
-        return Vector4{ left.x + right.x, left.y + right.y, left.z + right.z,left.w + right.w };
-    }
-    Vector4 product(Vector4 q, float k) {
-        return Vector4{ k*q.x, k*q.y, k*q.z,k*q.w };
-    }
-    Vector4 conj(const Vector4 x) {
-        return {  -x.x, -x.y, -x.z, x.w };
-    }
-    
-    Vector4 inverse(const Vector4 x) {   // Might need to take in reference
-        auto sq = norm_squared(x);
-        if (sq == 0.0f)
-            return QuaternionIdentity;
-        return divide(conj(x), sq);
-    }
-    /*
-    Vector4 inverse( Vector4 a) {
-        float a0 = a.x, a1 = a.y, a2 = a.z, a3 = a.z,
-            dot = a0 * a0 + a1 * a1 + a2 * a2 + a3 * a3,
-            invDot = dot ? 1.0 / dot : 0;
-
-        // TODO: Would be faster to return [0,0,0,0] immediately if dot == 0
-        Vector4 out;
-        out.x = -a0 * invDot;
-        out.y = -a1 * invDot;
-        out.z = -a2 * invDot;
-        out.w = a3 * invDot;
-        return out;
-    }
-    */
-    float norm_squared(const Vector4 x) const {
-        return  x.w * x.w + x.x * x.x + x.y * x.y + x.z * x.z;
-    }
-    Vector4 RotationBetweenQuaternions(Vector4 quaternionA, Vector4 quaternionB)
-    {
-        if (equal(quaternionA, quaternionB))
-            return quaternionA;
-        Vector4 modifiedB = EnsureQuaternionNeighborhood(quaternionA, quaternionB);
-        return product(inverse(quaternionA), modifiedB);
-    }
-    float dot(Vector4 q1, Vector4 q2) {
-        return q1.x * q2.x + q1.y * q2.y + q1.z *q2.z + q1.w * q2.w;
-    }
-    Vector4 EnsureQuaternionNeighborhood(Vector4 quaternionA, Vector4 quaternionB)
-    {
-        if (dot(quaternionA, quaternionB) < 0)
-        {
-            // Negate the second quaternion, to place it in the opposite 3D sphere.
-            //return -quaternionB;
-            return Vector4{ -quaternionB.x, -quaternionB.y, -quaternionB.z, -quaternionB.w };
+            sf::Vector3f rawPosition = { joints[jointIndex].Position.X, joints[jointIndex].Position.Y, joints[jointIndex].Position.Z };
+            bool orientationIsValid = jointPositionIsValid(rawPosition) && isTrackedOrInferred(joints, jointIndex) && rotationIsValid(rawOrientation);
+            if (!orientationIsValid && historyFrameCount[jointIndex] > 0)
+            {
+                rawOrientation = historyFiltered[jointIndex];
+                historyFrameCount[jointIndex] = 0;
+            }
+            rawOrientations[jointIndex] = rawOrientation;
         }
-
-        return quaternionB;
     }
-    float QuaternionAngle(Vector4 rotation)
-    {
-        //rotation.Normalize();
-        float angle = 2.0f * acos(rotation.w);
-        return angle;
-    }
-    Vector4 EnhancedQuaternionSlerp(Vector4 quaternionA, Vector4 quaternionB, float amount)
-    {
-        if (equal(quaternionA, quaternionB))
-            return quaternionA;
-        Vector4 modifiedB = EnsureQuaternionNeighborhood(quaternionA, quaternionB);
-        return slerp(quaternionA, modifiedB, amount);
-    }
-    Vector4 slerp(const Vector4& q1, const Vector4& q2, const float t)
-    {
-        // From wikipedia
-        Vector4 a = normalisedQ(q1);
-        Vector4 b = normalisedQ(q2);
-
-        // Compute the cosine of the angle between the two vectors.
-        double dproduct = dot(a, b);
-
-        // If the dot product is negative, the quaternions
-        // have opposite handed-ness and slerp won't take
-        // the shorter path. Fix by reversing one quaternion.
-        if (dproduct < 0.0f) {
-            b = Vector4{ -b.x, -b.y, -b.z, -b.w };
-            dproduct = -dproduct;
-        }
-        const double DOT_THRESHOLD = 0.9995;
-        if (dproduct > DOT_THRESHOLD) {
-            // If the inputs are too close for comfort, linearly interpolate
-            // and normalize the result.
-            Vector4 result = add(a, product( subtract(b,a) ,t));
-            result = normalisedQ(result);
-            return result;
-        }
-        double theta_0 = acos(dproduct);
-        double theta = theta_0 * t;    // theta = angle between v0 and result
-
-        double s0 = cos(theta) - dproduct * sin(theta) / sin(theta_0);  // == sin(theta_0 - theta) / sin(theta_0)
-        double s1 = sin(theta) / sin(theta_0);
 
-        return (add(product(a, s0), product(b, s1)));
-    }
-    Vector4 vrToKinectQuat(vr::HmdQuaternion_t vrQuaternion) {
-        Vector4 temp;
-        temp.w = vrQuaternion.w;
-        temp.x = vrQuaternion.x;
-        temp.y = vrQuaternion.y;
-        temp.z = vrQuaternion.z;
-        return temp;
-    }
-    vr::HmdQuaternion_t kinectToVRQuat(Vector4 kQuaternion) {
-        vr::HmdQuaternion_t temp;
-        temp.w = kQuaternion.w;
-        temp.x = kQuaternion.x;
-        temp.y = kQuaternion.y;
-        temp.z = kQuaternion.z;
-        return temp;
-    }
-    Vector4 rotationBetween(sf::Vector3f v1, sf::Vector3f v2) {
-        if (KMath::dot(v1, v2) > 0.999999 && KMath::dot(v1, v1) < -0.999999) {
-            return QuaternionIdentity;
-        }
-    }
-    Vector4 getRotationTo(sf::Vector3f from,sf::Vector3f dest,
-        sf::Vector3f fallbackAxis = { 0,0,0 }) 
+    // Set the filtered and predicted data back into the bone orientation
+    void StoreFilteredJoints()
     {
-        // Taken from Ogre3d's Vector3.h
-        // Based on Stan Melax's article in Game Programming Gems
-        Vector4 q;
-        // Copy, since cannot modify local
-        sf::Vector3f v0 = from;
-        sf::Vector3f v1 = dest;
-        v0 = normalise(v0);
-        v1 = normalise(v1);
-
-        float d = KMath::dot(v0, v1);
-        // If dot == 1, vectors are the same
-        if (d >= 1.0f)
-        {
-            return QuaternionIdentity;
-        }
-        if (d < (1e-6f - 1.0f))
+        for (int jointIndex = 0; jointIndex < JointType_Count; jointIndex++)
         {
-            if (fallbackAxis != sf::Vector3f{0, 0, 0})
-            {
-                // rotate 180 degrees about the fallback axis
-                q = vrToKinectQuat(vrmath::quaternionFromRotationAxis(PI, fallbackAxis.x, fallbackAxis.y, fallbackAxis.z));
-            }
-            else
-            {
-                // Generate an axis
-                sf::Vector3f axis = KMath::cross({ 1,0,0 }, v0);
-                if (KMath::length(axis) == 0.0f) // pick another if colinear
-                    axis = KMath::cross({ 0,1,0 },v0);
-                axis = normalise(axis);
-                q = vrToKinectQuat(vrmath::quaternionFromRotationAxis(PI, axis.x, axis.y, axis.z));
-            }
+            if (rotationIsValid(predictedOrientations[jointIndex]))
+                filteredOrientations[jointIndex] = KMath::fromQuaternion<Vector4>(predictedOrientations[jointIndex]);
         }
-        else
-        {
-            float s = sqrt((1 + d) * 2);
-            float invs = 1 / s;
-
-            sf::Vector3f c = KMath::cross(v0,v1);
-
-            q.x = c.x * invs;
-            q.y = c.y * invs;
-            q.z = c.z * invs;
-            q.w = s * 0.5f;
-            q = normalisedQ(q);
-        }
-        return q;
     }
 
-    bool isTrackedOrInferred(Joint joints[], int index) {
-        return (joints[index].TrackingState == TrackingState_Inferred || joints[index].TrackingState == TrackingState_Tracked);
-    }
-    bool rotationIsValid(Vector4 q) {
-        return !(isnan(q.x) || isnan(q.y) || isnan(q.z) || isnan(q.w));
-    }
-    void FilterJoint(Joint *joints, int jointIndex, SmoothingParameters & params, JointOrientation *jointOrientations)
+    // Update the filter for one joint, only doing the work for the stage it's at
+    void FilterJoint(int jointIndex)
     {
-        //        if (null == skeleton)
-        //        {
-        //            return;
-        //        }
-
-        //        int jointIndex = (int)jt;
-
+        const SmoothingParameters & params = smoothParameters;
+        const float jitterRadius = jitterRadii[jointIndex];
+        const float maxDeviationRadius = maxDeviationRadii[jointIndex];
+        KMath::Quaternion filteredOrientation;
+        KMath::Quaternion trend;
 
-        Vector4 filteredOrientation{};
-        Vector4 trend{};
+        KMath::Quaternion rawOrientation = rawOrientations[jointIndex];
+        KMath::Quaternion prevFilteredOrientation = historyFiltered[jointIndex];
+        KMath::Quaternion prevTrend = historyTrend[jointIndex];
 
-        sf::Vector3f fwdVector = { 0, 0 , 1 }; // LOOK INTO THIS VALUE!!!
-        sf::Vector3f upAxis = { 0,1,0 };
-        if (fwdVector == sf::Vector3f{0, 0, 0})
-            return;
-        vr::HmdVector3d_t v = { fwdVector.x, fwdVector.y, fwdVector.z };
-
-        Vector4 rawOrientation = jointOrientations[jointIndex].Orientation;
-        if (equal(rawOrientation, { 0,0,0,0 }))
-            rawOrientation = QuaternionIdentity;
-
-        Vector4 prevFilteredOrientation = history[jointIndex].FilteredBoneOrientation;
-        Vector4 prevTrend = history[jointIndex].Trend;
-        sf::Vector3f rawPosition = { joints[jointIndex].Position.X, joints[jointIndex].Position.Y, joints[jointIndex].Position.Z};
-        bool orientationIsValid = jointPositionIsValid(rawPosition) && isTrackedOrInferred(joints, jointIndex) && rotationIsValid(rawOrientation);
-
-        if (!orientationIsValid)
-        {
-            if (history[jointIndex].FrameCount > 0)
-            {
-                rawOrientation = history[jointIndex].FilteredBoneOrientation;
-                history[jointIndex].FrameCount = 0;
-            }
-        }
-        /*
-        if (equal(rawOrientation, { 0,0,0,0 })) {
-            // Causing NaN errors
-            return;
-        }
-        */
         // Initial start values or reset values
-        if (history[jointIndex].FrameCount == 0)
+        if (historyFrameCount[jointIndex] == 0)
         {
             // Use raw position and zero trend for first value
             filteredOrientation = rawOrientation;
-            trend = QuaternionIdentity;
+            trend = KMath::identityQuaternion();
         }
-        else if (history[jointIndex].FrameCount == 1)
+        else if (historyFrameCount[jointIndex] == 1)
         {
             // Use average of two positions and calculate proper trend for end value
-            Vector4 prevRawOrientation = history[jointIndex].RawBoneOrientation;
-            filteredOrientation = EnhancedQuaternionSlerp(prevRawOrientation, rawOrientation, 0.5f);
+            filteredOrientation = KMath::slerp(historyRaw[jointIndex], rawOrientation, 0.5f);
 
-            Vector4 diffStarted = RotationBetweenQuaternions(filteredOrientation, prevFilteredOrientation); 
-            trend = EnhancedQuaternionSlerp(prevTrend, diffStarted, params.correction);
+            KMath::Quaternion diffStarted = KMath::rotationBetween(filteredOrientation, prevFilteredOrientation);
+            trend = KMath::slerp(prevTrend, diffStarted, params.correction);
         }
         else
         {
             // First apply a jitter filter
-            Vector4 diffJitter = RotationBetweenQuaternions(rawOrientation, prevFilteredOrientation);
+            KMath::Quaternion diffJitter = KMath::rotationBetween(rawOrientation, prevFilteredOrientation);
+            float diffValJitter = std::fabs(KMath::angle(diffJitter));
 
-            float diffValJitter = abs(QuaternionAngle(diffJitter));
-
-            if (diffValJitter <= params.jitterRadius)
-            {
-                filteredOrientation = EnhancedQuaternionSlerp(prevFilteredOrientation, rawOrientation, diffValJitter / params.jitterRadius);
-            }
+            if (diffValJitter <= jitterRadius)
+                filteredOrientation = KMath::slerp(prevFilteredOrientation, rawOrientation, diffValJitter / jitterRadius);
             else
-            {
                 filteredOrientation = rawOrientation;
-            }
 
             // Now the double exponential smoothing filter
-            filteredOrientation = EnhancedQuaternionSlerp(filteredOrientation, product(prevFilteredOrientation, prevTrend), params.smoothing);
-
-            diffJitter = RotationBetweenQuaternions(filteredOrientation, prevFilteredOrientation);
+            filteredOrientation = KMath::slerp(filteredOrientation, KMath::multiply(prevFilteredOrientation, prevTrend), params.smoothing);
 
-            trend = EnhancedQuaternionSlerp(prevTrend, diffJitter, params.correction);
+            diffJitter = KMath::rotationBetween(filteredOrientation, prevFilteredOrientation);
+            trend = KMath::slerp(prevTrend, diffJitter, params.correction);
         }
 
         // Use the trend and predict into the future to reduce latency
-        Vector4 predictedOrientation = product(filteredOrientation, EnhancedQuaternionSlerp(QuaternionIdentity, trend, params.prediction));
+        KMath::Quaternion predictedOrientation = KMath::multiply(filteredOrientation, KMath::slerp(KMath::identityQuaternion(), trend, params.prediction));
 
         // Check that we are not too far away from raw data
-        Vector4 diff = RotationBetweenQuaternions(predictedOrientation, filteredOrientation);
-        float diffVal = abs(QuaternionAngle(diff));
+        KMath::Quaternion diff = KMath::rotationBetween(predictedOrientation, filteredOrientation);
+        float diffVal = std::fabs(KMath::angle(diff));
 
-        if (diffVal > params.maxDeviationRadius)
-        {
-            predictedOrientation = EnhancedQuaternionSlerp(filteredOrientation, predictedOrientation, params.maxDeviationRadius / diffVal);
-        }
-
-        //        predictedOrientation.Normalize();
-        //        filteredOrientation.Normalize();
-        //        trend.Normalize();
+        if (diffVal > maxDeviationRadius)
+            predictedOrientation = KMath::slerp(filteredOrientation, predictedOrientation, maxDeviationRadius / diffVal);
 
         // Save the data from this frame
-        history[jointIndex].RawBoneOrientation = rawOrientation;
-        history[jointIndex].FilteredBoneOrientation = filteredOrientation;
-        history[jointIndex].Trend = trend;
-        history[jointIndex].FrameCount++;
-
-        // Set the filtered and predicted data back into the bone orientation
-        if (rotationIsValid(predictedOrientation))
+        historyRaw[jointIndex] = rawOrientation;
+        historyFiltered[jointIndex] = filteredOrientation;
+        historyTrend[jointIndex] = trend;
+        if (historyFrameCount[jointIndex] < 2)
+            historyFrameCount[jointIndex]++;
+        predictedOrientations[jointIndex] = predictedOrientation;
+    }
+
+#ifdef KVR_QUATERNION_SSE
+    // FilterJoint for four joints per instruction. The lanes go through every stage any of them is at,
+    // and each keeps the one its frame count says FilterJoint would have taken
+    void FilterJointsSSE()
+    {
+        using namespace KMath::QuaternionSSE;
+        const __m128 smoothing = _mm_set1_ps(smoothParameters.smoothing);
+        const __m128 correction = _mm_set1_ps(smoothParameters.correction);
+        const __m128 prediction = _mm_set1_ps(smoothParameters.prediction);
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 signBit = _mm_set1_ps(-0.0f);
+        const __m128i zeroi = _mm_setzero_si128();
+        const __m128i onei = _mm_set1_epi32(1);
+        const Quaternion4 identity = identity4();
+
+        for (int i = 0; i < jointLanes; i += 4)
         {
-            filteredOrientations[jointIndex] = predictedOrientation; //Was previously a TRS matrix!!!
+            const __m128 jitterRadius = _mm_loadu_ps(jitterRadii + i);
+            const __m128 maxDeviationRadius = _mm_loadu_ps(maxDeviationRadii + i);
+            const __m128i frameCount = _mm_loadu_si128(reinterpret_cast<const __m128i*>(historyFrameCount + i));
+            const __m128 firstFrame = _mm_castsi128_ps(_mm_cmpeq_epi32(frameCount, zeroi));
+            const __m128 secondFrame = _mm_castsi128_ps(_mm_cmpeq_epi32(frameCount, onei));
+
+            const Quaternion4 rawOrientation = load4(rawOrientations + i);
+            const Quaternion4 prevFilteredOrientation = load4(historyFiltered + i);
+            const Quaternion4 prevTrend = load4(historyTrend + i);
+
+            // Each stage is only worked out if one of the four joints is at it
+            // Second frame: average of the two
+            Quaternion4 averaged = rawOrientation;
+            if (_mm_movemask_ps(secondFrame))
+                averaged = slerp(load4(historyRaw + i), rawOrientation, half);
+
+            // Warmed up: jitter filter, then the double exponential smoothing
+            Quaternion4 smoothed = rawOrientation;
+            if (_mm_movemask_ps(_mm_or_ps(firstFrame, secondFrame)) != 0xF) {
+                __m128 diffValJitter = _mm_andnot_ps(signBit, angle(rotationBetween(rawOrientation, prevFilteredOrientation)));
+                smoothed = select(_mm_cmple_ps(diffValJitter, jitterRadius),
+                    slerp(prevFilteredOrientation, rawOrientation, _mm_div_ps(diffValJitter, jitterRadius)), rawOrientation);
+                smoothed = slerp(smoothed, multiply(prevFilteredOrientation, prevTrend), smoothing);
+            }
+
+            Quaternion4 filteredOrientation = select(firstFrame, rawOrientation, select(secondFrame, averaged, smoothed));
+
+            // The trend works out the same way for the second frame and once warmed up, and is identity on the first
+            Quaternion4 trend = slerp(prevTrend, rotationBetween(filteredOrientation, prevFilteredOrientation), correction);
+            trend = select(firstFrame, identity, trend);
+
+            // Use the trend and predict into the future, without straying too far from the filtered data
+            Quaternion4 predictedOrientation = multiply(filteredOrientation, slerp(identity, trend, prediction));
+            __m128 diffVal = _mm_andnot_ps(signBit, angle(rotationBetween(predictedOrientation, filteredOrientation)));
+            predictedOrientation = select(_mm_cmpgt_ps(diffVal, maxDeviationRadius),
+                slerp(filteredOrientation, predictedOrientation, _mm_div_ps(maxDeviationRadius, diffVal)), predictedOrientation);
+
+            store4(historyRaw + i, rawOrientation);
+            store4(historyFiltered + i, filteredOrientation);
+            store4(historyTrend + i, trend);
+            // Counts up to 2, the masks being -1 where it's 0 or 1
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(historyFrameCount + i),
+                _mm_sub_epi32(frameCount, _mm_castps_si128(_mm_or_ps(firstFrame, secondFrame))));
+            store4(predictedOrientations + i, predictedOrientation);
         }
-        
-    }
-    Vector4 product(const Vector4 &lhs, const Vector4 &rhs) {
-        return {
-            (lhs.w * rhs.x) + (lhs.x * rhs.w) + (lhs.y * rhs.z) - (lhs.z * rhs.y),
-            (lhs.w * rhs.y) + (lhs.y * rhs.w) + (lhs.z * rhs.x) - (lhs.x * rhs.z),
-            (lhs.w * rhs.z) + (lhs.z * rhs.w) + (lhs.x * rhs.y) - (lhs.y * rhs.x),
-            (lhs.w * rhs.w) - (lhs.x * rhs.x) - (lhs.y * rhs.y) - (lhs.z * rhs.z)
-        };
     }
-    private:
-        Vector4 filteredOrientations[JointType_Count];
-};
\ No newline at end of file
+#endif
+
+    Vector4 filteredOrientations[JointType_Count];
+};
@@ -2,57 +2,19 @@
 #include "KinectJointFilter.h"
 #include <iostream>
 #include "VectorMath.h"
-inline float lerp(float f1, float f2, float fBlend)
-{
-    return f1 + (f2 - f1) * fBlend;
-}
-
-//--------------------------------------------------------------------------------------
-// if joint is 0 it is not valid.
-//--------------------------------------------------------------------------------------
-inline bool jointPositionIsValid(sf::Vector3f vJointPosition)
-{
-    return (vJointPosition.x != 0.0f ||
-        vJointPosition.y != 0.0f ||
-        vJointPosition.z != 0.0f);
-}
-
 //--------------------------------------------------------------------------------------
 // Implementation of a Holt Double Exponential Smoothing filter. The double exponential
 // smooths the curve and predicts.  There is also noise jitter removal. And maximum
 // prediction bounds.  The paramaters are commented in the init function.
+// The per-joint filter lives in JointSmoothingKernel.h, this just lays the joints out for it
 //--------------------------------------------------------------------------------------
 void DoubleExponentialFilter::update(IBody* const pBody, bool newFrameArrived)
 {
     assert(pBody);
 
-    // Check for divide by zero. Use an epsilon of a 10th of a millimeter
-    m_fJitterRadius = std::max(0.0001f, m_fJitterRadius);
-
-    SmoothingParameters SmoothingParams;
-
-    int jointCapacity = 0;
     Joint joints[JointType_Count];
-
-    pBody->GetJoints(jointCapacity, joints);
-    for (int i = 0; i < JointType_Count; i++)
-    {
-        SmoothingParams.smoothing = m_fSmoothing;
-        SmoothingParams.correction = m_fCorrection;
-        SmoothingParams.prediction = m_fPrediction;
-        SmoothingParams.jitterRadius = m_fJitterRadius;
-        SmoothingParams.maxDeviationRadius = m_fMaxDeviationRadius;
-
-        // If inferred, we smooth a bit more by using a bigger jitter radius
-        Joint joint = joints[i];
-        if (joint.TrackingState == TrackingState::TrackingState_Inferred)
-        {
-            SmoothingParams.jitterRadius *= 2.0f;
-            SmoothingParams.maxDeviationRadius *= 2.0f;
-        }
-
-        update(joints, i, SmoothingParams, newFrameArrived);
-    }
+    pBody->GetJoints(JointType_Count, joints);
+    update(joints, newFrameArrived);
 }
 
 void DoubleExponentialFilter::update(Joint joints[], bool newFrameArrived)
@@ -60,140 +22,20 @@ void DoubleExponentialFilter::update(Joint joints[], bool newFrameArrived)
     // Check for divide by zero. Use an epsilon of a 10th of a millimeter
     m_fJitterRadius = std::max(0.0001f, m_fJitterRadius);
 
-    SmoothingParameters SmoothingParams;
-    for (INT i = 0; i < JointType_Count; i++)
+    const KVR::JointSmoothingParams smoothingParams{ m_fSmoothing, m_fCorrection, m_fPrediction, m_fJitterRadius, m_fMaxDeviationRadius };
+    for (int i = 0; i < JointType_Count; i++)
     {
-        SmoothingParams.smoothing = m_fSmoothing;
-        SmoothingParams.correction = m_fCorrection;
-        SmoothingParams.prediction = m_fPrediction;
-        SmoothingParams.jitterRadius = m_fJitterRadius;
-        SmoothingParams.maxDeviationRadius = m_fMaxDeviationRadius;
-
+        latestJoints.x[i] = joints[i].Position.X;
+        latestJoints.y[i] = joints[i].Position.Y;
+        latestJoints.z[i] = joints[i].Position.Z;
         // If inferred, we smooth a bit more by using a bigger jitter radius
-        Joint joint = joints[i];
-        if (joint.TrackingState == TrackingState::TrackingState_Inferred)
-        {
-            SmoothingParams.jitterRadius *= 2.0f;
-            SmoothingParams.maxDeviationRadius *= 2.0f;
-        }
-
-        update(joints, i, SmoothingParams, newFrameArrived);
-    }
-
-}
-
-void DoubleExponentialFilter::update(Joint joints[], UINT JointID, SmoothingParameters smoothingParams, bool newFrameArrived)
-{
-    sf::Vector3f vPrevRawPosition;
-    sf::Vector3f vPrevFilteredPosition;
-    sf::Vector3f vPrevTrend;
-    sf::Vector3f vRawPosition;
-    sf::Vector3f vFilteredPosition;
-    sf::Vector3f vPredictedPosition;
-    sf::Vector3f vDiff;
-    sf::Vector3f vTrend;
-
-    float vectorLength;
-    float fDiff;
-    bool bJointIsValid;
-
-    const Joint joint = joints[JointID];
-
-    // Smoothing always run on old frames (DJ Lukis' Impl.)
-    
-    vPrevRawPosition = pointHistory[JointID].rawPosition;
-    sf::Vector3f latestRawPosition = sf::Vector3f(joint.Position.X, joint.Position.Y, joint.Position.Z);
-    vPrevFilteredPosition = pointHistory[JointID].filteredPosition;
-    vPrevTrend = pointHistory[JointID].trend;
-
-    if (newFrameArrived) {
-        vRawPosition = latestRawPosition; // New frame        
+        latestJoints.inferred[i] = (joints[i].TrackingState == TrackingState::TrackingState_Inferred) ? -1 : 0;
     }
-    else {
-        // Old Frame
-        vRawPosition = vPrevFilteredPosition + vPrevTrend * 0.9f /** smoothingParams.prediction*/;
-    }
-
-
-    bJointIsValid = jointPositionIsValid(vRawPosition);
 
-    // If joint is invalid, reset the filter
-    if (!bJointIsValid)
-    {
-        pointHistory[JointID].frameCount = 0;
-    }
+    KVR::smoothJoints(smoothingParams, latestJoints, newFrameArrived, history, smoothedJoints);
 
-    // Initial start values
-    if (pointHistory[JointID].frameCount == 0)
-    {
-        vFilteredPosition = vRawPosition;
-        vTrend = { 0,0,0 };
-        pointHistory[JointID].frameCount++;
-    }
-    else if (pointHistory[JointID].frameCount == 1)
-    {
-        vFilteredPosition = (vRawPosition + vPrevRawPosition) * 0.5f;
-        vDiff = vFilteredPosition - vPrevFilteredPosition;
-        vTrend = (vDiff * smoothingParams.correction) 
-            + (vPrevTrend * (1.0f - smoothingParams.correction));
-        pointHistory[JointID].frameCount++;
-    }
-    else
-    {
-
-        // First apply jitter filter
-        vDiff = vRawPosition - vPrevFilteredPosition;
-        vectorLength = KMath::length(vDiff);
-        fDiff = fabs(vectorLength);
-
-        if (fDiff <= smoothingParams.jitterRadius)
-        {
-            vFilteredPosition = 
-                vRawPosition 
-                    * (fDiff / smoothingParams.jitterRadius)
-                + vPrevFilteredPosition 
-                    *( 1.0f - fDiff / smoothingParams.jitterRadius);
-        }
-        else
-        {
-            vFilteredPosition = vRawPosition;
-        }
-
-        // Now the double exponential smoothing filter
-        vFilteredPosition = 
-            vFilteredPosition * ( 1.0f - smoothingParams.smoothing)
-            +
-            (vPrevFilteredPosition + vPrevTrend) * smoothingParams.smoothing;
-
-
-        vDiff = vFilteredPosition - vPrevFilteredPosition;
-        vTrend = vDiff * smoothingParams.correction +
-            vPrevTrend *( 1.0f - smoothingParams.correction);
-    }
-
-    // Predict into the future to reduce latency
-    vPredictedPosition = vFilteredPosition + vTrend * smoothingParams.prediction;
-
-    // Check that we are not too far away from raw data
-    vDiff = vPredictedPosition - vRawPosition;
-    vectorLength = KMath::length(vDiff);
-    fDiff = fabs(vectorLength);
-
-    if (fDiff > smoothingParams.maxDeviationRadius)
+    for (int i = 0; i < JointType_Count; i++)
     {
-        vPredictedPosition = 
-            vPredictedPosition * (smoothingParams.maxDeviationRadius / fDiff)
-            +
-            vRawPosition * ( 1.0f - (smoothingParams.maxDeviationRadius / fDiff));
+        filteredJointPoints[i] = sf::Vector3f(smoothedJoints.x[i], smoothedJoints.y[i], smoothedJoints.z[i]);
     }
-
-    // Save the data from this frame
-    pointHistory[JointID].rawPosition = vRawPosition;
-    pointHistory[JointID].filteredPosition = vFilteredPosition;
-    pointHistory[JointID].trend = vTrend;
-
-    // Output the data
-    filteredJointPoints[JointID] = vPredictedPosition;
-    //if (JointID == 14)
-       // std::cerr << "Foot Frame " << pointHistory[JointID].frameCount << " , Predicted: " << vPredictedPosition.x << ", " << vPredictedPosition.y << ", " << vPredictedPosition.z << "\n";
-}
\ No newline at end of file
+}
@@ -6,9 +6,21 @@
 #include <VRHelper.h>
 #include "KinectJointFilter.h"
 #include <ppl.h>
+#include <algorithm>
 #include <thread>
 #include <chrono>
 
+namespace {
+    // Neighbouring depth pixels land about 3.15 x 2.84 colour pixels apart, so the nearest one to a colour pixel
+    // can be up to half that diagonal (~2.1px) away. Allow a bit over that for the lens distortion
+    const float depthPixelColorSpacingX = 3.15f;
+    const float depthPixelColorSpacingY = 2.84f;
+    const float maxColorMatchDistanceSquared = 1.2f * 1.2f
+        * (depthPixelColorSpacingX * depthPixelColorSpacingX + depthPixelColorSpacingY * depthPixelColorSpacingY) / 4.f;
+    // At least the match distance across, so any match is in the target's cell or one next to it
+    const int colorMatchCellSize = 4;
+}
+
 HRESULT KinectV2Handler::getStatusResult()
 {
     BOOLEAN avail;
@@ -31,12 +43,9 @@ std::string KinectV2Handler::statusResultString(HRESULT stat)
 void KinectV2Handler::initialise() {
     try {
         kVersion = KinectVersion::Version2;
-        kinectImageData = std::make_unique<GLubyte[]>(KinectSettings::kinectV2Width * KinectSettings::kinectV2Height * 4);  //RGBA
         initialised = initKinect();
-        // initialiseColor(); 
-        // Commented both image frames out, as most people use the kinect for skeletal data
-        // Updating all of the arrays uses a shit ton of CPU, but then again, it's still WIP
-        // initialiseDepth();
+        // Color and depth are only opened once something subscribes to them (see applyStreamSubscriptions),
+        // as most people use the kinect for skeletal data, and updating all of the arrays uses a shit ton of CPU
         initialiseSkeleton();
         if (!initialised) throw FailedKinectInitialisation;
     }
@@ -46,6 +55,7 @@ void KinectV2Handler::initialise() {
 }
 void KinectV2Handler::initialiseSkeleton()
 {
+    captureThread.stop();
     if (bodyFrameReader)
         bodyFrameReader->Release();
     IBodyFrameSource* bodyFrameSource;
@@ -63,6 +73,10 @@ void KinectV2Handler::initialiseSkeleton()
     }
     else {
         LOG(INFO) << "Kinect Skeleton Reader subscribed to event, initialised successfully.";
+        bodyFrameEvents.handle = h_bodyFrameEvent;
+        captureThread.start(&bodyFrameEvents, [this](int64_t arrivalTimestamp) {
+            captureBodyFrame(arrivalTimestamp);
+        });
     }
 }
 void KinectV2Handler::initialiseColor()
@@ -84,6 +98,7 @@ https://github.com/UnaNancyOwen/Kinect2Sample/blob/master/sample/CoordinateMappe
 
                                                                                 // Allocation Color Buffer
     colorBuffer.resize(colorWidth * colorHeight * colorBytesPerPixel);
+    colorStagingBuffer.resize(colorBuffer.size());
     if (colorFrameSource) colorFrameSource->Release();
     if (colorFrameDescription) colorFrameDescription->Release();
 
@@ -111,6 +126,7 @@ https://github.com/UnaNancyOwen/Kinect2Sample/blob/master/sample/CoordinateMappe
     depthFrameDescription->get_BytesPerPixel(&depthBytesPerPixel); // 2
                                                                                 // Allocation Depth Buffer
     depthBuffer.resize(depthWidth * depthHeight);
+    depthStagingBuffer.resize(depthBuffer.size());
 
     if (depthFrameSource) depthFrameSource->Release();
     if (depthFrameDescription) depthFrameDescription->Release();
@@ -123,6 +139,8 @@ https://github.com/UnaNancyOwen/Kinect2Sample/blob/master/sample/CoordinateMappe
 }
 void KinectV2Handler::terminateSkeleton()
 {
+    captureThread.stop();
+    bodyFrameEvents.handle = 0;
     if (bodyFrameReader) {
         HRESULT hr = bodyFrameReader->UnsubscribeFrameArrived(h_bodyFrameEvent);
         if (FAILED(hr)) {
@@ -165,23 +183,7 @@ void KinectV2Handler::terminateDepth()
 void KinectV2Handler::initOpenGL()
 {
     LOG(INFO) << "Attempted to initialise OpenGL";
-    int width = 0, height = 0;
-    if (kVersion == KinectVersion::Version1) {
-        width = KinectSettings::kinectWidth;
-        height = KinectSettings::kinectHeight;
-    }
-    else if (kVersion == KinectVersion::Version2) {
-        width = KinectSettings::kinectV2Width;
-        height = KinectSettings::kinectV2Height;
-    }   // REMOVE THIS INTO KINECT V2 IMPL
-        // Initialize textures
-    glGenTextures(1, &kinectTextureId);
-    glBindTexture(GL_TEXTURE_2D, kinectTextureId);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height,
-        0, GL_BGRA_EXT, GL_UNSIGNED_BYTE, (GLvoid*)kinectImageData.get());
-    glBindTexture(GL_TEXTURE_2D, 0);
+    // The image preview is drawn through SFML (see KVR::KinectPreview), so there's no texture to set up here
 
     // OpenGL setup
     glClearColor(1, 0, 0, 0);
@@ -202,78 +204,87 @@ void KinectV2Handler::update()
         BOOLEAN isAvailable = false;
         HRESULT kinectStatus = kinectSensor->get_IsAvailable(&isAvailable);
         if (kinectStatus == S_OK) {
-            // NEW ARRIVED FRAMES ------------------------
-            MSG msg;
-            while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) // Unneccesary?
-            {
-                DispatchMessage(&msg);
+            if (streams.generation() != appliedStreamGeneration)
+                applyStreamSubscriptions();
+
+            // The capture thread has already acquired and filtered the body frame, just pick up the newest one
+            if (const KinectV2SkeletonSnapshot* snapshot = skeletonSlot.consume()) {
+                latestSkeleton = snapshot->skeleton;
+                skeletonCaptureTimestamp = snapshot->skeleton.captureTimestamp;
+                skeletonFilteredTimestamp = snapshot->filteredTimestamp;
+                std::copy(snapshot->joints, snapshot->joints + JointType_Count, drawnJoints);
+                drawnLeftHandState = snapshot->leftHandState;
+                drawnRightHandState = snapshot->rightHandState;
             }
-
-            if (h_bodyFrameEvent)
-            {
-                //printf("Kinect Event ID: %d\n" ,(int)h_bodyFrameEvent);
-
-                //now check for IR Events
-                HANDLE handles[] = { reinterpret_cast<HANDLE>(h_bodyFrameEvent) }; // , reinterpret_cast<HANDLE>(ke.hMSEvent)		};
-
-                switch (MsgWaitForMultipleObjects(_countof(handles), handles, false, 0, QS_ALLINPUT))
-                {
-                case WAIT_OBJECT_0:
-                {
-                    IBodyFrameArrivedEventArgs* pArgs = nullptr;
-                    //printf("Body Frame Event Signaled.\n");
-
-                    if (bodyFrameReader)
-                    {
-                        HRESULT hr = bodyFrameReader->GetFrameArrivedEventData(h_bodyFrameEvent, &pArgs);
-                        //printf("Retreive Frame Arrive Event Data -HR: %d\n", hr);
-
-                        if (SUCCEEDED(hr))
-                        {
-                            //printf("Retreived Frame Arrived Event Data\n");
-                            onBodyFrameArrived(*bodyFrameReader, *pArgs);
-                            pArgs->Release();
-                            //printf("Frame Arrived Event Data Released\n");
-                        }
-                    }
-                }
-                break;
-                }
-            }
-            // ------------------------------
             updateKinectData();
         }
     }
 }
-template <typename T>
-void updateBufferWithSmoothedMat(cv::Mat &in, cv::Mat &out, std::vector<T> &buffer) {
-    int filterIntensity = 5; //MUST be odd
-    cv::medianBlur(in, out, filterIntensity);
-    
-
-    if (out.isContinuous()) {
-        buffer.assign((T*)out.datastart, (T*)out.dataend);
-    }
-    else {
-        for (int i = 0; i < out.rows; ++i) {
-            buffer.insert(buffer.end(), out.ptr<T>(i), out.ptr<T>(i) + out.cols);
-        }
+bool KinectV2Handler::waitForNewFrame(std::chrono::milliseconds timeout)
+{
+    if (!isInitialised() || !captureThread.isRunning()) {
+        std::this_thread::sleep_for(timeout);
+        return false;
     }
+    return skeletonSlot.waitForFresh(timeout);
 }
+void KinectV2Handler::applyStreamSubscriptions()
+{
+    // Generation first, so a change made while this runs is picked up next update
+    appliedStreamGeneration = streams.generation();
+
+    bool wantColor = streams.wanted(KVR::KinectStream::Color);
+    if (wantColor && !colorFrameReader)
+        initialiseColor();
+    else if (!wantColor && colorFrameReader)
+        terminateColor();
+    colorRequest = streams.combined(KVR::KinectStream::Color);
+
+    bool wantDepth = streams.wanted(KVR::KinectStream::Depth);
+    if (wantDepth && !depthFrameReader)
+        initialiseDepth();
+    else if (!wantDepth && depthFrameReader)
+        terminateDepth();
+    depthRequest = streams.combined(KVR::KinectStream::Depth);
+}
+const int streamMedianFilterSize = 5; //MUST be odd
 void KinectV2Handler::updateColorData()
 {
     if (colorFrameReader) {
-        IColorFrame* colorFrame;
+        IColorFrame* colorFrame = nullptr;
         const HRESULT retrieveFrame = colorFrameReader->AcquireLatestFrame(&colorFrame);
         if (FAILED(retrieveFrame)) {
-            LOG(ERROR) << "Could not retrieve color frame! HRESULT " << retrieveFrame;
+            if (retrieveFrame != E_PENDING) // Pending just means there's no new frame yet
+                LOG(ERROR) << "Could not retrieve color frame! HRESULT " << retrieveFrame;
         }
         else { // Necessary instead of instant return to prevent memory leak of colorFrame
-            //Convert from YUY2 -> BGRA
-            colorFrame->CopyConvertedFrameDataToArray(static_cast<UINT>(colorBuffer.size()), &colorBuffer[0], ColorImageFormat::ColorImageFormat_Bgra);
-            colorMat = cv::Mat(colorHeight, colorWidth, CV_8UC4, &colorBuffer[0]);
+            int width, height;
+            KVR::resolveStreamResolution(colorRequest, colorWidth, colorHeight, width, height);
+            bool resizing = width != colorWidth || height != colorHeight;
+            if (colorBuffer.size() != size_t(width * height * colorBytesPerPixel))
+                colorBuffer.resize(width * height * colorBytesPerPixel);
+            colorMat = cv::Mat(height, width, CV_8UC4, &colorBuffer[0]);
 
-            updateBufferWithSmoothedMat(colorMat, colorMat, colorBuffer);
+            //Convert from YUY2 -> BGRA
+            // Straight into the handed out buffer if nothing else is done to it, otherwise the staging buffer,
+            // with the resize/smoothing writing their result into the handed out buffer
+            if (!resizing && !colorRequest.smoothed) {
+                colorFrame->CopyConvertedFrameDataToArray(static_cast<UINT>(colorBuffer.size()), &colorBuffer[0], ColorImageFormat::ColorImageFormat_Bgra);
+            }
+            else {
+                colorFrame->CopyConvertedFrameDataToArray(static_cast<UINT>(colorStagingBuffer.size()), &colorStagingBuffer[0], ColorImageFormat::ColorImageFormat_Bgra);
+                cv::Mat stagedMat(colorHeight, colorWidth, CV_8UC4, &colorStagingBuffer[0]);
+                if (resizing && colorRequest.smoothed) {
+                    cv::resize(stagedMat, resizedColorMat, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+                    cv::medianBlur(resizedColorMat, colorMat, streamMedianFilterSize);
+                }
+                else if (resizing)
+                    cv::resize(stagedMat, colorMat, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+                else
+                    cv::medianBlur(stagedMat, colorMat, streamMedianFilterSize);
+            }
+            if (KinectSettings::isKinectDrawn)
+                preview.submitFrame(colorMat.data, colorMat.cols, colorMat.rows, colorMat.step);
         }
         if (colorFrame) colorFrame->Release();
     }
@@ -283,18 +294,23 @@ void KinectV2Handler::updateDepthData()
 {
     if (depthFrameReader) {
         // Retrieve Depth Frame
-        IDepthFrame* depthFrame;
+        IDepthFrame* depthFrame = nullptr;
         const HRESULT retrieveFrame = depthFrameReader->AcquireLatestFrame(&depthFrame);
         if (FAILED(retrieveFrame)) {
-            LOG(ERROR) << "Could not retrieve depth frame! HRESULT " << retrieveFrame;
+            if (retrieveFrame != E_PENDING)
+                LOG(ERROR) << "Could not retrieve depth frame! HRESULT " << retrieveFrame;
         }
         else {// Necessary instead of instant return to prevent memory leak of depthFrame
-            // Retrieve Depth Data
-            depthFrame->CopyFrameDataToArray(static_cast<UINT>(depthBuffer.size()), &depthBuffer[0]);
-
-            // Create cv::Mat from Depth Buffer
-            auto unsmoothedDepthMat = cv::Mat(depthHeight, depthWidth, CV_16U, &depthBuffer[0]);
-            updateBufferWithSmoothedMat(unsmoothedDepthMat, depthMat, depthBuffer);
+            // Always at the sensor's resolution, as the coordinate mapper needs the whole frame
+            depthMat = cv::Mat(depthHeight, depthWidth, CV_16U, &depthBuffer[0]);
+            if (depthRequest.smoothed) {
+                depthFrame->CopyFrameDataToArray(static_cast<UINT>(depthStagingBuffer.size()), &depthStagingBuffer[0]);
+                cv::Mat stagedMat(depthHeight, depthWidth, CV_16U, &depthStagingBuffer[0]);
+                cv::medianBlur(stagedMat, depthMat, streamMedianFilterSize);
+            }
+            else
+                depthFrame->CopyFrameDataToArray(static_cast<UINT>(depthBuffer.size()), &depthBuffer[0]);
+            ++depthFrameSequence;
         }
         if (depthFrame) depthFrame->Release();
     }
@@ -307,62 +323,26 @@ void KinectV2Handler::drawKinectData(sf::RenderWindow &win) {
         drawTrackedSkeletons(win);
     }
 }
-void KinectV2Handler::drawKinectImageData(sf::RenderWindow &win) {
-    glBindTexture(GL_TEXTURE_2D, kinectTextureId);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, SFMLsettings::m_window_width, SFMLsettings::m_window_height, GL_BGRA, GL_UNSIGNED_BYTE, (GLvoid*)kinectImageData.get());
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    glBegin(GL_QUADS);
-    glTexCoord2f(0.0f, 0.0f);
-    glVertex3f(0, 0, 0);
-    glTexCoord2f(1.0f, 0.0f);
-    glVertex3f(SFMLsettings::m_window_width, 0, 0);
-    glTexCoord2f(1.0f, 1.0f);
-    glVertex3f(SFMLsettings::m_window_width, SFMLsettings::m_window_height, 0.0f);
-    glTexCoord2f(0.0f, 1.0f);
-    glVertex3f(0, SFMLsettings::m_window_height, 0.0f);
-    glEnd();
-}
 void KinectV2Handler::drawTrackedSkeletons(sf::RenderWindow &win) {
-    for (int i = 0; i < BODY_COUNT; ++i) {
-        IBody* pBody = kinectBodies[i];
-        if (pBody)
-        {
-            BOOLEAN bTracked = false;
-            HRESULT thisBodyTracked = pBody->get_IsTracked(&bTracked);
-            if (SUCCEEDED(thisBodyTracked) && bTracked)
-            {
-                Joint joints[JointType_Count];
-                sf::Vector2f jointPoints[JointType_Count];
-                HandState leftHandState = HandState_Unknown;
-                HandState rightHandState = HandState_Unknown;
-
-                pBody->get_HandLeftState(&leftHandState);
-                pBody->get_HandRightState(&rightHandState);
-
-                HRESULT jointsFound = pBody->GetJoints(_countof(joints), joints);
-                if (SUCCEEDED(jointsFound))
-                {
-                    for (int j = 0; j < _countof(joints); ++j)
-                    {
-                        jointPoints[j] = BodyToScreen(joints[j].Position, SFMLsettings::m_window_width, SFMLsettings::m_window_height);
-                    }
-
-                    if (KinectSettings::isSkeletonDrawn) {
-                        win.pushGLStates();
-                        win.resetGLStates();
-
-                        drawBody(joints, jointPoints, win);
-
-                        drawHand(leftHandState, jointPoints[JointType_HandLeft], win);
-                        drawHand(rightHandState, jointPoints[JointType_HandRight], win);
-
-                        win.popGLStates();
-                    }
-                    
-                }
-            }
-        }
+    // Drawn from the latest snapshot, as the bodies themselves belong to the capture thread
+    if (!latestSkeleton.isTracking)
+        return;
+    sf::Vector2f jointPoints[JointType_Count];
+    for (int j = 0; j < JointType_Count; ++j)
+    {
+        jointPoints[j] = BodyToScreen(drawnJoints[j].Position, SFMLsettings::m_window_width, SFMLsettings::m_window_height);
+    }
+
+    if (KinectSettings::isSkeletonDrawn) {
+        win.pushGLStates();
+        win.resetGLStates();
+
+        drawBody(drawnJoints, jointPoints, win);
+
+        drawHand(drawnLeftHandState, jointPoints[JointType_HandLeft], win);
+        drawHand(drawnRightHandState, jointPoints[JointType_HandRight], win);
+
+        win.popGLStates();
     }
 }
 void KinectV2Handler::drawHand(HandState handState, const sf::Vector2f& handPosition, sf::RenderWindow &win)
@@ -390,6 +370,19 @@ void KinectV2Handler::drawHand(HandState handState, const sf::Vector2f& handPosi
         break;
     }
 }
+void KinectV2Handler::captureBodyFrame(int64_t arrivalTimestamp) {
+    // Capture thread
+    if (!bodyFrameReader)
+        return;
+    IBodyFrameArrivedEventArgs* pArgs = nullptr;
+    HRESULT hr = bodyFrameReader->GetFrameArrivedEventData(h_bodyFrameEvent, &pArgs);
+    if (SUCCEEDED(hr))
+    {
+        bodyFrameArrivalTimestamp = arrivalTimestamp;
+        onBodyFrameArrived(*bodyFrameReader, *pArgs);
+        pArgs->Release();
+    }
+}
 void KinectV2Handler::onBodyFrameArrived(IBodyFrameReader& sender, IBodyFrameArrivedEventArgs& eventArgs) {
     updateSkeletalData();
 }
@@ -415,11 +408,42 @@ void KinectV2Handler::updateSkeletalData() {
         bodyFrame->GetAndRefreshBodyData(BODY_COUNT, kinectBodies);
         newBodyFrameArrived = true;
         if (bodyFrame) bodyFrame->Release();
+        capturedSkeleton.captureTimestamp = bodyFrameArrivalTimestamp ? bodyFrameArrivalTimestamp : KVR::monotonicNanoseconds();
+        bodyFrameArrivalTimestamp = 0;
 
         updateSkeletalFilters();
+        updateCapturedSkeleton();
+        publishSkeletonSnapshot();
     }
 }
+void KinectV2Handler::updateCapturedSkeleton() {
+    capturedSkeleton.isTracking = isTracking;
+    if (!isTracking)
+        return;
+    for (int i = 0; i < KVR::KinectJointCount; ++i) {
+        JointType j = convertJoint(KVR::KinectJointType(i));
+        sf::Vector3f position = filter.GetFilteredJoints()[j];
+        capturedSkeleton.setJoint(i, KVR::JointTrackingState(joints[j].TrackingState), position.x, position.y, position.z);
+        Vector4 raw = jointOrientations[j].Orientation;
+        Vector4 filtered = rotationFilter.GetFilteredJoints()[j];
+        capturedSkeleton.setOrientations(i, raw.w, raw.x, raw.y, raw.z, filtered.w, filtered.x, filtered.y, filtered.z);
+    }
+}
+void KinectV2Handler::publishSkeletonSnapshot() {
+    KinectV2SkeletonSnapshot & snapshot = skeletonSlot.writeBuffer();
+    snapshot.skeleton = capturedSkeleton;
+    std::copy(joints, joints + JointType_Count, snapshot.joints);
+    snapshot.leftHandState = HandState_Unknown;
+    snapshot.rightHandState = HandState_Unknown;
+    if (isTracking && trackedBodyIndex >= 0) {
+        kinectBodies[trackedBodyIndex]->get_HandLeftState(&snapshot.leftHandState);
+        kinectBodies[trackedBodyIndex]->get_HandRightState(&snapshot.rightHandState);
+    }
+    snapshot.filteredTimestamp = KVR::monotonicNanoseconds();
+    skeletonSlot.publish();
+}
 void KinectV2Handler::updateSkeletalFilters() {
+    trackedBodyIndex = -1;
     for (int i = 0; i < BODY_COUNT; i++) {
         if (kinectBodies[i])
             kinectBodies[i]->get_IsTracked(&isTracking);
@@ -432,6 +456,7 @@ void KinectV2Handler::updateSkeletalFilters() {
             rotationFilter.UpdateFilter(kinectBodies[i], jointOrientations);
 
             newBodyFrameArrived = false;
+            trackedBodyIndex = i;
 
             break;
         }
@@ -493,77 +518,130 @@ void KinectV2Handler::updateTrackersWithSkeletonPosition( std::vector<KVR::Kinec
         }
     }
 }
-void KinectV2Handler::updateTrackersWithColorPosition( std::vector<KVR::KinectTrackedDevice> trackers, sf::Vector2i pos)
+void KinectV2Handler::updateTrackersWithColorPosition( std::vector<KVR::KinectTrackedDevice> & trackers, sf::Vector2i pos)
 {
     //std::cerr << "Tracked Point: " << pos.x << ", " << pos.y << '\n';
 
-    std::vector<CameraSpacePoint> resultPoints(colorWidth * colorHeight);
-    HRESULT hr = coordMapper->MapColorFrameToCameraSpace(depthBuffer.size(), &depthBuffer[0], resultPoints.size(), &resultPoints[0]);
-    if (SUCCEEDED(hr)) {
-        int colorX = static_cast<int>(pos.x + 0.5f);
-        int colorY = static_cast<int>(pos.y + 0.5f);
-        long colorIndex = (long)(colorY * 1920 + colorX);
-        CameraSpacePoint worldCoordinate = resultPoints[colorIndex];
-        //auto worldCoordinate = resultArray[pos.y * 1920 + pos.x];
-        //std::cerr << "World Point: " << worldCoordinate.X << ", " << worldCoordinate.Y << ", " << worldCoordinate.Z << '\n';
-        if (isnan(worldCoordinate.X)) {
-            return;
-        }
-        for (KVR::KinectTrackedDevice device : trackers) {
-            if (device.positionTrackingOption == KVR::JointPositionTrackingOption::Color) {
-                if (device.isSensor()) {
-                    device.update(KinectSettings::kinectRepPosition, { 0,0,0 }, KinectSettings::kinectRepRotation);
+    // Back to the sensor's colour resolution, if the colour stream was scaled down for the subscribers
+    if (colorMat.cols && colorMat.cols != colorWidth) {
+        pos.x = pos.x * colorWidth / colorMat.cols;
+        pos.y = pos.y * colorHeight / colorMat.rows;
+    }
+    CameraSpacePoint worldCoordinate;
+    if (!mapColorPixelToCameraSpace(pos, worldCoordinate))
+        return;
+    //std::cerr << "World Point: " << worldCoordinate.X << ", " << worldCoordinate.Y << ", " << worldCoordinate.Z << '\n';
+    for (KVR::KinectTrackedDevice & device : trackers) {
+        if (device.positionTrackingOption == KVR::JointPositionTrackingOption::Color) {
+            if (device.isSensor()) {
+                device.update(KinectSettings::kinectRepPosition, { 0,0,0 }, KinectSettings::kinectRepRotation);
+            }
+            else {
+                vr::HmdVector3d_t jointPosition{ 0,0,0 };
+                if (worldCoordinate.X + worldCoordinate.Y + worldCoordinate.Z != 0) {
+                    jointPosition.v[0] = worldCoordinate.X;
+                    jointPosition.v[1] = worldCoordinate.Y;
+                    jointPosition.v[2] = worldCoordinate.Z;
+                    device.update(trackedPositionVROffset, jointPosition, { 0,0,0,1 });
                 }
-                else {
-                    vr::HmdVector3d_t jointPosition{ 0,0,0 };
-                    if (worldCoordinate.X + worldCoordinate.Y + worldCoordinate.Z != 0) {
-                        jointPosition.v[0] = worldCoordinate.X;
-                        jointPosition.v[1] = worldCoordinate.Y;
-                        jointPosition.v[2] = worldCoordinate.Z;
-                        device.update(trackedPositionVROffset, jointPosition, { 0,0,0,1 });
-                    }
+            }
+        }
+    }
+}
+bool KinectV2Handler::mapColorPixelToCameraSpace(sf::Vector2i colorPixel, CameraSpacePoint & cameraPoint)
+{
+    // Mapping the whole colour frame to camera space is ~25MB and most of a frame's time, just to read one pixel.
+    // Instead, map the (much smaller) depth frame into colour space once per new depth frame,
+    // then only the depth pixel landing on the tracked colour pixel is mapped to camera space
+    if (depthBuffer.empty() || !coordMapper)
+        return false;
+    if (mappedDepthFrameSequence != depthFrameSequence || depthToColorPoints.size() != depthBuffer.size()) {
+        depthToColorPoints.resize(depthBuffer.size());
+        HRESULT hr = coordMapper->MapDepthFrameToColorSpace(
+            static_cast<UINT>(depthBuffer.size()), &depthBuffer[0],
+            static_cast<UINT>(depthToColorPoints.size()), &depthToColorPoints[0]);
+        if (FAILED(hr)) {
+            LOG(ERROR) << "Could not map depth frame to color space! HRESULT " << hr;
+            return false;
+        }
+        mappedDepthFrameSequence = depthFrameSequence;
+        bucketDepthPointsByColorCell();
+    }
+
+    int depthIndex = findDepthIndexForColorPixel(colorPixel.x + 0.5f, colorPixel.y + 0.5f);
+    if (depthIndex < 0)
+        return false;
+    DepthSpacePoint depthPoint = { float(depthIndex % depthWidth), float(depthIndex / depthWidth) };
+    HRESULT hr = coordMapper->MapDepthPointToCameraSpace(depthPoint, depthBuffer[depthIndex], &cameraPoint);
+    return SUCCEEDED(hr) && !isnan(cameraPoint.X);
+}
+void KinectV2Handler::bucketDepthPointsByColorCell()
+{
+    colorCellColumns = (colorWidth + colorMatchCellSize - 1) / colorMatchCellSize;
+    colorCellRows = (colorHeight + colorMatchCellSize - 1) / colorMatchCellSize;
+    colorCellFirstDepthIndex.assign(colorCellColumns * colorCellRows, -1);
+    nextDepthIndexInColorCell.assign(depthToColorPoints.size(), -1);
+    for (int i = 0; i < (int)depthToColorPoints.size(); ++i) {
+        if (!depthBuffer[i])
+            continue; // No depth reading, so no valid colour position either
+        // Off the colour frame, or -inf where the mapper couldn't place it
+        float x = depthToColorPoints[i].X;
+        float y = depthToColorPoints[i].Y;
+        if (!(x >= 0.f && x < colorWidth && y >= 0.f && y < colorHeight))
+            continue;
+        int cell = int(y) / colorMatchCellSize * colorCellColumns + int(x) / colorMatchCellSize;
+        nextDepthIndexInColorCell[i] = colorCellFirstDepthIndex[cell];
+        colorCellFirstDepthIndex[cell] = i;
+    }
+}
+int KinectV2Handler::findDepthIndexForColorPixel(float colorX, float colorY)
+{
+    // Nearest depth pixel whose colour space projection is within matching distance of the target
+    if (colorX < 0.f || colorY < 0.f || colorCellFirstDepthIndex.empty())
+        return -1;
+    int cellX = int(colorX) / colorMatchCellSize;
+    int cellY = int(colorY) / colorMatchCellSize;
+    float bestDistanceSquared = maxColorMatchDistanceSquared;
+    int best = -1;
+    for (int y = std::max(cellY - 1, 0); y <= std::min(cellY + 1, colorCellRows - 1); ++y) {
+        for (int x = std::max(cellX - 1, 0); x <= std::min(cellX + 1, colorCellColumns - 1); ++x) {
+            for (int i = colorCellFirstDepthIndex[y * colorCellColumns + x]; i >= 0; i = nextDepthIndexInColorCell[i]) {
+                float dx = depthToColorPoints[i].X - colorX;
+                float dy = depthToColorPoints[i].Y - colorY;
+                float distanceSquared = dx * dx + dy * dy;
+                if (distanceSquared < bestDistanceSquared) {
+                    bestDistanceSquared = distanceSquared;
+                    best = i;
                 }
             }
         }
     }
-    //std::cout << "HR: " << hr << '\n';
+    return best;
 }
-bool KinectV2Handler::getFilteredJoint(KVR::KinectTrackedDevice device, vr::HmdVector3d_t& position, vr::HmdQuaternion_t &rotation) {
-    sf::Vector3f filteredPos = filter.GetFilteredJoints()[convertJoint(device.joint0)];
-    float jointX = filteredPos.x;
-    float jointY = filteredPos.y;
-    float jointZ = filteredPos.z;
-    position = vr::HmdVector3d_t{ jointX,jointY,jointZ };
+bool KinectV2Handler::getFilteredJoint(const KVR::KinectTrackedDevice & device, vr::HmdVector3d_t& position, vr::HmdQuaternion_t &rotation) {
+    // From the latest snapshot, as the filters themselves belong to the capture thread
+    position = latestSkeleton.position(device.joint0.joint);
 
     //Rotation - need to seperate into function
-    Vector4 kRotation;
     switch (device.rotationFilterOption) {
     case KVR::JointRotationFilterOption::Unfiltered:
-        kRotation = jointOrientations[convertJoint(device.joint0)].Orientation;
+        rotation = latestSkeleton.orientation(device.joint0.joint, false);
         break;
     case KVR::JointRotationFilterOption::Filtered:
-        kRotation = rotationFilter.GetFilteredJoints()[convertJoint(device.joint0)]; 
+        rotation = latestSkeleton.orientation(device.joint0.joint, true);
         break;
     case KVR::JointRotationFilterOption::HeadLook: {        // Ew
         auto q = KinectSettings::hmdRotation;
         //Isolate Yaw
         float yaw = atan2(2 * q.w*q.y + 2 * q.x*q.z, +q.w*q.w + q.x*q.x - q.z*q.z - q.y*q.y);
 
-        auto kq = vrmath::quaternionFromRotationY(yaw);
-        kRotation.w = kq.w;
-        kRotation.x = kq.x;
-        kRotation.y = kq.y;
-        kRotation.z = kq.z;
+        rotation = vrmath::quaternionFromRotationY(yaw);
     }
                                              break;
     default:
         LOG(ERROR) << "JOINT ROTATION OPTION UNDEFINED IN DEVICE " << device.deviceId << '\n';
         break;
     }
-    rotation.w = kRotation.w;
-    rotation.x = kRotation.x;
-    rotation.y = kRotation.y;
-    rotation.z = kRotation.z;
     
     return true;
 }
@@ -2,6 +2,7 @@
 #include "stdafx.h"
 #include <IKinectHandler.h>
 #include <KinectHandlerBase.h>
+#include <SkeletonCapture.h>
 #include "KinectJointFilter.h"
 #include "KinectDoubleExponentialRotationFilter.h"
 
@@ -9,14 +10,44 @@
 // Kinect V2 - directory local due to my win 7 machine being unsupported for actual install
 
 #include <Kinect.h>
+
+struct KinectV2SkeletonSnapshot {
+    // Everything the tracking and GUI threads need from one body frame,
+    // handed over from the capture thread in one piece
+    KVR::SkeletonFrame skeleton;
+    int64_t filteredTimestamp = 0;
+    Joint joints[JointType_Count] = {};    // Raw, for drawing
+    HandState leftHandState = HandState_Unknown;
+    HandState rightHandState = HandState_Unknown;
+};
+
+class KinectV2BodyFrameEvents : public KVR::FrameEventSource {
+public:
+    WAITABLE_HANDLE handle = 0;
+
+    bool waitForFrame(std::chrono::milliseconds timeout) {
+        if (!handle) {
+            std::this_thread::sleep_for(timeout);
+            return false;
+        }
+        DWORD result = WaitForSingleObject(reinterpret_cast<HANDLE>(handle), static_cast<DWORD>(timeout.count()));
+        if (result == WAIT_FAILED) // Handle closed underneath us, don't spin
+            std::this_thread::sleep_for(timeout);
+        return result == WAIT_OBJECT_0;
+    }
+};
+
 class KinectV2Handler : public KinectHandlerBase {
 public:
     KinectV2Handler() {
         KinectV2Handler::initialise();
         KinectV2Handler::initOpenGL();
     }
-    virtual ~KinectV2Handler() {}
+    virtual ~KinectV2Handler() {
+        captureThread.stop();
+    }
 
+    // Only touched by the capture thread while it's running
     DoubleExponentialFilter filter;
     DoubleExpBoneOrientationsFilter rotationFilter;
     IKinectSensor* kinectSensor = nullptr;
@@ -33,10 +64,7 @@ public:
     Joint joints[JointType_Count];
     JointOrientation jointOrientations[JointType_Count];
     IBody* kinectBodies[BODY_COUNT];
-
-    // TODO: Convert the current opengl stuff into buffer objects
-    GLuint kinectTextureId;   // color buffer object for the K
-                                   //GLuint vertexBufferObjectId;    // unused, as depth data is not to be displayed
+    int trackedBodyIndex = -1;
 
     virtual HRESULT getStatusResult();
     virtual std::string statusResultString(HRESULT stat);
@@ -53,14 +81,14 @@ public:
 
     virtual void initOpenGL();
     virtual void update();
+    virtual bool waitForNewFrame(std::chrono::milliseconds timeout);
     void updateColorData();
     void updateDepthData();
 
     virtual void drawKinectData(sf::RenderWindow &win);
-    virtual void drawKinectImageData(sf::RenderWindow &win);
     virtual void drawTrackedSkeletons(sf::RenderWindow &win);
 
-    virtual bool getFilteredJoint(KVR::KinectTrackedDevice device, vr::HmdVector3d_t& position, vr::HmdQuaternion_t &rotation);
+    virtual bool getFilteredJoint(const KVR::KinectTrackedDevice & device, vr::HmdVector3d_t& position, vr::HmdQuaternion_t &rotation);
 
     
 
@@ -90,12 +118,19 @@ public:
 
     virtual void zeroAllTracking(vr::IVRSystem* &m_sys);
     virtual void updateTrackersWithSkeletonPosition(std::vector<KVR::KinectTrackedDevice> & trackers);
-    virtual void updateTrackersWithColorPosition(std::vector<KVR::KinectTrackedDevice> trackers, sf::Vector2i pos);
+    virtual void updateTrackersWithColorPosition(std::vector<KVR::KinectTrackedDevice> & trackers, sf::Vector2i pos);
     JointType convertJoint(KVR::KinectJoint joint);
 private:
     bool initKinect();
     void updateKinectData();
+    void applyStreamSubscriptions();
     void updateSkeletalFilters();
+    bool mapColorPixelToCameraSpace(sf::Vector2i colorPixel, CameraSpacePoint & cameraPoint);
+    void bucketDepthPointsByColorCell();
+    int findDepthIndexForColorPixel(float colorX, float colorY);
+    void updateCapturedSkeleton();
+    void captureBodyFrame(int64_t arrivalTimestamp);
+    void publishSkeletonSnapshot();
 
     sf::Vector3f zeroKinectPosition(int trackedSkeletonIndex);
     void setKinectToVRMultiplier(int skeletonIndex);
@@ -121,8 +156,41 @@ private:
     void drawBone(const Joint* pJoints, const sf::Vector2f* pJointPoints, JointType joint0, JointType joint1, sf::RenderWindow &window);
     void drawLine(sf::Vector2f start, sf::Vector2f end, sf::Color colour, float lineThickness, sf::RenderWindow &window);
 
+    // Streams as last read from the subscriptions
+    uint64_t appliedStreamGeneration = 0;
+    KVR::KinectStreamRequest colorRequest;
+    KVR::KinectStreamRequest depthRequest;
+    // Raw frames land here when they're resized/smoothed on the way into colorBuffer/depthBuffer
+    std::vector<BYTE> colorStagingBuffer;
+    std::vector<UINT16> depthStagingBuffer;
+    cv::Mat resizedColorMat;
+
+    // Colour tracker lookups. The depth frame's colour space positions are only remapped when a new depth frame arrives
+    std::vector<ColorSpacePoint> depthToColorPoints;
+    uint64_t depthFrameSequence = 0;
+    uint64_t mappedDepthFrameSequence = 0;
+    // The depth pixels landing in each colorMatchCellSize square of the colour frame, as a list per cell,
+    // so a lookup only checks the cells around the target. Rebuilt with depthToColorPoints
+    std::vector<int> colorCellFirstDepthIndex;      // -1 for an empty cell
+    std::vector<int> nextDepthIndexInColorCell;     // -1 at the end of a cell's list
+    int colorCellColumns = 0;
+    int colorCellRows = 0;
+
     WAITABLE_HANDLE h_bodyFrameEvent;
     bool newBodyFrameArrived = false;
+    int64_t bodyFrameArrivalTimestamp = 0;
+
+    // Body frames are acquired and filtered on their own thread as soon as the event fires,
+    // and handed to the tracking thread through the slot
+    KinectV2BodyFrameEvents bodyFrameEvents;
+    KVR::FrameCaptureThread captureThread;
+    KVR::LatestValueSlot<KinectV2SkeletonSnapshot> skeletonSlot;
+    KVR::SkeletonFrame capturedSkeleton;    // Capture thread's working copy, kept between frames like the filters
+
+    // The latest snapshot's raw joints, for drawing. Tracking thread, or the GUI with the pipeline lock
+    Joint drawnJoints[JointType_Count] = {};
+    HandState drawnLeftHandState = HandState_Unknown;
+    HandState drawnRightHandState = HandState_Unknown;
 
 };
 
@@ -0,0 +1,39 @@
+#include "stdafx.h"
+#include "AllocationAudit.h"
+
+#ifdef KVR_AUDIT_ALLOCATIONS
+#include <cstdlib>
+#include <new>
+
+namespace {
+    thread_local uint64_t allocationCount = 0;
+}
+
+uint64_t AllocationAudit::threadAllocationCount() {
+    return allocationCount;
+}
+
+void* operator new(std::size_t size) {
+    ++allocationCount;
+    if (size == 0)
+        size = 1;
+    if (void* memory = std::malloc(size))
+        return memory;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+void operator delete[](void* memory) noexcept {
+    std::free(memory);
+}
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+void operator delete[](void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+#endif
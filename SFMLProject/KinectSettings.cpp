@@ -1,5 +1,6 @@
 #include "stdafx.h"
 #include "KinectSettings.h"
+#include "KinectSettingsConfig.h"
 #include <cereal/archives/json.hpp>
 #include <cereal/cereal.hpp>
 #include <cereal/types/array.hpp>
@@ -45,13 +46,14 @@ namespace KinectSettings {
     float g_InferredBoneThickness = 1.5f;
     float g_JointThickness = 4.0f;
 
-    const int kinectHeight = 640;
-    const int kinectWidth = 480;
+    const int kinectHeight = 480;
+    const int kinectWidth = 640;
 
-    const int kinectV2Height = 1920;
-    const int kinectV2Width = 1080;
+    const int kinectV2Height = 1080;
+    const int kinectV2Width = 1920;
 
     double kinectToVRScale = 1;
+    std::atomic<double> trackerPredictionLookAhead{ 0.04 }; // The sensor's own latency, before a frame reaches us and gets timestamped
     double hipRoleHeightAdjust = 0.0;   // in metres up - applied post-scale
                                         //Need to delete later (Merge should sort it)
     int leftHandPlayspaceMovementButton = 0;
@@ -90,25 +92,19 @@ namespace KinectSettings {
             
             using namespace KinectSettings;
             using namespace SFMLsettings;
-            float rot[3] = { 0,0,0 };
-            float pos[3] = { 0,0,0 };
-            double hipHeight = 0;
-            float fontScale = 12.f;
-            
-            try {
-                cereal::JSONInputArchive archive(is);
-                archive(rot);
-                archive(pos);
-                archive(hipHeight);
-                archive(globalFontSize);
-                archive(secondaryTrackingOriginOffset);
-            }
-            catch(cereal::RapidJSONException & e){
-                LOG(ERROR) << "CONFIG FILE LOAD JSON ERROR: " << e.what();
-            }
-            kinectRadRotation = { rot[0], rot[1], rot[2] };
-            kinectRepPosition = { pos[0], pos[1], pos[2] };
-            hipRoleHeightAdjust = hipHeight;
+            ConfigValues config;
+            config.fontSize = globalFontSize;
+            config.secondaryTrackingOriginOffset = secondaryTrackingOriginOffset;
+            config.predictionLookAhead = trackerPredictionLookAhead;
+            readConfig(is, config);
+
+            kinectRadRotation = { config.rot[0], config.rot[1], config.rot[2] };
+            kinectRepPosition = { config.pos[0], config.pos[1], config.pos[2] };
+            hipRoleHeightAdjust = config.hipHeight;
+            globalFontSize = config.fontSize;
+            secondaryTrackingOriginOffset = config.secondaryTrackingOriginOffset;
+            if (config.predictionLookAhead >= 0.0 && config.predictionLookAhead <= 0.15)
+                trackerPredictionLookAhead = config.predictionLookAhead;
             KinectSettings::sensorConfigChanged = true;
         }
     }
@@ -127,6 +123,7 @@ namespace KinectSettings {
 
             vr::HmdVector3d_t pos = kinectRepPosition;
             float kPosition[3] = { pos.v[0], pos.v[1] , pos.v[2] };
+            double trackerPredictionLookAhead = KinectSettings::trackerPredictionLookAhead; // cereal can't write an atomic
             cereal::JSONOutputArchive archive(os);
             LOG(INFO) << "Attempted to save config settings to file";
             try {
@@ -135,7 +132,8 @@ namespace KinectSettings {
                     CEREAL_NVP(kPosition),
                     CEREAL_NVP(hipRoleHeightAdjust),
                     CEREAL_NVP(globalFontSize),
-                    CEREAL_NVP(secondaryTrackingOriginOffset)
+                    CEREAL_NVP(secondaryTrackingOriginOffset),
+                    CEREAL_NVP(trackerPredictionLookAhead)
                 );
             }
             catch (cereal::RapidJSONException & e) {
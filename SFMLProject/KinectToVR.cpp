@@ -20,11 +20,14 @@
 #include "PSMoveHandler.h"
 #include "DeviceHandler.h"
 #include "TrackingPoolManager.h"
+#include "TrackingLoop.h"
+#include "FrameProfiler.h"
 
 #include <SFML\Audio.hpp>
 
 #include <locale>
 #include <codecvt>
+#include <fstream>
 #include <iostream>
 #include <string>
 #include <thread>
@@ -61,6 +64,9 @@ void processKeyEvents(sf::Event event) {
     case sf::Keyboard::A:
         toggle(KinectSettings::isKinectDrawn);
         break;
+    case sf::Keyboard::P:
+        dumpFrameProfile();
+        break;
     default:
         break;
     }
@@ -68,6 +74,17 @@ void processKeyEvents(sf::Event event) {
 void toggle(bool &b) {
     b = !b;
 }
+void dumpFrameProfile() {
+#ifdef KVR_FRAME_PROFILER
+    // Whatever is still in the profiler's sample rings - roughly the last few seconds
+    std::ofstream csv(KVR::fileToDirPath(L"frameProfile.csv"));
+    KVR::FrameProfiler::instance().writeCSV(csv);
+    std::ofstream trace(KVR::fileToDirPath(L"frameProfile.json"));
+    KVR::FrameProfiler::instance().writeChromeTrace(trace);
+    LOG(INFO) << "Frame profile:\n" << KVR::FrameProfiler::instance().report();
+    LOG(INFO) << "Frame profile dumped to " << KVR::fileToDirPath(L"frameProfile.csv") << " and frameProfile.json";
+#endif
+}
 // Get the horizontal and vertical screen sizes in pixel
 //  https://stackoverflow.com/questions/8690619/how-to-get-screen-resolution-in-c
 void getDesktopResolution(int& horizontal, int& vertical)
@@ -217,7 +234,7 @@ void limitVRFramerate(double &endFrameMilliseconds)
     //SFMLsettings::debugDisplayTextStream << "FPS End = " << 1000.0 / endFrameMilliseconds << '\n';
 }
 
-void processLoop(KinectHandlerBase& kinect) {
+void processLoop(KinectHandlerBase& kinect, std::vector<std::unique_ptr<DeviceHandler>> extraDeviceHandlers) {
     LOG(INFO) << "~~~New logging session for main process begins here!~~~";
     LOG(INFO) << "Kinect version is V" << (int)kinect.kVersion;
     updateFilePath();
@@ -343,10 +360,20 @@ void processLoop(KinectHandlerBase& kinect) {
 
     std::vector<std::unique_ptr<DeviceHandler>> v_deviceHandlers;
     v_deviceHandlers.push_back(std::make_unique<VRDeviceHandler>(vrDeviceHandler));
+    for (auto & device_ptr : extraDeviceHandlers) {
+        device_ptr->initialise();
+        v_deviceHandlers.push_back(std::move(device_ptr));
+    }
     guiRef.setDeviceHandlersReference(v_deviceHandlers);
     guiRef.initialisePSMoveHandlerIntoGUI(); // Needs the deviceHandlerRef to be set
 
+    // Sensor -> filter -> pool -> SteamVR runs on its own thread from here on,
+    // the GUI only needs to take the pipeline lock when it touches tracking state
+    TrackingLoop trackingLoop(kinect, v_trackers, v_trackingMethods, v_deviceHandlers, m_VRSystem, eError == vr::VRInitError_None);
+    trackingLoop.start();
 
+    // The preview only needs the colour stream while it's shown. At the sensor's resolution, it downsamples it itself
+    KVR::KinectStreamSubscription previewStream;
 
     while (renderWindow.isOpen() && SFMLsettings::keepRunning)
     {
@@ -356,11 +383,25 @@ void processLoop(KinectHandlerBase& kinect) {
 
         double currentTime = frameClock.restart().asSeconds();
         double deltaT = currentTime;
-        SFMLsettings::debugDisplayTextStream << "FPS Start = " << 1.0 / deltaT << '\n';
+        KVR_PROFILE_SCOPE("GUI frame");
+        TrackingLoopSnapshot trackingStats = trackingLoop.snapshot();
+        SFMLsettings::debugDisplayTextStream << "Tracking Hz = " << trackingStats.tickRateHz
+            << " (tick " << trackingStats.lastTickMilliseconds << "ms)\n";
+        for (int i = 0; i < (int)KVR::LatencyStage::Count; ++i) {
+            SFMLsettings::debugDisplayTextStream << KVR::LatencyStageName[i] << ": " << trackingStats.latency.stages[i].summary() << '\n';
+        }
+        if (AllocationAudit::enabled)
+            SFMLsettings::debugDisplayTextStream << "Tick allocations = " << trackingStats.lastTickAllocations << '\n';
+#ifdef KVR_FRAME_PROFILER
+        SFMLsettings::debugDisplayTextStream << KVR::FrameProfiler::instance().report();
+#endif
         //std::cout << SFMLsettings::debugDisplayTextStream.str() << std::endl;
         
         if (timingClock.getElapsedTime() > time_lastGuiDesktopUpdate + sf::milliseconds(33)) {
+            KVR_PROFILE_SCOPE("GUI update");
             sf::Event event;
+            // GUI signals spawn trackers and device handlers, so events are handled under the pipeline lock
+            auto pipelineLock = trackingLoop.lockPipeline();
 
             while (renderWindow.pollEvent(event))
             {
@@ -372,6 +413,13 @@ void processLoop(KinectHandlerBase& kinect) {
                 }
                 if (event.type == sf::Event::KeyPressed) {
                     processKeyEvents(event);
+                    if (event.key.code == sf::Keyboard::R) {
+                        // Already holding the pipeline lock, so the tracking thread can't be mid-record
+                        if (trackingLoop.isRecording())
+                            trackingLoop.stopRecording();
+                        else
+                            trackingLoop.startRecording(KVR::fileToDirPath(L"lastSession.kvrsession"), kinect.kVersion);
+                    }
                 }
                 if (event.type == sf::Event::Resized) {
                     std::cerr << "HELP I AM RESIZING!\n";
@@ -400,6 +448,7 @@ void processLoop(KinectHandlerBase& kinect) {
                     guiRef.updateWithNewWindowSize(size);
                 }
             }
+            pipelineLock.unlock();
             if (!(renderWindow.isOpen() && SFMLsettings::keepRunning)) {
                 // Possible for window to be closed mid-loop, in which case, instead of using goto's
                 // this is used to avoid glErrors that crash the program, and prevent proper
@@ -414,16 +463,18 @@ void processLoop(KinectHandlerBase& kinect) {
 
             //Process -------------------------------------
             //Update GUI
-
+            // The widgets read the trackers and device handlers as they update, so back under the pipeline lock
+            pipelineLock.lock();
             guiRef.updateDesktop(deltaT);
+            pipelineLock.unlock();
             time_lastGuiDesktopUpdate = timingClock.getElapsedTime();
         }
 
         //Update VR Components
         if (eError == vr::VRInitError_None) {
+            KVR_PROFILE_SCOPE("VR input");
             rightController.update(deltaT);
             leftController.update(deltaT);
-            updateHMDPosAndRot(m_VRSystem);
 
             VRInput::updateVRInput();
 
@@ -447,19 +498,20 @@ void processLoop(KinectHandlerBase& kinect) {
             // -------------------------
         }
 
-        for (auto & device_ptr : v_deviceHandlers) {
-            if (device_ptr->active) device_ptr->run();
-        }
-
         // Update Kinect Status
         // Only needs to be updated sparingly
         if (timingClock.getElapsedTime() > time_lastKinectStatusUpdate + sf::seconds(2.0)) {
+            // Asks the sensor, which the tracking thread may be in the middle of updating
+            auto pipelineLock = trackingLoop.lockPipeline();
             guiRef.updateKinectStatusLabel(kinect);
             time_lastKinectStatusUpdate = timingClock.getElapsedTime();
         }
 
+        previewStream.setActive(KinectSettings::isKinectDrawn, kinect.streams, KVR::KinectStream::Color,
+            { 0, 0, false });
         if (kinect.isInitialised()) {
-            kinect.update();
+            KVR_PROFILE_SCOPE("Kinect draw");
+            auto pipelineLock = trackingLoop.lockPipeline();
             if (KinectSettings::adjustingKinectRepresentationPos
                 || KinectSettings::adjustingKinectRepresentationRot)
                 currentCalibrationMethod(
@@ -470,16 +522,6 @@ void processLoop(KinectHandlerBase& kinect) {
                     VRInput::confirmCalibrationHandle,
                     guiRef);
 
-            //kinect.updateTrackersWithSkeletonPosition(v_trackers);
-            
-            for (auto & method_ptr : v_trackingMethods) {
-                method_ptr->update(kinect, v_trackers);
-                method_ptr->updateTrackers(kinect, v_trackers);
-            }
-            for (auto & tracker : v_trackers) {
-                tracker.update();
-            }
-            
             kinect.drawKinectData(renderWindow);
         }
         //std::vector<uint32_t> virtualDeviceIndexes;
@@ -496,27 +538,28 @@ void processLoop(KinectHandlerBase& kinect) {
 
 
         // Draw GUI
-        renderWindow.setActive(true);
+        {
+            KVR_PROFILE_SCOPE("GUI draw");
+            renderWindow.setActive(true);
 
-        renderWindow.setView(mGUIView);
-        guiRef.display(renderWindow);
-
-        //Draw debug font
-        double endTimeMilliseconds = frameClock.getElapsedTime().asMilliseconds();
-        SFMLsettings::debugDisplayTextStream << "endTimeMilli: " << endTimeMilliseconds << '\n';
+            renderWindow.setView(mGUIView);
+            guiRef.display(renderWindow);
 
-        //limitVRFramerate(endTimeMilliseconds);
-        debugText.setString(SFMLsettings::debugDisplayTextStream.str());
-        renderWindow.draw(debugText);
+            //Draw debug font
+            debugText.setString(SFMLsettings::debugDisplayTextStream.str());
+            renderWindow.draw(debugText);
 
 
-        //renderWindow.popGLStates();
+            //renderWindow.popGLStates();
 
-        renderWindow.resetGLStates();
+            renderWindow.resetGLStates();
+        }
         //End Frame
         renderWindow.display();
 
     }
+    trackingLoop.stop();
+    dumpFrameProfile();
     for (auto & device_ptr : v_deviceHandlers) {
         device_ptr->shutdown();
     }
@@ -539,6 +582,7 @@ void spawnAndConnectTracker(vrinputemulator::VRInputEmulator & inputE, std::vect
     KVR::KinectTrackedDevice device(inputE, posDevice_gId, rotDevice_gId, role);
     device.init(inputE);
     v_trackers.push_back(device);
+    TrackingMethod::trackersChanged();
 }
 void spawnAndConnectTracker(vrinputemulator::VRInputEmulator & inputE, std::vector<KVR::KinectTrackedDevice>& v_trackers, KVR::KinectJointType mainJoint, KVR::KinectJointType secondaryJoint, KVR::KinectDeviceRole role)
 {
@@ -549,6 +593,7 @@ void spawnAndConnectTracker(vrinputemulator::VRInputEmulator & inputE, std::vect
     device.joint1 = secondaryJoint;
     device.init(inputE);
     v_trackers.push_back(device);
+    TrackingMethod::trackersChanged();
 }
 
 void spawnAndConnectHandTrackers(vrinputemulator::VRInputEmulator & inputE, std::vector<KVR::KinectTrackedDevice>& v_trackers) {
@@ -568,4 +613,5 @@ void spawnAndConnectKinectTracker(vrinputemulator::VRInputEmulator &inputE, std:
     kinectTrackerRef.init(inputE);
     setKinectTrackerProperties(inputE, kinectTrackerRef.deviceId);
     v_trackers.push_back(kinectTrackerRef);
+    TrackingMethod::trackersChanged();
 }
@@ -3,6 +3,16 @@
 #include "TrackingPoolManager.h"
 
 std::vector<KVR::TrackedDeviceInputData> TrackingPoolManager::devicePool;
+std::unordered_map<std::string, uint32_t> TrackingPoolManager::serialIndex;
+uint64_t TrackingPoolManager::freeSlotMask[TrackingPoolManager::freeSlotWords];
+std::atomic<uint32_t> TrackingPoolManager::slotGenerations[k_maxTrackingPoolDevices];
+std::atomic<uint32_t> TrackingPoolManager::poseSequences[k_maxTrackingPoolDevices];
+vr::HmdQuaternion_t TrackingPoolManager::poseRotations[k_maxTrackingPoolDevices];
+vr::HmdVector3d_t TrackingPoolManager::posePositions[k_maxTrackingPoolDevices];
+vr::DriverPose_t TrackingPoolManager::driverPoses[k_maxTrackingPoolDevices];
+int64_t TrackingPoolManager::poseCaptureTimestamps[k_maxTrackingPoolDevices];
+KVR::PoseHistory TrackingPoolManager::poseHistories[k_maxTrackingPoolDevices];
+uint32_t TrackingPoolManager::historyGenerations[k_maxTrackingPoolDevices];
 
 uint32_t TrackingPoolManager::leftFootDevicePosGID = k_invalidTrackerID;
 uint32_t TrackingPoolManager::rightFootDevicePosGID = k_invalidTrackerID;
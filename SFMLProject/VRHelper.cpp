@@ -3,6 +3,7 @@
 #include "VRHelper.h"
 #include <openvr_math.h>
 #include "KinectSettings.h"
+#include "QuaternionMath.h"
 namespace vrmath {
     double length_sq(vr::HmdVector3d_t v) {
         return
@@ -17,13 +18,7 @@ namespace vrmath {
         return sqrt(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
     }
     vr::HmdQuaternion_t normalized(vr::HmdQuaternion_t a) {
-        vr::HmdQuaternion_t q = a;
-        float magnitude = length(q);
-        q.w /= magnitude;
-        q.x /= magnitude;
-        q.y /= magnitude;
-        q.z /= magnitude;
-        return q;
+        return KMath::normalised(a);
     }
     float norm_squared(const vr::HmdQuaternion_t x) {
         return  x.w * x.w + x.x * x.x + x.y * x.y + x.z * x.z;
@@ -36,11 +31,8 @@ namespace vrmath {
         q.z = x.z / k;
         return q;
     }
-    vr::HmdQuaternion_t  inverse(const vr::HmdQuaternion_t  x) {   // Might need to take in reference
-        auto sq = norm_squared(x);
-        if (sq == 0.0f)
-            return { 1,0,0,0 };
-        return divide(vrmath::quaternionConjugate(x), sq);
+    vr::HmdQuaternion_t  inverse(const vr::HmdQuaternion_t  x) {
+        return KMath::inverse(x);
     }
 
     vr::HmdVector3d_t cross(vr::HmdVector3d_t v1, vr::HmdVector3d_t v2) {
@@ -202,14 +194,17 @@ vr::HmdVector3d_t getWorldPositionFromDriverPose(vr::DriverPose_t pose)
     return position;
 }
 vr::HmdVector3d_t updateHMDPosAndRot(vr::IVRSystem* &m_system) {
+    vr::TrackedDevicePose_t devicePose[vr::k_unMaxTrackedDeviceCount];
+    m_system->GetDeviceToAbsoluteTrackingPose(vr::ETrackingUniverseOrigin::TrackingUniverseStanding, 0, devicePose, vr::k_unMaxTrackedDeviceCount);
+    return updateHMDPosAndRot(devicePose);
+}
+vr::HmdVector3d_t updateHMDPosAndRot(const vr::TrackedDevicePose_t* devicePose) {
     //Gets the HMD location for relative position setting
     // Use the head joint for the zero location!
     vr::HmdVector3d_t position{};
     const int HMD_INDEX = 0;
 
     vr::TrackedDevicePose_t hmdPose;
-    vr::TrackedDevicePose_t devicePose[vr::k_unMaxTrackedDeviceCount];
-    m_system->GetDeviceToAbsoluteTrackingPose(vr::ETrackingUniverseOrigin::TrackingUniverseStanding, 0, devicePose, vr::k_unMaxTrackedDeviceCount);
     if (devicePose[HMD_INDEX].bPoseIsValid) {
         if (vr::VRSystem()->GetTrackedDeviceClass(HMD_INDEX) == vr::TrackedDeviceClass_HMD) {
             hmdPose = devicePose[HMD_INDEX];
@@ -1,6 +1,6 @@
 #include "stdafx.h"
 #include "VectorMath.h"
-#include <SFML\System\Vector3.hpp>
+#include <SFML/System/Vector3.hpp>
 #include <math.h>
 #include <string>
 namespace KMath {
@@ -0,0 +1,18 @@
+#pragma once
+#include "stdafx.h"
+#include <cstdint>
+
+namespace AllocationAudit {
+    // Counts the heap allocations made by the calling thread, so that the tracking loop
+    // can check a steady-state tick doesn't allocate.
+    // Only active when built with KVR_AUDIT_ALLOCATIONS defined, as it has to replace the global operator new
+#ifdef KVR_AUDIT_ALLOCATIONS
+    const bool enabled = true;
+    uint64_t threadAllocationCount();
+#else
+    const bool enabled = false;
+    inline uint64_t threadAllocationCount() { return 0; }
+#endif
+    // Ticks to let caches, buffers and the pool fill up before allocations count against a tick
+    const uint64_t warmupTicks = 300;
+}
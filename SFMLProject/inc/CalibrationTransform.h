@@ -0,0 +1,123 @@
+#pragma once
+#include "stdafx.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include <openvr.h>
+#include <openvr_math.h>
+
+#include "KinectSettings.h"
+#include "QuaternionMath.h"
+#include "VRHelper.h"
+
+namespace KVR {
+    class CalibrationTransform {
+        // Everything that takes a tracker from Kinect space to what's sent to InputEmulator, worked out once
+        // per change rather than per tracker per frame:
+        //  - Kinect -> VR, the calibration arrow's rotation and position, as one rigid transform
+        //  - InputEmulator's origin offsets (see KinectTrackedDevice::applyInputEmulatorOffsets)
+        // refresh() is called once per tick, at the start of TrackingLoop::tick, and only recomputes if the
+        // settings it's built from have changed - which covers sensorConfigChanged, the tracking origin changing, and the arrow being moved around
+        // while calibrating, when sensorConfigChanged isn't set until it's confirmed.
+        // Only touched from the thread holding the pipeline lock, like the settings themselves
+    public:
+        static CalibrationTransform & shared() {
+            static CalibrationTransform transform;
+            return transform;
+        }
+
+        // True if anything changed, and so the transform was recomputed
+        bool refresh() {
+            Source current;
+            current.kinectRepRotation = KinectSettings::kinectRepRotation;
+            current.kinectRepPosition = KinectSettings::kinectRepPosition;
+            current.trackingOrigin = KinectSettings::trackingOrigin;
+            current.trackingOriginPosition = KinectSettings::trackingOriginPosition;
+            current.secondaryTrackingOriginOffset = KinectSettings::secondaryTrackingOriginOffset;
+            if (transformVersion && std::memcmp(&current, &source, sizeof(Source)) == 0)
+                return false;
+            source = current;
+
+            kinectToVRRotation = source.kinectRepRotation;
+            kinectToVRRotationF = KMath::toQuaternion(source.kinectRepRotation);
+            kinectToVRTranslation = source.kinectRepPosition;
+
+            inputEmulatorRotation = vrmath::inverse(GetVRRotationFromMatrix(source.trackingOrigin));
+            inputEmulatorTranslation = source.trackingOriginPosition;
+            inputEmulatorPositionOffset = source.secondaryTrackingOriginOffset;
+
+            ++transformVersion;
+            return true;
+        }
+        // Bumped every time the transform is recomputed, 0 before the first refresh()
+        uint64_t version() const { return transformVersion; }
+
+        // Kinect -> VR for a single tracker, e.g. the sensor's arrow
+        void applyKinectToVR(vr::HmdQuaternion_t & rotation, vr::HmdVector3d_t & position, bool rotateRotation = true) const {
+            position = KMath::rotate(kinectToVRRotation, position);
+            position.v[0] += kinectToVRTranslation.v[0];
+            position.v[1] += kinectToVRTranslation.v[1];
+            position.v[2] += kinectToVRTranslation.v[2];
+            if (rotateRotation)
+                rotation = kinectToVRRotation * rotation;
+        }
+        // Kinect -> VR for every joint at once. Rotations whose rotateRotation entry is 0
+        // (head look trackers) are left alone, only their positions move
+        void applyKinectToVR(vr::HmdQuaternion_t* rotations, vr::HmdVector3d_t* positions, const uint8_t* rotateRotation, int count) const {
+            const int chunkSize = 32;
+            KMath::Quaternion chunkRotations[chunkSize];
+            sf::Vector3f chunkPositions[chunkSize];
+            for (int first = 0; first < count; first += chunkSize) {
+                int n = std::min(chunkSize, count - first);
+                for (int i = 0; i < n; ++i) {
+                    chunkRotations[i] = KMath::toQuaternion(rotations[first + i]);
+                    const vr::HmdVector3d_t & p = positions[first + i];
+                    chunkPositions[i] = { float(p.v[0]), float(p.v[1]), float(p.v[2]) };
+                }
+                KMath::multiplyBatch(kinectToVRRotationF, chunkRotations, chunkRotations, n);
+                KMath::rotateBatch(kinectToVRRotationF, chunkPositions, chunkPositions, n);
+                for (int i = 0; i < n; ++i) {
+                    if (rotateRotation[first + i])
+                        rotations[first + i] = KMath::toHmdQuaternion(chunkRotations[i]);
+                    positions[first + i] = { {
+                        chunkPositions[i].x + kinectToVRTranslation.v[0],
+                        chunkPositions[i].y + kinectToVRTranslation.v[1],
+                        chunkPositions[i].z + kinectToVRTranslation.v[2] } };
+                }
+            }
+        }
+
+        void applyInputEmulatorOffsets(vr::DriverPose_t & pose) const {
+            pose.vecWorldFromDriverTranslation[0] -= inputEmulatorTranslation.v[0];
+            pose.vecWorldFromDriverTranslation[1] -= inputEmulatorTranslation.v[1];
+            pose.vecWorldFromDriverTranslation[2] -= inputEmulatorTranslation.v[2];
+
+            pose.vecPosition[0] -= inputEmulatorPositionOffset.v[0];
+            pose.vecPosition[1] -= inputEmulatorPositionOffset.v[1];
+            pose.vecPosition[2] -= inputEmulatorPositionOffset.v[2];
+
+            pose.qWorldFromDriverRotation = pose.qWorldFromDriverRotation * inputEmulatorRotation;
+        }
+
+    private:
+        struct Source {
+            // The settings the transform was last built from
+            vr::HmdQuaternion_t kinectRepRotation = {};
+            vr::HmdVector3d_t kinectRepPosition = {};
+            vr::HmdMatrix34_t trackingOrigin = {};
+            vr::HmdVector3d_t trackingOriginPosition = {};
+            vr::HmdVector3d_t secondaryTrackingOriginOffset = {};
+        };
+        Source source;
+        uint64_t transformVersion = 0;
+
+        vr::HmdQuaternion_t kinectToVRRotation = { 1, 0, 0, 0 };
+        KMath::Quaternion kinectToVRRotationF = KMath::identityQuaternion();
+        vr::HmdVector3d_t kinectToVRTranslation = { 0, 0, 0 };
+
+        vr::HmdQuaternion_t inputEmulatorRotation = { 1, 0, 0, 0 };
+        vr::HmdVector3d_t inputEmulatorTranslation = { 0, 0, 0 };
+        vr::HmdVector3d_t inputEmulatorPositionOffset = { 0, 0, 0 };
+    };
+}
@@ -52,6 +52,8 @@ public:
     }
     void terminate() {
         destroyAllWindows();
+        colorStream.release();
+        depthStream.release();
         active = false;
     }
     std::vector<TrackedColorComponent> getTrackedPoints() {
@@ -59,9 +61,12 @@ public:
     }
     void update(KinectHandlerBase& kinect,
         std::vector<KVR::KinectTrackedDevice> & v_trackers) {
+        if (!active) { return; }
+        // Smoothed full resolution colour for the blob, and depth to map it into 3D
+        colorStream.setActive(true, kinect.streams, KVR::KinectStream::Color, { FRAME_WIDTH, FRAME_HEIGHT, true });
+        depthStream.setActive(true, kinect.streams, KVR::KinectStream::Depth, { 0, 0, true });
         Mat imageFeed = kinect.colorMat;
         Mat depthFeed = kinect.depthMat;
-        if (!active) { return; }
 
 
         if (imageFeed.empty() || depthFeed.empty())
@@ -143,6 +148,9 @@ private:
 
     uchar lastPickedHSV {};
 
+    KVR::KinectStreamSubscription colorStream;
+    KVR::KinectStreamSubscription depthStream;
+
     Mat lastImageFeed = Mat();
     Mat lastDepthFeed = Mat();
 
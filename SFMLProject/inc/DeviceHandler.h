@@ -9,6 +9,7 @@ static const uint32_t k_invalidTrackerID = 80808080;
 struct TrackerIDs {
     uint32_t internalID = k_invalidTrackerID; // DeviceHandler Specific
     uint32_t globalID = k_invalidTrackerID; // Relative to the Pool
+    uint32_t generation = 0; // Of the pool slot when it was given out, see TrackingPoolManager::isCurrent
 };
 
 class DeviceHandler {
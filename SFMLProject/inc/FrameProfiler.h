@@ -0,0 +1,224 @@
+#pragma once
+#include "stdafx.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "LatencyStats.h"
+
+// Scoped timers for each stage of a frame (Kinect update, tracking methods, device handlers,
+// tracker publish, GUI update/draw), replacing the old 'FPS Start'/'endTimeMilli' debug text.
+// Only compiled in when KVR_FRAME_PROFILER is defined (Debug builds), otherwise the
+// KVR_PROFILE_* macros expand to nothing, so release builds don't even read the clock.
+#ifdef KVR_FRAME_PROFILER
+#define KVR_PROFILE_CONCAT_INNER(a, b) a##b
+#define KVR_PROFILE_CONCAT(a, b) KVR_PROFILE_CONCAT_INNER(a, b)
+// For a fixed stage name - the stage is looked up once per call site
+#define KVR_PROFILE_SCOPE(name) \
+    static const int KVR_PROFILE_CONCAT(kvrProfileStage, __LINE__) = KVR::FrameProfiler::instance().stageId(name); \
+    KVR::ScopedProfileTimer KVR_PROFILE_CONCAT(kvrProfileTimer, __LINE__)(KVR_PROFILE_CONCAT(kvrProfileStage, __LINE__))
+// For a name only known at runtime, e.g. each tracking method. The name must outlive the profiler
+#define KVR_PROFILE_SCOPE_DYNAMIC(name) \
+    KVR::ScopedProfileTimer KVR_PROFILE_CONCAT(kvrProfileTimer, __LINE__)(KVR::FrameProfiler::instance().stageId(name))
+#else
+#define KVR_PROFILE_SCOPE(name) ((void)0)
+#define KVR_PROFILE_SCOPE_DYNAMIC(name) ((void)0)
+#endif
+
+namespace KVR {
+    struct ProfileStageSummary {
+        const char* name = "";
+        uint32_t samples = 0;
+        double p50Milliseconds = 0.0;
+        double p95Milliseconds = 0.0;
+        double p99Milliseconds = 0.0;
+        double maxMilliseconds = 0.0;
+    };
+
+    class FrameProfiler {
+        // Each stage keeps the last 'samplesPerStage' timings in a fixed ring, so recording
+        // never allocates. A stage is only ever recorded from one thread (e.g. the tracking
+        // thread, or the GUI thread), and can be read from any other.
+    public:
+        static const int maxStages = 32;
+        static const int samplesPerStage = 512;
+
+        static FrameProfiler & instance() {
+            static FrameProfiler profiler;
+            return profiler;
+        }
+
+        // Finds, or registers, the stage with this name. Returns -1 if there's no room left,
+        // which record() ignores
+        int stageId(const char* name) {
+            int count = stageCount.load(std::memory_order_acquire);
+            int existing = findStage(name, count);
+            if (existing >= 0)
+                return existing;
+
+            std::lock_guard<std::mutex> guard(registrationMutex);
+            count = stageCount.load(std::memory_order_acquire);
+            existing = findStage(name, count);
+            if (existing >= 0)
+                return existing;
+            if (count >= maxStages)
+                return -1;
+            stages[count].name = name;
+            stageCount.store(count + 1, std::memory_order_release);
+            return count;
+        }
+
+        void record(int stage, int64_t startNanoseconds, int64_t endNanoseconds) {
+            if (stage < 0)
+                return;
+            Stage & s = stages[stage];
+            if (!s.threadId.load(std::memory_order_relaxed))
+                s.threadId.store(currentThreadId(), std::memory_order_relaxed);
+            uint64_t index = s.written.load(std::memory_order_relaxed);
+            Sample & sample = s.samples[index % samplesPerStage];
+            sample.start.store(startNanoseconds, std::memory_order_relaxed);
+            sample.duration.store(endNanoseconds - startNanoseconds, std::memory_order_relaxed);
+            s.written.store(index + 1, std::memory_order_release);
+        }
+
+        int stageCountSnapshot() const {
+            return stageCount.load(std::memory_order_acquire);
+        }
+
+        ProfileStageSummary summary(int stage) const {
+            ProfileStageSummary result;
+            if (stage < 0 || stage >= stageCountSnapshot())
+                return result;
+            const Stage & s = stages[stage];
+            result.name = s.name;
+
+            int64_t durations[samplesPerStage];
+            uint32_t count = copyDurations(s, durations);
+            result.samples = count;
+            if (!count)
+                return result;
+            std::sort(durations, durations + count);
+            auto percentile = [&](double p) {
+                uint32_t index = uint32_t(p / 100.0 * count);
+                if (index >= count)
+                    index = count - 1;
+                return durations[index] / 1.0e6;
+            };
+            result.p50Milliseconds = percentile(50);
+            result.p95Milliseconds = percentile(95);
+            result.p99Milliseconds = percentile(99);
+            result.maxMilliseconds = durations[count - 1] / 1.0e6;
+            return result;
+        }
+
+        // One line per stage, for the debug display and log
+        std::string report() const {
+            std::stringstream ss;
+            ss.precision(3);
+            int count = stageCountSnapshot();
+            for (int i = 0; i < count; ++i) {
+                ProfileStageSummary s = summary(i);
+                ss << s.name << ": p50 " << s.p50Milliseconds << "ms, p95 " << s.p95Milliseconds
+                    << "ms, p99 " << s.p99Milliseconds << "ms, max " << s.maxMilliseconds << "ms\n";
+            }
+            return ss.str();
+        }
+
+        // stage,thread,start_us,duration_us - for every sample still in the rings
+        void writeCSV(std::ostream & os) const {
+            os << "stage,thread,start_us,duration_us\n";
+            forEachSample([&](const Stage & s, int64_t start, int64_t duration) {
+                os << '"' << s.name << "\"," << s.threadId.load(std::memory_order_relaxed) << ','
+                    << start / 1000.0 << ',' << duration / 1000.0 << '\n';
+            });
+        }
+        // Chrome trace event format, which can be loaded in chrome://tracing or Perfetto
+        void writeChromeTrace(std::ostream & os) const {
+            os << "{\"traceEvents\":[";
+            bool first = true;
+            forEachSample([&](const Stage & s, int64_t start, int64_t duration) {
+                if (!first)
+                    os << ',';
+                first = false;
+                os << "\n{\"name\":\"" << s.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                    << s.threadId.load(std::memory_order_relaxed)
+                    << ",\"ts\":" << start / 1000.0 << ",\"dur\":" << duration / 1000.0 << '}';
+            });
+            os << "\n]}\n";
+        }
+
+    private:
+        struct Sample {
+            std::atomic<int64_t> start{ 0 };
+            std::atomic<int64_t> duration{ 0 };
+        };
+        struct Stage {
+            const char* name = "";
+            std::atomic<uint32_t> threadId{ 0 };
+            std::atomic<uint64_t> written{ 0 };
+            Sample samples[samplesPerStage];
+        };
+
+        Stage stages[maxStages];
+        std::atomic<int> stageCount{ 0 };
+        std::mutex registrationMutex;
+
+        FrameProfiler() {}
+
+        static uint32_t currentThreadId() {
+            // Only needs to tell threads apart in the dumps, and never be 0
+            return uint32_t(std::hash<std::thread::id>()(std::this_thread::get_id())) | 1u;
+        }
+
+        int findStage(const char* name, int count) const {
+            for (int i = 0; i < count; ++i) {
+                if (stages[i].name == name || std::strcmp(stages[i].name, name) == 0)
+                    return i;
+            }
+            return -1;
+        }
+
+        uint32_t copyDurations(const Stage & s, int64_t* durations) const {
+            uint64_t written = s.written.load(std::memory_order_acquire);
+            uint32_t count = uint32_t(std::min<uint64_t>(written, samplesPerStage));
+            for (uint32_t i = 0; i < count; ++i)
+                durations[i] = s.samples[i].duration.load(std::memory_order_relaxed);
+            return count;
+        }
+
+        template <typename Fn>
+        void forEachSample(Fn fn) const {
+            int count = stageCountSnapshot();
+            for (int i = 0; i < count; ++i) {
+                const Stage & s = stages[i];
+                uint64_t written = s.written.load(std::memory_order_acquire);
+                uint64_t first = written > samplesPerStage ? written - samplesPerStage : 0;
+                for (uint64_t n = first; n < written; ++n) {
+                    const Sample & sample = s.samples[n % samplesPerStage];
+                    fn(s, sample.start.load(std::memory_order_relaxed), sample.duration.load(std::memory_order_relaxed));
+                }
+            }
+        }
+    };
+
+    class ScopedProfileTimer {
+    public:
+        explicit ScopedProfileTimer(int stage)
+            : stageId(stage), startNanoseconds(monotonicNanoseconds()) {}
+        ~ScopedProfileTimer() {
+            FrameProfiler::instance().record(stageId, startNanoseconds, monotonicNanoseconds());
+        }
+        ScopedProfileTimer(const ScopedProfileTimer &) = delete;
+        ScopedProfileTimer & operator=(const ScopedProfileTimer &) = delete;
+    private:
+        int stageId;
+        int64_t startNanoseconds;
+    };
+}
@@ -257,7 +257,7 @@ void error_trackerCfgEmpty(std::wstring &trackerConfig)
     auto result = MessageBox(NULL, message.c_str(), L"WARNING!!!", MB_OK + MB_ICONWARNING);
 }
 void connectPSMoveHandlerGUIEvents() {
-    if (psMoveHandler.active) {
+    if (psMoveHandler && psMoveHandler->active) {
         PSMoveHandlerLabel->SetText("Status: Connected!");
     }
     else {
@@ -268,9 +268,9 @@ void connectPSMoveHandlerGUIEvents() {
         initialisePSMoveHandlerIntoGUI();
     });
     StopPSMoveHandler->GetSignal(sfg::Widget::OnLeftClick).Connect([this] {
-        if (!psMoveHandler.active)
+        if (!psMoveHandler || !psMoveHandler->active)
             return;
-        psMoveHandler.shutdown();
+        psMoveHandler->shutdown();
         updateDeviceLists();
         PSMoveHandlerLabel->SetText("Status: Disconnected!");
     });
@@ -278,24 +278,25 @@ void connectPSMoveHandlerGUIEvents() {
 
 void initialisePSMoveHandlerIntoGUI()
 {
-    if (psMoveHandler.active) {
+    if (psMoveHandler && psMoveHandler->active) {
         LOG(INFO) << "Tried to initialise PSMoveHandler in the GUI, but it was already active";
         return;
     }
+    if (!psMoveHandler) {
+        // The vector owns it, so the handler that's updated is the same one the GUI starts and stops
+        auto handler = std::make_unique<PSMoveHandler>();
+        psMoveHandler = handler.get();
+        v_deviceHandlersRef->push_back(std::move(handler));
+    }
 
-    auto errorCode = psMoveHandler.initialise();
+    auto errorCode = psMoveHandler->initialise();
 
-    if (psMoveHandler.active) {
-        static bool addedToVector = false;
-        if (!addedToVector) {
-            v_deviceHandlersRef->push_back(std::make_unique<PSMoveHandler>(psMoveHandler));
-            addedToVector = true;
-            PSMoveHandlerLabel->SetText("Status: Connected!");
-        }
+    if (psMoveHandler->active) {
+        PSMoveHandlerLabel->SetText("Status: Connected!");
         updateDeviceLists();
     }
     else {
-        PSMoveHandlerLabel->SetText(psMoveHandler.connectionMessages[errorCode]);
+        PSMoveHandlerLabel->SetText(psMoveHandler->connectionMessages[errorCode]);
     }
 }
 
@@ -441,6 +442,10 @@ void setDefaultSignals() {
         KinectSettings::hipRoleHeightAdjust = HipScale->GetValue();
     }
     );
+    PredictionLookAhead->GetSignal(sfg::SpinButton::OnValueChanged).Connect([this] {
+        KinectSettings::trackerPredictionLookAhead = PredictionLookAhead->GetValue();
+    }
+    );
     setCalibrationSignal();
 
     
@@ -732,6 +737,7 @@ void spawnAndConnectTracker(vrinputemulator::VRInputEmulator & inputE, std::vect
     device.customModelName = TrackingPoolManager::getDeviceData(t_tracker.data.positionGlobalDeviceId).customModelName;
     device.init(inputE);
     v_trackers.push_back(device);
+    TrackingMethod::trackersChanged();
 }
 void setTrackerButtonSignals(vrinputemulator::VRInputEmulator &inputE, std::vector<KVR::KinectTrackedDevice> &v_trackers, vr::IVRSystem * & m_VRSystem) {
     calibrateOffsetButton->GetSignal(sfg::Widget::OnLeftClick).Connect([this, & inputE, & v_trackers, & m_VRSystem]{
@@ -975,6 +981,7 @@ void packElementsIntoMainBox() {
     mainGUIBox->Pack(InstructionsLabel);
 
     setHipScaleBox();
+    setPredictionLookAheadBox();
     mainGUIBox->Pack(ShowSkeletonButton);
 
     mainGUIBox->Pack(EnableGamepadButton);
@@ -1001,6 +1008,14 @@ void setHipScaleBox() {
     HipScaleBox->Pack(HipScale);
     mainGUIBox->Pack(HipScaleBox);
 }
+void setPredictionLookAheadBox() {
+    auto PredictionLabel = sfg::Label::Create("Tracker prediction look-ahead (seconds, 0 to disable)");
+    PredictionLookAhead->SetDigits(3);
+
+    PredictionLookAheadBox->Pack(PredictionLabel, false, false);
+    PredictionLookAheadBox->Pack(PredictionLookAhead);
+    mainGUIBox->Pack(PredictionLookAheadBox);
+}
 void packElementsIntoTrackingMethodBox() {
     //trackingMethodBox->Pack(InitiateColorTrackingButton);
     //trackingMethodBox->Pack(DestroyColorTrackingButton);
@@ -1328,7 +1343,7 @@ private:
     std::vector<std::unique_ptr<TrackingMethod>> * v_trackingMethodsRef;
 
     // All the device handlers
-    PSMoveHandler psMoveHandler;
+    PSMoveHandler* psMoveHandler = nullptr; // Owned by v_deviceHandlersRef, once first initialised
 
     HRESULT lastKinectStatus = E_FAIL;
 
@@ -1413,6 +1428,8 @@ private:
     sfg::Box::Ptr TrackerListOptionsBox = sfg::Box::Create(sfg::Box::Orientation::VERTICAL, 5);
     sfg::SpinButton::Ptr HipScale = sfg::SpinButton::Create(sfg::Adjustment::Create(KinectSettings::hipRoleHeightAdjust, -1.f, 1.f, .01f));
     sfg::Box::Ptr HipScaleBox = sfg::Box::Create(sfg::Box::Orientation::HORIZONTAL);
+    sfg::SpinButton::Ptr PredictionLookAhead = sfg::SpinButton::Create(sfg::Adjustment::Create(KinectSettings::trackerPredictionLookAhead, 0.f, .15f, .005f));
+    sfg::Box::Ptr PredictionLookAheadBox = sfg::Box::Create(sfg::Box::Orientation::HORIZONTAL);
 
     bool kinectJointDevicesHiddenFromList = true;
     sfg::CheckButton::Ptr showJointDevicesButton = sfg::CheckButton::Create("Show joints in devices");
@@ -1473,6 +1490,8 @@ private:
         SetAllJointsRotUnfiltered->Show(show);
         HipScale->Show(show);
         HipScaleBox->Show(show);
+        PredictionLookAhead->Show(show);
+        PredictionLookAheadBox->Show(show);
         SetAllJointsRotHead->Show(show);
         SetAllJointsRotFiltered->Show(show);
         SetJointsToAnkleRotationButton->Show(show);
@@ -10,7 +10,7 @@
 #include <SFML/Graphics/RenderWindow.hpp>
 #include <glew.h>
 
-#include <opencv2\opencv.hpp>
+#include <opencv2/opencv.hpp>
 
 
 #include <windows.h>
@@ -43,7 +43,7 @@ public:
     bool isZeroed() { return zeroed; }
 
     KinectVersion kVersion = KinectVersion::INVALID;
-    std::unique_ptr<GLubyte[]> kinectImageData; // array containing the texture data
+    std::unique_ptr<GLubyte[]> kinectImageData; // The v1 colour frame, which its colorMat wraps
     
     bool zeroed = false;
     vr::HmdVector3d_t trackedPositionVROffset = { 0,0,0 };
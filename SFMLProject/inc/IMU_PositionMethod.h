@@ -4,6 +4,7 @@
 
 #include "KinectHandlerBase.h"
 #include "TrackingMethod.h"
+#include "TrackingPoolManager.h"
 
 class IMU_PositionMethod : public TrackingMethod {
 public:
@@ -27,24 +28,24 @@ public:
         KinectHandlerBase& kinect,
         std::vector<KVR::KinectTrackedDevice> & v_trackers
     ) {
-        for (int i = 0; i < v_trackers.size(); ++i) {
+        for (int i : subscribedTrackers(v_trackers)) {
             auto & device = v_trackers[i];
-            if (device.positionTrackingOption != KVR::JointPositionTrackingOption::IMU) {
-                continue;
-            }
-            if (device.isSensor()) {
-                // Does not handle kinect representation
-            }
-            else {
-                auto deviceData = TrackingPoolManager::getDeviceData(device.positionDevice_gId);
-               
-                device.setPositionForNextUpdate(deviceData.position);
-
-                // Assume that if the user selects both position and rotation from the same device, it's entire pose will be used
-                if (device.positionDevice_gId == device.rotationDevice_gId) {
-                    device.setPoseForNextUpdate(deviceData.pose, true);
-                }
+            KVR::TrackedDevicePose devicePose;
+            TrackingPoolManager::readDevicePose(device.positionDevice_gId, devicePose);
+           
+            device.setPositionForNextUpdate(devicePose.position);
+            device.noteCaptureTimestamp(devicePose.captureTimestamp);
+
+            // Assume that if the user selects both position and rotation from the same device, it's entire pose will be used
+            if (device.positionDevice_gId == device.rotationDevice_gId) {
+                device.setPoseForNextUpdate(devicePose.pose, true);
             }
         }
     }
+
+protected:
+    bool servesTracker(KVR::KinectTrackedDevice & device) {
+        // Does not handle kinect representation
+        return device.positionTrackingOption == KVR::JointPositionTrackingOption::IMU && !device.isSensor();
+    }
 };
\ No newline at end of file
@@ -27,19 +27,20 @@ public:
         KinectHandlerBase& kinect,
         std::vector<KVR::KinectTrackedDevice> & v_trackers
     ) {
-        for (int i = 0; i < v_trackers.size(); ++i) {
+        for (int i : subscribedTrackers(v_trackers)) {
             auto & device = v_trackers[i];
-            if (device.rotationTrackingOption != KVR::JointRotationTrackingOption::IMU) {
-                continue;
-            }
-            if (device.isSensor()) {
-                // Does not handle kinect representation
-            }
-            else {
-                auto deviceData = TrackingPoolManager::getDeviceData(device.rotationDevice_gId);
-
-                device.setRotationForNextUpdate(deviceData.rotation);
-            }
+            vr::HmdQuaternion_t rotation;
+            int64_t captureTimestamp = 0;
+            TrackingPoolManager::readDeviceRotation(device.rotationDevice_gId, rotation, captureTimestamp);
+
+            device.setRotationForNextUpdate(rotation);
+            device.noteCaptureTimestamp(captureTimestamp);
         }
     }
+
+protected:
+    bool servesTracker(KVR::KinectTrackedDevice & device) {
+        // Does not handle kinect representation
+        return device.rotationTrackingOption == KVR::JointRotationTrackingOption::IMU && !device.isSensor();
+    }
 };
\ No newline at end of file
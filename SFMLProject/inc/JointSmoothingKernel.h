@@ -0,0 +1,346 @@
+#pragma once
+#include "stdafx.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define KVR_JOINT_SMOOTHING_SSE
+#include <emmintrin.h>
+#endif
+
+#include "LatencyStats.h"
+#include "logging.h"
+
+namespace KVR {
+    // The Holt double exponential joint smoothing from the v2's DoubleExponentialFilter, over every joint at once.
+    // Joints are laid out structure-of-arrays (all x's, then all y's...) so the SSE path filters four joints
+    // per instruction, with the per-joint branches (inferred, invalid, filter warm up) done as lane masks.
+    // smoothJointsScalar() is the original per-joint code, kept as the reference and as the fallback
+
+    // JointType_Count (25), rounded up to whole SSE registers. The padding lanes stay at 0, i.e. invalid
+    const int jointSmoothingLanes = 28;
+
+    struct JointSmoothingParams {
+        float smoothing;
+        float correction;
+        float prediction;
+        float jitterRadius;         // Doubled for inferred joints, as is maxDeviationRadius
+        float maxDeviationRadius;
+    };
+
+    struct alignas(16) JointSmoothingInput {
+        float x[jointSmoothingLanes] = {};
+        float y[jointSmoothingLanes] = {};
+        float z[jointSmoothingLanes] = {};
+        int32_t inferred[jointSmoothingLanes] = {}; // -1 (all bits set) for inferred joints, 0 otherwise
+    };
+
+    struct alignas(16) JointSmoothingState {
+        float rawX[jointSmoothingLanes];
+        float rawY[jointSmoothingLanes];
+        float rawZ[jointSmoothingLanes];
+        float filteredX[jointSmoothingLanes];
+        float filteredY[jointSmoothingLanes];
+        float filteredZ[jointSmoothingLanes];
+        float trendX[jointSmoothingLanes];
+        float trendY[jointSmoothingLanes];
+        float trendZ[jointSmoothingLanes];
+        int32_t frameCount[jointSmoothingLanes]; // 0, 1, or 2 once the filter is warmed up
+
+        JointSmoothingState() { reset(); }
+        void reset() { std::memset(this, 0, sizeof(*this)); }
+    };
+
+    struct alignas(16) JointSmoothingOutput {
+        float x[jointSmoothingLanes] = {};
+        float y[jointSmoothingLanes] = {};
+        float z[jointSmoothingLanes] = {};
+    };
+
+    inline void smoothJointsScalar(const JointSmoothingParams & params, const JointSmoothingInput & input, bool newFrameArrived,
+        JointSmoothingState & state, JointSmoothingOutput & output)
+    {
+        for (int i = 0; i < jointSmoothingLanes; ++i) {
+            float jitterRadius = params.jitterRadius;
+            float maxDeviationRadius = params.maxDeviationRadius;
+            // If inferred, we smooth a bit more by using a bigger jitter radius
+            if (input.inferred[i]) {
+                jitterRadius *= 2.0f;
+                maxDeviationRadius *= 2.0f;
+            }
+
+            const float prevRaw[3] = { state.rawX[i], state.rawY[i], state.rawZ[i] };
+            const float prevFiltered[3] = { state.filteredX[i], state.filteredY[i], state.filteredZ[i] };
+            const float prevTrend[3] = { state.trendX[i], state.trendY[i], state.trendZ[i] };
+            float raw[3], filtered[3], trend[3], predicted[3], diff[3];
+
+            for (int c = 0; c < 3; ++c) {
+                // Smoothing always run on old frames (DJ Lukis' Impl.)
+                if (newFrameArrived)
+                    raw[c] = c == 0 ? input.x[i] : c == 1 ? input.y[i] : input.z[i];
+                else
+                    raw[c] = prevFiltered[c] + prevTrend[c] * 0.9f;
+            }
+
+            // If joint is invalid, reset the filter
+            if (raw[0] == 0.0f && raw[1] == 0.0f && raw[2] == 0.0f)
+                state.frameCount[i] = 0;
+
+            if (state.frameCount[i] == 0) {
+                for (int c = 0; c < 3; ++c) {
+                    filtered[c] = raw[c];
+                    trend[c] = 0.0f;
+                }
+                state.frameCount[i]++;
+            }
+            else if (state.frameCount[i] == 1) {
+                for (int c = 0; c < 3; ++c) {
+                    filtered[c] = (raw[c] + prevRaw[c]) * 0.5f;
+                    diff[c] = filtered[c] - prevFiltered[c];
+                    trend[c] = diff[c] * params.correction + prevTrend[c] * (1.0f - params.correction);
+                }
+                state.frameCount[i]++;
+            }
+            else {
+                // First apply jitter filter
+                for (int c = 0; c < 3; ++c)
+                    diff[c] = raw[c] - prevFiltered[c];
+                float length = std::sqrt(diff[0] * diff[0] + diff[1] * diff[1] + diff[2] * diff[2]);
+                for (int c = 0; c < 3; ++c) {
+                    if (length <= jitterRadius)
+                        filtered[c] = raw[c] * (length / jitterRadius) + prevFiltered[c] * (1.0f - length / jitterRadius);
+                    else
+                        filtered[c] = raw[c];
+                }
+                // Now the double exponential smoothing filter
+                for (int c = 0; c < 3; ++c) {
+                    filtered[c] = filtered[c] * (1.0f - params.smoothing) + (prevFiltered[c] + prevTrend[c]) * params.smoothing;
+                    diff[c] = filtered[c] - prevFiltered[c];
+                    trend[c] = diff[c] * params.correction + prevTrend[c] * (1.0f - params.correction);
+                }
+            }
+
+            // Predict into the future to reduce latency
+            for (int c = 0; c < 3; ++c) {
+                predicted[c] = filtered[c] + trend[c] * params.prediction;
+                diff[c] = predicted[c] - raw[c];
+            }
+            // Check that we are not too far away from raw data
+            float length = std::sqrt(diff[0] * diff[0] + diff[1] * diff[1] + diff[2] * diff[2]);
+            if (length > maxDeviationRadius) {
+                for (int c = 0; c < 3; ++c)
+                    predicted[c] = predicted[c] * (maxDeviationRadius / length) + raw[c] * (1.0f - (maxDeviationRadius / length));
+            }
+
+            state.rawX[i] = raw[0]; state.rawY[i] = raw[1]; state.rawZ[i] = raw[2];
+            state.filteredX[i] = filtered[0]; state.filteredY[i] = filtered[1]; state.filteredZ[i] = filtered[2];
+            state.trendX[i] = trend[0]; state.trendY[i] = trend[1]; state.trendZ[i] = trend[2];
+            output.x[i] = predicted[0]; output.y[i] = predicted[1]; output.z[i] = predicted[2];
+        }
+    }
+
+#ifdef KVR_JOINT_SMOOTHING_SSE
+    namespace JointSmoothingSSE {
+        // mask ? a : b, SSE2 has no blend
+        inline __m128 select(__m128 mask, __m128 a, __m128 b) {
+            return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+        }
+        inline __m128i select(__m128i mask, __m128i a, __m128i b) {
+            return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+        }
+    }
+
+    // Same operations in the same order as smoothJointsScalar, every branch computed and masked,
+    // so each lane gives what the scalar path gives for that joint
+    inline void smoothJointsSSE(const JointSmoothingParams & params, const JointSmoothingInput & input, bool newFrameArrived,
+        JointSmoothingState & state, JointSmoothingOutput & output)
+    {
+        using JointSmoothingSSE::select;
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 two = _mm_set1_ps(2.0f);
+        const __m128 oldFrameTrendScale = _mm_set1_ps(0.9f);
+        const __m128 smoothing = _mm_set1_ps(params.smoothing);
+        const __m128 oneMinusSmoothing = _mm_set1_ps(1.0f - params.smoothing);
+        const __m128 correction = _mm_set1_ps(params.correction);
+        const __m128 oneMinusCorrection = _mm_set1_ps(1.0f - params.correction);
+        const __m128 prediction = _mm_set1_ps(params.prediction);
+        const __m128 baseJitterRadius = _mm_set1_ps(params.jitterRadius);
+        const __m128 baseMaxDeviationRadius = _mm_set1_ps(params.maxDeviationRadius);
+        const __m128i zeroi = _mm_setzero_si128();
+        const __m128i onei = _mm_set1_epi32(1);
+
+        for (int i = 0; i < jointSmoothingLanes; i += 4) {
+            __m128 inferred = _mm_castsi128_ps(_mm_load_si128(reinterpret_cast<const __m128i*>(input.inferred + i)));
+            __m128 jitterRadius = select(inferred, _mm_mul_ps(baseJitterRadius, two), baseJitterRadius);
+            __m128 maxDeviationRadius = select(inferred, _mm_mul_ps(baseMaxDeviationRadius, two), baseMaxDeviationRadius);
+
+            __m128 prevRawX = _mm_load_ps(state.rawX + i);
+            __m128 prevRawY = _mm_load_ps(state.rawY + i);
+            __m128 prevRawZ = _mm_load_ps(state.rawZ + i);
+            __m128 prevFilteredX = _mm_load_ps(state.filteredX + i);
+            __m128 prevFilteredY = _mm_load_ps(state.filteredY + i);
+            __m128 prevFilteredZ = _mm_load_ps(state.filteredZ + i);
+            __m128 prevTrendX = _mm_load_ps(state.trendX + i);
+            __m128 prevTrendY = _mm_load_ps(state.trendY + i);
+            __m128 prevTrendZ = _mm_load_ps(state.trendZ + i);
+
+            __m128 rawX, rawY, rawZ;
+            if (newFrameArrived) {
+                rawX = _mm_load_ps(input.x + i);
+                rawY = _mm_load_ps(input.y + i);
+                rawZ = _mm_load_ps(input.z + i);
+            }
+            else {
+                rawX = _mm_add_ps(prevFilteredX, _mm_mul_ps(prevTrendX, oldFrameTrendScale));
+                rawY = _mm_add_ps(prevFilteredY, _mm_mul_ps(prevTrendY, oldFrameTrendScale));
+                rawZ = _mm_add_ps(prevFilteredZ, _mm_mul_ps(prevTrendZ, oldFrameTrendScale));
+            }
+
+            // Invalid joints restart the filter
+            __m128 valid = _mm_or_ps(_mm_or_ps(_mm_cmpneq_ps(rawX, zero), _mm_cmpneq_ps(rawY, zero)), _mm_cmpneq_ps(rawZ, zero));
+            __m128i frameCount = _mm_and_si128(_mm_load_si128(reinterpret_cast<const __m128i*>(state.frameCount + i)), _mm_castps_si128(valid));
+            __m128 firstFrame = _mm_castsi128_ps(_mm_cmpeq_epi32(frameCount, zeroi));
+            __m128 secondFrame = _mm_castsi128_ps(_mm_cmpeq_epi32(frameCount, onei));
+            _mm_store_si128(reinterpret_cast<__m128i*>(state.frameCount + i),
+                select(_mm_castps_si128(_mm_or_ps(firstFrame, secondFrame)), _mm_add_epi32(frameCount, onei), frameCount));
+
+            // Second frame: average with the previous raw position
+            __m128 secondX = _mm_mul_ps(_mm_add_ps(rawX, prevRawX), half);
+            __m128 secondY = _mm_mul_ps(_mm_add_ps(rawY, prevRawY), half);
+            __m128 secondZ = _mm_mul_ps(_mm_add_ps(rawZ, prevRawZ), half);
+
+            // Warmed up: jitter filter, then the double exponential smoothing
+            __m128 diffX = _mm_sub_ps(rawX, prevFilteredX);
+            __m128 diffY = _mm_sub_ps(rawY, prevFilteredY);
+            __m128 diffZ = _mm_sub_ps(rawZ, prevFilteredZ);
+            __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(diffX, diffX), _mm_mul_ps(diffY, diffY)), _mm_mul_ps(diffZ, diffZ)));
+            __m128 withinJitter = _mm_cmple_ps(length, jitterRadius);
+            __m128 jitterBlend = _mm_div_ps(length, jitterRadius);
+            __m128 jitterKeep = _mm_sub_ps(one, jitterBlend);
+            __m128 smoothX = select(withinJitter, _mm_add_ps(_mm_mul_ps(rawX, jitterBlend), _mm_mul_ps(prevFilteredX, jitterKeep)), rawX);
+            __m128 smoothY = select(withinJitter, _mm_add_ps(_mm_mul_ps(rawY, jitterBlend), _mm_mul_ps(prevFilteredY, jitterKeep)), rawY);
+            __m128 smoothZ = select(withinJitter, _mm_add_ps(_mm_mul_ps(rawZ, jitterBlend), _mm_mul_ps(prevFilteredZ, jitterKeep)), rawZ);
+            smoothX = _mm_add_ps(_mm_mul_ps(smoothX, oneMinusSmoothing), _mm_mul_ps(_mm_add_ps(prevFilteredX, prevTrendX), smoothing));
+            smoothY = _mm_add_ps(_mm_mul_ps(smoothY, oneMinusSmoothing), _mm_mul_ps(_mm_add_ps(prevFilteredY, prevTrendY), smoothing));
+            smoothZ = _mm_add_ps(_mm_mul_ps(smoothZ, oneMinusSmoothing), _mm_mul_ps(_mm_add_ps(prevFilteredZ, prevTrendZ), smoothing));
+
+            __m128 filteredX = select(firstFrame, rawX, select(secondFrame, secondX, smoothX));
+            __m128 filteredY = select(firstFrame, rawY, select(secondFrame, secondY, smoothY));
+            __m128 filteredZ = select(firstFrame, rawZ, select(secondFrame, secondZ, smoothZ));
+
+            // The trend is the same for the second frame and once warmed up, and 0 on the first
+            __m128 trendX = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(filteredX, prevFilteredX), correction), _mm_mul_ps(prevTrendX, oneMinusCorrection));
+            __m128 trendY = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(filteredY, prevFilteredY), correction), _mm_mul_ps(prevTrendY, oneMinusCorrection));
+            __m128 trendZ = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(filteredZ, prevFilteredZ), correction), _mm_mul_ps(prevTrendZ, oneMinusCorrection));
+            trendX = _mm_andnot_ps(firstFrame, trendX);
+            trendY = _mm_andnot_ps(firstFrame, trendY);
+            trendZ = _mm_andnot_ps(firstFrame, trendZ);
+
+            // Predict into the future, without straying further than maxDeviationRadius from the raw data
+            __m128 predictedX = _mm_add_ps(filteredX, _mm_mul_ps(trendX, prediction));
+            __m128 predictedY = _mm_add_ps(filteredY, _mm_mul_ps(trendY, prediction));
+            __m128 predictedZ = _mm_add_ps(filteredZ, _mm_mul_ps(trendZ, prediction));
+            diffX = _mm_sub_ps(predictedX, rawX);
+            diffY = _mm_sub_ps(predictedY, rawY);
+            diffZ = _mm_sub_ps(predictedZ, rawZ);
+            length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(diffX, diffX), _mm_mul_ps(diffY, diffY)), _mm_mul_ps(diffZ, diffZ)));
+            __m128 deviated = _mm_cmpgt_ps(length, maxDeviationRadius);
+            __m128 deviationScale = _mm_div_ps(maxDeviationRadius, length); // Only used where length > the radius, so never /0
+            __m128 deviationKeep = _mm_sub_ps(one, deviationScale);
+            predictedX = select(deviated, _mm_add_ps(_mm_mul_ps(predictedX, deviationScale), _mm_mul_ps(rawX, deviationKeep)), predictedX);
+            predictedY = select(deviated, _mm_add_ps(_mm_mul_ps(predictedY, deviationScale), _mm_mul_ps(rawY, deviationKeep)), predictedY);
+            predictedZ = select(deviated, _mm_add_ps(_mm_mul_ps(predictedZ, deviationScale), _mm_mul_ps(rawZ, deviationKeep)), predictedZ);
+
+            _mm_store_ps(state.rawX + i, rawX);
+            _mm_store_ps(state.rawY + i, rawY);
+            _mm_store_ps(state.rawZ + i, rawZ);
+            _mm_store_ps(state.filteredX + i, filteredX);
+            _mm_store_ps(state.filteredY + i, filteredY);
+            _mm_store_ps(state.filteredZ + i, filteredZ);
+            _mm_store_ps(state.trendX + i, trendX);
+            _mm_store_ps(state.trendY + i, trendY);
+            _mm_store_ps(state.trendZ + i, trendZ);
+            _mm_store_ps(output.x + i, predictedX);
+            _mm_store_ps(output.y + i, predictedY);
+            _mm_store_ps(output.z + i, predictedZ);
+        }
+    }
+#endif
+
+    inline void smoothJoints(const JointSmoothingParams & params, const JointSmoothingInput & input, bool newFrameArrived,
+        JointSmoothingState & state, JointSmoothingOutput & output)
+    {
+#ifdef KVR_JOINT_SMOOTHING_SSE
+        smoothJointsSSE(params, input, newFrameArrived, state, output);
+#else
+        smoothJointsScalar(params, input, newFrameArrived, state, output);
+#endif
+    }
+
+    struct JointSmoothingBenchmarkResult {
+        int frames = 0;
+        double scalarNanosecondsPerFrame = 0.0;
+        double batchNanosecondsPerFrame = 0.0;
+        float maxDifference = 0.0f;     // Largest difference between the two paths' outputs, in metres
+    };
+
+    // Runs the scalar and batch (smoothJoints) paths side by side over the same synthetic skeleton -
+    // joints wandering about, some inferred, some dropping out, and repeated frames - checking they
+    // agree and timing each
+    inline JointSmoothingBenchmarkResult runJointSmoothingBenchmark(int frames) {
+        JointSmoothingBenchmarkResult result;
+        result.frames = frames;
+        const JointSmoothingParams params{ 0.25f, 0.25f, 0.25f, 0.03f, 0.05f };
+        JointSmoothingInput input;
+        JointSmoothingState scalarState;
+        JointSmoothingState batchState;
+        JointSmoothingOutput scalarOutput;
+        JointSmoothingOutput batchOutput;
+
+        uint32_t seed = 12345;
+        auto noise = [&seed]() {
+            seed = seed * 1664525u + 1013904223u;
+            return float(seed >> 8) / float(1 << 24) - 0.5f;
+        };
+
+        int64_t scalarNanoseconds = 0;
+        int64_t batchNanoseconds = 0;
+        for (int frame = 0; frame < frames; ++frame) {
+            bool newFrameArrived = (frame % 4) != 3;
+            for (int j = 0; j < 25; ++j) {
+                input.x[j] += noise() * 0.05f;
+                input.y[j] = 1.0f + j * 0.05f + noise() * 0.02f;
+                input.z[j] = 2.0f + noise() * 0.04f;
+                input.inferred[j] = (noise() > 0.3f) ? -1 : 0;
+                if (noise() > 0.48f) {
+                    input.x[j] = 0.0f; input.y[j] = 0.0f; input.z[j] = 0.0f;
+                }
+            }
+
+            int64_t start = monotonicNanoseconds();
+            smoothJointsScalar(params, input, newFrameArrived, scalarState, scalarOutput);
+            int64_t middle = monotonicNanoseconds();
+            smoothJoints(params, input, newFrameArrived, batchState, batchOutput);
+            int64_t end = monotonicNanoseconds();
+            scalarNanoseconds += middle - start;
+            batchNanoseconds += end - middle;
+
+            for (int j = 0; j < jointSmoothingLanes; ++j) {
+                float difference = std::fabs(scalarOutput.x[j] - batchOutput.x[j]);
+                difference = std::fmax(difference, std::fabs(scalarOutput.y[j] - batchOutput.y[j]));
+                difference = std::fmax(difference, std::fabs(scalarOutput.z[j] - batchOutput.z[j]));
+                result.maxDifference = std::fmax(result.maxDifference, difference);
+            }
+        }
+        if (frames > 0) {
+            result.scalarNanosecondsPerFrame = scalarNanoseconds / double(frames);
+            result.batchNanosecondsPerFrame = batchNanoseconds / double(frames);
+        }
+        LOG(INFO) << "Joint smoothing benchmark: " << frames << " frames, scalar " << result.scalarNanosecondsPerFrame
+            << " ns/frame, batch " << result.batchNanosecondsPerFrame << " ns/frame, max difference " << result.maxDifference;
+        return result;
+    }
+}
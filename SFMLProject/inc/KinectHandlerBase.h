@@ -1,7 +1,13 @@
 #pragma once
 #include "IKinectHandler.h"
-#include <opencv2\opencv.hpp>
+#include <opencv2/opencv.hpp>
 #include "KinectTrackedDevice.h"
+#include "KinectPreview.h"
+#include "KinectStreams.h"
+#include "LatencyStats.h"
+#include "SkeletonFrame.h"
+#include <chrono>
+#include <thread>
 class KinectHandlerBase : public IKinectHandler {
 public:
     KinectHandlerBase() {
@@ -11,6 +17,11 @@ public:
 
     }
     bool convertColorToDepthResolution = false;
+    // Which of the color/depth streams below are wanted, and how. Nothing by default - skeleton only
+    KVR::KinectStreamSubscriptions streams;
+    // Colour frames for the image preview, fed by the handlers while KinectSettings::isKinectDrawn
+    KVR::KinectPreview preview;
+
     // Color Buffer
     std::vector<BYTE> colorBuffer;
     int colorWidth;
@@ -25,6 +36,13 @@ public:
     unsigned int depthBytesPerPixel;
     cv::Mat depthMat;
 
+    // KVR::monotonicNanoseconds() of the latest skeleton frame's arrival, and of when the filters finished with it
+    int64_t skeletonCaptureTimestamp = 0;
+    int64_t skeletonFilteredTimestamp = 0;
+    // The latest skeleton after filtering, in a form that doesn't depend on the sensor version
+    // Used for recording sessions, and filled back in when replaying them
+    KVR::SkeletonFrame latestSkeleton;
+
     virtual void initOpenGL() {};
     virtual void initialise() {};
 
@@ -38,13 +56,19 @@ public:
 
     virtual HRESULT getStatusResult() { return E_NOTIMPL; }
     virtual std::string statusResultString(HRESULT stat) { return "statusResultString behaviour not defined"; };
-    virtual bool getFilteredJoint(KVR::KinectTrackedDevice device, vr::HmdVector3d_t& position, vr::HmdQuaternion_t &rotation) { return false; };
+    virtual bool getFilteredJoint(const KVR::KinectTrackedDevice & device, vr::HmdVector3d_t& position, vr::HmdQuaternion_t &rotation) { return false; };
 
     virtual void update() {};
+    // Blocks the tracking thread until the sensor signals a new skeleton frame, or the timeout passes.
+    // Sensors without a frame event just wait out the timeout
+    virtual bool waitForNewFrame(std::chrono::milliseconds timeout) {
+        std::this_thread::sleep_for(timeout);
+        return false;
+    }
 
     virtual bool putRGBDataIntoMatrix(cv::Mat& image) { return false; }
     virtual void drawKinectData(sf::RenderWindow &win) {};  // Houses the below draw functions with a check
-    virtual void drawKinectImageData(sf::RenderWindow &win) {};
+    virtual void drawKinectImageData(sf::RenderWindow &win) { preview.draw(win); };
     virtual void drawTrackedSkeletons(sf::RenderWindow &win) {};
 
     virtual void zeroAllTracking(vr::IVRSystem* &m_sys) {};
@@ -52,5 +76,5 @@ public:
         std::vector<KVR::KinectTrackedDevice> & trackers
     ) {};
     virtual void updateTrackersWithColorPosition(
-        std::vector<KVR::KinectTrackedDevice> trackers, sf::Vector2i pos) {}
+        std::vector<KVR::KinectTrackedDevice> & trackers, sf::Vector2i pos) {}
 };
\ No newline at end of file
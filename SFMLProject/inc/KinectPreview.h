@@ -0,0 +1,213 @@
+#pragma once
+#include "stdafx.h"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define KVR_PREVIEW_SSE2
+#include <emmintrin.h>
+#endif
+
+#include <SFML/Graphics/RenderWindow.hpp>
+#include <SFML/Graphics/Sprite.hpp>
+#include <SFML/Graphics/Texture.hpp>
+
+#include "SkeletonCapture.h"
+
+namespace KVR {
+    // CPU side of the Kinect image preview. Frames go in at the sensor's resolution, and only when a new one
+    // has arrived is it downsampled towards the size it's shown at and handed to a PreviewTarget to upload/keep
+    struct PreviewFrame {
+        int width = 0;
+        int height = 0;
+        std::vector<uint8_t> pixels; // BGRA, tightly packed
+    };
+
+    // Averages each 2x2 block of a BGRA image into dst, which is (width/2)x(height/2), tightly packed.
+    // The SSE2 and plain loops round the same way, so either gives identical output
+    inline void halveBGRA(const uint8_t* src, int width, int height, size_t stride, uint8_t* dst) {
+        const int halfWidth = width / 2;
+        const int halfHeight = height / 2;
+        for (int y = 0; y < halfHeight; ++y) {
+            const uint8_t* row0 = src + (2 * y) * stride;
+            const uint8_t* row1 = row0 + stride;
+            uint8_t* out = dst + size_t(y) * halfWidth * 4;
+            int x = 0;
+#ifdef KVR_PREVIEW_SSE2
+            // 8 source pixels from each row -> 4 output pixels
+            for (; x + 4 <= halfWidth; x += 4) {
+                __m128i a = _mm_avg_epu8(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8)),
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8)));
+                __m128i b = _mm_avg_epu8(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8 + 16)),
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8 + 16)));
+                __m128 af = _mm_castsi128_ps(a);
+                __m128 bf = _mm_castsi128_ps(b);
+                __m128i even = _mm_castps_si128(_mm_shuffle_ps(af, bf, _MM_SHUFFLE(2, 0, 2, 0)));
+                __m128i odd = _mm_castps_si128(_mm_shuffle_ps(af, bf, _MM_SHUFFLE(3, 1, 3, 1)));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4), _mm_avg_epu8(even, odd));
+            }
+#endif
+            for (; x < halfWidth; ++x) {
+                for (int c = 0; c < 4; ++c) {
+                    int left = (row0[x * 8 + c] + row1[x * 8 + c] + 1) >> 1;
+                    int right = (row0[x * 8 + 4 + c] + row1[x * 8 + 4 + c] + 1) >> 1;
+                    out[x * 4 + c] = uint8_t((left + right + 1) >> 1);
+                }
+            }
+        }
+    }
+
+    // BGRA -> RGBA (what sf::Texture takes), tightly packed into dst.
+    // Alpha is forced opaque, as the v1 sensor leaves it at 0
+    inline void convertBGRAToRGBA(const uint8_t* src, int width, int height, size_t stride, uint8_t* dst) {
+        for (int y = 0; y < height; ++y) {
+            const uint8_t* in = src + y * stride;
+            uint8_t* out = dst + size_t(y) * width * 4;
+            int x = 0;
+#ifdef KVR_PREVIEW_SSE2
+            const __m128i greenMask = _mm_set1_epi32(0x0000FF00);
+            const __m128i lowByteMask = _mm_set1_epi32(0x000000FF);
+            const __m128i opaque = _mm_set1_epi32(int(0xFF000000));
+            for (; x + 4 <= width; x += 4) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + x * 4));
+                __m128i red = _mm_and_si128(_mm_srli_epi32(v, 16), lowByteMask);
+                __m128i blue = _mm_slli_epi32(_mm_and_si128(v, lowByteMask), 16);
+                __m128i rgba = _mm_or_si128(_mm_or_si128(_mm_and_si128(v, greenMask), opaque), _mm_or_si128(red, blue));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4), rgba);
+            }
+#endif
+            for (; x < width; ++x) {
+                out[x * 4 + 0] = in[x * 4 + 2];
+                out[x * 4 + 1] = in[x * 4 + 1];
+                out[x * 4 + 2] = in[x * 4 + 0];
+                out[x * 4 + 3] = 0xFF;
+            }
+        }
+    }
+
+    class PreviewTarget {
+        // Wherever a prepared preview frame ends up
+    public:
+        virtual ~PreviewTarget() {}
+        // rgba is tightly packed, width * height * 4 bytes. Only called when there's a new frame
+        virtual void present(const uint8_t* rgba, int width, int height) = 0;
+    };
+
+    class MemoryPreviewTarget : public PreviewTarget {
+        // Keeps the last presented frame in memory, so the preview can run without a window or GL context
+    public:
+        int width = 0;
+        int height = 0;
+        std::vector<uint8_t> pixels;
+        uint64_t presentedFrames = 0;
+
+        void present(const uint8_t* rgba, int frameWidth, int frameHeight) {
+            width = frameWidth;
+            height = frameHeight;
+            pixels.assign(rgba, rgba + size_t(frameWidth) * frameHeight * 4);
+            ++presentedFrames;
+        }
+    };
+
+    class WindowPreviewTarget : public PreviewTarget {
+        // Uploads into a texture the size of the prepared frame (only reallocated when that changes),
+        // and draws it stretched over the window
+    public:
+        void present(const uint8_t* rgba, int width, int height) {
+            if (texture.getSize() != sf::Vector2u(width, height)) {
+                if (!texture.create(width, height)) {
+                    LOG(ERROR) << "Could not create the " << width << "x" << height << " Kinect preview texture";
+                    return;
+                }
+                sprite.setTexture(texture, true);
+            }
+            texture.update(rgba);
+        }
+        void draw(sf::RenderWindow & window) {
+            sf::Vector2u textureSize = texture.getSize();
+            if (!textureSize.x || !textureSize.y)
+                return;
+            sf::Vector2u windowSize = window.getSize();
+            sprite.setScale(float(windowSize.x) / textureSize.x, float(windowSize.y) / textureSize.y);
+
+            window.pushGLStates();
+            window.resetGLStates();
+            window.setView(window.getDefaultView());
+            window.draw(sprite);
+            window.popGLStates();
+        }
+
+    private:
+        sf::Texture texture;
+        sf::Sprite sprite;
+    };
+
+    class KinectPreview {
+        // submitFrame() from whichever thread updates the Kinect, render()/draw() from the one drawing.
+        // The staging buffers are a triple buffer (see LatestValueSlot), so neither side waits on the other,
+        // and their allocations are reused for as long as the sensor resolution stays the same
+    public:
+        // Copies a BGRA frame at the sensor's resolution into the next staging buffer
+        void submitFrame(const uint8_t* bgra, int width, int height, size_t stride) {
+            if (!bgra || width <= 0 || height <= 0)
+                return;
+            PreviewFrame & frame = staging.writeBuffer();
+            frame.width = width;
+            frame.height = height;
+            frame.pixels.resize(size_t(width) * height * 4);
+            const size_t rowBytes = size_t(width) * 4;
+            if (stride == rowBytes) {
+                std::memcpy(frame.pixels.data(), bgra, rowBytes * height);
+            }
+            else {
+                for (int y = 0; y < height; ++y)
+                    std::memcpy(frame.pixels.data() + y * rowBytes, bgra + y * stride, rowBytes);
+            }
+            staging.publish();
+        }
+
+        // If a frame has arrived since the last call, halves it while it's still at least the target size
+        // both ways, and presents it. False if there was nothing new, i.e. nothing needs uploading
+        bool render(PreviewTarget & target, int targetWidth, int targetHeight) {
+            const PreviewFrame* frame = staging.consume();
+            if (!frame || frame->pixels.empty())
+                return false;
+
+            const uint8_t* source = frame->pixels.data();
+            int width = frame->width;
+            int height = frame->height;
+            std::vector<uint8_t>* halved = &halvedA;
+            while (width / 2 >= targetWidth && height / 2 >= targetHeight && width >= 2 && height >= 2) {
+                halved->resize(size_t(width / 2) * (height / 2) * 4);
+                halveBGRA(source, width, height, size_t(width) * 4, halved->data());
+                source = halved->data();
+                width /= 2;
+                height /= 2;
+                halved = (halved == &halvedA) ? &halvedB : &halvedA;
+            }
+
+            converted.resize(size_t(width) * height * 4);
+            convertBGRAToRGBA(source, width, height, size_t(width) * 4, converted.data());
+            target.present(converted.data(), width, height);
+            return true;
+        }
+
+        void draw(sf::RenderWindow & window) {
+            sf::Vector2u windowSize = window.getSize();
+            render(windowTarget, int(windowSize.x), int(windowSize.y));
+            windowTarget.draw(window);
+        }
+
+    private:
+        LatestValueSlot<PreviewFrame> staging;
+        // Scratch for the downsample, kept between frames so they aren't reallocated
+        std::vector<uint8_t> halvedA;
+        std::vector<uint8_t> halvedB;
+        std::vector<uint8_t> converted;
+
+        WindowPreviewTarget windowTarget;
+    };
+}
@@ -1,8 +1,9 @@
 #pragma once
 #include "stdafx.h"
+#include <atomic>
 #include <openvr.h>
 #include <SFML/System/Vector3.hpp>
-#include <SFML\Graphics\Text.hpp>
+#include <SFML/Graphics/Text.hpp>
 #include <string>
 #include <sstream>
 
@@ -39,6 +40,9 @@ namespace KinectSettings {
     extern double kinectToVRScale;
 
     extern double hipRoleHeightAdjust;
+    // Seconds past the measured latency to extrapolate Kinect trackers, 0 disables prediction
+    // Set by the GUI and read by the tracking thread, so it's atomic rather than under the pipeline lock
+    extern std::atomic<double> trackerPredictionLookAhead;
 
 
     //Need to delete later (Merge should sort it)
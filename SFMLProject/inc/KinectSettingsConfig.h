@@ -0,0 +1,49 @@
+#pragma once
+#include "stdafx.h"
+#include <istream>
+
+#include <cereal/archives/json.hpp>
+#include <cereal/cereal.hpp>
+#include <openvr.h>
+
+#include "KinectSettings.h"
+#include "logging.h"
+
+namespace KinectSettings {
+    // What KinectToVR.cfg holds, read apart from the globals so that loading old configs can be tested.
+    // Start it from the current settings - anything the config doesn't have keeps that value
+    struct ConfigValues {
+        float rot[3] = { 0,0,0 };
+        float pos[3] = { 0,0,0 };
+        double hipHeight = 0;
+        float fontSize = 12.f;
+        vr::HmdVector3d_t secondaryTrackingOriginOffset = { 0,0,0 };
+        double predictionLookAhead = 0.04;
+    };
+
+    // False if the config couldn't be parsed. Whatever was read before the error is kept
+    inline bool readConfig(std::istream & is, ConfigValues & values) {
+        try {
+            cereal::JSONInputArchive archive(is);
+            archive(values.rot);
+            archive(values.pos);
+            archive(values.hipHeight);
+            archive(values.fontSize);
+            archive(values.secondaryTrackingOriginOffset);
+
+            // Added after the first release, so older configs won't have it. Looked up by name,
+            // as cereal throws if it reads past the last value
+            try {
+                archive(cereal::make_nvp("trackerPredictionLookAhead", values.predictionLookAhead));
+            }
+            catch (cereal::Exception &) {
+                LOG(INFO) << "Config has no trackerPredictionLookAhead, keeping " << values.predictionLookAhead;
+            }
+        }
+        catch (cereal::Exception & e) {
+            LOG(ERROR) << "CONFIG FILE LOAD JSON ERROR: " << e.what();
+            return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include "stdafx.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace KVR {
+    // The Kinect's image streams. The skeleton stream always runs, these only run while something subscribes to them
+    enum class KinectStream {
+        Color = 0,
+        Depth,
+        Count
+    };
+
+    struct KinectStreamRequest {
+        int width = 0;      // 0 for the sensor's own resolution
+        int height = 0;
+        bool smoothed = false;  // Median filtered before it's handed out
+    };
+
+    class KinectStreamSubscriptions {
+        // Tracking methods and the GUI preview declare which image streams they need here,
+        // and the handler only opens, acquires, converts and smooths those.
+        // Subscribing is rare (GUI thread), so it's just a mutex - the handler checks generation()
+        // each update and only re-reads the subscriptions when it has moved
+    public:
+        typedef uint32_t SubscriptionID;
+        static const SubscriptionID invalidSubscription = 0;
+
+        SubscriptionID subscribe(KinectStream stream, KinectStreamRequest request) {
+            std::lock_guard<std::mutex> guard(subscriptionMutex);
+            Subscription subscription{ nextID++, stream, request };
+            subscriptions.push_back(subscription);
+            ++changeGeneration;
+            return subscription.id;
+        }
+        void unsubscribe(SubscriptionID id) {
+            std::lock_guard<std::mutex> guard(subscriptionMutex);
+            auto it = std::remove_if(subscriptions.begin(), subscriptions.end(), [id](const Subscription & s) { return s.id == id; });
+            if (it == subscriptions.end())
+                return;
+            subscriptions.erase(it, subscriptions.end());
+            ++changeGeneration;
+        }
+
+        uint64_t generation() const {
+            return changeGeneration.load(std::memory_order_acquire);
+        }
+        bool wanted(KinectStream stream) {
+            std::lock_guard<std::mutex> guard(subscriptionMutex);
+            for (const Subscription & s : subscriptions) {
+                if (s.stream == stream)
+                    return true;
+            }
+            return false;
+        }
+        // What satisfies every subscriber: the largest resolution asked for (any 0 means the sensor's own),
+        // smoothed if anyone wants it smoothed
+        KinectStreamRequest combined(KinectStream stream) {
+            std::lock_guard<std::mutex> guard(subscriptionMutex);
+            KinectStreamRequest result;
+            bool first = true;
+            bool nativeResolution = false;
+            for (const Subscription & s : subscriptions) {
+                if (s.stream != stream)
+                    continue;
+                if (!s.request.width || !s.request.height)
+                    nativeResolution = true;
+                if (first || s.request.width * s.request.height > result.width * result.height) {
+                    result.width = s.request.width;
+                    result.height = s.request.height;
+                }
+                result.smoothed = result.smoothed || s.request.smoothed;
+                first = false;
+            }
+            if (nativeResolution) {
+                result.width = 0;
+                result.height = 0;
+            }
+            return result;
+        }
+
+    private:
+        struct Subscription {
+            SubscriptionID id;
+            KinectStream stream;
+            KinectStreamRequest request;
+        };
+        std::mutex subscriptionMutex;
+        std::vector<Subscription> subscriptions;
+        SubscriptionID nextID = 1;
+        std::atomic<uint64_t> changeGeneration{ 0 };
+    };
+
+    class KinectStreamSubscription {
+        // One subscriber's hold on a stream, e.g. the preview while it's visible
+    public:
+        ~KinectStreamSubscription() {
+            release();
+        }
+        // Subscribes or releases to match 'active', so it can be called every frame with whether it's needed
+        void setActive(bool active, KinectStreamSubscriptions & subscriptions, KinectStream stream, KinectStreamRequest request) {
+            if (active && !owner) {
+                owner = &subscriptions;
+                id = subscriptions.subscribe(stream, request);
+            }
+            else if (!active)
+                release();
+        }
+        void release() {
+            if (owner)
+                owner->unsubscribe(id);
+            owner = nullptr;
+            id = KinectStreamSubscriptions::invalidSubscription;
+        }
+        bool isActive() const { return owner != nullptr; }
+
+    private:
+        KinectStreamSubscriptions* owner = nullptr;
+        KinectStreamSubscriptions::SubscriptionID id = KinectStreamSubscriptions::invalidSubscription;
+    };
+
+    // Clamps a request's resolution to the sensor's, 0 meaning the sensor's own
+    inline void resolveStreamResolution(const KinectStreamRequest & request, int nativeWidth, int nativeHeight, int & width, int & height) {
+        width = nativeWidth;
+        height = nativeHeight;
+        if (request.width > 0 && request.height > 0 && request.width < nativeWidth && request.height < nativeHeight) {
+            width = request.width;
+            height = request.height;
+        }
+    }
+}
@@ -3,17 +3,23 @@
 //OpenGl and SFML
 #include <SFML/Window/Event.hpp>
 #include "KinectHandlerBase.h"
+#include "DeviceHandler.h"
+#include <memory>
+#include <vector>
 //VR
 #include <openvr.h>
 
 //void updateKinectTracker(vrinputemulator::VRInputEmulator &emulator, KinectTrackedDevice device);
 void processKeyEvents(sf::Event event);
 void toggle(bool &b);
+// Writes the frame profiler's samples as CSV and a Chrome trace, when built with KVR_FRAME_PROFILER
+void dumpFrameProfile();
 
 
 void limitVRFramerate(double &endTimeMilliseconds, std::stringstream &ss);
 
-void processLoop(KinectHandlerBase& kinect);
+// extraDeviceHandlers are added alongside the default ones, e.g. a ReplayDeviceHandler
+void processLoop(KinectHandlerBase& kinect, std::vector<std::unique_ptr<DeviceHandler>> extraDeviceHandlers = {});
 
 void updateFilePath();
 
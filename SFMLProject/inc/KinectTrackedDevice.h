@@ -8,10 +8,14 @@
 #include "KinectJoint.h"
 #include "IETracker.h"
 #include "VRHelper.h"
+#include "PoseSubmissionBatch.h"
+#include "PosePredictor.h"
 #include <vrinputemulator.h>
 #include <SFML/System/Vector3.hpp>
 #include <openvr_math.h>
 #include "VectorMath.h"
+#include "QuaternionMath.h"
+#include "CalibrationTransform.h"
 
 namespace KVR {
 
@@ -111,7 +115,14 @@ namespace KVR {
                 nextUpdatePose = pose;
             }
         }
+        void noteCaptureTimestamp(int64_t captureTimestamp) {
+            // A pose is only as fresh as the oldest sample that went into it
+            if (captureTimestamp && (!nextUpdateCaptureTimestamp || captureTimestamp < nextUpdateCaptureTimestamp))
+                nextUpdateCaptureTimestamp = captureTimestamp;
+        }
         void update() {
+            submitCaptureTimestamp = nextUpdateCaptureTimestamp;
+            nextUpdateCaptureTimestamp = 0;
             if (sensorShouldSkipUpdate())
                 return;
             // Send through the positions for the next update of the controller
@@ -124,6 +135,9 @@ namespace KVR {
              */
             if (!nextUpdatePose.poseIsValid) {
                 nextUpdatePoseIsSet = false;
+                submitCaptureTimestamp = 0; // Resending an old pose, so no idea how stale it is
+                // and it shouldn't keep being extrapolated along its last velocity either
+                KVR::PoseVelocityEstimator::clearPrediction(lastValidPose);
                 update(lastValidPose);
                 return;
             }
@@ -165,7 +179,7 @@ namespace KVR {
             pose.poseIsValid = true;
 
             pose.result = vr::TrackingResult_Running_OK;
-            inputEmulatorRef.setVirtualDevicePose(deviceId, pose);
+            submitPose(pose);
 
             lastValidPose = pose;
         }
@@ -185,20 +199,15 @@ namespace KVR {
             // VR Offsets' button after spawning a tracker in the Adv tab - calculated by applying 
             // the offsets like normal, and then seeing if it's still off for some reason.
 
-            nextUpdatePose.vecWorldFromDriverTranslation[0] -= KinectSettings::trackingOriginPosition.v[0];
-            nextUpdatePose.vecWorldFromDriverTranslation[1] -= KinectSettings::trackingOriginPosition.v[1];
-            nextUpdatePose.vecWorldFromDriverTranslation[2] -= KinectSettings::trackingOriginPosition.v[2];
-
-            nextUpdatePose.vecPosition[0] -= KinectSettings::secondaryTrackingOriginOffset.v[0];
-            nextUpdatePose.vecPosition[1] -= KinectSettings::secondaryTrackingOriginOffset.v[1];
-            nextUpdatePose.vecPosition[2] -= KinectSettings::secondaryTrackingOriginOffset.v[2];
+            // Both are cached in the CalibrationTransform, along with the origin's rotation,
+            // rather than being recomputed for every tracker
 
-            nextUpdatePose.qWorldFromDriverRotation = nextUpdatePose.qWorldFromDriverRotation * vrmath::inverse(GetVRRotationFromMatrix(KinectSettings::trackingOrigin)) ; // CLEAN UP INTO SETTINGS
+            KVR::CalibrationTransform::shared().applyInputEmulatorOffsets(nextUpdatePose);
         }
 
         void update(vr::DriverPose_t pose) {
             // Pose already completely handled by Tracking Method
-            inputEmulatorRef.setVirtualDevicePose(deviceId, pose);
+            submitPose(pose);
 
             // DEBUG
             //LOG(INFO) << "PSMOVE: IE: " << pose.vecPosition[0] + pose.vecWorldFromDriverTranslation[0] << ", " << pose.vecPosition[1] + pose.vecWorldFromDriverTranslation[1] << ", " << pose.vecPosition[2] + pose.vecWorldFromDriverTranslation[2];
@@ -341,17 +350,9 @@ namespace KVR {
                 rotation = rotation * vrmath::quaternionFromRotationY(PI);
             }
 
-            vr::HmdVector3d_t rotatedPos = vrmath::quaternionRotateVector(KinectSettings::kinectRepRotation, position, false);
-
-            //Adjust this position by the Kinect's VR pos offset
-            rotatedPos.v[0] += KinectSettings::kinectRepPosition.v[0];
-            rotatedPos.v[1] += KinectSettings::kinectRepPosition.v[1];
-            rotatedPos.v[2] += KinectSettings::kinectRepPosition.v[2];
-            
-            if (rotationFilterOption == JointRotationFilterOption::HeadLook) {}
-            else
-                rotation = KinectSettings::kinectRepRotation * rotation;
-            position = rotatedPos;
+            //Then adjust the position by the Kinect's VR pos offset
+            KVR::CalibrationTransform::shared().applyKinectToVR(rotation, position,
+                rotationFilterOption != JointRotationFilterOption::HeadLook);
         }
 
         bool isSensor() {
@@ -367,6 +368,8 @@ namespace KVR {
 
         vrinputemulator::VRInputEmulator &inputEmulatorRef;
         uint32_t deviceId;
+        // Set by the tracking loop each tick - if null, poses are sent straight away and modally like before
+        PoseSubmissionBatch *poseBatch = nullptr;
 
         KVR::KinectJoint joint0 = KVR::KinectJointType::INVALID;
         KVR::KinectJoint joint1 = KVR::KinectJointType::INVALID;
@@ -389,6 +392,8 @@ namespace KVR {
         bool nextUpdateRotationIsSet = false;
         vr::HmdVector3d_t nextUpdatePosition{0,0,0};
         bool nextUpdatePositionIsSet = false;
+        int64_t nextUpdateCaptureTimestamp = 0;
+        int64_t submitCaptureTimestamp = 0;
 
         JointRotationFilterOption rotationFilterOption = JointRotationFilterOption::Filtered;
         JointPositionFilterOption positionFilterOption = JointPositionFilterOption::Filtered;
@@ -401,6 +406,12 @@ namespace KVR {
 
         KinectDeviceRole role;
     private:
+        void submitPose(const vr::DriverPose_t &pose) {
+            if (poseBatch)
+                poseBatch->queue(inputEmulatorRef, deviceId, pose, submitCaptureTimestamp);
+            else
+                inputEmulatorRef.setVirtualDevicePose(deviceId, pose);
+        }
         void updateDevicePosePosition(vr::DriverPose_t &pose, vr::HmdVector3d_t rotatedPos) {
             pose.vecPosition[0] = rotatedPos.v[0] + trackedPositionVROffset.v[0];
             pose.vecPosition[1] = rotatedPos.v[1] + trackedPositionVROffset.v[1];
@@ -0,0 +1,104 @@
+#pragma once
+#include "stdafx.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <sstream>
+
+namespace KVR {
+    // Every timestamp in the tracking pipeline uses this clock, in nanoseconds
+    // steady_clock is QPC based on Windows, so it's monotonic and comparable between processes
+    inline int64_t monotonicNanoseconds() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    class LatencyHistogram {
+        // Fixed power-of-two buckets in microseconds (<1us, <2us, <4us ... <~1s, and everything above)
+        // so recording never allocates, and a copy is cheap enough to hand to the GUI every tick
+    public:
+        static const int bucketCount = 22;
+
+        void record(int64_t nanoseconds) {
+            if (nanoseconds < 0)
+                nanoseconds = 0;
+            int64_t microseconds = nanoseconds / 1000;
+            int bucket = 0;
+            while (bucket < bucketCount - 1 && microseconds >= (int64_t(1) << bucket))
+                ++bucket;
+            ++buckets[bucket];
+            ++samples;
+            totalNanoseconds += nanoseconds;
+            if (nanoseconds > maxNanoseconds)
+                maxNanoseconds = nanoseconds;
+        }
+        void reset() {
+            *this = LatencyHistogram();
+        }
+
+        uint64_t count() const { return samples; }
+        double meanMilliseconds() const {
+            return samples ? (totalNanoseconds / double(samples)) / 1.0e6 : 0.0;
+        }
+        double maxMilliseconds() const {
+            return maxNanoseconds / 1.0e6;
+        }
+        // Upper bound of the bucket the percentile falls in, so it's accurate to within a factor of 2
+        double percentileMilliseconds(double percentile) const {
+            if (!samples)
+                return 0.0;
+            uint64_t target = uint64_t(percentile / 100.0 * samples);
+            if (target >= samples)
+                target = samples - 1;
+            uint64_t seen = 0;
+            for (int i = 0; i < bucketCount; ++i) {
+                seen += buckets[i];
+                if (seen > target)
+                    return i == bucketCount - 1 ? maxMilliseconds() : (int64_t(1) << i) / 1000.0;
+            }
+            return maxMilliseconds();
+        }
+        std::string summary() const {
+            std::stringstream ss;
+            ss.precision(3);
+            ss << "p50 " << percentileMilliseconds(50) << "ms, p95 " << percentileMilliseconds(95)
+                << "ms, p99 " << percentileMilliseconds(99) << "ms, max " << maxMilliseconds() << "ms (" << samples << ")";
+            return ss.str();
+        }
+
+    private:
+        uint64_t buckets[bucketCount] = {};
+        uint64_t samples = 0;
+        int64_t totalNanoseconds = 0;
+        int64_t maxNanoseconds = 0;
+    };
+
+    enum class LatencyStage {
+        CaptureToFilter = 0,    // Sensor frame arrival -> filters updated
+        FilterToPool,           // Filters updated -> joint poses in the tracking pool
+        PoolToPublish,          // Tracking pool -> poses sent to SteamVR
+        CaptureToPublish,       // Per published pose, from it's oldest source sample to being sent
+        Count
+    };
+    const static std::string LatencyStageName[] = {
+        "Capture->Filter",
+        "Filter->Pool",
+        "Pool->Publish",
+        "Capture->Publish"
+    };
+
+    struct LatencyStats {
+        LatencyHistogram stages[(int)LatencyStage::Count];
+
+        LatencyHistogram & operator[](LatencyStage stage) {
+            return stages[(int)stage];
+        }
+        const LatencyHistogram & operator[](LatencyStage stage) const {
+            return stages[(int)stage];
+        }
+        void reset() {
+            for (auto & stage : stages)
+                stage.reset();
+        }
+    };
+}
@@ -2,8 +2,10 @@
 
 #include <iostream>
 #include <iomanip>
+#include <atomic>
 #include <chrono>
 #include <cstring>
+#include <mutex>
 #include <thread>
 
 #include <PSMoveClient_CAPI.h>
@@ -15,18 +17,24 @@
 #include "DeviceHandler.h"
 #include "TrackingPoolManager.h"
 #include "TrackedDeviceInputData.h"
+#include "VRPoseSnapshot.h"
 
 #define M_PI_2 1.57079632679
 
 class PSMoveHandler : public DeviceHandler{
     // Heavily based off of the example template program
     // test_console_CAPI.cpp in the MoveService project
+    // Once started, the PSMoveService client runs on its own thread, which polls for new controller
+    // data and publishes each controller's pose into the pool as soon as it arrives - the pool's pose slots
+    // are lock-free for readers, so the tracking loop just reads the latest one instead of polling itself
 public:
     PSMoveHandler() 
         : m_started(false),
         m_keepRunning(true) {
     }
-    ~PSMoveHandler() {}
+    ~PSMoveHandler() {
+        stopClientThread();
+    }
 
     std::vector<std::string> connectionMessages{
         "Connected!",
@@ -37,6 +45,7 @@ public:
         try {
             if (startup()) {
                 active = true;
+                startClientThread();
                 return 0;
             }
             else {
@@ -49,6 +58,7 @@ public:
         return 1;
     }
     void identify(int globalId, bool on) {
+        std::lock_guard<std::mutex> guard(clientMutex);
         int controllerId = 0;
         for (MoveWrapper_PSM & t : v_controllers) {
             if (t.id.globalID == globalId)
@@ -94,14 +104,24 @@ public:
         default: return "PSMRESULTTOSTRING INVALID!!!!";
         }
     }
-    // Attempt to start and run the client
+    // Called by the tracking loop, with the pipeline lock held. The client thread does the polling,
+    // so all that's left here is adding/removing pool devices when PSMoveService's lists change,
+    // as the pool's device list may only be changed under that lock
     int run() {
-        update();
-
+        if (controllerPoolRebuildPending || eyePoolRebuildPending) {
+            std::lock_guard<std::mutex> guard(clientMutex);
+            if (controllerPoolRebuildPending.exchange(false))
+                rebuildPSMovesForPool();
+            if (eyePoolRebuildPending.exchange(false))
+                rebuildPSEyesForPool();
+        }
         return m_keepRunning;
     }
     void shutdown()
     {
+        if (!active)
+            return;
+        stopClientThread();
         if (!PSM_GetIsConnected()) {
             LOG(ERROR) << "Attempted PSM shutdown on disconnected PSMoveService!";
             return;
@@ -304,10 +324,17 @@ public:
             return;
         }
 
-        vr::TrackedDeviceIndex_t hmd_device_index = 0;
+        vr::TrackedDeviceIndex_t hmd_device_index = vr::k_unTrackedDeviceIndex_Hmd;
 
+        // This runs on the client thread, so the HMD pose is copied out of the tracking tick's
+        // snapshot under its lock, rather than read from KinectSettings while the tick writes it
+        vr::TrackedDevicePose_t hmdPose;
+        if (!VRPoseSnapshot::shared().readPose(hmd_device_index, hmdPose) || !hmdPose.bPoseIsValid) {
+            LOG(WARNING) << "PSMove HMD alignment skipped, there's no valid HMD pose yet";
+            return;
+        }
         PSMPosef hmd_pose_meters;
-        hmd_pose_meters = openvrMatrixExtractPSMPosef(KinectSettings::hmdAbsoluteTracking);
+        hmd_pose_meters = openvrMatrixExtractPSMPosef(hmdPose.mDeviceToAbsoluteTracking);
 
         // Make the HMD orientation only contain a yaw
         hmd_pose_meters.Orientation = ExtractHMDYawQuaternion(hmd_pose_meters.Orientation);
@@ -399,6 +426,7 @@ public:
             m_hasCalibratedWorldFromDriverPose = true;
             //driver_pose_to_world_pose.Position.y -= 1.73f; //Input Emulator's y origin is actually the users set height
             m_worldFromDriverPose = driver_pose_to_world_pose;
+            eyePosesStale = true;
 
             saveTrackingCalibration();
         }
@@ -740,41 +768,89 @@ private:
 
         return success;
     }
+    void startClientThread() {
+        stopClientThread();
+        clientRunning = true;
+        clientThread = std::thread(&PSMoveHandler::runClient, this);
+        LOG(INFO) << "PSMoveService client thread started";
+    }
+    void stopClientThread() {
+        if (!clientRunning)
+            return;
+        clientRunning = false;
+        if (clientThread.joinable())
+            clientThread.join();
+        LOG(INFO) << "PSMoveService client thread stopped";
+    }
+    void runClient() {
+        // The client API has no way to block until data arrives, so this polls it at a short interval,
+        // only publishing the controllers whose data frame actually changed
+        while (clientRunning) {
+            {
+                std::lock_guard<std::mutex> guard(clientMutex);
+                update();
+            }
+            std::this_thread::sleep_for(clientPollInterval);
+        }
+    }
     void update()
     {
         rebuildPSMoveLists();
 
+        // v_controllers/v_eyeTrackers are stale until the tracking loop has rebuilt their pool entries
+        if (controllerPoolRebuildPending || eyePoolRebuildPending)
+            return;
+
         // Get the controller data for each controller
         if (m_keepRunning)
         {
-            processKeyInputs();
+            int64_t captureTimestamp = KVR::monotonicNanoseconds(); // PSM_Update just fetched the latest state
+            // Button presses stay 'PRESSED' until the next data frame, so they're only looked at when one arrives
+            bool newDataFrame = false;
+            for (const MoveWrapper_PSM & wrapper : v_controllers) {
+                if (wrapper.controller->OutputSequenceNum != wrapper.lastPublishedSequence)
+                    newDataFrame = true;
+            }
+            if (newDataFrame)
+                processKeyInputs();
             for (int i = 0; i < v_controllers.size(); ++i) {
                 //const PSMPSMove &view = v_controllers[i].controller->ControllerState.PSMoveState;
                 //LOG(INFO) << "Controller " << i << " has a battery level of " << (int)view.BatteryValue;
-                KVR::TrackedDeviceInputData data = defaultDeviceData(i);
-                data.pose = getDriverPose(i);
+                int sequence = v_controllers[i].controller->OutputSequenceNum;
+                if (sequence == v_controllers[i].lastPublishedSequence)
+                    continue;
+                v_controllers[i].lastPublishedSequence = sequence;
+
+                KVR::TrackedDevicePose devicePose;
+                devicePose.pose = getDriverPose(i);
                 // Reuse, instead of recalling for PSMoveState
-                data.position = { 
-                    data.pose.vecPosition[0],
-                    data.pose.vecPosition[1],
-                    data.pose.vecPosition[2] }; // Pose stores as array
-                data.rotation = data.pose.qRotation;
+                devicePose.position = { 
+                    devicePose.pose.vecPosition[0],
+                    devicePose.pose.vecPosition[1],
+                    devicePose.pose.vecPosition[2] }; // Pose stores as array
+                devicePose.rotation = devicePose.pose.qRotation;
+                devicePose.captureTimestamp = captureTimestamp;
                 
-                TrackingPoolManager::updatePoolWithDevice(data, data.deviceId);
+                TrackingPoolManager::publishDevicePose(v_controllers[i].id, devicePose);
             }
+            // The eyes don't move, so they're only republished when rebuilt or realigned
+            if (!eyePosesStale)
+                return;
+            eyePosesStale = false;
             for (int i = 0; i < v_eyeTrackers.size(); ++i) {
-                KVR::TrackedDeviceInputData data = defaultDeviceData_PSEYE(i);
-                data.pose = getPSEyeDriverPose(i);
+                KVR::TrackedDevicePose devicePose;
+                devicePose.pose = getPSEyeDriverPose(i);
                 // Reuse, instead of recalling for PSMoveState
-                data.position = {
-                    data.pose.vecPosition[0],
-                    data.pose.vecPosition[1],
-                    data.pose.vecPosition[2] }; // Pose stores as array
+                devicePose.position = {
+                    devicePose.pose.vecPosition[0],
+                    devicePose.pose.vecPosition[1],
+                    devicePose.pose.vecPosition[2] }; // Pose stores as array
 
-                //LOG(INFO) << "PSEYE " << i << data.position.v[0] << ", " << data.position.v[1] << ", " << data.position.v[2];
-                data.rotation = data.pose.qRotation;
+                //LOG(INFO) << "PSEYE " << i << devicePose.position.v[0] << ", " << devicePose.position.v[1] << ", " << devicePose.position.v[2];
+                devicePose.rotation = devicePose.pose.qRotation;
+                devicePose.captureTimestamp = captureTimestamp;
 
-                TrackingPoolManager::updatePoolWithDevice(data, data.deviceId);
+                TrackingPoolManager::publishDevicePose(v_eyeTrackers[i].id, devicePose);
             }
         }
     }
@@ -908,7 +984,7 @@ private:
     }
     void rebuildPSEyesForPool() {
         for (int i = 0; i < v_eyeTrackers.size(); ++i) {
-            TrackingPoolManager::clearDeviceInPool(v_eyeTrackers[i].id.globalID);
+            TrackingPoolManager::clearDeviceInPool(v_eyeTrackers[i].id);
         } // Clear last controllers in pool
 
         v_eyeTrackers.clear(); // All old controllers must be gone
@@ -925,14 +1001,13 @@ private:
             // But this time edit the wrapper with the tracking pool id's
             v_eyeTrackers[i].id.internalID = i;
             KVR::TrackedDeviceInputData data = defaultDeviceData_PSEYE(i);
-            uint32_t gID = k_invalidTrackerID;
-            TrackingPoolManager::addDeviceToPool(data, gID);
-            v_eyeTrackers[i].id.globalID = gID;
+            TrackingPoolManager::addDeviceToPool(data, v_eyeTrackers[i].id);
         }
+        eyePosesStale = true;
     }
     void rebuildPSMovesForPool() {
         for (int i = 0; i < v_controllers.size(); ++i) {
-            TrackingPoolManager::clearDeviceInPool(v_controllers[i].id.globalID);
+            TrackingPoolManager::clearDeviceInPool(v_controllers[i].id);
         } // Clear last controllers in pool
 
         v_controllers.clear(); // All old controllers must be gone
@@ -952,9 +1027,7 @@ private:
             // But this time edit the wrapper with the tracking pool id's
             v_controllers[i].id.internalID = i;
             KVR::TrackedDeviceInputData data = defaultDeviceData(i);
-            uint32_t gID = k_invalidTrackerID;
-            TrackingPoolManager::addDeviceToPool(data, gID);
-            v_controllers[i].id.globalID = gID;
+            TrackingPoolManager::addDeviceToPool(data, v_controllers[i].id);
 
             if (v_controllers[i].controller->ControllerType == PSMController_Move) {
                 auto value = v_controllers[i].controller->ControllerState.PSMoveState.BatteryValue;
@@ -1002,7 +1075,9 @@ private:
                     }
                 }
                 // Rebuild K2VR Controller List for Trackers
-                rebuildPSMovesForPool(); // Here, because of timing issue, where controllers will report as 'None' occasionally when uninitialised properly
+                // Here, because of timing issue, where controllers will report as 'None' occasionally when uninitialised properly
+                // The pool entries themselves are rebuilt by run(), under the pipeline lock
+                controllerPoolRebuildPending = true;
                 
             }
             else {
@@ -1015,7 +1090,7 @@ private:
         if (m_keepRunning && PSM_HasTrackerListChanged())
         {
             rebuildTrackerList();
-            rebuildPSEyesForPool();
+            eyePoolRebuildPending = true;
         }
 
         // See if we need to rebuild the hmd list
@@ -1112,6 +1187,7 @@ private:
     struct MoveWrapper_PSM {
         PSMController* controller = nullptr;
         TrackerIDs id;
+        int lastPublishedSequence = -1; // OutputSequenceNum of the data frame last sent to the pool
     };
     std::vector<MoveWrapper_PSM> v_controllers;
 
@@ -1125,7 +1201,16 @@ private:
     PSMTrackerList trackerList;
     PSMHmdList hmdList;
     bool m_started;
-    bool m_keepRunning;
+    std::atomic<bool> m_keepRunning;
+
+    // Client thread
+    std::thread clientThread;
+    std::atomic<bool> clientRunning{ false };
+    std::mutex clientMutex; // Held by the client thread while it touches PSMoveService, and by anything else that does
+    std::chrono::milliseconds clientPollInterval{ 1 };
+    std::atomic<bool> controllerPoolRebuildPending{ false };
+    std::atomic<bool> eyePoolRebuildPending{ false };
+    bool eyePosesStale = true;
 
     //Vars
     bool m_bDisableHMDAlignmentGesture = false;
@@ -0,0 +1,101 @@
+#pragma once
+#include "stdafx.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <vrinputemulator.h>
+
+#include "LatencyStats.h"
+#include "SessionRecording.h"
+#include "SessionReplay.h"
+#include "SkeletonTracker.h"
+#include "TrackingPoolManager.h"
+
+namespace KVR {
+    // Runs a recorded session's skeleton frames through SkeletonTracker's pose generation, the
+    // tracking pool and back out to every joint's tracker, with no window, SteamVR or InputEmulator.
+    // Reports ns/frame and ns/joint, as a baseline to compare pipeline changes against.
+    // Run by KinectlessProcess --benchmark, and by the PipelineBenchmark target in tests/ along with the v1/v2 filters
+    struct PipelineBenchmarkResult {
+        uint64_t frames = 0;
+        double meanNanosecondsPerFrame = 0.0;
+        double p50NanosecondsPerFrame = 0.0;
+        double p99NanosecondsPerFrame = 0.0;
+        double meanNanosecondsPerJoint = 0.0;
+    };
+
+    // Per-frame times -> the result, sorting the times in place
+    inline PipelineBenchmarkResult summariseFrameTimes(std::vector<int64_t> & frameNanoseconds, int jointsPerFrame) {
+        PipelineBenchmarkResult result;
+        result.frames = frameNanoseconds.size();
+        if (!result.frames)
+            return result;
+        int64_t total = 0;
+        for (int64_t ns : frameNanoseconds)
+            total += ns;
+        std::sort(frameNanoseconds.begin(), frameNanoseconds.end());
+        result.meanNanosecondsPerFrame = total / double(result.frames);
+        result.p50NanosecondsPerFrame = double(frameNanoseconds[result.frames / 2]);
+        result.p99NanosecondsPerFrame = double(frameNanoseconds[std::min<uint64_t>(result.frames - 1, result.frames * 99 / 100)]);
+        result.meanNanosecondsPerJoint = result.meanNanosecondsPerFrame / jointsPerFrame;
+        return result;
+    }
+    inline void logPipelineBenchmark(const char * stage, const PipelineBenchmarkResult & result) {
+        LOG(INFO) << stage << " benchmark: " << result.frames << " frames, "
+            << result.meanNanosecondsPerFrame << " ns/frame mean (p50 " << result.p50NanosecondsPerFrame
+            << ", p99 " << result.p99NanosecondsPerFrame << "), "
+            << result.meanNanosecondsPerJoint << " ns/joint";
+    }
+
+    inline PipelineBenchmarkResult runPipelineBenchmark(std::shared_ptr<SessionPlayback> playback, int passes) {
+        PipelineBenchmarkResult result;
+        if (playback->skeletons.empty()) {
+            LOG(ERROR) << "Recorded session has no skeleton frames to benchmark";
+            return result;
+        }
+        playback->speed = SessionPlayback::Speed::Maximum;
+        playback->loop = false;
+
+        ReplayKinectHandler kinect(playback);
+        SkeletonTracker skeletonTracker;
+        skeletonTracker.initialise();
+
+        // Trackers are never initialised, so nothing is ever sent to the (unconnected) InputEmulator
+        vrinputemulator::VRInputEmulator inputEmulator;
+        std::vector<KinectTrackedDevice> joints;
+        for (int i = 0; i < KinectJointCount; ++i) {
+            uint32_t gid = TrackingPoolManager::globalDeviceIDFromJoint(KinectJointType(i));
+            KinectTrackedDevice device(inputEmulator, gid, gid, KinectDeviceRole::Unassigned);
+            device.joint0 = KinectJointType(i);
+            device.joint1 = KinectJointType(i);
+            joints.push_back(device);
+        }
+
+        std::vector<int64_t> frameNanoseconds;
+        frameNanoseconds.reserve(playback->skeletons.size() * passes);
+        for (int pass = 0; pass < passes; ++pass) {
+            playback->rewind();
+            while (playback->skeletonsRemaining() && playback->waitForNextFrame(std::chrono::milliseconds(0))) {
+                int64_t start = monotonicNanoseconds();
+                CalibrationTransform::shared().refresh(); // As TrackingLoop::tick does
+                kinect.update();
+                skeletonTracker.update(kinect, joints);
+                skeletonTracker.updateTrackers(kinect, joints);
+                frameNanoseconds.push_back(monotonicNanoseconds() - start);
+
+                for (KinectTrackedDevice & device : joints) {
+                    device.nextUpdatePositionIsSet = false;
+                    device.nextUpdateRotationIsSet = false;
+                    device.nextUpdatePoseIsSet = false;
+                }
+            }
+        }
+
+        result = summariseFrameTimes(frameNanoseconds, KinectJointCount);
+        logPipelineBenchmark("Pipeline", result);
+        return result;
+    }
+}
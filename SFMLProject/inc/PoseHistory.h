@@ -0,0 +1,154 @@
+#pragma once
+#include "stdafx.h"
+#include <cmath>
+#include <cstdint>
+
+#include <openvr.h>
+#include <openvr_math.h>
+
+#include "QuaternionMath.h"
+
+namespace KVR {
+    struct PoseSample {
+        int64_t captureTimestamp = 0; // KVR::monotonicNanoseconds()
+        vr::HmdVector3d_t position = { 0, 0, 0 };
+        vr::HmdQuaternion_t rotation = { 1, 0, 0, 0 };
+    };
+
+    class PoseHistory {
+        // The last few timestamped poses of one device, so it can be asked where it was (or will shortly be)
+        // at any instant, instead of only what it last reported. Sources run at different rates -
+        // Kinect 30Hz, PSMove 60-120Hz, HMD 90-144Hz - so this is how they're lined up to one moment.
+        // Not thread safe by itself - TrackingPoolManager keeps one per pool slot, under that slot's seqlock
+    public:
+        static const uint32_t capacity = 32; // Power of 2. ~220ms of a 144Hz HMD, ~1s of Kinect
+        static const uint32_t indexMask = capacity - 1;
+
+        void reset() {
+            count = 0;
+            newest = 0;
+        }
+        // Samples without a timestamp, or older than the newest one, are ignored.
+        // The same timestamp again (e.g. a Kinect frame republished after calibrating) replaces it
+        void push(const vr::HmdVector3d_t & position, const vr::HmdQuaternion_t & rotation, int64_t captureTimestamp) {
+            if (!captureTimestamp)
+                return;
+            if (count) {
+                int64_t newestTimestamp = samples[newest].captureTimestamp;
+                if (captureTimestamp < newestTimestamp)
+                    return;
+                if (captureTimestamp > newestTimestamp) {
+                    newest = (newest + 1) & indexMask;
+                    if (count < capacity)
+                        ++count;
+                }
+            }
+            else {
+                count = 1;
+            }
+            PoseSample & sample = samples[newest];
+            sample.captureTimestamp = captureTimestamp;
+            sample.position = position;
+            sample.rotation = rotation;
+        }
+
+        bool empty() const { return count == 0; }
+
+        // The two samples either side of t, or the newest two if t is past them.
+        // Every index is masked, so it's safe to call on a history being written to, as long as
+        // the result is thrown away when the write is noticed (see TrackingPoolManager::sampleDevicePoseAt)
+        bool bracket(int64_t t, PoseSample & older, PoseSample & newer) const {
+            uint32_t n = count;
+            if (!n)
+                return false;
+            if (n > capacity)
+                n = capacity;
+            uint32_t oldestIndex = (newest + capacity - (n - 1)) & indexMask;
+            if (n == 1 || t <= samples[oldestIndex].captureTimestamp) {
+                older = samples[oldestIndex];
+                newer = older;
+                return true;
+            }
+            // Binary search by age, 0 being the oldest
+            uint32_t low = 0;
+            uint32_t high = n - 1;
+            if (t >= samples[newest].captureTimestamp) {
+                low = n - 2;
+            }
+            else {
+                while (high - low > 1) {
+                    uint32_t middle = (low + high) / 2;
+                    if (samples[(oldestIndex + middle) & indexMask].captureTimestamp <= t)
+                        low = middle;
+                    else
+                        high = middle;
+                }
+            }
+            older = samples[(oldestIndex + low) & indexMask];
+            newer = samples[(oldestIndex + low + 1) & indexMask];
+            return true;
+        }
+
+        // Where the device was at t: lerp/slerp between the samples either side of it. Past the newest sample,
+        // the last two are carried on for at most maxExtrapolationSeconds, and not at all if they're too far
+        // apart to say how it was moving. Before the oldest, it's just the oldest
+        static PoseSample interpolate(const PoseSample & older, const PoseSample & newer, int64_t t) {
+            PoseSample result = newer;
+            int64_t span = newer.captureTimestamp - older.captureTimestamp;
+            if (span <= 0)
+                return t <= older.captureTimestamp ? older : newer;
+            if (t <= older.captureTimestamp)
+                return older;
+            if (t > newer.captureTimestamp) {
+                if (span > int64_t(maxSampleGapSeconds * 1e9))
+                    return newer;
+                int64_t limit = newer.captureTimestamp + int64_t(maxExtrapolationSeconds * 1e9);
+                if (t > limit)
+                    t = limit;
+            }
+            double alpha = double(t - older.captureTimestamp) / double(span);
+            for (int i = 0; i < 3; ++i)
+                result.position.v[i] = older.position.v[i] + (newer.position.v[i] - older.position.v[i]) * alpha;
+            if (alpha > 1.0)
+                result.rotation = extrapolateRotation(older.rotation, newer.rotation, alpha - 1.0);
+            else
+                result.rotation = KMath::toHmdQuaternion(KMath::slerp(
+                    KMath::toQuaternion(older.rotation), KMath::toQuaternion(newer.rotation), float(alpha)));
+            result.captureTimestamp = t;
+            return result;
+        }
+
+        bool sampleAt(int64_t t, PoseSample & sample) const {
+            PoseSample older, newer;
+            if (!bracket(t, older, newer))
+                return false;
+            sample = interpolate(older, newer, t);
+            return true;
+        }
+
+    private:
+        // Carries on newer's rotation from older by 'fraction' more of the step between them. Done as an
+        // angle about the step's axis, as slerp's straight line fallback falls short this far past the end
+        static vr::HmdQuaternion_t extrapolateRotation(const vr::HmdQuaternion_t & older, const vr::HmdQuaternion_t & newer, double fraction) {
+            // World space step, newer = step * older, taking the short way round
+            vr::HmdQuaternion_t step = newer * vrmath::quaternionConjugate(older);
+            if (step.w < 0)
+                step = { -step.w, -step.x, -step.y, -step.z };
+            double sinHalfAngle = std::sqrt(step.x * step.x + step.y * step.y + step.z * step.z);
+            if (sinHalfAngle < 1e-9)
+                return newer;
+            double halfAngle = std::atan2(sinHalfAngle, step.w) * fraction;
+            double scale = std::sin(halfAngle) / sinHalfAngle;
+            vr::HmdQuaternion_t extra = { std::cos(halfAngle), step.x * scale, step.y * scale, step.z * scale };
+            return KMath::normalised(extra * newer);
+        }
+
+        // Same limits as the velocity estimate SteamVR is given, see PoseVelocityEstimator
+        static constexpr double maxSampleGapSeconds = 0.25;
+        static constexpr double maxExtrapolationSeconds = 0.2;
+
+        PoseSample samples[capacity];
+        uint32_t newest = 0;
+        uint32_t count = 0;
+    };
+}
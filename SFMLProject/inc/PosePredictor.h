@@ -0,0 +1,129 @@
+#pragma once
+#include "stdafx.h"
+#include <cmath>
+#include <cstdint>
+
+#include <openvr.h>
+#include <openvr_math.h>
+#include <vrinputemulator.h>
+
+#include "KinectSettings.h"
+#include "LatencyStats.h"
+
+namespace KVR {
+    class PoseVelocityEstimator {
+        // Estimates a tracker's linear and angular velocity from consecutive filtered poses,
+        // so SteamVR can extrapolate it over the Kinect's latency instead of showing it as-is.
+        // Only fed when a new skeleton frame arrives, so re-publishing the same frame doesn't read as standing still
+    public:
+        void reset() {
+            lastCaptureTimestamp = 0;
+            hasVelocity = false;
+            velocity = { 0,0,0 };
+            angularVelocity = { 0,0,0 };
+        }
+
+        void addSample(vr::HmdVector3d_t position, vr::HmdQuaternion_t rotation, int64_t captureTimestamp) {
+            if (captureTimestamp == lastCaptureTimestamp)
+                return;
+            double dt = (captureTimestamp - lastCaptureTimestamp) / 1e9;
+            if (!lastCaptureTimestamp || dt <= 0.0 || dt > maxSampleGapSeconds) {
+                // First sample, or tracking was lost for a while - a velocity across the gap would be junk
+                reset();
+                remember(position, rotation, captureTimestamp);
+                return;
+            }
+
+            vr::HmdVector3d_t measuredVelocity = (position - lastPosition) / dt;
+
+            // World space delta, rotation = delta * lastRotation, taking the short way round
+            vr::HmdQuaternion_t delta = rotation * vrmath::quaternionConjugate(lastRotation);
+            if (delta.w < 0)
+                delta = { -delta.w, -delta.x, -delta.y, -delta.z };
+            vr::HmdVector3d_t measuredAngularVelocity{ 0,0,0 };
+            double sinHalfAngle = std::sqrt(delta.x * delta.x + delta.y * delta.y + delta.z * delta.z);
+            if (sinHalfAngle > 1e-9) {
+                double angle = 2.0 * std::atan2(sinHalfAngle, delta.w);
+                vr::HmdVector3d_t axis{ delta.x / sinHalfAngle, delta.y / sinHalfAngle, delta.z / sinHalfAngle };
+                measuredAngularVelocity = axis * (angle / dt);
+            }
+
+            clampMagnitude(measuredVelocity, maxLinearSpeed);
+            clampMagnitude(measuredAngularVelocity, maxAngularSpeed);
+
+            if (hasVelocity) {
+                // The filters upstream already smooth the positions, this only takes the edge off the frame-to-frame noise
+                velocity = velocity + (measuredVelocity - velocity) * velocitySmoothing;
+                angularVelocity = angularVelocity + (measuredAngularVelocity - angularVelocity) * velocitySmoothing;
+            }
+            else {
+                velocity = measuredVelocity;
+                angularVelocity = measuredAngularVelocity;
+                hasVelocity = true;
+            }
+            remember(position, rotation, captureTimestamp);
+        }
+
+        // Fills in the velocities and how old the pose is, so SteamVR extrapolates it to
+        // (sample age + KinectSettings::trackerPredictionLookAhead) past when it was captured
+        void applyTo(vr::DriverPose_t & pose, int64_t captureTimestamp, int64_t now) const {
+            double lookAhead = KinectSettings::trackerPredictionLookAhead;
+            if (!hasVelocity || lookAhead <= 0.0 || !captureTimestamp) {
+                clearPrediction(pose);
+                return;
+            }
+            double age = (now - captureTimestamp) / 1e9;
+            if (age < 0.0)
+                age = 0.0;
+            double extrapolation = age + lookAhead;
+            if (extrapolation > maxExtrapolationSeconds)
+                extrapolation = maxExtrapolationSeconds;
+
+            pose.vecVelocity[0] = velocity.v[0];
+            pose.vecVelocity[1] = velocity.v[1];
+            pose.vecVelocity[2] = velocity.v[2];
+            pose.vecAngularVelocity[0] = angularVelocity.v[0];
+            pose.vecAngularVelocity[1] = angularVelocity.v[1];
+            pose.vecAngularVelocity[2] = angularVelocity.v[2];
+            pose.poseTimeOffset = -extrapolation; // Negative, as the pose is from the past
+        }
+
+        static void clearPrediction(vr::DriverPose_t & pose) {
+            for (int i = 0; i < 3; ++i) {
+                pose.vecVelocity[i] = 0;
+                pose.vecAngularVelocity[i] = 0;
+                pose.vecAcceleration[i] = 0;
+                pose.vecAngularAcceleration[i] = 0;
+            }
+            pose.poseTimeOffset = 0;
+        }
+
+    private:
+        // Kinect runs at 30Hz, anything much longer than a few dropped frames starts again
+        static constexpr double maxSampleGapSeconds = 0.25;
+        // Never throw a tracker further than this, whatever the measured latency is
+        static constexpr double maxExtrapolationSeconds = 0.2;
+        static constexpr double maxLinearSpeed = 10.0;          // m/s - a kick is ~5
+        static constexpr double maxAngularSpeed = 4.0 * 3.14159265358979; // rad/s
+        static constexpr double velocitySmoothing = 0.5;
+
+        int64_t lastCaptureTimestamp = 0;
+        vr::HmdVector3d_t lastPosition{ 0,0,0 };
+        vr::HmdQuaternion_t lastRotation{ 1,0,0,0 };
+
+        bool hasVelocity = false;
+        vr::HmdVector3d_t velocity{ 0,0,0 };
+        vr::HmdVector3d_t angularVelocity{ 0,0,0 };
+
+        void remember(vr::HmdVector3d_t position, vr::HmdQuaternion_t rotation, int64_t captureTimestamp) {
+            lastPosition = position;
+            lastRotation = rotation;
+            lastCaptureTimestamp = captureTimestamp;
+        }
+        static void clampMagnitude(vr::HmdVector3d_t & v, double maxMagnitude) {
+            double magnitude = std::sqrt(v.v[0] * v.v[0] + v.v[1] * v.v[1] + v.v[2] * v.v[2]);
+            if (magnitude > maxMagnitude)
+                v = v * (maxMagnitude / magnitude);
+        }
+    };
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "stdafx.h"
+#include <vrinputemulator.h>
+
+#include "SharedPoseRing.h"
+#include "LatencyStats.h"
+
+namespace KVR {
+    class PoseSubmissionBatch {
+        // Collects every tracker's pose for a tracking tick, and sends them all to InputEmulator at the end of it.
+        // The sends are non-modal, so the tick no longer waits on a driver reply per tracker,
+        // and a device updated more than once in a tick only has its latest pose sent.
+        // Poses are also written to the shared-memory pose ring if one is given. The message queue is only
+        // skipped if the ring has been told to replace it, and its consumer is still alive (see SharedPoseRingWriter).
+    public:
+        static const int maxPoses = 32;
+
+        void queue(vrinputemulator::VRInputEmulator &inputEmulator, uint32_t deviceId, const vr::DriverPose_t &pose, int64_t captureTimestamp) {
+            for (int i = 0; i < poseCount; ++i) {
+                if (poses[i].deviceId == deviceId && poses[i].inputEmulator == &inputEmulator) {
+                    poses[i].pose = pose;
+                    poses[i].captureTimestamp = captureTimestamp;
+                    return;
+                }
+            }
+            if (poseCount == maxPoses) {
+                // More trackers than anyone should have, just don't batch the extras
+                inputEmulator.setVirtualDevicePose(deviceId, pose, false);
+                return;
+            }
+            poses[poseCount].inputEmulator = &inputEmulator;
+            poses[poseCount].deviceId = deviceId;
+            poses[poseCount].pose = pose;
+            poses[poseCount].captureTimestamp = captureTimestamp;
+            ++poseCount;
+        }
+        int flush(SharedPoseRingWriter *sharedRing = nullptr, LatencyHistogram *captureToPublish = nullptr) {
+            int sent = poseCount;
+            bool sendThroughMessageQueue = !(sharedRing && sharedRing->replacesMessageQueue());
+            int64_t publishTimestamp = monotonicNanoseconds();
+            for (int i = 0; i < poseCount; ++i) {
+                int64_t captureTimestamp = poses[i].captureTimestamp ? poses[i].captureTimestamp : publishTimestamp;
+                if (sharedRing)
+                    sharedRing->write(poses[i].deviceId, poses[i].pose, captureTimestamp);
+                if (sendThroughMessageQueue)
+                    poses[i].inputEmulator->setVirtualDevicePose(poses[i].deviceId, poses[i].pose, false);
+                if (captureToPublish && poses[i].captureTimestamp)
+                    captureToPublish->record(publishTimestamp - captureTimestamp);
+            }
+            poseCount = 0;
+            return sent;
+        }
+        int size() const { return poseCount; }
+
+    private:
+        struct QueuedPose {
+            vrinputemulator::VRInputEmulator *inputEmulator = nullptr;
+            uint32_t deviceId = 0;
+            vr::DriverPose_t pose = {};
+            int64_t captureTimestamp = 0;
+        };
+        QueuedPose poses[maxPoses];
+        int poseCount = 0;
+    };
+}
@@ -1,14 +1,481 @@
 #pragma once
 #include "stdafx.h"
+#include <cmath>
 
-//Forward declare to preserve neutrality of KVRlib
-struct Vector4 {
-    float x;
-    float y;
-    float z;
-    float w;
-};
+#include <SFML/System/Vector3.hpp>
+#include <openvr.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define KVR_QUATERNION_SSE
+#include <emmintrin.h>
+#endif
 
 namespace KMath {
+    // The quaternion maths shared by the rotation filters and the trackers.
+    // Quaternion is x, y, z, w floats - the same layout as the Kinect SDKs' Vector4 - so one fills an SSE register.
+    // The single quaternion functions work on one at a time. For a whole skeleton, QuaternionSSE::Quaternion4
+    // holds four of them a component per register, so the same kernels run four joints per instruction.
+    // OpenVR's HmdQuaternion_t is w, x, y, z doubles, convert with toQuaternion/toHmdQuaternion
+    struct alignas(16) Quaternion {
+        float x;
+        float y;
+        float z;
+        float w;
+    };
+
+    inline Quaternion identityQuaternion() { return { 0.0f, 0.0f, 0.0f, 1.0f }; }
+
+    // Anything with x, y, z, w members, i.e. the Kinect SDKs' Vector4
+    template <typename XYZW>
+    inline Quaternion toQuaternion(const XYZW & q) { return { q.x, q.y, q.z, q.w }; }
+    template <typename XYZW>
+    inline XYZW fromQuaternion(const Quaternion & q) {
+        XYZW result;
+        result.x = q.x;
+        result.y = q.y;
+        result.z = q.z;
+        result.w = q.w;
+        return result;
+    }
+    inline Quaternion toQuaternion(const vr::HmdQuaternion_t & q) {
+        return { float(q.x), float(q.y), float(q.z), float(q.w) };
+    }
+    inline vr::HmdQuaternion_t toHmdQuaternion(const Quaternion & q) {
+        return { q.w, q.x, q.y, q.z };
+    }
+
+#ifdef KVR_QUATERNION_SSE
+    namespace QuaternionSSE {
+        inline __m128 load(const Quaternion & q) { return _mm_loadu_ps(&q.x); }
+        inline Quaternion store(__m128 v) {
+            Quaternion q;
+            _mm_storeu_ps(&q.x, v);
+            return q;
+        }
+        // The 4 component dot product, in every lane
+        inline __m128 dot(__m128 a, __m128 b) {
+            __m128 products = _mm_mul_ps(a, b);
+            products = _mm_add_ps(products, _mm_shuffle_ps(products, products, _MM_SHUFFLE(2, 3, 0, 1)));
+            return _mm_add_ps(products, _mm_shuffle_ps(products, products, _MM_SHUFFLE(1, 0, 3, 2)));
+        }
+        inline __m128 multiply(__m128 a, __m128 b) {
+            // x = aw*bx + ax*bw + ay*bz - az*by
+            // y = aw*by + ay*bw + az*bx - ax*bz
+            // z = aw*bz + az*bw + ax*by - ay*bx
+            // w = aw*bw - ax*bx - ay*by - az*bz
+            const __m128 negateW = _mm_set_ps(-0.0f, 0.0f, 0.0f, 0.0f);
+            __m128 result = _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 3, 3)), b);
+            __m128 t1 = _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 2, 1, 0)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 3, 3, 3)));
+            __m128 t2 = _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 0, 2, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 1, 0, 2)));
+            __m128 t3 = _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 1, 0, 2)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 0, 2, 1)));
+            result = _mm_add_ps(result, _mm_xor_ps(t1, negateW));
+            result = _mm_add_ps(result, _mm_xor_ps(t2, negateW));
+            return _mm_sub_ps(result, t3);
+        }
+        // Zero length stays zero
+        inline __m128 normalise(__m128 v) {
+            __m128 lengthSquared = dot(v, v);
+            __m128 nonZero = _mm_cmpneq_ps(lengthSquared, _mm_setzero_ps());
+            return _mm_and_ps(nonZero, _mm_div_ps(v, _mm_sqrt_ps(lengthSquared)));
+        }
+        inline __m128 lerp(__m128 a, __m128 b, float t) {
+            return _mm_add_ps(_mm_mul_ps(a, _mm_set1_ps(1.0f - t)), _mm_mul_ps(b, _mm_set1_ps(t)));
+        }
+        // (ay*bz - az*by, az*bx - ax*bz, ax*by - ay*bx, 0) for w = 0 inputs
+        inline __m128 cross(__m128 a, __m128 b) {
+            __m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+            __m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+            __m128 c = _mm_sub_ps(_mm_mul_ps(a, bYZX), _mm_mul_ps(aYZX, b));
+            return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+        }
+    }
+#endif
+
+    inline bool equal(const Quaternion & a, const Quaternion & b) {
+        return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w;
+    }
+    inline float dot(const Quaternion & a, const Quaternion & b) {
+        return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+    }
+    inline float lengthSquared(const Quaternion & q) { return dot(q, q); }
+    inline float length(const Quaternion & q) { return std::sqrt(lengthSquared(q)); }
+
+    inline Quaternion negated(const Quaternion & q) { return { -q.x, -q.y, -q.z, -q.w }; }
+    inline Quaternion conjugate(const Quaternion & q) { return { -q.x, -q.y, -q.z, q.w }; }
+    // Identity for a zero quaternion, rather than dividing by 0
+    inline Quaternion inverse(const Quaternion & q) {
+        float lengthSq = lengthSquared(q);
+        if (lengthSq == 0.0f)
+            return identityQuaternion();
+        return { -q.x / lengthSq, -q.y / lengthSq, -q.z / lengthSq, q.w / lengthSq };
+    }
+
+    // a * b, i.e. b's rotation then a's
+    inline Quaternion multiply(const Quaternion & a, const Quaternion & b) {
+#ifdef KVR_QUATERNION_SSE
+        return QuaternionSSE::store(QuaternionSSE::multiply(QuaternionSSE::load(a), QuaternionSSE::load(b)));
+#else
+        return {
+            a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+            a.w * b.y + a.y * b.w + a.z * b.x - a.x * b.z,
+            a.w * b.z + a.z * b.w + a.x * b.y - a.y * b.x,
+            a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z
+        };
+#endif
+    }
+
+    // Unit length. A zero quaternion stays zero
+    inline Quaternion normalised(const Quaternion & q) {
+#ifdef KVR_QUATERNION_SSE
+        return QuaternionSSE::store(QuaternionSSE::normalise(QuaternionSSE::load(q)));
+#else
+        float lengthSq = lengthSquared(q);
+        if (lengthSq == 0.0f)
+            return q;
+        float len = std::sqrt(lengthSq);
+        return { q.x / len, q.y / len, q.z / len, q.w / len };
+#endif
+    }
+
+    // q, or -q if that's the same rotation on the same side of the 4D sphere as reference,
+    // so interpolating between them takes the short way round
+    inline Quaternion sameHemisphere(const Quaternion & reference, const Quaternion & q) {
+        return dot(reference, q) < 0.0f ? negated(q) : q;
+    }
+
+    // The rotation taking 'from' to 'to': from * result = to
+    inline Quaternion rotationBetween(const Quaternion & from, const Quaternion & to) {
+        return multiply(inverse(from), sameHemisphere(from, to));
+    }
+
+    // Rotation angle in radians, [0, 2pi]
+    inline float angle(const Quaternion & q) {
+        float w = q.w;
+        if (w > 1.0f) w = 1.0f;
+        if (w < -1.0f) w = -1.0f;
+        return 2.0f * std::acos(w);
+    }
+
+    // Straight line between a and b, normalised. Doesn't pick the short way round, see slerp
+    inline Quaternion nlerp(const Quaternion & a, const Quaternion & b, float t) {
+#ifdef KVR_QUATERNION_SSE
+        return QuaternionSSE::store(QuaternionSSE::normalise(QuaternionSSE::lerp(QuaternionSSE::load(a), QuaternionSSE::load(b), t)));
+#else
+        float s = 1.0f - t;
+        return normalised(Quaternion{ s * a.x + t * b.x, s * a.y + t * b.y, s * a.z + t * b.z, s * a.w + t * b.w });
+#endif
+    }
+
+    // Spherical interpolation of the normalised a and b, the short way round
+    inline Quaternion slerp(const Quaternion & a, const Quaternion & b, float t) {
+        if (equal(a, b))
+            return a;
+        Quaternion from = normalised(a);
+        Quaternion to = sameHemisphere(from, normalised(b));
+        float cosTheta = dot(from, to);
+        // Close enough that sin(theta) loses precision, where the straight line is as good
+        if (cosTheta > 0.9995f)
+            return nlerp(from, to, t);
+        float theta = std::acos(cosTheta);
+        float sinTheta = std::sin(theta);
+        float fromScale = std::sin((1.0f - t) * theta) / sinTheta;
+        float toScale = std::sin(t * theta) / sinTheta;
+        return {
+            from.x * fromScale + to.x * toScale,
+            from.y * fromScale + to.y * toScale,
+            from.z * fromScale + to.z * toScale,
+            from.w * fromScale + to.w * toScale
+        };
+    }
+
+    // q * v * q^-1 for a unit q, as v + w*t + (q.xyz x t) with t = 2 * (q.xyz x v)
+    inline sf::Vector3f rotate(const Quaternion & q, const sf::Vector3f & v) {
+#ifdef KVR_QUATERNION_SSE
+        __m128 rotation = QuaternionSSE::load(q);
+        __m128 axis = _mm_and_ps(rotation, _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1)));
+        __m128 vector = _mm_set_ps(0.0f, v.z, v.y, v.x);
+        __m128 t = QuaternionSSE::cross(axis, vector);
+        t = _mm_add_ps(t, t);
+        __m128 result = _mm_add_ps(vector, _mm_mul_ps(_mm_shuffle_ps(rotation, rotation, _MM_SHUFFLE(3, 3, 3, 3)), t));
+        result = _mm_add_ps(result, QuaternionSSE::cross(axis, t));
+        alignas(16) float r[4];
+        _mm_store_ps(r, result);
+        return { r[0], r[1], r[2] };
+#else
+        sf::Vector3f axis{ q.x, q.y, q.z };
+        sf::Vector3f t{ 2.0f * (axis.y * v.z - axis.z * v.y), 2.0f * (axis.z * v.x - axis.x * v.z), 2.0f * (axis.x * v.y - axis.y * v.x) };
+        return {
+            v.x + q.w * t.x + (axis.y * t.z - axis.z * t.y),
+            v.y + q.w * t.y + (axis.z * t.x - axis.x * t.z),
+            v.z + q.w * t.z + (axis.x * t.y - axis.y * t.x)
+        };
+#endif
+    }
+
+    // Same thing in OpenVR's doubles, without vrmath::quaternionRotateVector's two full quaternion products
+    inline vr::HmdVector3d_t rotate(const vr::HmdQuaternion_t & q, const vr::HmdVector3d_t & v) {
+        double tx = 2.0 * (q.y * v.v[2] - q.z * v.v[1]);
+        double ty = 2.0 * (q.z * v.v[0] - q.x * v.v[2]);
+        double tz = 2.0 * (q.x * v.v[1] - q.y * v.v[0]);
+        return { {
+            v.v[0] + q.w * tx + (q.y * tz - q.z * ty),
+            v.v[1] + q.w * ty + (q.z * tx - q.x * tz),
+            v.v[2] + q.w * tz + (q.x * ty - q.y * tx)
+        } };
+    }
+
+    // OpenVR's doubles, for the pose maths that stays in double precision
+    inline double lengthSquared(const vr::HmdQuaternion_t & q) {
+        return q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z;
+    }
+    inline vr::HmdQuaternion_t normalised(const vr::HmdQuaternion_t & q) {
+        double lengthSq = lengthSquared(q);
+        if (lengthSq == 0.0)
+            return q;
+        double len = std::sqrt(lengthSq);
+        return { q.w / len, q.x / len, q.y / len, q.z / len };
+    }
+    inline vr::HmdQuaternion_t inverse(const vr::HmdQuaternion_t & q) {
+        double lengthSq = lengthSquared(q);
+        if (lengthSq == 0.0)
+            return { 1, 0, 0, 0 };
+        return { q.w / lengthSq, -q.x / lengthSq, -q.y / lengthSq, -q.z / lengthSq };
+    }
+
+    // The shortest rotation taking direction 'from' to direction 'to'
+    inline Quaternion fromToRotation(const sf::Vector3f & from, const sf::Vector3f & to) {
+        auto normalise = [](sf::Vector3f v) {
+            float lengthSq = v.x * v.x + v.y * v.y + v.z * v.z;
+            return lengthSq == 0.0f ? v : v / std::sqrt(lengthSq);
+        };
+        auto cross = [](sf::Vector3f a, sf::Vector3f b) {
+            return sf::Vector3f(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+        };
+        sf::Vector3f v0 = normalise(from);
+        sf::Vector3f v1 = normalise(to);
+        float d = v0.x * v1.x + v0.y * v1.y + v0.z * v1.z;
+        if (d >= 1.0f)
+            return identityQuaternion();
+        if (d <= -1.0f + 1e-6f) {
+            // Exactly opposite, so any perpendicular axis will do
+            sf::Vector3f axis = cross({ 1.0f, 0.0f, 0.0f }, v0);
+            if (axis.x * axis.x + axis.y * axis.y + axis.z * axis.z == 0.0f)
+                axis = cross({ 0.0f, 1.0f, 0.0f }, v0);
+            axis = normalise(axis);
+            return { axis.x, axis.y, axis.z, 0.0f };
+        }
+        const float s = std::sqrt((1.0f + d) * 2.0f);
+        const sf::Vector3f c = cross(v0, v1) / s;
+        return normalised(Quaternion{ c.x, c.y, c.z, s * 0.5f });
+    }
+
+#ifdef KVR_QUATERNION_SSE
+    namespace QuaternionSSE {
+        // Four quaternions laid out structure-of-arrays, all the x's in one register, all the y's in the next...
+        // Each function does for every lane what its single quaternion version does, with any branches
+        // computed both ways and picked per lane
+        struct Quaternion4 {
+            __m128 x;
+            __m128 y;
+            __m128 z;
+            __m128 w;
+        };
+
+        // q[0..3] transposed into lanes, and back
+        inline Quaternion4 load4(const Quaternion* q) {
+            __m128 x = load(q[0]);
+            __m128 y = load(q[1]);
+            __m128 z = load(q[2]);
+            __m128 w = load(q[3]);
+            _MM_TRANSPOSE4_PS(x, y, z, w);
+            return { x, y, z, w };
+        }
+        inline void store4(Quaternion* q, Quaternion4 v) {
+            _MM_TRANSPOSE4_PS(v.x, v.y, v.z, v.w);
+            _mm_storeu_ps(&q[0].x, v.x);
+            _mm_storeu_ps(&q[1].x, v.y);
+            _mm_storeu_ps(&q[2].x, v.z);
+            _mm_storeu_ps(&q[3].x, v.w);
+        }
+
+        // mask ? a : b, SSE2 has no blend
+        inline __m128 select(__m128 mask, __m128 a, __m128 b) {
+            return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+        }
+        inline Quaternion4 select(__m128 mask, const Quaternion4 & a, const Quaternion4 & b) {
+            return { select(mask, a.x, b.x), select(mask, a.y, b.y), select(mask, a.z, b.z), select(mask, a.w, b.w) };
+        }
+
+        inline Quaternion4 identity4() {
+            return { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_set1_ps(1.0f) };
+        }
+        // All bits set in the lanes where every component matches
+        inline __m128 equal(const Quaternion4 & a, const Quaternion4 & b) {
+            return _mm_and_ps(_mm_and_ps(_mm_cmpeq_ps(a.x, b.x), _mm_cmpeq_ps(a.y, b.y)),
+                _mm_and_ps(_mm_cmpeq_ps(a.z, b.z), _mm_cmpeq_ps(a.w, b.w)));
+        }
+        inline __m128 dot(const Quaternion4 & a, const Quaternion4 & b) {
+            return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a.x, b.x), _mm_mul_ps(a.y, b.y)),
+                _mm_add_ps(_mm_mul_ps(a.z, b.z), _mm_mul_ps(a.w, b.w)));
+        }
+
+        inline Quaternion4 multiply(const Quaternion4 & a, const Quaternion4 & b) {
+            return {
+                _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a.w, b.x), _mm_mul_ps(a.x, b.w)), _mm_mul_ps(a.y, b.z)), _mm_mul_ps(a.z, b.y)),
+                _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a.w, b.y), _mm_mul_ps(a.y, b.w)), _mm_mul_ps(a.z, b.x)), _mm_mul_ps(a.x, b.z)),
+                _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a.w, b.z), _mm_mul_ps(a.z, b.w)), _mm_mul_ps(a.x, b.y)), _mm_mul_ps(a.y, b.x)),
+                _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(_mm_mul_ps(a.w, b.w), _mm_mul_ps(a.x, b.x)), _mm_mul_ps(a.y, b.y)), _mm_mul_ps(a.z, b.z))
+            };
+        }
+
+        // Zero length stays zero
+        inline Quaternion4 normalise(const Quaternion4 & q) {
+            __m128 lengthSquared = dot(q, q);
+            __m128 nonZero = _mm_cmpneq_ps(lengthSquared, _mm_setzero_ps());
+            __m128 inverseLength = _mm_and_ps(nonZero, _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(lengthSquared)));
+            return { _mm_mul_ps(q.x, inverseLength), _mm_mul_ps(q.y, inverseLength), _mm_mul_ps(q.z, inverseLength), _mm_mul_ps(q.w, inverseLength) };
+        }
+
+        // Identity for a zero quaternion
+        inline Quaternion4 inverse(const Quaternion4 & q) {
+            const __m128 signBit = _mm_set1_ps(-0.0f);
+            __m128 lengthSquared = dot(q, q);
+            __m128 zero = _mm_cmpeq_ps(lengthSquared, _mm_setzero_ps());
+            __m128 scale = _mm_div_ps(_mm_set1_ps(1.0f), lengthSquared);
+            __m128 negativeScale = _mm_xor_ps(scale, signBit);
+            Quaternion4 inverted = {
+                _mm_mul_ps(q.x, negativeScale),
+                _mm_mul_ps(q.y, negativeScale),
+                _mm_mul_ps(q.z, negativeScale),
+                _mm_mul_ps(q.w, scale)
+            };
+            return select(zero, identity4(), inverted);
+        }
+
+        inline Quaternion4 sameHemisphere(const Quaternion4 & reference, const Quaternion4 & q) {
+            __m128 flip = _mm_and_ps(_mm_cmplt_ps(dot(reference, q), _mm_setzero_ps()), _mm_set1_ps(-0.0f));
+            return { _mm_xor_ps(q.x, flip), _mm_xor_ps(q.y, flip), _mm_xor_ps(q.z, flip), _mm_xor_ps(q.w, flip) };
+        }
+
+        inline Quaternion4 rotationBetween(const Quaternion4 & from, const Quaternion4 & to) {
+            return multiply(inverse(from), sameHemisphere(from, to));
+        }
+
+        // acos of each lane, for [-1, 1]. Cephes' asinf polynomial on [0, 0.5], with
+        // acos(x) = 2 asin(sqrt((1 - x) / 2)) past that so it keeps its precision near +-1
+        inline __m128 acosPerLane(__m128 x) {
+            const __m128 signBit = _mm_set1_ps(-0.0f);
+            const __m128 half = _mm_set1_ps(0.5f);
+            const __m128 one = _mm_set1_ps(1.0f);
+            const __m128 pi = _mm_set1_ps(3.14159265358979f);
+            const __m128 halfPi = _mm_set1_ps(1.57079632679490f);
+
+            __m128 a = _mm_andnot_ps(signBit, x);
+            __m128 nearOne = _mm_cmpgt_ps(a, half);
+            __m128 z = select(nearOne, _mm_mul_ps(half, _mm_sub_ps(one, a)), _mm_mul_ps(a, a));
+            __m128 s = select(nearOne, _mm_sqrt_ps(z), a);
+
+            __m128 p = _mm_set1_ps(4.2163199048e-2f);
+            p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(2.4181311049e-2f));
+            p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(4.5470025998e-2f));
+            p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(7.4953002686e-2f));
+            p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(1.6666752422e-1f));
+            __m128 asinS = _mm_add_ps(s, _mm_mul_ps(_mm_mul_ps(s, z), p));
+
+            // |x| <= 0.5: pi/2 - asin(x). Past it: 2 asin(s), or pi - that for negative x
+            __m128 nearZero = _mm_sub_ps(halfPi, _mm_xor_ps(asinS, _mm_and_ps(x, signBit)));
+            __m128 twice = _mm_add_ps(asinS, asinS);
+            __m128 farFromZero = select(_mm_cmplt_ps(x, _mm_setzero_ps()), _mm_sub_ps(pi, twice), twice);
+            return select(nearOne, farFromZero, nearZero);
+        }
+
+        // sin of each lane. Brought into [-pi/2, pi/2] by a whole number of pi (flipping the sign for odd ones),
+        // then the Taylor series to x^11, which is within 1e-7 there
+        inline __m128 sinPerLane(__m128 x) {
+            __m128i halfTurns = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(0.318309886183791f)));
+            __m128 k = _mm_cvtepi32_ps(halfTurns);
+            // pi in two parts, the first exact in a float, so r keeps x's low bits
+            __m128 r = _mm_sub_ps(x, _mm_mul_ps(k, _mm_set1_ps(3.140625f)));
+            r = _mm_sub_ps(r, _mm_mul_ps(k, _mm_set1_ps(9.67653589793e-4f)));
+            __m128 flip = _mm_castsi128_ps(_mm_slli_epi32(halfTurns, 31));
+
+            __m128 r2 = _mm_mul_ps(r, r);
+            __m128 p = _mm_set1_ps(-2.5052108e-8f);
+            p = _mm_add_ps(_mm_mul_ps(p, r2), _mm_set1_ps(2.7557319e-6f));
+            p = _mm_add_ps(_mm_mul_ps(p, r2), _mm_set1_ps(-1.9841270e-4f));
+            p = _mm_add_ps(_mm_mul_ps(p, r2), _mm_set1_ps(8.3333333e-3f));
+            p = _mm_add_ps(_mm_mul_ps(p, r2), _mm_set1_ps(-1.6666667e-1f));
+            __m128 sinR = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, r2), p));
+            return _mm_xor_ps(sinR, flip);
+        }
+
+        inline __m128 angle(const Quaternion4 & q) {
+            __m128 w = _mm_max_ps(_mm_min_ps(q.w, _mm_set1_ps(1.0f)), _mm_set1_ps(-1.0f));
+            __m128 halfAngle = acosPerLane(w);
+            return _mm_add_ps(halfAngle, halfAngle);
+        }
+
+        inline Quaternion4 nlerp(const Quaternion4 & a, const Quaternion4 & b, __m128 t) {
+            __m128 s = _mm_sub_ps(_mm_set1_ps(1.0f), t);
+            return normalise(Quaternion4{
+                _mm_add_ps(_mm_mul_ps(s, a.x), _mm_mul_ps(t, b.x)),
+                _mm_add_ps(_mm_mul_ps(s, a.y), _mm_mul_ps(t, b.y)),
+                _mm_add_ps(_mm_mul_ps(s, a.z), _mm_mul_ps(t, b.z)),
+                _mm_add_ps(_mm_mul_ps(s, a.w), _mm_mul_ps(t, b.w))
+            });
+        }
+
+        inline Quaternion4 slerp(const Quaternion4 & a, const Quaternion4 & b, __m128 t) {
+            Quaternion4 from = normalise(a);
+            Quaternion4 to = sameHemisphere(from, normalise(b));
+            __m128 cosTheta = dot(from, to);
+            __m128 close = _mm_cmpgt_ps(cosTheta, _mm_set1_ps(0.9995f));
+            __m128 same = equal(a, b);
+            // Frame to frame, joints hardly turn, so often enough no lane needs the trig at all
+            if (_mm_movemask_ps(_mm_or_ps(close, same)) == 0xF)
+                return select(same, a, nlerp(from, to, t));
+
+            // The close lanes get the nlerp, so only clamp to keep acos in range
+            __m128 theta = acosPerLane(_mm_min_ps(cosTheta, _mm_set1_ps(1.0f)));
+            __m128 inverseSinTheta = _mm_div_ps(_mm_set1_ps(1.0f), sinPerLane(theta));
+            __m128 fromScale = _mm_mul_ps(sinPerLane(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(1.0f), t), theta)), inverseSinTheta);
+            __m128 toScale = _mm_mul_ps(sinPerLane(_mm_mul_ps(t, theta)), inverseSinTheta);
+            Quaternion4 spherical = {
+                _mm_add_ps(_mm_mul_ps(from.x, fromScale), _mm_mul_ps(to.x, toScale)),
+                _mm_add_ps(_mm_mul_ps(from.y, fromScale), _mm_mul_ps(to.y, toScale)),
+                _mm_add_ps(_mm_mul_ps(from.z, fromScale), _mm_mul_ps(to.z, toScale)),
+                _mm_add_ps(_mm_mul_ps(from.w, fromScale), _mm_mul_ps(to.w, toScale))
+            };
+            return select(same, a, select(close, nlerp(from, to, t), spherical));
+        }
+    }
+#endif
 
-};
\ No newline at end of file
+    // The same rotation applied to many, e.g. the calibration over every tracker - out may be the same array as an input
+    // Everything by the same rotation on the right, e.g. a change of basis
+    inline void multiplyBatch(const Quaternion* lhs, const Quaternion & rhs, Quaternion* out, int count) {
+#ifdef KVR_QUATERNION_SSE
+        __m128 right = QuaternionSSE::load(rhs);
+        for (int i = 0; i < count; ++i)
+            _mm_storeu_ps(&out[i].x, QuaternionSSE::multiply(QuaternionSSE::load(lhs[i]), right));
+#else
+        for (int i = 0; i < count; ++i)
+            out[i] = multiply(lhs[i], rhs);
+#endif
+    }
+    // Everything by the same rotation on the left, i.e. rotated again after their own rotation
+    inline void multiplyBatch(const Quaternion & lhs, const Quaternion* rhs, Quaternion* out, int count) {
+#ifdef KVR_QUATERNION_SSE
+        __m128 left = QuaternionSSE::load(lhs);
+        for (int i = 0; i < count; ++i)
+            _mm_storeu_ps(&out[i].x, QuaternionSSE::multiply(left, QuaternionSSE::load(rhs[i])));
+#else
+        for (int i = 0; i < count; ++i)
+            out[i] = multiply(lhs, rhs[i]);
+#endif
+    }
+    inline void rotateBatch(const Quaternion & q, const sf::Vector3f* v, sf::Vector3f* out, int count) {
+        for (int i = 0; i < count; ++i)
+            out[i] = rotate(q, v[i]);
+    }
+}
@@ -0,0 +1,398 @@
+#pragma once
+#include "stdafx.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <codecvt>
+#include <locale>
+#endif
+
+#include <openvr.h>
+
+#include "KinectSettings.h"
+#include "LatencyStats.h"
+#include "SkeletonFrame.h"
+#include "TrackedDeviceInputData.h"
+#include "TrackingPoolManager.h"
+
+namespace KVR {
+    // Recorded sessions: the filtered skeleton, every non-Kinect device in the tracking pool
+    // (PSMoves, SteamVR devices), and the HMD pose, each with the time they were captured.
+    // Replayed by ReplayKinectHandler/ReplayDeviceHandler to reproduce tracking problems
+    // without any of the hardware plugged in.
+    //
+    // File layout: magic, version and kinect version (uint32 each), then a stream of records, each a one byte SessionRecordType
+    // followed by that record's fields. Fields are written in the machine's byte order.
+    static const uint32_t k_sessionFileMagic = 0x5352564B; // "KVRS"
+    static const uint32_t k_sessionFileVersion = 1;
+
+    // MSVC's fstreams open wide paths as they are, everywhere else they're narrowed to UTF-8 first
+#ifdef _WIN32
+    inline const std::wstring & sessionFilePath(const std::wstring & path) { return path; }
+#else
+    inline std::string sessionFilePath(const std::wstring & path) {
+        return std::wstring_convert<std::codecvt_utf8<wchar_t>>().to_bytes(path);
+    }
+#endif
+
+    enum class SessionRecordType : uint8_t {
+        Skeleton = 1,   // SkeletonFrame
+        DeviceInfo,     // uint32 gid, uint8 position option, uint8 rotation option, name, serial, model name
+        DevicePose,     // uint32 gid, int64 timestamp, TrackedDevicePose fields
+        HMDPose,        // int64 timestamp, hmd position, rotation and absolute tracking matrix
+    };
+
+    struct RecordedDevice {
+        uint32_t globalID = k_invalidTrackerID; // As it was in the recording's pool
+        TrackedDeviceInputData data;
+    };
+    struct RecordedDevicePose {
+        int64_t timestamp = 0;
+        uint32_t globalID = k_invalidTrackerID;
+        TrackedDevicePose pose;
+    };
+    struct RecordedHMDPose {
+        int64_t timestamp = 0;
+        vr::HmdVector3d_t position = { 0, 0, 0 };
+        vr::HmdQuaternion_t rotation = { 1, 0, 0, 0 };
+        vr::HmdMatrix34_t absoluteTracking = {};
+    };
+
+    class SessionRecorder {
+        // Only ever written to from the tracking thread, once per tick.
+        // The stream is buffered, so nothing is allocated per record
+    public:
+        ~SessionRecorder() {
+            close();
+        }
+
+        bool open(const std::wstring & path, KinectVersion kinectVersion) {
+            close();
+            file.open(sessionFilePath(path), std::ios::binary | std::ios::trunc);
+            if (!file) {
+                LOG(ERROR) << "Could not open session recording " << path;
+                return false;
+            }
+            write(k_sessionFileMagic);
+            write(k_sessionFileVersion);
+            write(uint32_t(kinectVersion));
+            std::fill(recordedSerials, recordedSerials + k_maxTrackingPoolDevices, std::string());
+            std::fill(lastPoseTimestamps, lastPoseTimestamps + k_maxTrackingPoolDevices, int64_t(-1));
+            records = 0;
+            LOG(INFO) << "Recording session to " << path;
+            return true;
+        }
+        void close() {
+            if (!file.is_open())
+                return;
+            file.close();
+            LOG(INFO) << "Session recording stopped after " << records << " records";
+        }
+        bool isOpen() const { return file.is_open(); }
+
+        void recordSkeleton(const SkeletonFrame & frame) {
+            writeType(SessionRecordType::Skeleton);
+            write(frame.captureTimestamp);
+            write(frame.isTracking);
+            file.write(reinterpret_cast<const char*>(frame.trackingStates), sizeof(frame.trackingStates));
+            file.write(reinterpret_cast<const char*>(frame.positions), sizeof(frame.positions));
+            file.write(reinterpret_cast<const char*>(frame.orientations), sizeof(frame.orientations));
+            file.write(reinterpret_cast<const char*>(frame.filteredOrientations), sizeof(frame.filteredOrientations));
+        }
+
+        void recordHMD(int64_t timestamp) {
+            writeType(SessionRecordType::HMDPose);
+            write(timestamp);
+            write(KinectSettings::hmdPosition);
+            write(KinectSettings::hmdRotation);
+            write(KinectSettings::hmdAbsoluteTracking);
+        }
+
+        // Every pool device which isn't driven by the kinect, i.e. the PSMove and SteamVR device handlers
+        void recordPoolDevices() {
+            for (uint32_t gid = 0; gid < uint32_t(TrackingPoolManager::count()) && gid < k_maxTrackingPoolDevices; ++gid) {
+                if (gid == TrackingPoolManager::kinectSensorGID || TrackingPoolManager::trackerIdInKinectRange(gid))
+                    continue;
+                const TrackedDeviceInputData & data = TrackingPoolManager::getDeviceData(gid);
+                if (data.clearedForReinit)
+                    continue;
+                if (recordedSerials[gid] != data.serial) {
+                    recordedSerials[gid] = data.serial;
+                    recordDeviceInfo(gid, data);
+                }
+                TrackedDevicePose pose;
+                TrackingPoolManager::readDevicePose(gid, pose);
+                if (pose.captureTimestamp && pose.captureTimestamp == lastPoseTimestamps[gid])
+                    continue; // Nothing new from this device since last tick
+                lastPoseTimestamps[gid] = pose.captureTimestamp;
+
+                writeType(SessionRecordType::DevicePose);
+                write(gid);
+                write(pose.captureTimestamp ? pose.captureTimestamp : monotonicNanoseconds());
+                write(pose.rotation);
+                write(pose.position);
+                write(pose.pose);
+            }
+        }
+
+    private:
+        std::ofstream file;
+        uint64_t records = 0;
+        std::string recordedSerials[k_maxTrackingPoolDevices];
+        int64_t lastPoseTimestamps[k_maxTrackingPoolDevices];
+
+        void recordDeviceInfo(uint32_t gid, const TrackedDeviceInputData & data) {
+            writeType(SessionRecordType::DeviceInfo);
+            write(gid);
+            write(uint8_t(data.positionTrackingOption));
+            write(uint8_t(data.rotationTrackingOption));
+            writeString(data.deviceName);
+            writeString(data.serial);
+            writeString(data.customModelName);
+        }
+        void writeType(SessionRecordType type) {
+            ++records;
+            write(type);
+        }
+        template <typename T>
+        void write(const T & value) {
+            file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+        void writeString(const std::string & s) {
+            write(uint32_t(s.size()));
+            file.write(s.data(), s.size());
+        }
+    };
+
+    class SessionPlayback {
+        // Loads a whole recorded session up front, then hands it out against a playback clock.
+        // Everything after open() is called from the tracking thread only
+    public:
+        enum class Speed {
+            Recorded,   // Frames are released at the rate they were captured
+            Maximum     // Every tick gets the next skeleton frame straight away, for benchmarking
+        };
+
+        Speed speed = Speed::Recorded;
+        bool loop = false;
+        KinectVersion kinectVersion = KinectVersion::INVALID;
+
+        std::vector<SkeletonFrame> skeletons;
+        std::vector<RecordedDevice> devices;
+        std::vector<RecordedDevicePose> devicePoses;
+        std::vector<RecordedHMDPose> hmdPoses;
+
+        bool open(const std::wstring & path) {
+            std::ifstream file(sessionFilePath(path), std::ios::binary);
+            if (!file) {
+                LOG(ERROR) << "Could not open recorded session " << path;
+                return false;
+            }
+            uint32_t magic = 0, version = 0, recordedKinectVersion = 0;
+            read(file, magic);
+            read(file, version);
+            read(file, recordedKinectVersion);
+            if (!file || magic != k_sessionFileMagic || version != k_sessionFileVersion) {
+                LOG(ERROR) << path << " is not a version " << k_sessionFileVersion << " recorded session";
+                return false;
+            }
+            kinectVersion = KinectVersion(recordedKinectVersion);
+
+            SessionRecordType type;
+            while (read(file, type)) {
+                bool complete = false;
+                switch (type) {
+                case SessionRecordType::Skeleton:
+                    complete = readSkeleton(file);
+                    break;
+                case SessionRecordType::DeviceInfo:
+                    complete = readDeviceInfo(file);
+                    break;
+                case SessionRecordType::DevicePose:
+                    complete = readDevicePose(file);
+                    break;
+                case SessionRecordType::HMDPose:
+                    complete = readHMDPose(file);
+                    break;
+                default:
+                    break;
+                }
+                if (!complete) {
+                    // A recording cut off mid-record (e.g. a crash) is still worth replaying up to that point
+                    LOG(WARNING) << "Recorded session " << path << " is truncated or corrupt, replaying what was read";
+                    break;
+                }
+            }
+            // Each device was written as its own samples came in, so they're only roughly in order between devices
+            std::stable_sort(devicePoses.begin(), devicePoses.end(), [](const RecordedDevicePose & a, const RecordedDevicePose & b) {
+                return a.timestamp < b.timestamp;
+            });
+            startTimestamp = earliestTimestamp();
+            endTimestamp = latestTimestamp();
+            LOG(INFO) << "Loaded recorded session " << path << ": " << skeletons.size() << " skeleton frames, "
+                << devices.size() << " devices, " << (endTimestamp - startTimestamp) / 1.0e9 << "s";
+            rewind();
+            return true;
+        }
+
+        void rewind() {
+            nextSkeleton = 0;
+            nextDevicePose = 0;
+            nextHMDPose = 0;
+            currentTimestamp = startTimestamp;
+            wallClockStart = monotonicNanoseconds();
+        }
+        bool skeletonsRemaining() const {
+            return nextSkeleton < skeletons.size();
+        }
+        bool finished() const {
+            return nextSkeleton >= skeletons.size()
+                && nextDevicePose >= devicePoses.size()
+                && nextHMDPose >= hmdPoses.size();
+        }
+
+        // Stands in for the sensor's frame event: returns true once the next skeleton frame is due
+        bool waitForNextFrame(std::chrono::milliseconds timeout) {
+            if (finished()) {
+                if (!loop) {
+                    std::this_thread::sleep_for(timeout);
+                    return false;
+                }
+                rewind();
+            }
+            if (speed == Speed::Maximum) {
+                if (nextSkeleton < skeletons.size())
+                    currentTimestamp = skeletons[nextSkeleton].captureTimestamp;
+                else
+                    currentTimestamp = endTimestamp;
+                return true;
+            }
+            int64_t now = monotonicNanoseconds();
+            int64_t deadline = now + std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count();
+            int64_t due = deadline;
+            if (nextSkeleton < skeletons.size())
+                due = std::min(deadline, wallClockStart + (skeletons[nextSkeleton].captureTimestamp - startTimestamp));
+            if (due > now)
+                std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+            currentTimestamp = startTimestamp + (monotonicNanoseconds() - wallClockStart);
+            return nextSkeleton < skeletons.size() && skeletons[nextSkeleton].captureTimestamp <= currentTimestamp;
+        }
+
+        // Latest skeleton frame that's due, skipping any that were missed
+        bool takeSkeleton(SkeletonFrame & frame) {
+            bool taken = false;
+            while (nextSkeleton < skeletons.size() && skeletons[nextSkeleton].captureTimestamp <= currentTimestamp) {
+                frame = skeletons[nextSkeleton++];
+                taken = true;
+            }
+            return taken;
+        }
+        template <typename PoseFunction>
+        void takeDevicePoses(PoseFunction onPose) {
+            while (nextDevicePose < devicePoses.size() && devicePoses[nextDevicePose].timestamp <= currentTimestamp)
+                onPose(devicePoses[nextDevicePose++]);
+        }
+        bool takeHMDPose(RecordedHMDPose & pose) {
+            bool taken = false;
+            while (nextHMDPose < hmdPoses.size() && hmdPoses[nextHMDPose].timestamp <= currentTimestamp) {
+                pose = hmdPoses[nextHMDPose++];
+                taken = true;
+            }
+            return taken;
+        }
+
+    private:
+        int64_t startTimestamp = 0;
+        int64_t endTimestamp = 0;
+        int64_t currentTimestamp = 0;
+        int64_t wallClockStart = 0;
+        size_t nextSkeleton = 0;
+        size_t nextDevicePose = 0;
+        size_t nextHMDPose = 0;
+
+        template <typename T>
+        static bool read(std::ifstream & file, T & value) {
+            return bool(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+        }
+        static bool readString(std::ifstream & file, std::string & s) {
+            uint32_t size = 0;
+            if (!read(file, size) || size > 4096)
+                return false;
+            s.resize(size);
+            return size == 0 || bool(file.read(&s[0], size));
+        }
+        bool readSkeleton(std::ifstream & file) {
+            SkeletonFrame frame;
+            read(file, frame.captureTimestamp);
+            read(file, frame.isTracking);
+            file.read(reinterpret_cast<char*>(frame.trackingStates), sizeof(frame.trackingStates));
+            file.read(reinterpret_cast<char*>(frame.positions), sizeof(frame.positions));
+            file.read(reinterpret_cast<char*>(frame.orientations), sizeof(frame.orientations));
+            if (!file.read(reinterpret_cast<char*>(frame.filteredOrientations), sizeof(frame.filteredOrientations)))
+                return false;
+            skeletons.push_back(frame);
+            return true;
+        }
+        bool readDeviceInfo(std::ifstream & file) {
+            RecordedDevice device;
+            uint8_t positionOption = 0, rotationOption = 0;
+            read(file, device.globalID);
+            read(file, positionOption);
+            read(file, rotationOption);
+            if (!readString(file, device.data.deviceName)
+                || !readString(file, device.data.serial)
+                || !readString(file, device.data.customModelName))
+                return false;
+            device.data.positionTrackingOption = JointPositionTrackingOption(positionOption);
+            device.data.rotationTrackingOption = JointRotationTrackingOption(rotationOption);
+            // A gid reused by a different device mid-session keeps the first device's slot when replayed
+            for (const RecordedDevice & existing : devices) {
+                if (existing.globalID == device.globalID)
+                    return true;
+            }
+            devices.push_back(device);
+            return true;
+        }
+        bool readDevicePose(std::ifstream & file) {
+            RecordedDevicePose pose;
+            read(file, pose.globalID);
+            read(file, pose.timestamp);
+            read(file, pose.pose.rotation);
+            read(file, pose.pose.position);
+            if (!read(file, pose.pose.pose))
+                return false;
+            devicePoses.push_back(pose);
+            return true;
+        }
+        bool readHMDPose(std::ifstream & file) {
+            RecordedHMDPose pose;
+            read(file, pose.timestamp);
+            read(file, pose.position);
+            read(file, pose.rotation);
+            if (!read(file, pose.absoluteTracking))
+                return false;
+            hmdPoses.push_back(pose);
+            return true;
+        }
+
+        int64_t earliestTimestamp() const {
+            int64_t earliest = INT64_MAX;
+            if (!skeletons.empty()) earliest = std::min(earliest, skeletons.front().captureTimestamp);
+            if (!devicePoses.empty()) earliest = std::min(earliest, devicePoses.front().timestamp);
+            if (!hmdPoses.empty()) earliest = std::min(earliest, hmdPoses.front().timestamp);
+            return earliest == INT64_MAX ? 0 : earliest;
+        }
+        int64_t latestTimestamp() const {
+            int64_t latest = 0;
+            if (!skeletons.empty()) latest = std::max(latest, skeletons.back().captureTimestamp);
+            if (!devicePoses.empty()) latest = std::max(latest, devicePoses.back().timestamp);
+            if (!hmdPoses.empty()) latest = std::max(latest, hmdPoses.back().timestamp);
+            return latest;
+        }
+    };
+}
@@ -0,0 +1,132 @@
+#pragma once
+#include "stdafx.h"
+#include <cmath>
+#include <memory>
+
+#include "KinectHandlerBase.h"
+#include "DeviceHandler.h"
+#include "SessionRecording.h"
+#include "TrackingPoolManager.h"
+
+// Stand-ins for the Kinect and the physical device handlers, which feed a recorded session
+// back through the normal tracking pipeline. Built on the same idea as KinectlessProcess's FakeKinect.
+// Both share one SessionPlayback, which is only ever advanced from the tracking thread.
+
+class ReplayKinectHandler : public KinectHandlerBase {
+public:
+    ReplayKinectHandler(std::shared_ptr<KVR::SessionPlayback> session)
+        : playback(session)
+    {
+        kVersion = playback->kinectVersion;
+        initialised = true;
+    }
+    ~ReplayKinectHandler() {}
+
+    virtual HRESULT getStatusResult() { return S_OK; }
+    virtual std::string statusResultString(HRESULT stat) { return "Replaying recorded session"; }
+
+    virtual bool waitForNewFrame(std::chrono::milliseconds timeout) {
+        return playback->waitForNextFrame(timeout);
+    }
+    virtual void update() {
+        if (playback->takeSkeleton(latestSkeleton)) {
+            // Restamped, so latency is measured through this run of the pipeline rather than the recording's
+            skeletonCaptureTimestamp = KVR::monotonicNanoseconds();
+            skeletonFilteredTimestamp = skeletonCaptureTimestamp;
+            latestSkeleton.captureTimestamp = skeletonCaptureTimestamp;
+        }
+    }
+
+    virtual bool getFilteredJoint(const KVR::KinectTrackedDevice & device, vr::HmdVector3d_t& position, vr::HmdQuaternion_t &rotation) {
+        if (!latestSkeleton.isTracking)
+            return false;
+        if (kVersion == KinectVersion::Version1 && !v1JointsUsable(device.joint0.joint, device.joint1.joint))
+            return false;
+
+        position = latestSkeleton.position(device.joint0.joint);
+        switch (device.rotationFilterOption) {
+        case KVR::JointRotationFilterOption::Unfiltered:
+            rotation = latestSkeleton.orientation(device.joint0.joint, false);
+            break;
+        case KVR::JointRotationFilterOption::Filtered:
+            rotation = latestSkeleton.orientation(device.joint0.joint, true);
+            break;
+        case KVR::JointRotationFilterOption::HeadLook: {
+            auto q = KinectSettings::hmdRotation;
+            //Isolate Yaw
+            float yaw = atan2(2 * q.w*q.y + 2 * q.x*q.z, +q.w*q.w + q.x*q.x - q.z*q.z - q.y*q.y);
+            rotation = vrmath::quaternionFromRotationY(yaw);
+        }
+            break;
+        default:
+            LOG(ERROR) << "JOINT ROTATION OPTION UNDEFINED IN DEVICE " << device.deviceId;
+            break;
+        }
+        return true;
+    }
+
+private:
+    std::shared_ptr<KVR::SessionPlayback> playback;
+
+    // The v1 handler drops joints that aren't tracked, or are only inferred alongside their secondary joint
+    bool v1JointsUsable(KVR::KinectJointType joint0, KVR::KinectJointType joint1) {
+        if (!KinectSettings::ignoreInferredPositions)
+            return true;
+        KVR::JointTrackingState state0 = latestSkeleton.trackingStates[(int)joint0];
+        KVR::JointTrackingState state1 = latestSkeleton.trackingStates[(int)joint1];
+        if (state0 == KVR::JointTrackingState::NotTracked || state1 == KVR::JointTrackingState::NotTracked)
+            return false;
+        return !(state0 == KVR::JointTrackingState::Inferred && state1 == KVR::JointTrackingState::Inferred);
+    }
+};
+
+class ReplayDeviceHandler : public DeviceHandler {
+    // Re-adds every recorded PSMove/SteamVR device to the pool, and publishes their recorded poses
+    // (and the HMD's) as the playback clock passes them
+public:
+    ReplayDeviceHandler(std::shared_ptr<KVR::SessionPlayback> session)
+        : playback(session)
+    {
+        std::fill(replayGlobalIDs, replayGlobalIDs + k_maxTrackingPoolDevices, k_invalidTrackerID);
+    }
+    ~ReplayDeviceHandler() {}
+
+    int initialise() {
+        for (const KVR::RecordedDevice & device : playback->devices) {
+            if (device.globalID >= k_maxTrackingPoolDevices)
+                continue;
+            KVR::TrackedDeviceInputData data = device.data;
+            data.parentHandler = this;
+            uint32_t gID = k_invalidTrackerID;
+            TrackingPoolManager::addDeviceToPool(data, gID);
+            replayGlobalIDs[device.globalID] = gID;
+        }
+        active = true;
+        LOG(INFO) << "Replaying " << playback->devices.size() << " recorded devices";
+        return 0;
+    }
+    int run() {
+        KVR::RecordedHMDPose hmd;
+        if (playback->takeHMDPose(hmd)) {
+            KinectSettings::hmdPosition = hmd.position;
+            KinectSettings::hmdRotation = hmd.rotation;
+            KinectSettings::hmdAbsoluteTracking = hmd.absoluteTracking;
+        }
+        int64_t now = KVR::monotonicNanoseconds();
+        playback->takeDevicePoses([this, now](const KVR::RecordedDevicePose & recorded) {
+            if (recorded.globalID >= k_maxTrackingPoolDevices)
+                return;
+            KVR::TrackedDevicePose pose = recorded.pose;
+            pose.captureTimestamp = now;
+            TrackingPoolManager::publishDevicePose(replayGlobalIDs[recorded.globalID], pose);
+        });
+        return 0;
+    }
+    void shutdown() {
+        active = false;
+    }
+
+private:
+    std::shared_ptr<KVR::SessionPlayback> playback;
+    uint32_t replayGlobalIDs[k_maxTrackingPoolDevices]; // Recorded gid -> gid in this run's pool
+};
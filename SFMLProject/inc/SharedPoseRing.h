@@ -0,0 +1,283 @@
+#pragma once
+#include "stdafx.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vrinputemulator.h>
+
+#include "LatencyStats.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace KVR {
+    // Shared-memory pose transport
+    // Every virtual device gets a small single-producer/single-consumer ring of timestamped poses.
+    // The consumer only ever takes the newest record, so unlike the InputEmulator message queue,
+    // stale poses are overwritten instead of queued up behind each other.
+    // Everything in the mapping is fixed size POD (plus lock-free atomics), as it's shared between processes.
+    // A consumer keeps a heartbeat in the header, which is how the producer knows someone is still reading it
+
+#ifdef _WIN32
+    const wchar_t * const sharedPoseRingName = L"Local\\KinectToVR_SharedPoseRing";
+#else
+    const char * const sharedPoseRingName = "/KinectToVR_SharedPoseRing";
+#endif
+    const uint32_t sharedPoseRingMagic = 0x4B325652; // 'K2VR'
+    const uint32_t sharedPoseRingVersion = 2;
+    const uint32_t sharedPoseRingDevices = 32;
+    const uint32_t sharedPoseRingLength = 4;
+
+    struct SharedPoseRecord {
+        uint64_t sequence;
+        int64_t timestampNanoseconds; // Capture time of the pose, from KVR::monotonicNanoseconds()
+        vr::DriverPose_t pose;
+    };
+    struct SharedPoseDeviceRing {
+        std::atomic<uint64_t> writeSequence; // Number of records ever written, 0 for an unused ring
+        uint32_t deviceId;
+        uint32_t padding;
+        SharedPoseRecord records[sharedPoseRingLength];
+    };
+    struct SharedPoseRingHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t deviceCapacity;
+        uint32_t ringLength;
+        std::atomic<uint32_t> deviceCount;
+        std::atomic<int64_t> consumerHeartbeat; // KVR::monotonicNanoseconds() of the consumer's last poll, 0 if never
+    };
+    struct SharedPoseRingLayout {
+        SharedPoseRingHeader header;
+        SharedPoseDeviceRing devices[sharedPoseRingDevices];
+    };
+
+    class SharedPoseRingMapping {
+    public:
+        ~SharedPoseRingMapping() {
+            close();
+        }
+        bool isOpen() const { return layout != nullptr; }
+        void close() {
+#ifdef _WIN32
+            if (layout)
+                UnmapViewOfFile(layout);
+            if (mapping)
+                CloseHandle(mapping);
+            mapping = nullptr;
+#else
+            if (layout)
+                munmap(layout, sizeof(SharedPoseRingLayout));
+            if (mapping >= 0)
+                ::close(mapping);
+            mapping = -1;
+#endif
+            layout = nullptr;
+        }
+    protected:
+#ifdef _WIN32
+        HANDLE mapping = nullptr;
+#else
+        int mapping = -1; // shm_open descriptor
+#endif
+        SharedPoseRingLayout *layout = nullptr;
+
+        bool mapView() {
+#ifdef _WIN32
+            layout = static_cast<SharedPoseRingLayout*>(
+                MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(SharedPoseRingLayout)));
+            if (!layout) {
+                LOG(ERROR) << "Could not map the shared pose ring! Error " << GetLastError();
+                CloseHandle(mapping);
+                mapping = nullptr;
+                return false;
+            }
+#else
+            void *view = mmap(nullptr, sizeof(SharedPoseRingLayout), PROT_READ | PROT_WRITE, MAP_SHARED, mapping, 0);
+            if (view == MAP_FAILED) {
+                LOG(ERROR) << "Could not map the shared pose ring! Error " << errno;
+                ::close(mapping);
+                mapping = -1;
+                return false;
+            }
+            layout = static_cast<SharedPoseRingLayout*>(view);
+#endif
+            return true;
+        }
+    };
+
+    class SharedPoseRingWriter : public SharedPoseRingMapping {
+    public:
+        // Off by default: poses are always written to the ring, but also still sent through InputEmulator.
+        // Only turn this on with a driver that reads the ring - even then, the message queue is only
+        // skipped while that driver's heartbeat is fresh, so a consumer that crashes or hangs
+        // just puts the trackers back on the message queue after consumerTimeout
+        bool bypassMessageQueue = false;
+        std::chrono::milliseconds consumerTimeout{ 250 };
+
+        ~SharedPoseRingWriter() {
+            close();
+        }
+        void close() {
+#ifndef _WIN32
+            // Windows drops the mapping once the last handle to it closes, POSIX keeps the name until it's
+            // unlinked. Consumers still mapped keep their view, and have to reopen to find the next producer
+            if (isOpen())
+                shm_unlink(sharedPoseRingName);
+#endif
+            SharedPoseRingMapping::close();
+        }
+        bool open() {
+            if (isOpen())
+                return true;
+#ifdef _WIN32
+            mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, sizeof(SharedPoseRingLayout), sharedPoseRingName);
+            if (!mapping) {
+                LOG(ERROR) << "Could not create the shared pose ring! Error " << GetLastError();
+                return false;
+            }
+            bool alreadyExisted = GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+            mapping = shm_open(sharedPoseRingName, O_RDWR | O_CREAT, 0600);
+            if (mapping < 0) {
+                LOG(ERROR) << "Could not create the shared pose ring! Error " << errno;
+                return false;
+            }
+            struct stat mappingStat;
+            bool alreadyExisted = fstat(mapping, &mappingStat) == 0 && mappingStat.st_size == sizeof(SharedPoseRingLayout);
+            if (!alreadyExisted && ftruncate(mapping, sizeof(SharedPoseRingLayout)) != 0) {
+                LOG(ERROR) << "Could not size the shared pose ring! Error " << errno;
+                ::close(mapping);
+                mapping = -1;
+                return false;
+            }
+#endif
+            if (!mapView())
+                return false;
+            if (!alreadyExisted || layout->header.magic != sharedPoseRingMagic
+                || layout->header.version != sharedPoseRingVersion) {
+                // Fresh mappings are zeroed by the OS, so only the header needs filling in
+                layout->header.version = sharedPoseRingVersion;
+                layout->header.deviceCapacity = sharedPoseRingDevices;
+                layout->header.ringLength = sharedPoseRingLength;
+                layout->header.deviceCount.store(0, std::memory_order_relaxed);
+                layout->header.consumerHeartbeat.store(0, std::memory_order_relaxed);
+                layout->header.magic = sharedPoseRingMagic;
+            }
+            LOG(INFO) << "Shared pose ring opened";
+            return true;
+        }
+        // A consumer has polled the ring within consumerTimeout
+        bool consumerAlive() const {
+            if (!isOpen())
+                return false;
+            int64_t heartbeat = layout->header.consumerHeartbeat.load(std::memory_order_relaxed);
+            return heartbeat
+                && monotonicNanoseconds() - heartbeat < std::chrono::duration_cast<std::chrono::nanoseconds>(consumerTimeout).count();
+        }
+        // Whether this tick's poses can go through the ring alone
+        bool replacesMessageQueue() const {
+            return bypassMessageQueue && consumerAlive();
+        }
+        bool write(uint32_t deviceId, const vr::DriverPose_t &pose, int64_t timestampNanoseconds) {
+            SharedPoseDeviceRing *ring = ringForDevice(deviceId);
+            if (!ring)
+                return false;
+            uint64_t sequence = ring->writeSequence.load(std::memory_order_relaxed);
+            SharedPoseRecord &record = ring->records[sequence % sharedPoseRingLength];
+            record.sequence = sequence;
+            record.timestampNanoseconds = timestampNanoseconds;
+            record.pose = pose;
+            ring->writeSequence.store(sequence + 1, std::memory_order_release);
+            return true;
+        }
+    private:
+        SharedPoseDeviceRing * ringForDevice(uint32_t deviceId) {
+            if (!isOpen())
+                return nullptr;
+            uint32_t count = layout->header.deviceCount.load(std::memory_order_relaxed);
+            for (uint32_t i = 0; i < count; ++i) {
+                if (layout->devices[i].deviceId == deviceId)
+                    return &layout->devices[i];
+            }
+            if (count == sharedPoseRingDevices)
+                return nullptr;
+            // Single producer, so the device's ring can be claimed without a CAS
+            SharedPoseDeviceRing &ring = layout->devices[count];
+            ring.deviceId = deviceId;
+            ring.writeSequence.store(0, std::memory_order_relaxed);
+            layout->header.deviceCount.store(count + 1, std::memory_order_release);
+            return &ring;
+        }
+    };
+
+    class SharedPoseRingReader : public SharedPoseRingMapping {
+        // For the consumer (driver) side, or an in-process loopback when debugging the transport.
+        // Every read refreshes the heartbeat - a consumer with nothing to read should still call
+        // heartbeat() at least every SharedPoseRingWriter::consumerTimeout, or the producer falls back to the message queue
+    public:
+        bool open() {
+            if (isOpen())
+                return true;
+#ifdef _WIN32
+            mapping = OpenFileMappingW(FILE_MAP_ALL_ACCESS, FALSE, sharedPoseRingName);
+            if (!mapping)
+                return false; // Producer not running yet
+#else
+            mapping = shm_open(sharedPoseRingName, O_RDWR, 0600);
+            if (mapping < 0)
+                return false; // Producer not running yet
+            struct stat mappingStat;
+            if (fstat(mapping, &mappingStat) != 0 || mappingStat.st_size != sizeof(SharedPoseRingLayout)) {
+                ::close(mapping);
+                mapping = -1;
+                return false; // Still being created
+            }
+#endif
+            if (!mapView())
+                return false;
+            if (layout->header.magic != sharedPoseRingMagic
+                || layout->header.version != sharedPoseRingVersion) {
+                LOG(ERROR) << "Shared pose ring version mismatch, expected " << sharedPoseRingVersion << " but found " << layout->header.version;
+                SharedPoseRingMapping::close();
+                return false;
+            }
+            heartbeat();
+            return true;
+        }
+        void heartbeat() const {
+            if (isOpen())
+                layout->header.consumerHeartbeat.store(monotonicNanoseconds(), std::memory_order_relaxed);
+        }
+        // Copies out the newest pose for the device, returns false if there is none yet
+        bool readLatest(uint32_t deviceId, SharedPoseRecord &record) const {
+            if (!isOpen())
+                return false;
+            heartbeat();
+            uint32_t count = layout->header.deviceCount.load(std::memory_order_acquire);
+            for (uint32_t i = 0; i < count; ++i) {
+                const SharedPoseDeviceRing &ring = layout->devices[i];
+                if (ring.deviceId != deviceId)
+                    continue;
+                while (true) {
+                    uint64_t written = ring.writeSequence.load(std::memory_order_acquire);
+                    if (written == 0)
+                        return false;
+                    record = ring.records[(written - 1) % sharedPoseRingLength];
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    // If the producer lapped the ring while copying, the record may be torn
+                    if (ring.writeSequence.load(std::memory_order_relaxed) - written < sharedPoseRingLength - 1)
+                        return true;
+                }
+            }
+            return false;
+        }
+    };
+}
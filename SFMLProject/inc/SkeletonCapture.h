@@ -0,0 +1,140 @@
+#pragma once
+#include "stdafx.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "LatencyStats.h"
+#include "logging.h"
+
+namespace KVR {
+    template <typename T>
+    class LatestValueSlot {
+        // Single producer, single consumer triple buffer. The producer fills writeBuffer() and publishes it,
+        // the consumer takes whatever was published last - neither ever blocks the other, and frames
+        // the consumer was too slow for are just overwritten.
+        // waitForFresh() is only there so the consumer can sleep until something arrives
+    public:
+        T & writeBuffer() { return buffers[writeIndex]; }
+
+        // Producer only
+        void publish() {
+            uint8_t previous = middle.exchange(uint8_t(writeIndex | freshBit), std::memory_order_acq_rel);
+            writeIndex = previous & indexMask;
+            {
+                std::lock_guard<std::mutex> guard(wakeMutex);
+            }
+            wakeCondition.notify_one();
+        }
+
+        // Consumer only. nullptr if nothing new has been published since the last call
+        const T* consume() {
+            if (!hasFresh())
+                return nullptr;
+            uint8_t previous = middle.exchange(readIndex, std::memory_order_acq_rel);
+            readIndex = previous & indexMask;
+            return &buffers[readIndex];
+        }
+        bool hasFresh() const {
+            return (middle.load(std::memory_order_acquire) & freshBit) != 0;
+        }
+        bool waitForFresh(std::chrono::milliseconds timeout) {
+            if (hasFresh())
+                return true;
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            return wakeCondition.wait_for(lock, timeout, [this] { return hasFresh(); });
+        }
+
+    private:
+        static const uint8_t indexMask = 0x3;
+        static const uint8_t freshBit = 0x4;
+
+        T buffers[3];
+        uint8_t writeIndex = 0;     // Producer's
+        std::atomic<uint8_t> middle{ 1 };
+        uint8_t readIndex = 2;      // Consumer's
+
+        std::mutex wakeMutex;
+        std::condition_variable wakeCondition;
+    };
+
+    class FrameEventSource {
+        // Whatever signals that the sensor has a new frame ready, e.g. the Kinect v2's body frame event
+    public:
+        virtual ~FrameEventSource() {}
+        // True if a frame arrived before the timeout
+        virtual bool waitForFrame(std::chrono::milliseconds timeout) = 0;
+    };
+
+    class SimulatedFrameEventSource : public FrameEventSource {
+        // Signalled by hand, to drive a FrameCaptureThread without the sensor attached
+    public:
+        void signal() {
+            {
+                std::lock_guard<std::mutex> guard(pendingMutex);
+                ++pendingFrames;
+            }
+            pendingCondition.notify_one();
+        }
+        bool waitForFrame(std::chrono::milliseconds timeout) {
+            std::unique_lock<std::mutex> lock(pendingMutex);
+            if (!pendingCondition.wait_for(lock, timeout, [this] { return pendingFrames > 0; }))
+                return false;
+            --pendingFrames;
+            return true;
+        }
+
+    private:
+        std::mutex pendingMutex;
+        std::condition_variable pendingCondition;
+        int pendingFrames = 0;
+    };
+
+    class FrameCaptureThread {
+        // Blocks on a sensor's frame event, and runs the capture (acquire + filter + publish)
+        // as soon as it fires, rather than waiting for whichever loop polls the sensor next.
+        // The capture function is handed the time the event fired
+    public:
+        ~FrameCaptureThread() {
+            stop();
+        }
+
+        void start(FrameEventSource* source, std::function<void(int64_t)> captureFrame) {
+            stop();
+            eventSource = source;
+            capture = captureFrame;
+            running = true;
+            captureThread = std::thread(&FrameCaptureThread::run, this);
+            LOG(INFO) << "Skeleton capture thread started";
+        }
+        void stop() {
+            if (!running)
+                return;
+            running = false;
+            if (captureThread.joinable())
+                captureThread.join();
+            LOG(INFO) << "Skeleton capture thread stopped";
+        }
+        bool isRunning() const { return running; }
+
+        // How long a wait can go without checking whether the thread has been stopped
+        std::chrono::milliseconds stopCheckInterval{ 100 };
+
+    private:
+        FrameEventSource* eventSource = nullptr;
+        std::function<void(int64_t)> capture;
+        std::thread captureThread;
+        std::atomic<bool> running{ false };
+
+        void run() {
+            while (running) {
+                if (eventSource->waitForFrame(stopCheckInterval))
+                    capture(monotonicNanoseconds());
+            }
+        }
+    };
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "stdafx.h"
+#include <cstdint>
+#include <openvr.h>
+
+#include "KinectJoint.h"
+
+namespace KVR {
+    // Same values as both NUI_SKELETON_POSITION_TRACKING_STATE (v1) and TrackingState (v2)
+    enum class JointTrackingState : uint8_t {
+        NotTracked = 0,
+        Inferred = 1,
+        Tracked = 2
+    };
+
+    struct SkeletonFrame {
+        // Sensor-neutral copy of the tracked skeleton, indexed by KVR::KinectJointType,
+        // filled in by the v1/v2 handlers after their filters have run.
+        // Plain old data, so it can be written straight into a recorded session
+        int64_t captureTimestamp = 0;
+        uint8_t isTracking = 0;
+        JointTrackingState trackingStates[KinectJointCount] = {};
+        float positions[KinectJointCount][3] = {};              // Filtered positions, in kinect space
+        float orientations[KinectJointCount][4] = {};           // Unfiltered w,x,y,z
+        float filteredOrientations[KinectJointCount][4] = {};   // Filtered w,x,y,z
+
+        void setJoint(int joint, JointTrackingState state, float x, float y, float z) {
+            trackingStates[joint] = state;
+            positions[joint][0] = x;
+            positions[joint][1] = y;
+            positions[joint][2] = z;
+        }
+        void setOrientations(int joint, float w, float x, float y, float z, float filteredW, float filteredX, float filteredY, float filteredZ) {
+            orientations[joint][0] = w;
+            orientations[joint][1] = x;
+            orientations[joint][2] = y;
+            orientations[joint][3] = z;
+            filteredOrientations[joint][0] = filteredW;
+            filteredOrientations[joint][1] = filteredX;
+            filteredOrientations[joint][2] = filteredY;
+            filteredOrientations[joint][3] = filteredZ;
+        }
+
+        vr::HmdVector3d_t position(KinectJointType joint) const {
+            const float* p = positions[(int)joint];
+            return { p[0], p[1], p[2] };
+        }
+        vr::HmdQuaternion_t orientation(KinectJointType joint, bool filtered) const {
+            const float* q = filtered ? filteredOrientations[(int)joint] : orientations[(int)joint];
+            return { q[0], q[1], q[2], q[3] };
+        }
+    };
+}
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "TrackingMethod.h"
+#include "PosePredictor.h"
+#include "QuaternionMath.h"
+#include "CalibrationTransform.h"
 #include "logging.h"
 class SkeletonTracker : public TrackingMethod {
     // For now, always register the kinect FIRST, until there's some structure which binds joints and global id's
@@ -43,38 +46,60 @@ public:
         // Iterate over trackers
         // Determine if they use kinect bones, update those bones only
         // Set flag to make sure bones aren't updated multiple times
-        for (KVR::KinectTrackedDevice device : v_trackers) {
+        // The calibration transform has already been refreshed for this tick by TrackingLoop::tick
+
+        // Every tracker's joint is fetched first, so the calibration can be applied to all of them in one batch
+        const std::vector<int> & trackers = subscribedTrackers(v_trackers);
+        jointBatch.resize(trackers.size()); // Only allocates when trackers are added
+        batchRotations.resize(trackers.size());
+        batchPositions.resize(trackers.size());
+        batchRotateRotation.resize(trackers.size());
+        int batchCount = 0;
+        for (int i : trackers) {
+            KVR::KinectTrackedDevice & device = v_trackers[i];
             if (device.role == KVR::KinectDeviceRole::KinectSensor)
                 updatePoolWithKinectSensor(device);
-            else
-                updatePoolWithKinectJoint(kinect, device);
+            else if (fetchKinectJoint(kinect, device, i, batchCount))
+                ++batchCount;
         }
+        KVR::CalibrationTransform::shared().applyKinectToVR(
+            batchRotations.data(), batchPositions.data(), batchRotateRotation.data(), batchCount);
+        for (int j = 0; j < batchCount; ++j)
+            updatePoolWithKinectJoint(kinect, v_trackers[jointBatch[j].trackerIndex], j);
     }
 
     void updateTrackers(
         KinectHandlerBase& kinect,
         std::vector<KVR::KinectTrackedDevice> & v_trackers
     ) {
-        for (int i = 0; i < v_trackers.size(); ++i) {
+        KVR::TrackedDevicePose devicePose;
+        for (int i : subscribedTrackers(v_trackers)) {
             auto & device = v_trackers[i];
             if (device.isSensor()) {
-                auto deviceData = TrackingPoolManager::getDeviceData(device.positionDevice_gId);
-                device.setPositionForNextUpdate(deviceData.position);
-                device.setRotationForNextUpdate(deviceData.rotation);
-                device.setPoseForNextUpdate(deviceData.pose);
+                TrackingPoolManager::readDevicePose(device.positionDevice_gId, devicePose);
+                device.setPositionForNextUpdate(devicePose.position);
+                device.setRotationForNextUpdate(devicePose.rotation);
+                device.setPoseForNextUpdate(devicePose.pose);
+                device.noteCaptureTimestamp(devicePose.captureTimestamp);
                 break;
             }
+            if (deviceUsesJointPose(device)) {
+                TrackingPoolManager::readDevicePose(device.positionDevice_gId, devicePose);
+                device.setPositionForNextUpdate(devicePose.position);
+                device.setRotationForNextUpdate(devicePose.rotation);
+                device.setPoseForNextUpdate(devicePose.pose);
+                device.noteCaptureTimestamp(devicePose.captureTimestamp);
+                continue;
+            }
             if (device.positionTrackingOption == KVR::JointPositionTrackingOption::Skeleton) {
-                auto deviceData = TrackingPoolManager::getDeviceData(device.positionDevice_gId);
-                device.setPositionForNextUpdate(deviceData.position);
+                TrackingPoolManager::readDevicePosition(device.positionDevice_gId, devicePose.position, devicePose.captureTimestamp);
+                device.setPositionForNextUpdate(devicePose.position);
+                device.noteCaptureTimestamp(devicePose.captureTimestamp);
             }
             if (device.rotationTrackingOption == KVR::JointRotationTrackingOption::Skeleton) {
-                auto deviceData = TrackingPoolManager::getDeviceData(device.rotationDevice_gId);
-                device.setRotationForNextUpdate(deviceData.rotation);
-            }
-            if (deviceUsesJointPose(device)) {
-                auto deviceData = TrackingPoolManager::getDeviceData(device.positionDevice_gId);
-                device.setPoseForNextUpdate(deviceData.pose);
+                TrackingPoolManager::readDeviceRotation(device.rotationDevice_gId, devicePose.rotation, devicePose.captureTimestamp);
+                device.setRotationForNextUpdate(devicePose.rotation);
+                device.noteCaptureTimestamp(devicePose.captureTimestamp);
             }
         }
     }
@@ -86,7 +111,26 @@ public:
             &&
             device.positionDevice_gId == device.rotationDevice_gId;
     }
+protected:
+    bool servesTracker(KVR::KinectTrackedDevice & device) {
+        return device.isSensor()
+            || device.positionTrackingOption == KVR::JointPositionTrackingOption::Skeleton
+            || device.rotationTrackingOption == KVR::JointRotationTrackingOption::Skeleton;
+    }
 private:
+    KVR::PoseVelocityEstimator jointMotion[k_maxTrackingPoolDevices]; // By global ID, as several trackers can share a joint
+
+    struct BatchedJoint {
+        int trackerIndex;
+        uint32_t globalID;
+        bool valid;
+    };
+    // One entry per tracker using a skeleton joint this update, the positions/rotations in the same order
+    std::vector<BatchedJoint> jointBatch;
+    std::vector<vr::HmdQuaternion_t> batchRotations;
+    std::vector<vr::HmdVector3d_t> batchPositions;
+    std::vector<uint8_t> batchRotateRotation; // Not vector<bool>, so it can be handed over as an array
+
     KVR::TrackedDeviceInputData defaultDeviceData(uint32_t localID) {
         KVR::TrackedDeviceInputData data;
         data.deviceName = "KID: " + std::to_string(localID) + " " + KVR::KinectJointName[localID];
@@ -137,17 +181,9 @@ private:
             rotation = rotation * vrmath::quaternionFromRotationY(PI);
         }
 
-        vr::HmdVector3d_t rotatedPos = vrmath::quaternionRotateVector(KinectSettings::kinectRepRotation, position, false);
-
-        //Adjust this position by the Kinect's VR pos offset
-        rotatedPos.v[0] += KinectSettings::kinectRepPosition.v[0];
-        rotatedPos.v[1] += KinectSettings::kinectRepPosition.v[1];
-        rotatedPos.v[2] += KinectSettings::kinectRepPosition.v[2];
-
-        if (device.rotationFilterOption == KVR::JointRotationFilterOption::HeadLook) {}
-        else
-            rotation = KinectSettings::kinectRepRotation * rotation;
-        position = rotatedPos;
+        //Then adjust the position by the Kinect's VR pos offset
+        KVR::CalibrationTransform::shared().applyKinectToVR(rotation, position,
+            device.rotationFilterOption != KVR::JointRotationFilterOption::HeadLook);
     }
     void updateDevicePosePosition(KVR::KinectTrackedDevice & device, vr::DriverPose_t &pose, vr::HmdVector3d_t rotatedPos) {
         pose.vecPosition[0] = rotatedPos.v[0] + device.trackedPositionVROffset.v[0];
@@ -157,10 +193,11 @@ private:
             pose.vecPosition[1] += KinectSettings::hipRoleHeightAdjust;
         }
     }
-    vr::DriverPose_t generateKinectPose(KVR::KinectTrackedDevice & device, vr::HmdQuaternion_t &rotation, vr::HmdVector3d_t &position) {
+    // alreadyCalibrated if the rotation/position have been through the calibration transform, i.e. the joint batch
+    vr::DriverPose_t generateKinectPose(KVR::KinectTrackedDevice & device, vr::HmdQuaternion_t &rotation, vr::HmdVector3d_t &position, bool alreadyCalibrated = false) {
         vr::DriverPose_t pose = defaultReadyDriverPose();
         bool usingKinectCalibrationModel = true;
-        if (usingKinectCalibrationModel) {
+        if (usingKinectCalibrationModel && !alreadyCalibrated) {
             applyKinectArrowCalibrationToTracker(device, rotation, position);
         }
         pose.deviceIsConnected = true;
@@ -183,39 +220,61 @@ private:
     }
     void updatePoolWithKinectSensor(KVR::KinectTrackedDevice & device) {
         // Kinect Sensor
-        KVR::TrackedDeviceInputData data = defaultSensorDeviceData();
+        KVR::TrackedDevicePose devicePose;
 
-        data.position = KinectSettings::kinectRepPosition;
-        data.rotation = KinectSettings::kinectRepRotation;
+        devicePose.position = KinectSettings::kinectRepPosition;
+        devicePose.rotation = KinectSettings::kinectRepRotation;
         
         vr::HmdQuaternion_t identityQuaterion = { 1,0,0,0 };
+        vr::HmdVector3d_t zeroPosition = { 0,0,0 };
 
-        data.pose = generateKinectPose(device, identityQuaterion, vr::HmdVector3d_t());
+        devicePose.pose = generateKinectPose(device, identityQuaterion, zeroPosition);
+        devicePose.captureTimestamp = KVR::monotonicNanoseconds();
 
-        TrackingPoolManager::updatePoolWithDevice(data, data.deviceId);
+        TrackingPoolManager::publishDevicePose(TrackingPoolManager::kinectSensorGID, devicePose);
     }
-    void updatePoolWithKinectJoint(KinectHandlerBase& kinect, KVR::KinectTrackedDevice & device) {
+    // Adds the tracker's filtered joint to the batch, false if the tracker doesn't use the skeleton at all
+    bool fetchKinectJoint(KinectHandlerBase& kinect, KVR::KinectTrackedDevice & device, int trackerIndex, int batchIndex) {
         bool usingSkeletonPosition = device.positionTrackingOption == KVR::JointPositionTrackingOption::Skeleton;
         bool usingSkeletonRotation = device.rotationTrackingOption == KVR::JointRotationTrackingOption::Skeleton;
         if (!usingSkeletonPosition
             && !usingSkeletonRotation)
-            return;
-        KVR::TrackedDeviceInputData data = defaultDeviceData((int)device.joint0.joint);
+            return false;
+        BatchedJoint & joint = jointBatch[batchIndex];
+        joint.trackerIndex = trackerIndex;
+        joint.globalID = usingSkeletonPosition ? device.positionDevice_gId : device.rotationDevice_gId; // Doesn't need to be checked, as if it's made it past the initial check, it's going to be one or the other ID
 
-        data.deviceId = usingSkeletonPosition ? device.positionDevice_gId : device.rotationDevice_gId; // Doesn't need to be checked, as if it's made it past the initial check, it's going to be one or the other ID
+        batchPositions[batchIndex] = { 0,0,0 };
+        batchRotations[batchIndex] = { 1,0,0,0 };
+        joint.valid = kinect.getFilteredJoint(device, batchPositions[batchIndex], batchRotations[batchIndex]);
+        batchRotateRotation[batchIndex] = device.rotationFilterOption != KVR::JointRotationFilterOption::HeadLook;
+        return true;
+    }
+    void updatePoolWithKinectJoint(KinectHandlerBase& kinect, KVR::KinectTrackedDevice & device, int batchIndex) {
+        const BatchedJoint & joint = jointBatch[batchIndex];
+        uint32_t globalID = joint.globalID;
+        KVR::PoseVelocityEstimator* motion = globalID < k_maxTrackingPoolDevices ? &jointMotion[globalID] : nullptr;
 
-        vr::HmdVector3d_t jointPosition{ 0,0,0 };
-        vr::HmdQuaternion_t jointRotation{ 1,0,0,0 };
-        if (kinect.getFilteredJoint(device, jointPosition, jointRotation)) {
-            data.position = jointPosition;
-            data.rotation = jointRotation;
+        KVR::TrackedDevicePose devicePose;
+        devicePose.captureTimestamp = kinect.skeletonCaptureTimestamp;
+        if (joint.valid) {
+            devicePose.position = batchPositions[batchIndex];
+            devicePose.rotation = batchRotations[batchIndex];
 
-            data.pose = generateKinectPose(device, data.rotation, data.position);
+            devicePose.pose = generateKinectPose(device, devicePose.rotation, devicePose.position, true);
 
+            // After the filters and calibration, so the velocities are in the same space SteamVR gets the pose in
+            if (motion) {
+                motion->addSample(devicePose.position, devicePose.rotation, devicePose.captureTimestamp);
+                motion->applyTo(devicePose.pose, devicePose.captureTimestamp, KVR::monotonicNanoseconds());
+            }
+        }
+        else {
+            devicePose.pose.poseIsValid = false;
+            if (motion)
+                motion->reset();
         }
-        else
-            data.pose.poseIsValid = false;
         // If no joint is gotten, then it will be left as 0,0,0 to be handled in the KinectTrackedDevice
-        TrackingPoolManager::updatePoolWithDevice(data, data.deviceId);
+        TrackingPoolManager::publishDevicePose(globalID, devicePose);
     }
 };
\ No newline at end of file
@@ -5,24 +5,30 @@
 
 #include "DeviceHandler.h"
 namespace KVR {
+    struct TrackedDevicePose {
+        // The per-frame part of a device's tracking data - plain old data only,
+        // published every frame into TrackingPoolManager's pose arrays
+        vr::HmdQuaternion_t rotation = { 1, 0, 0, 0 };
+        vr::HmdVector3d_t position = { 0, 0, 0 };
+
+        // Pose left invalid if not in use
+        vr::DriverPose_t pose = {};
+
+        // KVR::monotonicNanoseconds() when the sample this pose came from was captured, 0 if unknown
+        int64_t captureTimestamp = 0;
+    };
     struct TrackedDeviceInputData {
-        // Used by tracking methods to say what the desired position/rotation for this device should be
+        // Registered once per device when it's added to the tracking pool
+        // The pose itself is published separately each frame as a TrackedDevicePose
         // All data should be converted to VR coords within the device handler
-        // Only data ready for tracking use is put into these structs
         bool clearedForReinit = false; // Flag for devices that like to clear themselves once a new one is added
         std::string deviceName = "UNSET_DEVICE_DATA";
         std::string serial = "INVALID_SERIAL";
         uint32_t deviceId = 0;
 
-        vr::HmdQuaternion_t rotation = { 1, 0, 0, 0 };
         KVR::JointRotationTrackingOption rotationTrackingOption = KVR::JointRotationTrackingOption::IMU;
-
-        vr::HmdVector3d_t position = { 0, 0, 0 };
         KVR::JointPositionTrackingOption positionTrackingOption = KVR::JointPositionTrackingOption::IMU;
 
-        // Pose left invalid if not in use
-        vr::DriverPose_t pose = {};
-
         DeviceHandler *parentHandler;
         std::string customModelName = "{htc}vr_tracker_vive_1_0";
     };
@@ -0,0 +1,236 @@
+#pragma once
+#include "stdafx.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <typeinfo>
+#include <vector>
+
+#include <openvr.h>
+
+#include "KinectHandlerBase.h"
+#include "KinectTrackedDevice.h"
+#include "PoseSubmissionBatch.h"
+#include "TrackingMethod.h"
+#include "DeviceHandler.h"
+#include "VRHelper.h"
+#include "AllocationAudit.h"
+#include "LatencyStats.h"
+#include "FrameProfiler.h"
+#include "SessionRecording.h"
+#include "VRPoseSnapshot.h"
+#include "CalibrationTransform.h"
+
+struct TrackingLoopSnapshot {
+    // Copy of the tracking thread's state which the GUI is allowed to read
+    uint64_t tickCount = 0;
+    double tickRateHz = 0.0;
+    double lastTickMilliseconds = 0.0;
+    int trackerCount = 0;
+    uint64_t lastTickAllocations = 0; // Always 0 unless built with KVR_AUDIT_ALLOCATIONS
+    KVR::LatencyStats latency;
+};
+
+class TrackingLoop {
+    // Runs sensor poll -> filter -> pool -> tracker publish on its own thread,
+    // so that the trackers sent to SteamVR are no longer tied to the GUI's
+    // framerate limit, or stalled by a slow SFGUI update/draw.
+    // The loop is woken by the Kinect as soon as a new frame arrives, and
+    // otherwise ticks at 'maxTickInterval' so the device handlers (PSMove, SteamVR)
+    // still get updated when the Kinect is slow or missing.
+public:
+    TrackingLoop(
+        KinectHandlerBase &kinect,
+        std::vector<KVR::KinectTrackedDevice> &v_trackers,
+        std::vector<std::unique_ptr<TrackingMethod>> &v_trackingMethods,
+        std::vector<std::unique_ptr<DeviceHandler>> &v_deviceHandlers,
+        vr::IVRSystem* &m_VRSystem,
+        bool vrAvailable)
+        :
+        kinectRef(kinect),
+        v_trackersRef(v_trackers),
+        v_trackingMethodsRef(v_trackingMethods),
+        v_deviceHandlersRef(v_deviceHandlers),
+        m_VRSystemRef(m_VRSystem),
+        vrSystemAvailable(vrAvailable)
+    {
+    }
+    ~TrackingLoop() {
+        stop();
+    }
+
+    void start() {
+        if (running)
+            return;
+        running = true;
+        sharedPoseRing.open();
+        trackingThread = std::thread(&TrackingLoop::run, this);
+        LOG(INFO) << "Tracking thread started";
+    }
+    void stop() {
+        if (!running)
+            return;
+        running = false;
+        if (trackingThread.joinable())
+            trackingThread.join();
+        LOG(INFO) << "Tracking thread stopped";
+        sessionRecorder.close();
+        for (int i = 0; i < (int)KVR::LatencyStage::Count; ++i) {
+            LOG(INFO) << "Tracking latency " << KVR::LatencyStageName[i] << ": " << latency.stages[i].summary();
+        }
+    }
+
+    // Anything on the GUI thread which touches the trackers, tracking methods,
+    // device handlers or the kinect's skeleton data must hold this for the duration.
+    // It is only ever held by the tracking thread for a single tick.
+    std::unique_lock<std::mutex> lockPipeline() {
+        return std::unique_lock<std::mutex>(pipelineMutex);
+    }
+
+    // Records every tick's skeleton, device and HMD poses for replaying later
+    // Must be called with the pipeline lock held
+    bool startRecording(const std::wstring & path, KinectVersion kinectVersion) {
+        return sessionRecorder.open(path, kinectVersion);
+    }
+    void stopRecording() {
+        sessionRecorder.close();
+    }
+    bool isRecording() const {
+        return sessionRecorder.isOpen();
+    }
+
+    TrackingLoopSnapshot snapshot() {
+        std::lock_guard<std::mutex> guard(snapshotMutex);
+        return lastSnapshot;
+    }
+
+    // One sensor poll -> publish pass, as the tracking thread runs it each time it wakes.
+    // Only called directly when the tracking thread isn't running, e.g. to step the pipeline in tests.
+    // Returns the number of trackers published
+    int tick() {
+        std::lock_guard<std::mutex> guard(pipelineMutex);
+        KVR_PROFILE_SCOPE("Tracking tick");
+
+        // Only recomputed if the calibration or the tracking origin changed since the last tick
+        KVR::CalibrationTransform::shared().refresh();
+        {
+            KVR_PROFILE_SCOPE("Device handlers");
+            if (vrSystemAvailable) {
+                // The one SteamVR pose fetch per tick, shared with the device handlers and controllers
+                VRPoseSnapshot::shared().update(m_VRSystemRef);
+                updateHMDPosAndRot(VRPoseSnapshot::shared().poses());
+            }
+
+            for (auto & device_ptr : v_deviceHandlersRef) {
+                if (device_ptr->active) device_ptr->run();
+            }
+        }
+        if (sessionRecorder.isOpen()) {
+            sessionRecorder.recordHMD(KVR::monotonicNanoseconds());
+            sessionRecorder.recordPoolDevices();
+        }
+
+        if (kinectRef.isInitialised()) {
+            {
+                KVR_PROFILE_SCOPE("Kinect update");
+                kinectRef.update();
+            }
+            if (sessionRecorder.isOpen() && kinectRef.skeletonCaptureTimestamp != lastSkeletonCaptureTimestamp)
+                sessionRecorder.recordSkeleton(kinectRef.latestSkeleton);
+
+            for (auto & method_ptr : v_trackingMethodsRef) {
+                KVR_PROFILE_SCOPE_DYNAMIC(typeid(*method_ptr).name());
+                method_ptr->update(kinectRef, v_trackersRef);
+            }
+            int64_t poolTimestamp = KVR::monotonicNanoseconds();
+            {
+                KVR_PROFILE_SCOPE("Tracking methods -> trackers");
+                for (auto & method_ptr : v_trackingMethodsRef) {
+                    method_ptr->updateTrackers(kinectRef, v_trackersRef);
+                }
+            }
+            {
+                KVR_PROFILE_SCOPE("Tracker publish");
+                for (auto & tracker : v_trackersRef) {
+                    tracker.poseBatch = &poseBatch;
+                    tracker.update();
+                }
+                poseBatch.flush(&sharedPoseRing, &latency[KVR::LatencyStage::CaptureToPublish]);
+            }
+            int64_t publishTimestamp = KVR::monotonicNanoseconds();
+
+            // Per-stage times are only meaningful for ticks that processed a new skeleton frame
+            if (kinectRef.skeletonCaptureTimestamp != lastSkeletonCaptureTimestamp) {
+                lastSkeletonCaptureTimestamp = kinectRef.skeletonCaptureTimestamp;
+                latency[KVR::LatencyStage::CaptureToFilter].record(kinectRef.skeletonFilteredTimestamp - kinectRef.skeletonCaptureTimestamp);
+                latency[KVR::LatencyStage::FilterToPool].record(poolTimestamp - kinectRef.skeletonFilteredTimestamp);
+                latency[KVR::LatencyStage::PoolToPublish].record(publishTimestamp - poolTimestamp);
+            }
+        }
+        return v_trackersRef.size();
+    }
+
+    // Upper bound on the time between ticks, when no new Kinect frame has arrived
+    std::chrono::milliseconds maxTickInterval{ 1000 / 90 };
+
+private:
+    KinectHandlerBase &kinectRef;
+    std::vector<KVR::KinectTrackedDevice> &v_trackersRef;
+    std::vector<std::unique_ptr<TrackingMethod>> &v_trackingMethodsRef;
+    std::vector<std::unique_ptr<DeviceHandler>> &v_deviceHandlersRef;
+    vr::IVRSystem* &m_VRSystemRef;
+    bool vrSystemAvailable = false;
+
+    std::thread trackingThread;
+    std::atomic<bool> running{ false };
+    std::mutex pipelineMutex;
+
+    std::mutex snapshotMutex;
+    TrackingLoopSnapshot lastSnapshot;
+
+    KVR::PoseSubmissionBatch poseBatch;
+    KVR::SharedPoseRingWriter sharedPoseRing;
+
+    KVR::LatencyStats latency;
+    int64_t lastSkeletonCaptureTimestamp = 0;
+
+    KVR::SessionRecorder sessionRecorder;
+
+    void run() {
+        using clock = std::chrono::steady_clock;
+        auto lastTickStart = clock::now();
+        uint64_t tickCount = 0;
+        bool allocationWarningLogged = false;
+
+        while (running) {
+            kinectRef.waitForNewFrame(maxTickInterval);
+
+            auto tickStart = clock::now();
+            uint64_t allocationsBefore = AllocationAudit::threadAllocationCount();
+            int trackerCount = tick();
+            uint64_t tickAllocations = AllocationAudit::threadAllocationCount() - allocationsBefore;
+            auto tickEnd = clock::now();
+
+            ++tickCount;
+            if (AllocationAudit::enabled
+                && tickCount > AllocationAudit::warmupTicks
+                && tickAllocations
+                && !allocationWarningLogged) {
+                LOG(WARNING) << "Steady-state tracking tick " << tickCount << " made " << tickAllocations << " heap allocations";
+                allocationWarningLogged = true;
+            }
+            double tickIntervalSeconds = std::chrono::duration<double>(tickStart - lastTickStart).count();
+            lastTickStart = tickStart;
+
+            std::lock_guard<std::mutex> guard(snapshotMutex);
+            lastSnapshot.tickCount = tickCount;
+            lastSnapshot.tickRateHz = tickIntervalSeconds > 0.0 ? 1.0 / tickIntervalSeconds : 0.0;
+            lastSnapshot.lastTickMilliseconds = std::chrono::duration<double, std::milli>(tickEnd - tickStart).count();
+            lastSnapshot.trackerCount = trackerCount;
+            lastSnapshot.lastTickAllocations = tickAllocations;
+            lastSnapshot.latency = latency;
+        }
+    }
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "stdafx.h"
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -31,6 +32,37 @@ public:
 
 
     bool isActive() { return active; }
+
+    // Call whenever trackers are spawned, removed, or have their tracking options changed,
+    // so every method rebuilds the list of trackers it serves before its next update.
+    // Like everything else touching v_trackers, only under the pipeline lock
+    static void trackersChanged() { ++trackerConfigurationVersion(); }
 protected:
     bool active = false;
+
+    // Indices into v_trackers of the trackers this method serves, in order. Rebuilt only after
+    // trackersChanged(), or if the tracker count has moved without it
+    const std::vector<int> & subscribedTrackers(std::vector<KVR::KinectTrackedDevice> & v_trackers) {
+        if (subscriberVersion != trackerConfigurationVersion() || subscribedTrackerCount != v_trackers.size()) {
+            subscribers.clear();
+            for (size_t i = 0; i < v_trackers.size(); ++i) {
+                if (servesTracker(v_trackers[i]))
+                    subscribers.push_back(static_cast<int>(i));
+            }
+            subscriberVersion = trackerConfigurationVersion();
+            subscribedTrackerCount = v_trackers.size();
+        }
+        return subscribers;
+    }
+    // Whether this method provides any part of the tracker's pose
+    virtual bool servesTracker(KVR::KinectTrackedDevice & device) { return false; }
+
+private:
+    static uint64_t & trackerConfigurationVersion() {
+        static uint64_t version = 0;
+        return version;
+    }
+    std::vector<int> subscribers;
+    uint64_t subscriberVersion = 0;
+    size_t subscribedTrackerCount = 0;
 };
\ No newline at end of file
@@ -5,16 +5,27 @@
 #include <vector>
 #include <iostream>
 #include <string>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #include "KinectTrackedDevice.h"
+#include "PoseHistory.h"
 #include "TrackedDeviceInputData.h"
 
+// Poses are kept in fixed slots, so readers never see them move when a device is added
+static const uint32_t k_maxTrackingPoolDevices = 128;
+
 class TrackingPoolManager {
 public:
     enum class TrackingPoolError {
         OK = 0,
         InsufficientSpace,
-        OverwritingWrongDevice
+        OverwritingWrongDevice,
+        StaleHandle // The id's slot has been cleared (and maybe reused) since the handle was given out
     };
 
     static uint32_t leftFootDevicePosGID;
@@ -28,103 +39,267 @@ public:
 
     static uint32_t kinectSensorGID;
 
+    // The kinect joints' ids are worked out as they're registered, rather than searched for
     static bool findKinectGlobalIDRange() {
-        static bool kinectIdLocated = false;
-        static uint32_t firstId = k_invalidTrackerID;
-        static uint32_t lastId = k_invalidTrackerID;
-        if (!kinectIdLocated) {
-            for (int i = 0; i < TrackingPoolManager::count(); ++i) {
-                auto data = TrackingPoolManager::getDeviceData(i);
-                if (data.positionTrackingOption == KVR::JointPositionTrackingOption::Skeleton) {
-                    firstId = i;
-                    // Kinect Trackers spawned all together, so no need to account for different devices's between this range
-                    lastId = i + KVR::KinectJointCount - 1;
-
-                    kinectIdLocated = true;
-                    break;
-                }
-            }
-        }
-        kinectFirstId = firstId;
-        kinectLastId = lastId;
-        if (kinectIdLocated)
-            return true;
-        return false;
+        return kinectFirstId != k_invalidTrackerID;
     }
 
     static bool trackerIdInKinectRange(uint32_t trackerId) {
-        findKinectGlobalIDRange();
-        return trackerId >= kinectFirstId && trackerId <= kinectLastId;
+        return findKinectGlobalIDRange() && trackerId >= kinectFirstId && trackerId <= kinectLastId;
     }
     static uint32_t globalDeviceIDFromJoint(KVR::KinectJointType joint) {
-        if (kinectFirstId == k_invalidTrackerID
-            && kinectLastId == k_invalidTrackerID) {
-            findKinectGlobalIDRange();
-            for (int i = 0; i < KVR::KinectJointCount; ++i) {
-                kinectJointToGlobalIDTable[i] = kinectFirstId + i;
-            }
-            return kinectJointToGlobalIDTable[(int)joint];
-        } else
-            return kinectJointToGlobalIDTable[(int)joint];
-        return k_invalidTrackerID;
+        if (!findKinectGlobalIDRange())
+            return k_invalidTrackerID;
+        return kinectJointToGlobalIDTable[(int)joint];
     }
     static uint32_t locateGlobalDeviceID(std::string serial) {
-        for (KVR::TrackedDeviceInputData & data : devicePool) {
-            if (data.serial == serial) {
-                return data.deviceId;
-            }
-        }
+        auto it = serialIndex.find(serial);
+        if (it != serialIndex.end())
+            return it->second;
         return k_invalidTrackerID;
     }
+
+    // Slots are generational: clearing a device bumps its slot's generation, so anything still holding
+    // the old id + generation (TrackerIDs) is told it's stale, instead of writing over whatever reuses the slot
     static TrackingPoolError addDeviceToPool(KVR::TrackedDeviceInputData & inputData, uint32_t & globalID) {
-        globalID = devicePool.size(); // for the default case of adding instead of rebuilding
-
-        // Some devices (PSMoves) rebuild the controller list, so essentially what's removed and readded needs to have that happen here too, but instead just zeroed out - otherwise the vector is screwed up.
-
-        // Search for first available position to fill
-        for (int i = 0; i < devicePool.size(); ++i) {
-            if (devicePool[i].clearedForReinit) {
-                globalID = i;
-                inputData.deviceId = globalID;
-                devicePool[i] = inputData;
-                devicePool[i].clearedForReinit = false;
-                return TrackingPoolError::OK;
+        // Some devices (PSMoves) rebuild the controller list, so what's removed and readded reuses the
+        // cleared slots - lowest first, so a rebuilt list gets its old ids back in order
+        globalID = takeFreeSlot();
+        if (globalID == k_invalidTrackerID) {
+            globalID = devicePool.size(); // for the default case of adding instead of rebuilding
+            if (globalID >= k_maxTrackingPoolDevices) {
+                LOG(ERROR) << "Tracking pool is full, " << inputData.deviceName << " could not be added";
+                globalID = k_invalidTrackerID;
+                return TrackingPoolError::InsufficientSpace;
             }
+            devicePool.emplace_back();
         }
         inputData.deviceId = globalID;
-        devicePool.push_back(inputData);
+        devicePool[globalID] = inputData;
+        devicePool[globalID].clearedForReinit = false;
+        serialIndex.emplace(inputData.serial, globalID); // First registered wins, as the old linear search did
+        if (inputData.positionTrackingOption == KVR::JointPositionTrackingOption::Skeleton)
+            registerKinectDevice(globalID);
+        publishDevicePose(globalID, KVR::TrackedDevicePose());
         return TrackingPoolError::OK;
     }
+    static TrackingPoolError addDeviceToPool(KVR::TrackedDeviceInputData & inputData, TrackerIDs & ids) {
+        TrackingPoolError error = addDeviceToPool(inputData, ids.globalID);
+        ids.generation = generation(ids.globalID);
+        return error;
+    }
     static TrackingPoolError clearDeviceInPool(uint32_t globalID) {
         // Should ideally be called directly before the devices are reinitialised in the pool
-        devicePool[globalID].clearedForReinit = true;
+        if (globalID >= devicePool.size() || devicePool[globalID].clearedForReinit)
+            return TrackingPoolError::OK;
+        KVR::TrackedDeviceInputData & data = devicePool[globalID];
+        data.clearedForReinit = true;
+        slotGenerations[globalID].fetch_add(1, std::memory_order_release);
+        freeSlotMask[globalID / 64] |= uint64_t(1) << (globalID % 64);
+
+        unindexSerial(globalID);
         return TrackingPoolError::OK;
     }
-    static TrackingPoolError updatePoolWithDevice(KVR::TrackedDeviceInputData inputData, uint32_t globalID) {
-        if ((inputData.deviceName != devicePool[globalID].deviceName)
-           || (inputData.deviceId != devicePool[globalID].deviceId)) {
-            LOG(ERROR) << devicePool[globalID].deviceName << " IS BEING OVERWRITTEN BY " << inputData.deviceName << '\n';
-            return TrackingPoolError::OverwritingWrongDevice;
+    static TrackingPoolError clearDeviceInPool(const TrackerIDs & ids) {
+        if (!isCurrent(ids)) {
+            LOG(WARNING) << "Tried to clear pool device " << ids.globalID << " with a stale handle";
+            return TrackingPoolError::StaleHandle;
         }
-        devicePool[globalID] = inputData;
+        return clearDeviceInPool(ids.globalID);
+    }
+
+    // For a device whose name or serial changed after it was added (e.g. SteamVR only filling in
+    // a serial once the device has finished connecting). Keeps its id, and re-indexes the serial.
+    // Must be called with the pipeline lock held
+    static TrackingPoolError updateDeviceMetadata(uint32_t globalID, const std::string & deviceName, const std::string & serial) {
+        if (globalID >= devicePool.size() || devicePool[globalID].clearedForReinit)
+            return TrackingPoolError::StaleHandle;
+        KVR::TrackedDeviceInputData & data = devicePool[globalID];
+        data.deviceName = deviceName;
+        if (data.serial != serial) {
+            unindexSerial(globalID);
+            data.serial = serial;
+            serialIndex.emplace(serial, globalID);
+        }
+        return TrackingPoolError::OK;
+    }
+
+    static uint32_t generation(uint32_t globalID) {
+        if (globalID >= k_maxTrackingPoolDevices)
+            return 0;
+        return slotGenerations[globalID].load(std::memory_order_acquire);
+    }
+    static bool isCurrent(const TrackerIDs & ids) {
+        return ids.globalID < devicePool.size() && generation(ids.globalID) == ids.generation;
+    }
+
+    // Per-frame poses are kept apart from the device metadata, as separate arrays indexed by global id
+    // Each id has a single producer (the handler/method that added it), and any number of readers,
+    // which never block the producer and retry if they catch it mid-write (seqlock)
+    static void publishDevicePose(uint32_t globalID, const KVR::TrackedDevicePose & pose) {
+        if (globalID >= k_maxTrackingPoolDevices)
+            return;
+        std::atomic<uint32_t> & sequence = poseSequences[globalID];
+        uint32_t current = sequence.load(std::memory_order_relaxed);
+        sequence.store(current + 1, std::memory_order_relaxed); // Odd while being written
+        std::atomic_thread_fence(std::memory_order_release);
+        poseRotations[globalID] = pose.rotation;
+        posePositions[globalID] = pose.position;
+        driverPoses[globalID] = pose.pose;
+        poseCaptureTimestamps[globalID] = pose.captureTimestamp;
+        // A reused slot mustn't interpolate into the previous device's poses
+        uint32_t slotGeneration = generation(globalID);
+        if (historyGenerations[globalID] != slotGeneration) {
+            poseHistories[globalID].reset();
+            historyGenerations[globalID] = slotGeneration;
+        }
+        if (pose.pose.poseIsValid)
+            poseHistories[globalID].push(pose.position, pose.rotation, pose.captureTimestamp);
+        sequence.store(current + 2, std::memory_order_release);
+    }
+    // As above, unless the handle is stale - safe to call from a device's own thread, as the
+    // generation is atomic and only moves when the pipeline lock holder clears the slot
+    static TrackingPoolError publishDevicePose(const TrackerIDs & ids, const KVR::TrackedDevicePose & pose) {
+        if (ids.globalID >= k_maxTrackingPoolDevices || generation(ids.globalID) != ids.generation)
+            return TrackingPoolError::StaleHandle;
+        publishDevicePose(ids.globalID, pose);
         return TrackingPoolError::OK;
     }
-    static KVR::TrackedDeviceInputData getDeviceData(uint32_t globalID) {
-        if (globalID >= 0 && globalID < devicePool.size())
+    static bool readDevicePose(uint32_t globalID, KVR::TrackedDevicePose & pose) {
+        return readConsistent(globalID, [&pose, globalID] {
+            pose.rotation = poseRotations[globalID];
+            pose.position = posePositions[globalID];
+            pose.pose = driverPoses[globalID];
+            pose.captureTimestamp = poseCaptureTimestamps[globalID];
+        });
+    }
+    static bool readDevicePosition(uint32_t globalID, vr::HmdVector3d_t & position, int64_t & captureTimestamp) {
+        return readConsistent(globalID, [&position, &captureTimestamp, globalID] {
+            position = posePositions[globalID];
+            captureTimestamp = poseCaptureTimestamps[globalID];
+        });
+    }
+    static bool readDeviceRotation(uint32_t globalID, vr::HmdQuaternion_t & rotation, int64_t & captureTimestamp) {
+        return readConsistent(globalID, [&rotation, &captureTimestamp, globalID] {
+            rotation = poseRotations[globalID];
+            captureTimestamp = poseCaptureTimestamps[globalID];
+        });
+    }
+
+    // Where the device was at t (KVR::monotonicNanoseconds()), interpolated from its recent valid poses -
+    // see KVR::PoseHistory. So devices updating at different rates can all be read at the same instant.
+    // False if it has no valid pose yet
+    static bool sampleDevicePoseAt(uint32_t globalID, int64_t t, KVR::PoseSample & sample) {
+        KVR::PoseSample older, newer;
+        bool found = false;
+        // Only the two samples either side are copied while checking for a concurrent write
+        if (!readConsistent(globalID, [&older, &newer, &found, globalID, t] {
+            found = poseHistories[globalID].bracket(t, older, newer);
+        }))
+            return false;
+        if (!found)
+            return false;
+        sample = KVR::PoseHistory::interpolate(older, newer, t);
+        return true;
+    }
+
+    static const KVR::TrackedDeviceInputData & getDeviceData(uint32_t globalID) {
+        // Registered metadata only - poses are read with readDevicePose
+        static const KVR::TrackedDeviceInputData invalidDeviceData{};
+        if (globalID < devicePool.size())
             return devicePool[globalID];
-        return KVR::TrackedDeviceInputData();
+        return invalidDeviceData;
     }
     static int count() {
         return devicePool.size();
     }
     static std::string deviceGuiString(uint32_t globalID) {
         // Have ID first, device name afters
-        if (globalID >= 0 && globalID < devicePool.size()) {
+        if (globalID < devicePool.size()) {
             return "GID: " + std::to_string(devicePool[globalID].deviceId) + " " + devicePool[globalID].deviceName;
         }
         return "ERROR: DEVICE ID OUTSIDE OF POOL RANGE";
     }
 private:
+    static uint32_t lowestSetBit(uint64_t mask) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, mask);
+        return uint32_t(index);
+#else
+        return uint32_t(__builtin_ctzll(mask));
+#endif
+    }
+    static uint32_t takeFreeSlot() {
+        for (uint32_t word = 0; word < freeSlotWords; ++word) {
+            if (freeSlotMask[word]) {
+                uint32_t bit = lowestSetBit(freeSlotMask[word]);
+                freeSlotMask[word] &= freeSlotMask[word] - 1;
+                return word * 64 + bit;
+            }
+        }
+        return k_invalidTrackerID;
+    }
+    static void unindexSerial(uint32_t globalID) {
+        const std::string & serial = devicePool[globalID].serial;
+        auto it = serialIndex.find(serial);
+        if (it == serialIndex.end() || it->second != globalID)
+            return;
+        serialIndex.erase(it);
+        // Rare, so it's fine to look for another device with the same serial to take over
+        for (uint32_t i = 0; i < devicePool.size(); ++i) {
+            if (i != globalID && !devicePool[i].clearedForReinit && devicePool[i].serial == serial) {
+                serialIndex.emplace(serial, i);
+                break;
+            }
+        }
+    }
+    static void registerKinectDevice(uint32_t globalID) {
+        // Kinect Trackers spawned all together, so no need to account for different devices's between this range
+        // The first skeleton device is joint 0, the sensor itself comes after the joints
+        if (kinectFirstId != k_invalidTrackerID)
+            return;
+        kinectFirstId = globalID;
+        kinectLastId = globalID + KVR::KinectJointCount - 1;
+        for (int i = 0; i < KVR::KinectJointCount; ++i) {
+            kinectJointToGlobalIDTable[i] = kinectFirstId + i;
+        }
+    }
+
+    template <typename CopyFunction>
+    static bool readConsistent(uint32_t globalID, CopyFunction copy) {
+        if (globalID >= k_maxTrackingPoolDevices)
+            return false;
+        const std::atomic<uint32_t> & sequence = poseSequences[globalID];
+        while (true) {
+            uint32_t before = sequence.load(std::memory_order_acquire);
+            if (before & 1) {
+                // Mid-write. Let the writer finish rather than spinning on it, it may not even be running
+                std::this_thread::yield();
+                continue;
+            }
+            copy();
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence.load(std::memory_order_relaxed) == before)
+                return true;
+        }
+    }
+
     // The global device tracking data pool - where every device allocates it's corresponding place by registering an id
     static std::vector<KVR::TrackedDeviceInputData> devicePool;
+    // Only changed with the pipeline lock held, as with the pool itself
+    static std::unordered_map<std::string, uint32_t> serialIndex;
+    static const uint32_t freeSlotWords = (k_maxTrackingPoolDevices + 63) / 64;
+    static uint64_t freeSlotMask[freeSlotWords]; // Cleared slots waiting to be reused
+    static std::atomic<uint32_t> slotGenerations[k_maxTrackingPoolDevices];
+
+    // Latest pose of each device in the pool, indexed by global id
+    static std::atomic<uint32_t> poseSequences[k_maxTrackingPoolDevices];
+    static vr::HmdQuaternion_t poseRotations[k_maxTrackingPoolDevices];
+    static vr::HmdVector3d_t posePositions[k_maxTrackingPoolDevices];
+    static vr::DriverPose_t driverPoses[k_maxTrackingPoolDevices];
+    static int64_t poseCaptureTimestamps[k_maxTrackingPoolDevices];
+    // Recent valid poses of each device, written with the latest pose under the same seqlock
+    static KVR::PoseHistory poseHistories[k_maxTrackingPoolDevices];
+    static uint32_t historyGenerations[k_maxTrackingPoolDevices]; // Slot generation the history belongs to
 };
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <thread>
 
 #include <openvr.h>
+#include "VRPoseSnapshot.h"
 #include <SFML\System\Vector2.hpp>
 #include <SFML\System\Vector3.hpp>
 
@@ -45,7 +46,11 @@ public:
                 controllerID = m_HMDSystem->GetTrackedDeviceIndexForControllerRole(controllerType);
             }
             else {
-                lastStateValid = m_HMDSystem->GetControllerStateWithPose(vr::ETrackingUniverseOrigin::TrackingUniverseStanding, controllerID, &state_, sizeof(state_), &controllerPose);
+                // Pose comes from the tracking thread's shared fetch, only the buttons are asked for here
+                if (VRPoseSnapshot::shared().readPose(controllerID, controllerPose))
+                    lastStateValid = m_HMDSystem->GetControllerState(controllerID, &state_, sizeof(state_));
+                else
+                    lastStateValid = m_HMDSystem->GetControllerStateWithPose(vr::ETrackingUniverseOrigin::TrackingUniverseStanding, controllerID, &state_, sizeof(state_), &controllerPose);
                 if (lastStateValid) {
                     prevState_ = state_;
                 }
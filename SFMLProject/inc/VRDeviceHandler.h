@@ -7,6 +7,7 @@
 #include "TrackingPoolManager.h"
 #include "TrackedDeviceInputData.h"
 #include "VRHelper.h"
+#include "VRPoseSnapshot.h"
 
 #include <openvr_math.h>
 
@@ -125,29 +126,13 @@ public:
         // Add all devices that aren't sensors or virtual
         LOG(INFO) << "Initialising VR Device Handler...";
 
-        vr::TrackedDevicePose_t devicePose[vr::k_unMaxTrackedDeviceCount];
-        m_VRSystem->GetDeviceToAbsoluteTrackingPose(vr::ETrackingUniverseOrigin::TrackingUniverseStanding, 0, devicePose, vr::k_unMaxTrackedDeviceCount);
-
         updateVirtualDeviceList();
 
-        for (int i = 0; i < vr::k_unMaxTrackedDeviceCount; ++i) {
-            // If device virtual, skip
-            if (virtualDevices[i])
-                continue;
-
-            // If device has no useful pos/rot data, skip
-            auto deviceClass = m_VRSystem->GetTrackedDeviceClass(i);
-            if (deviceClass == vr::TrackedDeviceClass_Invalid)
+        for (uint32_t i = 0; i < vr::k_unMaxTrackedDeviceCount; ++i) {
+            refreshDeviceMetadata(i);
+            if (deviceMetadata[i].deviceClass == vr::TrackedDeviceClass_Invalid)
                 break; // No point iterating past the last device
-            if (deviceClass == vr::TrackedDeviceClass_TrackingReference)
-                continue;
-
-            KVR::TrackedDeviceInputData data = defaultDeviceData(i);
-            uint32_t globalID = k_invalidTrackerID;
-            TrackingPoolManager::addDeviceToPool(data, globalID);
-
-            vrDeviceToPoolIds[i].internalID = i;
-            vrDeviceToPoolIds[i].globalID = globalID;
+            addDeviceToPoolIfUseful(i);
         }
 
         initVirtualHips();
@@ -157,13 +142,16 @@ public:
     }
     int run() {
         
-        vr::TrackedDevicePose_t devicePoses[vr::k_unMaxTrackedDeviceCount];
-        m_VRSystem->GetDeviceToAbsoluteTrackingPose(vr::ETrackingUniverseOrigin::TrackingUniverseStanding, 0, devicePoses, vr::k_unMaxTrackedDeviceCount);
+        // Already fetched for this tick by the tracking loop
+        const vr::TrackedDevicePose_t* devicePoses = VRPoseSnapshot::shared().poses();
+        int64_t captureTimestamp = VRPoseSnapshot::shared().timestamp();
 
-        for (int i = 0; i < vr::k_unMaxTrackedDeviceCount; ++i) {
-            vr::ETrackedDeviceClass deviceClass = m_VRSystem->GetTrackedDeviceClass(i);
-            if (deviceClass == vr::TrackedDeviceClass_Invalid)
-                break; // No point iterating past the last device
+        processVREvents();
+
+        // Only the cached metadata is used here, SteamVR's device properties are only queried on device events
+        for (uint32_t i = 0; i < deviceMetadataCount; ++i) {
+            if (!deviceMetadata[i].connected)
+                continue;
 
             if (devicePoses[i].bPoseIsValid && vrDeviceToPoolIds[i].globalID != k_invalidTrackerID) {
                 vr::TrackedDevicePose_t pose = devicePoses[i];
@@ -172,18 +160,18 @@ public:
                 position = GetVRPositionFromMatrix(pose.mDeviceToAbsoluteTracking);
                 rotation = GetVRRotationFromMatrix(pose.mDeviceToAbsoluteTracking);
 
-                KVR::TrackedDeviceInputData data = defaultDeviceData(i);
-                data.deviceId = vrDeviceToPoolIds[i].globalID;
-                data.position = position;
-                data.rotation = rotation;
+                KVR::TrackedDevicePose devicePose;
+                devicePose.position = position;
+                devicePose.rotation = rotation;
+                devicePose.captureTimestamp = captureTimestamp;
 
-                data.pose = trackedDeviceToDriverPose(pose);
-                data.pose.vecPosition[0] = position.v[0];
-                data.pose.vecPosition[1] = position.v[1];
-                data.pose.vecPosition[2] = position.v[2];
-                data.pose.qRotation = rotation;
+                devicePose.pose = trackedDeviceToDriverPose(pose);
+                devicePose.pose.vecPosition[0] = position.v[0];
+                devicePose.pose.vecPosition[1] = position.v[1];
+                devicePose.pose.vecPosition[2] = position.v[2];
+                devicePose.pose.qRotation = rotation;
 
-                TrackingPoolManager::updatePoolWithDevice(data, vrDeviceToPoolIds[i].globalID);
+                TrackingPoolManager::publishDevicePose(vrDeviceToPoolIds[i].globalID, devicePose);
             }
         }
 
@@ -204,6 +192,82 @@ private:
     vr::IVRSystem* &m_VRSystem;
     vrinputemulator::VRInputEmulator & m_inputEmulator;
 
+    struct VRDeviceMetadata {
+        vr::ETrackedDeviceClass deviceClass = vr::TrackedDeviceClass_Invalid;
+        bool connected = false;
+        std::string modelName;
+        std::string serial;
+    };
+    // Filled in on initialise, then only refreshed by SteamVR's device events
+    VRDeviceMetadata deviceMetadata[vr::k_unMaxTrackedDeviceCount];
+    uint32_t deviceMetadataCount = 0; // One past the highest device index that's been seen
+
+    void refreshDeviceMetadata(uint32_t openvrID) {
+        VRDeviceMetadata & metadata = deviceMetadata[openvrID];
+        metadata.deviceClass = m_VRSystem->GetTrackedDeviceClass(openvrID);
+        metadata.connected = metadata.deviceClass != vr::TrackedDeviceClass_Invalid
+            && m_VRSystem->IsTrackedDeviceConnected(openvrID);
+        if (metadata.deviceClass == vr::TrackedDeviceClass_Invalid)
+            return;
+        // Courtesy of https://steamcommunity.com/app/358720/discussions/0/1353742967802223832/
+        getVRStringProperty(openvrID, vr::Prop_ModelNumber_String, metadata.modelName);
+        getVRStringProperty(openvrID, vr::Prop_SerialNumber_String, metadata.serial);
+        if (openvrID >= deviceMetadataCount)
+            deviceMetadataCount = openvrID + 1;
+    }
+    void addDeviceToPoolIfUseful(uint32_t openvrID) {
+        if (vrDeviceToPoolIds[openvrID].globalID != k_invalidTrackerID)
+            return; // Already in the pool, e.g. reconnected
+        // If device virtual, skip
+        if (virtualDevices[openvrID])
+            return;
+        // If device has no useful pos/rot data, skip
+        auto deviceClass = deviceMetadata[openvrID].deviceClass;
+        if (deviceClass == vr::TrackedDeviceClass_Invalid
+            || deviceClass == vr::TrackedDeviceClass_TrackingReference)
+            return;
+
+        KVR::TrackedDeviceInputData data = defaultDeviceData(openvrID);
+        uint32_t globalID = k_invalidTrackerID;
+        TrackingPoolManager::addDeviceToPool(data, globalID);
+
+        vrDeviceToPoolIds[openvrID].internalID = openvrID;
+        vrDeviceToPoolIds[openvrID].globalID = globalID;
+    }
+    void processVREvents() {
+        vr::VREvent_t event;
+        while (m_VRSystem->PollNextEvent(&event, sizeof(event))) {
+            uint32_t openvrID = event.trackedDeviceIndex;
+            if (openvrID >= vr::k_unMaxTrackedDeviceCount)
+                continue;
+            switch (event.eventType) {
+            case vr::VREvent_TrackedDeviceActivated:
+                // Could be one of our own trackers being spawned, which mustn't be fed back into the pool
+                updateVirtualDeviceList();
+                refreshDeviceMetadata(openvrID);
+                addDeviceToPoolIfUseful(openvrID);
+                LOG(INFO) << "SteamVR device " << openvrID << " activated: " << deviceMetadata[openvrID].modelName;
+                break;
+            case vr::VREvent_TrackedDeviceDeactivated:
+                deviceMetadata[openvrID].connected = false;
+                break;
+            case vr::VREvent_PropertyChanged:
+                if (event.data.property.prop == vr::Prop_ModelNumber_String
+                    || event.data.property.prop == vr::Prop_SerialNumber_String) {
+                    refreshDeviceMetadata(openvrID);
+                    // Run from the tracking tick, so the pipeline lock is already held
+                    if (vrDeviceToPoolIds[openvrID].globalID != k_invalidTrackerID) {
+                        KVR::TrackedDeviceInputData data = defaultDeviceData(openvrID);
+                        TrackingPoolManager::updateDeviceMetadata(vrDeviceToPoolIds[openvrID].globalID, data.deviceName, data.serial);
+                    }
+                }
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
     int virtualDeviceCount = 0;
     bool virtualDevices[vr::k_unMaxTrackedDeviceCount]{ false };
     TrackerIDs vrDeviceToPoolIds[vr::k_unMaxTrackedDeviceCount]{};
@@ -222,6 +286,19 @@ private:
         virtualHipsIds.internalID = virtualHipsLocalId;
         virtualHipsIds.globalID = globalID;
     }
+    // The HMD position the hips are worked out from this update - where it was positionLatency ago,
+    // so the hips don't instantly follow every tiny head movement
+    vr::HmdVector3d_t headPosition{ 0, 0, 0 };
+    void updateHeadPosition() {
+        headPosition = KinectSettings::hmdPosition;
+        uint32_t hmdGlobalID = vrDeviceToPoolIds[vr::k_unTrackedDeviceIndex_Hmd].globalID;
+        if (hmdGlobalID == k_invalidTrackerID)
+            return;
+        int64_t latency = int64_t(VirtualHips::settings.positionLatency * 1e9);
+        KVR::PoseSample sample;
+        if (TrackingPoolManager::sampleDevicePoseAt(hmdGlobalID, VRPoseSnapshot::shared().timestamp() - latency, sample))
+            headPosition = sample.position;
+    }
     bool footTrackersAvailable() {
         return
             TrackingPoolManager::leftFootDevicePosGID != k_invalidTrackerID &&
@@ -231,9 +308,9 @@ private:
     }
     void calculateHipMode() {
         // Determine user mode from HMD position
-        if (KinectSettings::hmdPosition.v[1] <= VirtualHips::settings.lyingMaxHeightThreshold)
+        if (headPosition.v[1] <= VirtualHips::settings.lyingMaxHeightThreshold)
             VirtualHips::settings.hipMode = VirtualHipMode::Lying;
-        else if (KinectSettings::hmdPosition.v[1] <= VirtualHips::settings.sittingMaxHeightThreshold)
+        else if (headPosition.v[1] <= VirtualHips::settings.sittingMaxHeightThreshold)
             VirtualHips::settings.hipMode = VirtualHipMode::Sitting;
         else
             VirtualHips::settings.hipMode = VirtualHipMode::Standing;
@@ -242,8 +319,10 @@ private:
     {
         // Get average of feet controller positions
         // NEED TO TAKE INTO ACCOUNT DRIVER-WORLD OFFSET!
-        auto leftData = TrackingPoolManager::getDeviceData(TrackingPoolManager::leftFootDevicePosGID);
-        auto rightData = TrackingPoolManager::getDeviceData(TrackingPoolManager::rightFootDevicePosGID);
+        KVR::TrackedDevicePose leftData;
+        KVR::TrackedDevicePose rightData;
+        TrackingPoolManager::readDevicePose(TrackingPoolManager::leftFootDevicePosGID, leftData);
+        TrackingPoolManager::readDevicePose(TrackingPoolManager::rightFootDevicePosGID, rightData);
 
         vr::HmdVector3d_t leftPos = getWorldPositionFromDriverPose(leftData.pose);
         vr::HmdVector3d_t rightPos = getWorldPositionFromDriverPose(rightData.pose);
@@ -256,7 +335,7 @@ private:
     }
     void calculateStandingPosition(vr::HmdVector3d_t & hipPosition) {
         // Initially use head position, project downwards
-        hipPosition = KinectSettings::hmdPosition;
+        hipPosition = headPosition;
         hipPosition.v[1] -= VirtualHips::settings.heightFromHMD; 
 
         if (VirtualHips::settings.positionAccountsForFootTrackers &&
@@ -270,7 +349,7 @@ private:
     }
     void calculateSittingPosition(vr::HmdVector3d_t & hipPosition) {
         // Initially use head position, project downwards
-        hipPosition = KinectSettings::hmdPosition;
+        hipPosition = headPosition;
         hipPosition.v[1] -= VirtualHips::settings.heightFromHMD; 
 
         // Prevents sinking when head gets closer to ground
@@ -303,7 +382,7 @@ private:
     }
     void calculateLyingPosition(vr::HmdVector3d_t & hipPosition) {
         // Initially use head position, project downwards
-        hipPosition = KinectSettings::hmdPosition;
+        hipPosition = headPosition;
         hipPosition.v[1] -= VirtualHips::settings.heightFromHMD;
 
         // Prevents sinking when head gets closer to ground
@@ -316,7 +395,7 @@ private:
 
         if (footTrackersAvailable()) {
             // Get the point 'd' units along the line from point 'A' to 'B'
-            vr::HmdVector3d_t A = KinectSettings::hmdPosition;
+            vr::HmdVector3d_t A = headPosition;
             vr::HmdVector3d_t B = getAverageFootPosition();
             double ratio = 0.5; // Ratio for how far from the head to the feet the hips are
             double distanceAB = sqrt(
@@ -346,6 +425,7 @@ private:
         // Has access to head point directly, (and controllers if necessary)
         // Needs feet points to be supplied in order to properly predict the hips
 
+        updateHeadPosition();
         calculateHipMode();
 
         // Calculate Position
@@ -407,7 +487,7 @@ private:
             const double maxRotation = M_PI / 4.0; // 45 degrees up
 
             double rotationRatio = (
-                KinectSettings::hmdPosition.v[1] - VirtualHips::settings.heightFromHMD) 
+                headPosition.v[1] - VirtualHips::settings.heightFromHMD) 
                 / (VirtualHips::settings.sittingMaxHeightThreshold - VirtualHips::settings.heightFromHMD);
             double radiansToRotatePitch = -( maxRotation * rotationRatio);
             pitchRotation = vrmath::quaternionFromRotationX(radiansToRotatePitch);
@@ -421,13 +501,12 @@ private:
 
             if (footTrackersAvailable()) {
                 // rotation between
-                auto rawQ = vrmath::get_rotation_between(KinectSettings::hmdPosition, getAverageFootPosition());
+                auto rawQ = vrmath::get_rotation_between(headPosition, getAverageFootPosition());
                 double lookAtYaw = 0;
                 double lookAtPitch = 0;
                 double lookAtRoll = 0;
                 
                 toEulerAngle(rawQ, lookAtPitch, lookAtYaw, lookAtRoll);
-                LOG(INFO) << lookAtYaw;
                 yawRotation = vrmath::quaternionFromRotationY(lookAtYaw);
                 pitchRotation = vrmath::quaternionFromRotationX(lookAtPitch);
                 rollRotation = vrmath::quaternionFromRotationZ(lookAtRoll);
@@ -444,18 +523,18 @@ private:
 
         rotation = yawRotation * pitchRotation * rollRotation; // Right side applied first
 
-        KVR::TrackedDeviceInputData data = defaultDeviceData(virtualHipsLocalId);
-        data.deviceId = virtualHipsIds.globalID;
-        data.position = hipPosition;
-        data.rotation = rotation;
+        KVR::TrackedDevicePose devicePose;
+        devicePose.position = hipPosition;
+        devicePose.rotation = rotation;
+        devicePose.captureTimestamp = KVR::monotonicNanoseconds();
 
-        data.pose = defaultReadyDriverPose();
-        data.pose.vecPosition[0] = hipPosition.v[0];
-        data.pose.vecPosition[1] = hipPosition.v[1];
-        data.pose.vecPosition[2] = hipPosition.v[2];
-        data.pose.qRotation = rotation;
+        devicePose.pose = defaultReadyDriverPose();
+        devicePose.pose.vecPosition[0] = hipPosition.v[0];
+        devicePose.pose.vecPosition[1] = hipPosition.v[1];
+        devicePose.pose.vecPosition[2] = hipPosition.v[2];
+        devicePose.pose.qRotation = rotation;
 
-        TrackingPoolManager::updatePoolWithDevice(data, virtualHipsIds.globalID);
+        TrackingPoolManager::publishDevicePose(virtualHipsIds.globalID, devicePose);
     }
 
     KVR::TrackedDeviceInputData defaultDeviceData(uint32_t localID) {
@@ -480,30 +559,24 @@ private:
         data.rotationTrackingOption = KVR::JointRotationTrackingOption::IMU;
         data.parentHandler = dynamic_cast<DeviceHandler*>(this);
         
-        // Courtesy of https://steamcommunity.com/app/358720/discussions/0/1353742967802223832/
-        std::string modelName = "";
-        std::string serial = "";
-        getVRStringProperty(localID, vr::Prop_ModelNumber_String, modelName);
-        getVRStringProperty(localID, vr::Prop_SerialNumber_String, serial);
-
-        data.deviceName = "SteamVR ID: " + std::to_string(localID) + " " + modelName;
-        data.serial = serial;
+        const VRDeviceMetadata & metadata = deviceMetadata[localID];
+        data.deviceName = "SteamVR ID: " + std::to_string(localID) + " " + metadata.modelName;
+        data.serial = metadata.serial;
         data.deviceId = localID;
         data.customModelName = "vr_controller_vive_1_5";
         return data;
     }
     void getVRStringProperty(const uint32_t &openvrID, vr::ETrackedDeviceProperty strProperty, std::string &string)
     {
+        // Property strings are capped at k_unMaxPropertyStringSize, so one call into a stack buffer is enough
         vr::ETrackedPropertyError peError;
-        uint32_t unRequiredBufferLen = m_VRSystem->GetStringTrackedDeviceProperty(openvrID, strProperty, nullptr, 0, &peError);
-        if (unRequiredBufferLen == 0) {
+        char pchBuffer[vr::k_unMaxPropertyStringSize];
+        uint32_t unRequiredBufferLen = m_VRSystem->GetStringTrackedDeviceProperty(openvrID, strProperty, pchBuffer, vr::k_unMaxPropertyStringSize, &peError);
+        if (unRequiredBufferLen == 0 || peError != vr::TrackedProp_Success) {
             string = "";
         }
         else {
-            char* pchBuffer = new char[unRequiredBufferLen];
-            unRequiredBufferLen = m_VRSystem->GetStringTrackedDeviceProperty(openvrID, strProperty, pchBuffer, unRequiredBufferLen, &peError);
             string = pchBuffer;
-            delete[] pchBuffer;
         }
     }
 };
\ No newline at end of file
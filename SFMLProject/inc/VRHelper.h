@@ -30,6 +30,8 @@ vr::DriverPose_t trackedDeviceToDriverPose(vr::TrackedDevicePose_t tPose);
 vr::HmdVector3d_t getWorldPositionFromDriverPose(vr::DriverPose_t pose);
 
 vr::HmdVector3d_t updateHMDPosAndRot(vr::IVRSystem* &m_sys);
+// Same as above, from poses already fetched this tick (i.e. VRPoseSnapshot)
+vr::HmdVector3d_t updateHMDPosAndRot(const vr::TrackedDevicePose_t* devicePoses);
 
 // Get the quaternion representing the rotation
 vr::HmdQuaternion_t GetVRRotationFromMatrix(vr::HmdMatrix34_t matrix);
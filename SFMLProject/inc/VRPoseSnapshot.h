@@ -0,0 +1,60 @@
+#pragma once
+#include "stdafx.h"
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+
+#include <openvr.h>
+
+#include "LatencyStats.h"
+
+class VRPoseSnapshot {
+    // Every SteamVR device pose, fetched once per tracking tick with a single
+    // GetDeviceToAbsoluteTrackingPose, so the HMD, VRDeviceHandler (and so the virtual hips/pool)
+    // and the controllers all work from the same instant, instead of each asking SteamVR themselves.
+    // The tracking thread owns the fetch and can read poses() directly during its tick,
+    // any other thread (i.e. the GUI's controllers) copies a pose out with readPose()
+public:
+    static VRPoseSnapshot & shared() {
+        static VRPoseSnapshot snapshot;
+        return snapshot;
+    }
+
+    // How far ahead of now SteamVR should predict the poses, 0 for the latest measured pose
+    float predictionSecondsFromNow = 0.0f;
+
+    // Tracking thread only
+    void update(vr::IVRSystem* system) {
+        if (!system)
+            return;
+        system->GetDeviceToAbsoluteTrackingPose(vr::TrackingUniverseStanding, predictionSecondsFromNow, devicePoses, vr::k_unMaxTrackedDeviceCount);
+        fetchTimestamp = KVR::monotonicNanoseconds();
+
+        std::lock_guard<std::mutex> guard(publishedMutex);
+        std::copy(devicePoses, devicePoses + vr::k_unMaxTrackedDeviceCount, publishedPoses);
+        publishedTimestamp = fetchTimestamp;
+    }
+    const vr::TrackedDevicePose_t* poses() const { return devicePoses; }
+    int64_t timestamp() const { return fetchTimestamp; }
+
+    // Any thread. False until the first fetch, so callers can fall back to asking SteamVR directly
+    bool readPose(vr::TrackedDeviceIndex_t deviceIndex, vr::TrackedDevicePose_t & pose) {
+        if (deviceIndex >= vr::k_unMaxTrackedDeviceCount)
+            return false;
+        std::lock_guard<std::mutex> guard(publishedMutex);
+        if (!publishedTimestamp)
+            return false;
+        pose = publishedPoses[deviceIndex];
+        return true;
+    }
+
+private:
+    VRPoseSnapshot() {}
+
+    vr::TrackedDevicePose_t devicePoses[vr::k_unMaxTrackedDeviceCount] = {};
+    int64_t fetchTimestamp = 0;
+
+    std::mutex publishedMutex;
+    vr::TrackedDevicePose_t publishedPoses[vr::k_unMaxTrackedDeviceCount] = {};
+    int64_t publishedTimestamp = 0;
+};
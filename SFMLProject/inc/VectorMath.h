@@ -1,6 +1,6 @@
 #pragma once
 #include "stdafx.h"
-#include <SFML\System\Vector3.hpp>
+#include <SFML/System/Vector3.hpp>
 #include <string>
 namespace KMath {
 #define PI 3.14159265359
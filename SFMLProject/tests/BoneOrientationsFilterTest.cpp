@@ -0,0 +1,145 @@
+#include "stdafx.h"
+#include <cmath>
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include "KinectDoubleExponentialRotationFilter.h"
+#include "QuaternionMath.h"
+
+#ifdef KVR_QUATERNION_SSE
+using namespace KMath::QuaternionSSE;
+
+namespace {
+    // The lane versions use their own acos/sin, so they're held to within a few float ulps of the
+    // single quaternion functions rather than bit-identical
+    const float laneTolerance = 2e-6f;
+
+    float lane(__m128 v, int i) {
+        alignas(16) float values[4];
+        _mm_store_ps(values, v);
+        return values[i];
+    }
+
+    void expectNear(const KMath::Quaternion & expected, const KMath::Quaternion & actual, float tolerance, int index) {
+        EXPECT_NEAR(expected.x, actual.x, tolerance) << "Quaternion " << index;
+        EXPECT_NEAR(expected.y, actual.y, tolerance) << "Quaternion " << index;
+        EXPECT_NEAR(expected.z, actual.z, tolerance) << "Quaternion " << index;
+        EXPECT_NEAR(expected.w, actual.w, tolerance) << "Quaternion " << index;
+    }
+
+    KMath::Quaternion randomRotation(std::mt19937 & random) {
+        std::uniform_real_distribution<float> component(-1.0f, 1.0f);
+        return KMath::normalised(KMath::Quaternion{ component(random), component(random), component(random), component(random) });
+    }
+
+    struct FakeBody : public IBody {
+        Joint joints[JointType_Count];
+        HRESULT GetJoints(UINT capacity, Joint *out) {
+            for (UINT i = 0; i < capacity && i < JointType_Count; ++i)
+                out[i] = joints[i];
+            return S_OK;
+        }
+        HRESULT GetJointOrientations(UINT capacity, JointOrientation *out) {
+            return E_NOTIMPL;
+        }
+    };
+}
+
+TEST(QuaternionLanes, AcosAndSinMatchStd) {
+    auto inRange = [](int i) { return std::fmin(1.0f, -1.0f + i * 0.001f); };
+    for (int i = 0; i <= 2000; i += 4) {
+        __m128 x = _mm_setr_ps(inRange(i), inRange(i + 1), inRange(i + 2), inRange(i + 3));
+        __m128 acosX = acosPerLane(x);
+        for (int l = 0; l < 4; ++l)
+            ASSERT_NEAR(std::acos(lane(x, l)), lane(acosX, l), laneTolerance) << "acos(" << lane(x, l) << ")";
+    }
+    // Slerp only takes the sin of angles up to pi/2 times t, but check further round too
+    for (int i = 0; i < 2000; i += 4) {
+        __m128 x = _mm_setr_ps(-10.0f + i * 0.01f, -10.0f + (i + 1) * 0.01f, -10.0f + (i + 2) * 0.01f, -10.0f + (i + 3) * 0.01f);
+        __m128 sinX = sinPerLane(x);
+        for (int l = 0; l < 4; ++l)
+            ASSERT_NEAR(std::sin(lane(x, l)), lane(sinX, l), laneTolerance) << "sin(" << lane(x, l) << ")";
+    }
+}
+
+TEST(QuaternionLanes, MatchSingleQuaternionFunctions) {
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> amount(0.0f, 1.0f);
+    KMath::Quaternion a[4], b[4], result[4];
+    for (int round = 0; round < 500; ++round) {
+        for (int l = 0; l < 4; ++l) {
+            a[l] = randomRotation(random);
+            b[l] = randomRotation(random);
+        }
+        // One lane of each of slerp's special cases: the same, nearly the same, and the other side of the sphere
+        b[1] = a[1];
+        b[2] = KMath::normalised(KMath::Quaternion{ a[2].x + 0.001f, a[2].y, a[2].z, a[2].w });
+        b[3] = KMath::negated(b[3]);
+        float t = amount(random);
+
+        store4(result, slerp(load4(a), load4(b), _mm_set1_ps(t)));
+        for (int l = 0; l < 4; ++l)
+            expectNear(KMath::slerp(a[l], b[l], t), result[l], laneTolerance, l);
+
+        store4(result, rotationBetween(load4(a), load4(b)));
+        for (int l = 0; l < 4; ++l)
+            expectNear(KMath::rotationBetween(a[l], b[l]), result[l], laneTolerance, l);
+
+        store4(result, multiply(load4(a), load4(b)));
+        for (int l = 0; l < 4; ++l)
+            expectNear(KMath::multiply(a[l], b[l]), result[l], laneTolerance, l);
+
+        __m128 angles = angle(load4(a));
+        for (int l = 0; l < 4; ++l)
+            EXPECT_NEAR(KMath::angle(a[l]), lane(angles, l), laneTolerance);
+        if (HasFailure())
+            return;
+    }
+}
+
+TEST(QuaternionLanes, ZeroQuaternions) {
+    KMath::Quaternion zeros[4] = {};
+    KMath::Quaternion result[4];
+    store4(result, normalise(load4(zeros)));
+    for (int l = 0; l < 4; ++l)
+        EXPECT_TRUE(KMath::equal(KMath::Quaternion{ 0, 0, 0, 0 }, result[l]));
+    store4(result, inverse(load4(zeros)));
+    for (int l = 0; l < 4; ++l)
+        EXPECT_TRUE(KMath::equal(KMath::identityQuaternion(), result[l]));
+}
+
+TEST(BoneOrientationsFilter, SSEMatchesPerJoint) {
+    // Every joint turning on its own, some inferred or dropping out on their own schedules,
+    // so each lane is at a different point of the filter's warm up when its neighbours aren't
+    std::mt19937 random(4321);
+    std::uniform_real_distribution<float> noise(-1.0f, 1.0f);
+    DoubleExpBoneOrientationsFilter perJointFilter;
+    DoubleExpBoneOrientationsFilter sseFilter;
+    FakeBody body;
+    JointOrientation orientations[JointType_Count];
+    for (int frame = 0; frame < 3000; ++frame) {
+        for (int j = 0; j < JointType_Count; ++j) {
+            bool tracked = ((frame + j * 7) % (11 + j)) > 2;
+            body.joints[j].JointType = JointType(j);
+            body.joints[j].Position = { tracked ? 0.1f * j : 0.0f, tracked ? 1.0f : 0.0f, tracked ? 2.0f : 0.0f };
+            body.joints[j].TrackingState = !tracked ? TrackingState_NotTracked : (((frame + j) % 13) == 0 ? TrackingState_Inferred : TrackingState_Tracked);
+            // Mostly small turns a frame, with the odd big jump
+            float angle = 0.5f * std::sin(frame * 0.03f + j) + noise(random) * (((frame + j) % 50) == 0 ? 1.0f : 0.02f);
+            orientations[j].JointType = JointType(j);
+            orientations[j].Orientation = KMath::fromQuaternion<Vector4>(KMath::normalised(
+                KMath::Quaternion{ 0.3f * std::sin(angle / 2), std::sin(angle / 2), 0.0f, std::cos(angle / 2) }));
+        }
+        perJointFilter.UpdateFilterPerJoint(&body, orientations);
+        sseFilter.UpdateFilter(&body, orientations);
+        for (int j = 0; j < JointType_Count; ++j) {
+            const Vector4 & expected = perJointFilter.GetFilteredJoints()[j];
+            const Vector4 & actual = sseFilter.GetFilteredJoints()[j];
+            ASSERT_NEAR(expected.x, actual.x, 1e-5f) << "Joint " << j << ", frame " << frame;
+            ASSERT_NEAR(expected.y, actual.y, 1e-5f) << "Joint " << j << ", frame " << frame;
+            ASSERT_NEAR(expected.z, actual.z, 1e-5f) << "Joint " << j << ", frame " << frame;
+            ASSERT_NEAR(expected.w, actual.w, 1e-5f) << "Joint " << j << ", frame " << frame;
+        }
+    }
+}
+#endif
@@ -0,0 +1,18 @@
+#include "stdafx.h"
+#include <cstdlib>
+
+#include "JointSmoothingKernel.h"
+
+// Times the per-joint scalar smoothing against smoothJoints (SSE where it's available) over the same
+// synthetic skeleton, and reports how far apart their outputs got, which should be 0.
+//   JointSmoothingBenchmark [frames]
+
+int main(int argc, char ** argv) {
+    int frames = argc > 1 ? std::atoi(argv[1]) : 100000;
+    if (frames <= 0)
+        frames = 100000;
+
+    // Logs its own result
+    KVR::JointSmoothingBenchmarkResult result = KVR::runJointSmoothingBenchmark(frames);
+    return result.maxDifference == 0.0f ? 0 : 1;
+}
@@ -0,0 +1,105 @@
+#include "stdafx.h"
+#include <cstdint>
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include "JointSmoothingKernel.h"
+
+#ifdef KVR_JOINT_SMOOTHING_SSE
+namespace {
+    const KVR::JointSmoothingParams testParams{ 0.25f, 0.25f, 0.25f, 0.03f, 0.05f };
+
+    void expectSameOutput(const KVR::JointSmoothingOutput & scalar, const KVR::JointSmoothingOutput & sse, int frame) {
+        for (int j = 0; j < KVR::jointSmoothingLanes; ++j) {
+            ASSERT_EQ(scalar.x[j], sse.x[j]) << "Joint " << j << " x, frame " << frame;
+            ASSERT_EQ(scalar.y[j], sse.y[j]) << "Joint " << j << " y, frame " << frame;
+            ASSERT_EQ(scalar.z[j], sse.z[j]) << "Joint " << j << " z, frame " << frame;
+        }
+    }
+    void expectSameState(const KVR::JointSmoothingState & scalar, const KVR::JointSmoothingState & sse, int frame) {
+        for (int j = 0; j < KVR::jointSmoothingLanes; ++j) {
+            ASSERT_EQ(scalar.frameCount[j], sse.frameCount[j]) << "Joint " << j << ", frame " << frame;
+            ASSERT_EQ(scalar.filteredX[j], sse.filteredX[j]) << "Joint " << j << ", frame " << frame;
+            ASSERT_EQ(scalar.filteredY[j], sse.filteredY[j]) << "Joint " << j << ", frame " << frame;
+            ASSERT_EQ(scalar.filteredZ[j], sse.filteredZ[j]) << "Joint " << j << ", frame " << frame;
+            ASSERT_EQ(scalar.trendX[j], sse.trendX[j]) << "Joint " << j << ", frame " << frame;
+            ASSERT_EQ(scalar.trendY[j], sse.trendY[j]) << "Joint " << j << ", frame " << frame;
+            ASSERT_EQ(scalar.trendZ[j], sse.trendZ[j]) << "Joint " << j << ", frame " << frame;
+        }
+    }
+
+    // Feeds both paths the same frames, and holds them to bit-identical results after every one
+    template <typename MakeFrame>
+    void runBothPaths(int frames, MakeFrame makeFrame) {
+        KVR::JointSmoothingInput input;
+        KVR::JointSmoothingState scalarState;
+        KVR::JointSmoothingState sseState;
+        KVR::JointSmoothingOutput scalarOutput;
+        KVR::JointSmoothingOutput sseOutput;
+        for (int frame = 0; frame < frames; ++frame) {
+            bool newFrameArrived = makeFrame(frame, input);
+            KVR::smoothJointsScalar(testParams, input, newFrameArrived, scalarState, scalarOutput);
+            KVR::smoothJointsSSE(testParams, input, newFrameArrived, sseState, sseOutput);
+            expectSameOutput(scalarOutput, sseOutput, frame);
+            expectSameState(scalarState, sseState, frame);
+            if (::testing::Test::HasFatalFailure())
+                return;
+        }
+    }
+}
+
+TEST(JointSmoothingKernel, SSEMatchesScalarOnNoisySkeleton) {
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> noise(-0.5f, 0.5f);
+    runBothPaths(5000, [&](int frame, KVR::JointSmoothingInput & input) {
+        for (int j = 0; j < 25; ++j) {
+            input.x[j] += noise(random) * 0.05f;
+            input.y[j] = 1.0f + j * 0.05f + noise(random) * 0.02f;
+            input.z[j] = 2.0f + noise(random) * 0.04f;
+            input.inferred[j] = noise(random) > 0.3f ? -1 : 0;
+            if (noise(random) > 0.45f) {
+                input.x[j] = 0.0f;
+                input.y[j] = 0.0f;
+                input.z[j] = 0.0f;
+            }
+        }
+        return (frame % 4) != 3;
+    });
+}
+
+TEST(JointSmoothingKernel, SSEMatchesScalarThroughWarmUpAndDropouts) {
+    // Every joint drops out and comes back on its own schedule, so each lane is at a different
+    // point of the filter's warm up when its neighbours aren't
+    runBothPaths(400, [](int frame, KVR::JointSmoothingInput & input) {
+        for (int j = 0; j < 25; ++j) {
+            bool tracked = ((frame + j * 7) % (11 + j)) > 2;
+            input.x[j] = tracked ? 0.1f * j + 0.01f * frame : 0.0f;
+            input.y[j] = tracked ? 1.0f - 0.02f * j : 0.0f;
+            input.z[j] = tracked ? 2.0f + 0.3f * ((frame / 5) % 2) : 0.0f;
+            input.inferred[j] = ((frame + j) % 13) == 0 ? -1 : 0;
+        }
+        return frame % 3 != 0;
+    });
+}
+
+TEST(JointSmoothingKernel, SSEMatchesScalarOnLargeJumps) {
+    // Jumps bigger than maxDeviationRadius, so the deviation clamp is hit in every lane
+    runBothPaths(200, [](int frame, KVR::JointSmoothingInput & input) {
+        for (int j = 0; j < 25; ++j) {
+            float step = (frame % 10 < 5) ? 1.0f : -1.0f;
+            input.x[j] = step * (0.5f + j * 0.01f);
+            input.y[j] = 1.0f + step * 0.2f;
+            input.z[j] = 2.0f - step * 0.3f;
+            input.inferred[j] = (j % 2) ? -1 : 0;
+        }
+        return true;
+    });
+}
+#endif
+
+TEST(JointSmoothingKernel, BenchmarkPathsAgree) {
+    KVR::JointSmoothingBenchmarkResult result = KVR::runJointSmoothingBenchmark(2000);
+    EXPECT_EQ(2000, result.frames);
+    EXPECT_EQ(0.0f, result.maxDifference);
+}
@@ -0,0 +1,165 @@
+#include "stdafx.h"
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "KinectPreview.h"
+
+namespace {
+    // Plain per-pixel versions of the preview's conversions, to hold the SSE2 paths to
+    std::vector<uint8_t> referenceHalve(const std::vector<uint8_t> & src, int width, int height, size_t stride) {
+        std::vector<uint8_t> dst(size_t(width / 2) * (height / 2) * 4);
+        for (int y = 0; y < height / 2; ++y) {
+            for (int x = 0; x < width / 2; ++x) {
+                for (int c = 0; c < 4; ++c) {
+                    int topLeft = src[2 * y * stride + x * 8 + c];
+                    int topRight = src[2 * y * stride + x * 8 + 4 + c];
+                    int bottomLeft = src[(2 * y + 1) * stride + x * 8 + c];
+                    int bottomRight = src[(2 * y + 1) * stride + x * 8 + 4 + c];
+                    int left = (topLeft + bottomLeft + 1) >> 1;
+                    int right = (topRight + bottomRight + 1) >> 1;
+                    dst[(size_t(y) * (width / 2) + x) * 4 + c] = uint8_t((left + right + 1) >> 1);
+                }
+            }
+        }
+        return dst;
+    }
+    std::vector<uint8_t> referenceToRGBA(const std::vector<uint8_t> & src, int width, int height, size_t stride) {
+        std::vector<uint8_t> dst(size_t(width) * height * 4);
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                const uint8_t* in = &src[y * stride + x * 4];
+                uint8_t* out = &dst[(size_t(y) * width + x) * 4];
+                out[0] = in[2];
+                out[1] = in[1];
+                out[2] = in[0];
+                out[3] = 0xFF;
+            }
+        }
+        return dst;
+    }
+    std::vector<uint8_t> randomImage(size_t bytes, uint32_t seed) {
+        std::mt19937 random(seed);
+        std::vector<uint8_t> image(bytes);
+        for (uint8_t & byte : image)
+            byte = uint8_t(random());
+        return image;
+    }
+    std::vector<uint8_t> solidImage(int width, int height, uint8_t b, uint8_t g, uint8_t r) {
+        std::vector<uint8_t> image(size_t(width) * height * 4);
+        for (size_t i = 0; i < image.size(); i += 4) {
+            image[i + 0] = b;
+            image[i + 1] = g;
+            image[i + 2] = r;
+            image[i + 3] = 0;
+        }
+        return image;
+    }
+}
+
+TEST(KinectPreview, HalveMatchesPlainLoop) {
+    // Widths that do and don't fill whole SSE2 blocks, with and without row padding
+    const int sizes[][2] = { { 640, 480 }, { 1920, 1080 }, { 22, 6 }, { 7, 3 } };
+    for (auto & size : sizes) {
+        int width = size[0];
+        int height = size[1];
+        for (size_t padding : { size_t(0), size_t(12) }) {
+            size_t stride = size_t(width) * 4 + padding;
+            std::vector<uint8_t> src = randomImage(stride * height, uint32_t(width * 31 + padding));
+            std::vector<uint8_t> halved(size_t(width / 2) * (height / 2) * 4);
+            KVR::halveBGRA(src.data(), width, height, stride, halved.data());
+            EXPECT_EQ(referenceHalve(src, width, height, stride), halved) << width << "x" << height << " + " << padding;
+        }
+    }
+}
+
+TEST(KinectPreview, ConvertMatchesPlainLoop) {
+    const int sizes[][2] = { { 640, 480 }, { 13, 5 } };
+    for (auto & size : sizes) {
+        int width = size[0];
+        int height = size[1];
+        size_t stride = size_t(width) * 4 + 8;
+        std::vector<uint8_t> src = randomImage(stride * height, uint32_t(width));
+        std::vector<uint8_t> converted(size_t(width) * height * 4);
+        KVR::convertBGRAToRGBA(src.data(), width, height, stride, converted.data());
+        EXPECT_EQ(referenceToRGBA(src, width, height, stride), converted) << width << "x" << height;
+    }
+}
+
+TEST(KinectPreview, PresentsOnlyWhenThereIsANewFrame) {
+    KVR::KinectPreview preview;
+    KVR::MemoryPreviewTarget target;
+    EXPECT_FALSE(preview.render(target, 160, 120));
+    EXPECT_EQ(0u, target.presentedFrames);
+
+    std::vector<uint8_t> frame = solidImage(640, 480, 10, 20, 30);
+    preview.submitFrame(frame.data(), 640, 480, 640 * 4);
+    EXPECT_TRUE(preview.render(target, 160, 120));
+    EXPECT_EQ(1u, target.presentedFrames);
+
+    // Drawing again without a new frame shouldn't upload anything
+    EXPECT_FALSE(preview.render(target, 160, 120));
+    EXPECT_FALSE(preview.render(target, 160, 120));
+    EXPECT_EQ(1u, target.presentedFrames);
+
+    preview.submitFrame(frame.data(), 640, 480, 640 * 4);
+    EXPECT_TRUE(preview.render(target, 160, 120));
+    EXPECT_EQ(2u, target.presentedFrames);
+}
+
+TEST(KinectPreview, DownsamplesTowardsTargetSize) {
+    KVR::KinectPreview preview;
+    KVR::MemoryPreviewTarget target;
+    std::vector<uint8_t> frame = solidImage(640, 480, 10, 20, 30);
+
+    // Halved while both sides stay at least the target's
+    preview.submitFrame(frame.data(), 640, 480, 640 * 4);
+    ASSERT_TRUE(preview.render(target, 150, 100));
+    EXPECT_EQ(160, target.width);
+    EXPECT_EQ(120, target.height);
+    ASSERT_EQ(size_t(160 * 120 * 4), target.pixels.size());
+    // BGRA in, opaque RGBA out
+    EXPECT_EQ(30, target.pixels[0]);
+    EXPECT_EQ(20, target.pixels[1]);
+    EXPECT_EQ(10, target.pixels[2]);
+    EXPECT_EQ(255, target.pixels[3]);
+
+    // A target bigger than the frame gets it at full size
+    preview.submitFrame(frame.data(), 640, 480, 640 * 4);
+    ASSERT_TRUE(preview.render(target, 1280, 960));
+    EXPECT_EQ(640, target.width);
+    EXPECT_EQ(480, target.height);
+}
+
+TEST(KinectPreview, OnlyNewestStagedFrameIsPresented) {
+    KVR::KinectPreview preview;
+    KVR::MemoryPreviewTarget target;
+    const int width = 64;
+    const int height = 48;
+    // Rows padded, as the sensors' buffers can be
+    const size_t stride = width * 4 + 16;
+    for (uint8_t shade = 1; shade <= 5; ++shade) {
+        std::vector<uint8_t> frame(stride * height, 0);
+        for (int y = 0; y < height; ++y)
+            for (int x = 0; x < width; ++x)
+                frame[y * stride + x * 4] = shade;
+        preview.submitFrame(frame.data(), width, height, stride);
+    }
+    ASSERT_TRUE(preview.render(target, width, height));
+    EXPECT_EQ(1u, target.presentedFrames);
+    ASSERT_EQ(size_t(width * height * 4), target.pixels.size());
+    for (size_t i = 0; i < target.pixels.size(); i += 4)
+        ASSERT_EQ(5, target.pixels[i + 2]);
+    EXPECT_FALSE(preview.render(target, width, height));
+}
+
+TEST(KinectPreview, IgnoresEmptyFrames) {
+    KVR::KinectPreview preview;
+    KVR::MemoryPreviewTarget target;
+    preview.submitFrame(nullptr, 640, 480, 640 * 4);
+    uint8_t pixel[4] = {};
+    preview.submitFrame(pixel, 0, 480, 0);
+    EXPECT_FALSE(preview.render(target, 160, 120));
+}
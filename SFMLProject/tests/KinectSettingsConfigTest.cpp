@@ -0,0 +1,57 @@
+#include "stdafx.h"
+#include <sstream>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "KinectSettingsConfig.h"
+
+namespace {
+    // As cereal wrote it from writeKinectSettings, before the prediction look ahead was added
+    const char * const configWithoutLookAhead = R"({
+    "kRotation": { "value0": 0.0, "value1": 1.5, "value2": 0.0 },
+    "kPosition": { "value0": 0.1, "value1": 0.2, "value2": 0.3 },
+    "hipRoleHeightAdjust": 0.05,
+    "globalFontSize": 14.0,
+    "secondaryTrackingOriginOffset": { "value0": 0.5, "value1": 0.0, "value2": -0.5 }
+})";
+
+    const char * const currentConfig = R"({
+    "kRotation": { "value0": 0.0, "value1": 1.5, "value2": 0.0 },
+    "kPosition": { "value0": 0.1, "value1": 0.2, "value2": 0.3 },
+    "hipRoleHeightAdjust": 0.05,
+    "globalFontSize": 14.0,
+    "secondaryTrackingOriginOffset": { "value0": 0.5, "value1": 0.0, "value2": -0.5 },
+    "trackerPredictionLookAhead": 0.02
+})";
+}
+
+TEST(KinectSettingsConfig, OlderConfigKeepsDefaultLookAhead) {
+    std::istringstream is(configWithoutLookAhead);
+    KinectSettings::ConfigValues config;
+    config.predictionLookAhead = 0.04;
+    EXPECT_TRUE(KinectSettings::readConfig(is, config));
+
+    EXPECT_EQ(0.04, config.predictionLookAhead);
+    // Everything before it was still read
+    EXPECT_FLOAT_EQ(1.5f, config.rot[1]);
+    EXPECT_FLOAT_EQ(0.3f, config.pos[2]);
+    EXPECT_DOUBLE_EQ(0.05, config.hipHeight);
+    EXPECT_FLOAT_EQ(14.f, config.fontSize);
+    EXPECT_DOUBLE_EQ(-0.5, config.secondaryTrackingOriginOffset.v[2]);
+}
+
+TEST(KinectSettingsConfig, CurrentConfigReadsLookAhead) {
+    std::istringstream is(currentConfig);
+    KinectSettings::ConfigValues config;
+    EXPECT_TRUE(KinectSettings::readConfig(is, config));
+    EXPECT_DOUBLE_EQ(0.02, config.predictionLookAhead);
+    EXPECT_FLOAT_EQ(14.f, config.fontSize);
+}
+
+TEST(KinectSettingsConfig, BrokenConfigDoesNotThrow) {
+    std::istringstream is(R"({ "kRotation": { "value0": 0.0, )");
+    KinectSettings::ConfigValues config;
+    EXPECT_FALSE(KinectSettings::readConfig(is, config));
+    EXPECT_EQ(0.04, config.predictionLookAhead);
+}
@@ -0,0 +1,183 @@
+#include "stdafx.h"
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "KinectJointFilter.h"
+#include "KinectDoubleExponentialRotationFilter.h"
+#include "KinectOrientationFilter.h"
+#include "PipelineBenchmark.h"
+
+// Every stage between the sensor and the trackers, each timed on its own:
+//  - the v2 joint position filter (DoubleExponentialFilter)
+//  - the v2 bone orientation filter (DoubleExpBoneOrientationsFilter), one joint at a time and four at a time
+//  - the v1 rotation smoothing filter (RotationalSmoothingFilter)
+//  - SkeletonTracker's pose generation (vrmath, calibration) through the tracking pool and back out to a tracker per joint
+// Reported in ns/frame and ns/joint, as the baseline to compare pipeline changes against.
+//   PipelineBenchmark [frames] [recorded session]
+// Without a recorded session, the skeleton stage runs on a generated one, the filters always do
+
+namespace {
+    // A person swaying on the spot with some sensor noise, a few joints inferred or lost now and then
+    struct GeneratedSkeleton {
+        std::mt19937 random{ 1234 };
+        std::uniform_real_distribution<float> noise{ -1.0f, 1.0f };
+
+        float sway(int frame) const { return 0.1f * std::sin(frame * 0.1f); }
+        float jitter() { return noise(random) * 0.005f; }
+        // Mostly tracked, occasionally inferred or not tracked at all
+        int trackingState(int frame, int joint) {
+            int phase = (frame + joint * 13) % 97;
+            return phase == 0 ? 0 : (phase < 4 ? 1 : 2);
+        }
+        KMath::Quaternion rotation(int frame, int joint) {
+            float angle = 0.3f * std::sin(frame * 0.05f + joint) + noise(random) * 0.01f;
+            return KMath::normalised(KMath::Quaternion{ 0.0f, std::sin(angle / 2), 0.0f, std::cos(angle / 2) });
+        }
+    };
+
+    struct GeneratedBody : public IBody {
+        Joint joints[JointType_Count];
+        HRESULT GetJoints(UINT capacity, Joint *out) {
+            for (UINT i = 0; i < capacity && i < JointType_Count; ++i)
+                out[i] = joints[i];
+            return S_OK;
+        }
+        HRESULT GetJointOrientations(UINT capacity, JointOrientation *out) {
+            return E_NOTIMPL;
+        }
+    };
+
+    void fillV2Joints(GeneratedSkeleton & generator, int frame, Joint * joints, JointOrientation * orientations) {
+        for (int j = 0; j < JointType_Count; ++j) {
+            joints[j].JointType = JointType(j);
+            joints[j].Position = { generator.sway(frame) + 0.01f * j + generator.jitter(), 1.5f - 0.06f * j + generator.jitter(), 2.0f + generator.jitter() };
+            joints[j].TrackingState = TrackingState(generator.trackingState(frame, j));
+            orientations[j].JointType = JointType(j);
+            orientations[j].Orientation = KMath::fromQuaternion<Vector4>(generator.rotation(frame, j));
+        }
+    }
+
+    KVR::PipelineBenchmarkResult benchmarkJointFilter(int frames) {
+        GeneratedSkeleton generator;
+        DoubleExponentialFilter filter;
+        Joint joints[JointType_Count];
+        JointOrientation orientations[JointType_Count];
+        std::vector<int64_t> frameNanoseconds;
+        frameNanoseconds.reserve(frames);
+        for (int frame = 0; frame < frames; ++frame) {
+            fillV2Joints(generator, frame, joints, orientations);
+            int64_t start = KVR::monotonicNanoseconds();
+            filter.update(joints, true);
+            frameNanoseconds.push_back(KVR::monotonicNanoseconds() - start);
+        }
+        return KVR::summariseFrameTimes(frameNanoseconds, JointType_Count);
+    }
+
+    // The per-joint reference and UpdateFilter (SSE where it's available) on the same frames
+    struct BoneOrientationBenchmarkResult {
+        KVR::PipelineBenchmarkResult perJoint;
+        KVR::PipelineBenchmarkResult batch;
+        float maxDifference = 0.0f;
+    };
+    BoneOrientationBenchmarkResult benchmarkBoneOrientationFilter(int frames) {
+        GeneratedSkeleton generator;
+        DoubleExpBoneOrientationsFilter perJointFilter;
+        DoubleExpBoneOrientationsFilter batchFilter;
+        GeneratedBody body;
+        JointOrientation orientations[JointType_Count];
+        std::vector<int64_t> perJointNanoseconds;
+        std::vector<int64_t> batchNanoseconds;
+        perJointNanoseconds.reserve(frames);
+        batchNanoseconds.reserve(frames);
+        BoneOrientationBenchmarkResult result;
+        for (int frame = 0; frame < frames; ++frame) {
+            fillV2Joints(generator, frame, body.joints, orientations);
+            int64_t start = KVR::monotonicNanoseconds();
+            perJointFilter.UpdateFilterPerJoint(&body, orientations);
+            int64_t middle = KVR::monotonicNanoseconds();
+            batchFilter.UpdateFilter(&body, orientations);
+            int64_t end = KVR::monotonicNanoseconds();
+            perJointNanoseconds.push_back(middle - start);
+            batchNanoseconds.push_back(end - middle);
+
+            for (int j = 0; j < JointType_Count; ++j) {
+                const Vector4 & a = perJointFilter.GetFilteredJoints()[j];
+                const Vector4 & b = batchFilter.GetFilteredJoints()[j];
+                float difference = std::fmax(std::fmax(std::fabs(a.x - b.x), std::fabs(a.y - b.y)), std::fmax(std::fabs(a.z - b.z), std::fabs(a.w - b.w)));
+                result.maxDifference = std::fmax(result.maxDifference, difference);
+            }
+        }
+        result.perJoint = KVR::summariseFrameTimes(perJointNanoseconds, JointType_Count);
+        result.batch = KVR::summariseFrameTimes(batchNanoseconds, JointType_Count);
+        return result;
+    }
+
+    KVR::PipelineBenchmarkResult benchmarkRotationalSmoothingFilter(int frames) {
+        GeneratedSkeleton generator;
+        RotationalSmoothingFilter filter;
+        NUI_SKELETON_BONE_ORIENTATION bones[NUI_SKELETON_POSITION_COUNT] = {};
+        std::vector<int64_t> frameNanoseconds;
+        frameNanoseconds.reserve(frames);
+        for (int frame = 0; frame < frames; ++frame) {
+            for (int j = 0; j < NUI_SKELETON_POSITION_COUNT; ++j)
+                bones[j].absoluteRotation.rotationQuaternion = KMath::fromQuaternion<Vector4>(generator.rotation(frame, j));
+            int64_t start = KVR::monotonicNanoseconds();
+            filter.update(bones);
+            frameNanoseconds.push_back(KVR::monotonicNanoseconds() - start);
+        }
+        return KVR::summariseFrameTimes(frameNanoseconds, NUI_SKELETON_POSITION_COUNT);
+    }
+
+    std::shared_ptr<KVR::SessionPlayback> generatedSession(int frames) {
+        GeneratedSkeleton generator;
+        auto playback = std::make_shared<KVR::SessionPlayback>();
+        playback->kinectVersion = KinectVersion::Version2;
+        playback->skeletons.reserve(frames);
+        const int64_t frameInterval = 1000000000 / 30;
+        for (int frame = 0; frame < frames; ++frame) {
+            KVR::SkeletonFrame skeleton;
+            skeleton.captureTimestamp = (frame + 1) * frameInterval;
+            skeleton.isTracking = 1;
+            for (int j = 0; j < KVR::KinectJointCount; ++j) {
+                skeleton.setJoint(j, KVR::JointTrackingState(generator.trackingState(frame, j)),
+                    generator.sway(frame) + 0.01f * j + generator.jitter(), 1.5f - 0.06f * j + generator.jitter(), 2.0f + generator.jitter());
+                KMath::Quaternion q = generator.rotation(frame, j);
+                skeleton.setOrientations(j, q.w, q.x, q.y, q.z, q.w, q.x, q.y, q.z);
+            }
+            playback->skeletons.push_back(skeleton);
+        }
+        return playback;
+    }
+
+    std::shared_ptr<KVR::SessionPlayback> recordedSession(const std::string & path) {
+        auto playback = std::make_shared<KVR::SessionPlayback>();
+        if (!playback->open(std::wstring(path.begin(), path.end())))
+            return nullptr;
+        return playback;
+    }
+}
+
+int main(int argc, char ** argv) {
+    int frames = argc > 1 ? std::atoi(argv[1]) : 20000;
+    if (frames <= 0)
+        frames = 20000;
+
+    KVR::logPipelineBenchmark("DoubleExponentialFilter", benchmarkJointFilter(frames));
+    BoneOrientationBenchmarkResult boneOrientations = benchmarkBoneOrientationFilter(frames);
+    KVR::logPipelineBenchmark("DoubleExpBoneOrientationsFilter (per joint)", boneOrientations.perJoint);
+    KVR::logPipelineBenchmark("DoubleExpBoneOrientationsFilter", boneOrientations.batch);
+    LOG(INFO) << "DoubleExpBoneOrientationsFilter max difference from per joint: " << boneOrientations.maxDifference;
+    KVR::logPipelineBenchmark("RotationalSmoothingFilter", benchmarkRotationalSmoothingFilter(frames));
+
+    std::shared_ptr<KVR::SessionPlayback> playback = argc > 2 ? recordedSession(argv[2]) : generatedSession(frames);
+    if (!playback)
+        return 1;
+    // Each pass over a recorded session is its length, so make up roughly the same number of frames
+    int passes = argc > 2 ? std::max<int>(1, frames / std::max<size_t>(1, playback->skeletons.size())) : 1;
+    KVR::PipelineBenchmarkResult pipeline = KVR::runPipelineBenchmark(playback, passes);
+    return pipeline.frames ? 0 : 1;
+}
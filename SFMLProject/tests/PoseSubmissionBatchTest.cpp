@@ -0,0 +1,89 @@
+#include "stdafx.h"
+
+#include <gtest/gtest.h>
+
+#include "FakeInputEmulator.h"
+#include "PoseSubmissionBatch.h"
+
+namespace {
+    vr::DriverPose_t poseAt(double x) {
+        vr::DriverPose_t pose = {};
+        pose.qRotation = { 1, 0, 0, 0 };
+        pose.vecPosition[0] = x;
+        pose.poseIsValid = true;
+        return pose;
+    }
+
+    class PoseSubmissionBatchTest : public ::testing::Test {
+    protected:
+        void SetUp() override {
+            FakeInputEmulator::reset();
+        }
+        vrinputemulator::VRInputEmulator inputEmulator;
+        KVR::PoseSubmissionBatch batch;
+    };
+}
+
+TEST_F(PoseSubmissionBatchTest, NothingSentUntilFlush) {
+    batch.queue(inputEmulator, 1, poseAt(1), 0);
+    batch.queue(inputEmulator, 2, poseAt(2), 0);
+    EXPECT_EQ(2, batch.size());
+    EXPECT_EQ(0u, FakeInputEmulator::sentPoseCount());
+}
+
+TEST_F(PoseSubmissionBatchTest, NewestPosePerDeviceFlushedOnce) {
+    batch.queue(inputEmulator, 1, poseAt(1), 0);
+    batch.queue(inputEmulator, 2, poseAt(20), 0);
+    batch.queue(inputEmulator, 1, poseAt(2), 0);
+    batch.queue(inputEmulator, 1, poseAt(3), 0);
+
+    EXPECT_EQ(2, batch.flush());
+    ASSERT_EQ(2u, FakeInputEmulator::sentPoseCount());
+    const FakeInputEmulator::SentPose & first = FakeInputEmulator::sentPose(0);
+    const FakeInputEmulator::SentPose & second = FakeInputEmulator::sentPose(1);
+    EXPECT_EQ(1u, first.deviceId);
+    EXPECT_EQ(3.0, first.pose.vecPosition[0]);
+    EXPECT_EQ(2u, second.deviceId);
+    EXPECT_EQ(20.0, second.pose.vecPosition[0]);
+    // Nothing waits on a reply from the driver
+    EXPECT_FALSE(first.modal);
+    EXPECT_FALSE(second.modal);
+
+    // The next tick starts empty
+    EXPECT_EQ(0, batch.size());
+    EXPECT_EQ(0, batch.flush());
+    EXPECT_EQ(2u, FakeInputEmulator::sentPoseCount());
+}
+
+TEST_F(PoseSubmissionBatchTest, SameDeviceIdOnAnotherInputEmulatorIsSeparate) {
+    vrinputemulator::VRInputEmulator otherInputEmulator;
+    batch.queue(inputEmulator, 1, poseAt(1), 0);
+    batch.queue(otherInputEmulator, 1, poseAt(2), 0);
+
+    EXPECT_EQ(2, batch.flush());
+    ASSERT_EQ(2u, FakeInputEmulator::sentPoseCount());
+    EXPECT_EQ(&inputEmulator, FakeInputEmulator::sentPose(0).inputEmulator);
+    EXPECT_EQ(&otherInputEmulator, FakeInputEmulator::sentPose(1).inputEmulator);
+}
+
+TEST_F(PoseSubmissionBatchTest, DevicesPastCapacityAreSentStraightAway) {
+    const int maxPoses = KVR::PoseSubmissionBatch::maxPoses;
+    for (int device = 0; device < maxPoses; ++device)
+        batch.queue(inputEmulator, device, poseAt(device), 0);
+    EXPECT_EQ(0u, FakeInputEmulator::sentPoseCount());
+
+    batch.queue(inputEmulator, 100, poseAt(100), 0);
+    ASSERT_EQ(1u, FakeInputEmulator::sentPoseCount());
+    EXPECT_EQ(100u, FakeInputEmulator::sentPose(0).deviceId);
+
+    EXPECT_EQ(maxPoses, batch.flush());
+    EXPECT_EQ(uint64_t(maxPoses) + 1, FakeInputEmulator::sentPoseCount());
+}
+
+TEST_F(PoseSubmissionBatchTest, OnlyTimestampedPosesCountTowardsLatency) {
+    KVR::LatencyHistogram captureToPublish;
+    batch.queue(inputEmulator, 1, poseAt(1), KVR::monotonicNanoseconds());
+    batch.queue(inputEmulator, 2, poseAt(2), 0);
+    batch.flush(nullptr, &captureToPublish);
+    EXPECT_EQ(1u, captureToPublish.count());
+}
@@ -0,0 +1,111 @@
+#include "stdafx.h"
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <boost/interprocess/ipc/message_queue.hpp>
+
+#include "LatencyStats.h"
+#include "SharedPoseRing.h"
+
+// How long one pose takes from the producer to a consumer polling for it, through the shared pose ring,
+// and through a message queue carrying the same InputEmulator SetDevicePose request it would otherwise be sent as.
+// The consumer is a thread here rather than the driver, so this is the transports' own latency, not SteamVR's.
+// Each pose waits for the last to be received, so it's one-way latency rather than throughput.
+//   SharedPoseRingBenchmark [poses]
+
+namespace {
+    const char * const benchmarkQueueName = "KinectToVR_PoseBenchmarkQueue";
+
+    vr::DriverPose_t benchmarkPose(int i) {
+        vr::DriverPose_t pose = {};
+        pose.qRotation = { 1, 0, 0, 0 };
+        pose.vecPosition[0] = i;
+        pose.poseIsValid = true;
+        pose.deviceIsConnected = true;
+        return pose;
+    }
+
+    KVR::LatencyHistogram benchmarkSharedRing(int poseCount) {
+        KVR::LatencyHistogram latency;
+        KVR::SharedPoseRingWriter writer;
+        KVR::SharedPoseRingReader reader;
+        if (!writer.open() || !reader.open()) {
+            std::cerr << "Could not open the shared pose ring" << std::endl;
+            return latency;
+        }
+        std::atomic<int> received{ 0 };
+        std::thread consumer([&] {
+            KVR::SharedPoseRecord record;
+            uint64_t lastSequence = ~uint64_t(0);
+            while (received < poseCount) {
+                if (reader.readLatest(0, record) && record.sequence != lastSequence) {
+                    latency.record(KVR::monotonicNanoseconds() - record.timestampNanoseconds);
+                    lastSequence = record.sequence;
+                    ++received;
+                }
+                else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+        for (int i = 0; i < poseCount; ++i) {
+            writer.write(0, benchmarkPose(i), KVR::monotonicNanoseconds());
+            while (received <= i)
+                std::this_thread::yield();
+        }
+        consumer.join();
+        return latency;
+    }
+
+    KVR::LatencyHistogram benchmarkMessageQueue(int poseCount) {
+        using namespace boost::interprocess;
+        typedef vrinputemulator::ipc::Request Request;
+        KVR::LatencyHistogram latency;
+        message_queue::remove(benchmarkQueueName);
+        message_queue queue(create_only, benchmarkQueueName, 100, sizeof(Request));
+
+        std::vector<int64_t> sendTimes(poseCount);
+        std::atomic<int> received{ 0 };
+        std::thread consumer([&] {
+            Request request;
+            message_queue::size_type size;
+            unsigned int priority;
+            while (received < poseCount) {
+                queue.receive(&request, sizeof(Request), size, priority);
+                latency.record(KVR::monotonicNanoseconds() - sendTimes[request.msg.vd_SetDevicePose.messageId]);
+                ++received;
+            }
+        });
+        for (int i = 0; i < poseCount; ++i) {
+            Request request(vrinputemulator::ipc::RequestType::VirtualDevices_SetDevicePose);
+            request.msg.vd_SetDevicePose.clientId = 1;
+            request.msg.vd_SetDevicePose.messageId = i;
+            request.msg.vd_SetDevicePose.virtualDeviceId = 0;
+            request.msg.vd_SetDevicePose.pose = benchmarkPose(i);
+            sendTimes[i] = KVR::monotonicNanoseconds();
+            queue.send(&request, sizeof(Request), 0);
+            while (received <= i)
+                std::this_thread::yield();
+        }
+        consumer.join();
+        message_queue::remove(benchmarkQueueName);
+        return latency;
+    }
+
+    void printLatency(const char * transport, const KVR::LatencyHistogram & latency) {
+        std::cout << transport << ": mean " << latency.meanMilliseconds() * 1000.0 << "us, " << latency.summary() << std::endl;
+    }
+}
+
+int main(int argc, char ** argv) {
+    int poseCount = argc > 1 ? std::atoi(argv[1]) : 100000;
+    if (poseCount <= 0)
+        poseCount = 100000;
+
+    printLatency("Shared pose ring", benchmarkSharedRing(poseCount));
+    printLatency("Message queue   ", benchmarkMessageQueue(poseCount));
+    return 0;
+}
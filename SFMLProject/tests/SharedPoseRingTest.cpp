@@ -0,0 +1,164 @@
+#include "stdafx.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "FakeInputEmulator.h"
+#include "PoseSubmissionBatch.h"
+#include "SharedPoseRing.h"
+
+namespace {
+    vr::DriverPose_t poseAt(double x) {
+        vr::DriverPose_t pose = {};
+        pose.qRotation = { 1, 0, 0, 0 };
+        pose.vecPosition[0] = x;
+        pose.vecPosition[1] = x * 2;
+        pose.vecPosition[2] = x * 3;
+        pose.poseIsValid = true;
+        return pose;
+    }
+    bool poseIsConsistent(const KVR::SharedPoseRecord & record) {
+        double x = record.pose.vecPosition[0];
+        return record.pose.vecPosition[1] == x * 2 && record.pose.vecPosition[2] == x * 3
+            && record.timestampNanoseconds == int64_t(x);
+    }
+}
+
+TEST(SharedPoseRing, LoopbackReaderGetsNewestPose) {
+    KVR::SharedPoseRingWriter writer;
+    ASSERT_TRUE(writer.open());
+    KVR::SharedPoseRingReader reader;
+    ASSERT_TRUE(reader.open());
+
+    KVR::SharedPoseRecord record;
+    EXPECT_FALSE(reader.readLatest(7, record));
+
+    for (int i = 1; i <= 10; ++i) {
+        ASSERT_TRUE(writer.write(7, poseAt(i), i));
+        ASSERT_TRUE(writer.write(9, poseAt(100 + i), 100 + i));
+    }
+    ASSERT_TRUE(reader.readLatest(7, record));
+    EXPECT_EQ(9u, record.sequence);
+    EXPECT_EQ(10, record.timestampNanoseconds);
+    EXPECT_EQ(10.0, record.pose.vecPosition[0]);
+    ASSERT_TRUE(reader.readLatest(9, record));
+    EXPECT_EQ(110.0, record.pose.vecPosition[0]);
+    EXPECT_FALSE(reader.readLatest(8, record));
+}
+
+TEST(SharedPoseRing, ReaderInAnotherProcess) {
+    KVR::SharedPoseRingWriter writer;
+    ASSERT_TRUE(writer.open());
+    writer.write(3, poseAt(0), 0);
+
+    pid_t child = fork();
+    ASSERT_GE(child, 0);
+    if (child == 0) {
+        // Wait for the producer's last pose, the same way a driver would poll for it
+        KVR::SharedPoseRingReader reader;
+        if (!reader.open())
+            _exit(2);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        KVR::SharedPoseRecord record;
+        while (std::chrono::steady_clock::now() < deadline) {
+            if (reader.readLatest(3, record) && record.pose.vecPosition[0] == 500.0)
+                _exit(poseIsConsistent(record) ? 0 : 3);
+            std::this_thread::yield();
+        }
+        _exit(4);
+    }
+    for (int i = 1; i <= 500; ++i)
+        writer.write(3, poseAt(i), i);
+
+    int status = 0;
+    ASSERT_EQ(child, waitpid(child, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(0, WEXITSTATUS(status));
+}
+
+TEST(SharedPoseRing, ConcurrentReadsAreNeverTorn) {
+    KVR::SharedPoseRingWriter writer;
+    ASSERT_TRUE(writer.open());
+    KVR::SharedPoseRingReader reader;
+    ASSERT_TRUE(reader.open());
+
+    const int poseCount = 200000;
+    std::atomic<bool> done{ false };
+    std::thread producer([&] {
+        for (int i = 1; i <= poseCount; ++i)
+            writer.write(1, poseAt(i), i);
+        done = true;
+    });
+
+    uint64_t reads = 0;
+    uint64_t lastSequence = 0;
+    KVR::SharedPoseRecord record;
+    while (!done) {
+        if (!reader.readLatest(1, record))
+            continue;
+        ASSERT_TRUE(poseIsConsistent(record)) << "Torn read at sequence " << record.sequence;
+        ASSERT_GE(record.sequence, lastSequence);
+        lastSequence = record.sequence;
+        ++reads;
+    }
+    producer.join();
+    ASSERT_TRUE(reader.readLatest(1, record));
+    EXPECT_EQ(double(poseCount), record.pose.vecPosition[0]);
+    EXPECT_GT(reads, 0u);
+}
+
+TEST(SharedPoseRing, MessageQueueKeptUnlessBypassIsTurnedOn) {
+    KVR::SharedPoseRingWriter writer;
+    ASSERT_TRUE(writer.open());
+    KVR::SharedPoseRingReader reader;
+    ASSERT_TRUE(reader.open());
+    reader.heartbeat();
+    EXPECT_TRUE(writer.consumerAlive());
+    EXPECT_FALSE(writer.replacesMessageQueue());
+
+    vrinputemulator::VRInputEmulator inputEmulator;
+    KVR::PoseSubmissionBatch batch;
+    FakeInputEmulator::reset();
+    batch.queue(inputEmulator, 4, poseAt(1), 0);
+    batch.flush(&writer);
+    EXPECT_EQ(1u, FakeInputEmulator::sentPoseCount());
+
+    KVR::SharedPoseRecord record;
+    ASSERT_TRUE(reader.readLatest(4, record));
+    EXPECT_EQ(1.0, record.pose.vecPosition[0]);
+}
+
+TEST(SharedPoseRing, BypassOnlyWhileConsumerHeartbeatIsFresh) {
+    KVR::SharedPoseRingWriter writer;
+    ASSERT_TRUE(writer.open());
+    writer.bypassMessageQueue = true;
+    writer.consumerTimeout = std::chrono::milliseconds(50);
+    EXPECT_FALSE(writer.replacesMessageQueue()); // No consumer yet
+
+    vrinputemulator::VRInputEmulator inputEmulator;
+    KVR::PoseSubmissionBatch batch;
+    FakeInputEmulator::reset();
+
+    KVR::SharedPoseRingReader reader;
+    ASSERT_TRUE(reader.open());
+    EXPECT_TRUE(writer.replacesMessageQueue());
+    batch.queue(inputEmulator, 4, poseAt(1), 0);
+    batch.flush(&writer);
+    EXPECT_EQ(0u, FakeInputEmulator::sentPoseCount());
+
+    // A consumer that stops polling (crashed, hung) without closing puts the poses back on the message queue
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_FALSE(writer.consumerAlive());
+    batch.queue(inputEmulator, 4, poseAt(2), 0);
+    batch.flush(&writer);
+    EXPECT_EQ(1u, FakeInputEmulator::sentPoseCount());
+
+    KVR::SharedPoseRecord record;
+    ASSERT_TRUE(reader.readLatest(4, record));
+    EXPECT_TRUE(writer.replacesMessageQueue());
+}
@@ -0,0 +1,115 @@
+#include "stdafx.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "SkeletonCapture.h"
+
+namespace {
+    // Big enough that a copy racing a publish would show up as mismatched joints
+    struct FakeSkeleton {
+        uint64_t frame = 0;
+        int64_t eventTimestamp = 0;
+        double joints[25][7] = {};
+
+        void fill(uint64_t frameNumber, int64_t timestamp) {
+            frame = frameNumber;
+            eventTimestamp = timestamp;
+            for (auto & joint : joints)
+                for (double & value : joint)
+                    value = double(frameNumber);
+        }
+        bool consistent() const {
+            for (auto & joint : joints)
+                for (double value : joint)
+                    if (value != double(frame))
+                        return false;
+            return true;
+        }
+    };
+}
+
+TEST(LatestValueSlot, ConsumerGetsOnlyTheNewestPublish) {
+    KVR::LatestValueSlot<FakeSkeleton> slot;
+    EXPECT_EQ(nullptr, slot.consume());
+
+    for (uint64_t frame = 1; frame <= 3; ++frame) {
+        slot.writeBuffer().fill(frame, 0);
+        slot.publish();
+    }
+    const FakeSkeleton* skeleton = slot.consume();
+    ASSERT_NE(nullptr, skeleton);
+    EXPECT_EQ(3u, skeleton->frame);
+    EXPECT_TRUE(skeleton->consistent());
+    EXPECT_EQ(nullptr, slot.consume());
+
+    slot.writeBuffer().fill(4, 0);
+    slot.publish();
+    EXPECT_TRUE(slot.waitForFresh(std::chrono::milliseconds(0)));
+    skeleton = slot.consume();
+    ASSERT_NE(nullptr, skeleton);
+    EXPECT_EQ(4u, skeleton->frame);
+}
+
+TEST(FrameCaptureThread, SimulatedEventsReachConsumerNewestAndWhole) {
+    KVR::SimulatedFrameEventSource events;
+    KVR::LatestValueSlot<FakeSkeleton> slot;
+    std::atomic<uint64_t> captured{ 0 };
+
+    KVR::FrameCaptureThread capture;
+    capture.stopCheckInterval = std::chrono::milliseconds(10);
+    capture.start(&events, [&](int64_t eventTimestamp) {
+        uint64_t frame = captured + 1;
+        slot.writeBuffer().fill(frame, eventTimestamp);
+        slot.publish();
+        captured = frame;
+    });
+    ASSERT_TRUE(capture.isRunning());
+
+    const uint64_t frameCount = 2000;
+    std::thread sensor([&] {
+        for (uint64_t i = 0; i < frameCount; ++i) {
+            events.signal();
+            if (i % 64 == 0)
+                std::this_thread::yield();
+        }
+    });
+
+    // Consume while frames are still arriving, the way the tracking loop would
+    uint64_t lastFrame = 0;
+    uint64_t consumed = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (lastFrame < frameCount && std::chrono::steady_clock::now() < deadline) {
+        if (!slot.waitForFresh(std::chrono::milliseconds(50)))
+            continue;
+        const FakeSkeleton* skeleton = slot.consume();
+        ASSERT_NE(nullptr, skeleton);
+        ASSERT_TRUE(skeleton->consistent()) << "Torn skeleton at frame " << skeleton->frame;
+        ASSERT_GT(skeleton->frame, lastFrame);
+        ASSERT_GT(skeleton->eventTimestamp, 0);
+        lastFrame = skeleton->frame;
+        ++consumed;
+    }
+    sensor.join();
+    capture.stop();
+    EXPECT_FALSE(capture.isRunning());
+
+    // Every event was captured, and the last thing the consumer saw was the newest of them
+    EXPECT_EQ(frameCount, captured.load());
+    EXPECT_EQ(frameCount, lastFrame);
+    EXPECT_GT(consumed, 0u);
+    EXPECT_EQ(nullptr, slot.consume());
+}
+
+TEST(FrameCaptureThread, StopsWithoutAnyEvents) {
+    KVR::SimulatedFrameEventSource events;
+    int captures = 0;
+    KVR::FrameCaptureThread capture;
+    capture.stopCheckInterval = std::chrono::milliseconds(10);
+    capture.start(&events, [&](int64_t) { ++captures; });
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    capture.stop();
+    EXPECT_EQ(0, captures);
+}
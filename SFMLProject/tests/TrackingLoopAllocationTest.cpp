@@ -0,0 +1,140 @@
+#include "stdafx.h"
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "AllocationAudit.h"
+#include "FakeInputEmulator.h"
+#include "IMU_PositionMethod.h"
+#include "IMU_RotationMethod.h"
+#include "SessionRecording.h"
+#include "SessionReplay.h"
+#include "SkeletonTracker.h"
+#include "TrackingLoop.h"
+#include "TrackingPoolManager.h"
+
+// Built with KVR_AUDIT_ALLOCATIONS, so AllocationAudit's operator new is counting.
+// Steps the real tracking tick over a replayed session, the way the tracking thread would
+// run it, and fails if a tick after the warm up makes any heap allocation.
+
+#ifndef KVR_AUDIT_ALLOCATIONS
+#error TrackingLoopAllocationTest has to be built with KVR_AUDIT_ALLOCATIONS
+#endif
+
+namespace {
+    const int sessionFrames = 120;
+
+    // A person swaying on the spot, every joint tracked
+    KVR::SkeletonFrame swayingSkeleton(int frame, int64_t timestamp) {
+        KVR::SkeletonFrame skeleton;
+        skeleton.captureTimestamp = timestamp;
+        skeleton.isTracking = 1;
+        float sway = 0.1f * std::sin(frame * 0.1f);
+        for (int j = 0; j < KVR::KinectJointCount; ++j) {
+            skeleton.setJoint(j, KVR::JointTrackingState::Tracked, sway + 0.01f * j, 1.5f - 0.06f * j, 2.0f);
+            skeleton.setOrientations(j, 1, 0, 0, 0, 1, 0, 0, 0);
+        }
+        return skeleton;
+    }
+
+    // Written out and loaded back through the recorder and playback, as a real session would be
+    std::shared_ptr<KVR::SessionPlayback> recordedSession() {
+        std::string path = "/tmp/KinectToVR_AllocationTest_" + std::to_string(getpid()) + ".kvrs";
+        std::wstring widePath(path.begin(), path.end());
+        {
+            KVR::SessionRecorder recorder;
+            if (!recorder.open(widePath, KinectVersion::Version2))
+                return nullptr;
+            const int64_t frameInterval = 1000000000 / 30;
+            for (int frame = 0; frame < sessionFrames; ++frame) {
+                int64_t timestamp = (frame + 1) * frameInterval;
+                KinectSettings::hmdPosition = { 0.05 * std::sin(frame * 0.05), 1.7, 0 };
+                recorder.recordHMD(timestamp);
+                recorder.recordSkeleton(swayingSkeleton(frame, timestamp));
+            }
+        }
+        auto playback = std::make_shared<KVR::SessionPlayback>();
+        bool opened = playback->open(widePath);
+        std::remove(path.c_str());
+        if (!opened)
+            return nullptr;
+        playback->speed = KVR::SessionPlayback::Speed::Maximum;
+        playback->loop = true;
+        return playback;
+    }
+
+    KVR::KinectTrackedDevice jointTracker(vrinputemulator::VRInputEmulator & inputEmulator, KVR::KinectJointType joint, KVR::KinectDeviceRole role, uint32_t deviceId) {
+        uint32_t gid = TrackingPoolManager::globalDeviceIDFromJoint(joint);
+        KVR::KinectTrackedDevice tracker(inputEmulator, gid, gid, role);
+        tracker.joint0 = joint;
+        tracker.joint1 = joint;
+        // As the GUI would have after init(), without a driver to hand one out
+        tracker.deviceId = deviceId;
+        return tracker;
+    }
+}
+
+TEST(TrackingLoopAllocation, SteadyStateTickDoesNotAllocate) {
+    ASSERT_TRUE(AllocationAudit::enabled);
+    std::shared_ptr<KVR::SessionPlayback> playback = recordedSession();
+    ASSERT_NE(nullptr, playback);
+    ASSERT_EQ(size_t(sessionFrames), playback->skeletons.size());
+
+    ReplayKinectHandler kinect(playback);
+    vr::IVRSystem* vrSystem = nullptr;
+    vrinputemulator::VRInputEmulator inputEmulator;
+
+    std::vector<std::unique_ptr<TrackingMethod>> trackingMethods;
+    trackingMethods.emplace_back(new SkeletonTracker);
+    trackingMethods.emplace_back(new IMU_PositionMethod);
+    trackingMethods.emplace_back(new IMU_RotationMethod);
+    for (auto & method : trackingMethods)
+        method->initialise();
+
+    std::vector<std::unique_ptr<DeviceHandler>> deviceHandlers;
+    deviceHandlers.emplace_back(new ReplayDeviceHandler(playback));
+    deviceHandlers.back()->initialise();
+
+    // The default lower body set the GUI spawns
+    std::vector<KVR::KinectTrackedDevice> trackers;
+    trackers.push_back(jointTracker(inputEmulator, KVR::KinectJointType::AnkleLeft, KVR::KinectDeviceRole::LeftFoot, 0));
+    trackers.push_back(jointTracker(inputEmulator, KVR::KinectJointType::AnkleRight, KVR::KinectDeviceRole::RightFoot, 1));
+    trackers.push_back(jointTracker(inputEmulator, KVR::KinectJointType::SpineBase, KVR::KinectDeviceRole::Hip, 2));
+    TrackingMethod::trackersChanged();
+
+    TrackingLoop loop(kinect, trackers, trackingMethods, deviceHandlers, vrSystem, false);
+
+    // Through the session more than once, so rewinding is part of the steady state too
+    const uint64_t warmupTicks = AllocationAudit::warmupTicks;
+    const uint64_t measuredTicks = 3 * sessionFrames;
+    for (uint64_t i = 0; i < warmupTicks; ++i) {
+        kinect.waitForNewFrame(std::chrono::milliseconds(0));
+        loop.tick();
+    }
+    FakeInputEmulator::reset();
+
+    for (uint64_t i = 0; i < measuredTicks; ++i) {
+        kinect.waitForNewFrame(std::chrono::milliseconds(0));
+        uint64_t allocationsBefore = AllocationAudit::threadAllocationCount();
+        int trackerCount = loop.tick();
+        uint64_t tickAllocations = AllocationAudit::threadAllocationCount() - allocationsBefore;
+        ASSERT_EQ(0u, tickAllocations) << "Tick " << warmupTicks + i << " allocated";
+        ASSERT_EQ(3, trackerCount);
+    }
+
+    // The ticks actually published something, newest pose per tracker once a tick
+    EXPECT_EQ(measuredTicks * trackers.size(), FakeInputEmulator::sentPoseCount());
+}
+
+TEST(TrackingLoopAllocation, AuditCountsThisThreadsAllocations) {
+    // Without this, a broken hook would pass the test above without checking anything
+    uint64_t before = AllocationAudit::threadAllocationCount();
+    std::unique_ptr<std::vector<int>> allocated(new std::vector<int>(16));
+    EXPECT_GE(AllocationAudit::threadAllocationCount() - before, 2u);
+}
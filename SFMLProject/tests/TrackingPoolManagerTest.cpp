@@ -0,0 +1,64 @@
+#include "stdafx.h"
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "TrackingPoolManager.h"
+
+namespace {
+    uint32_t addDevice(const std::string & name, const std::string & serial) {
+        KVR::TrackedDeviceInputData data;
+        data.deviceName = name;
+        data.serial = serial;
+        data.positionTrackingOption = KVR::JointPositionTrackingOption::IMU;
+        data.rotationTrackingOption = KVR::JointRotationTrackingOption::IMU;
+        uint32_t globalID = k_invalidTrackerID;
+        TrackingPoolManager::addDeviceToPool(data, globalID);
+        return globalID;
+    }
+}
+
+// The pool is global, so each test uses its own serials
+
+TEST(TrackingPoolManager, UpdatedSerialIsReindexed) {
+    // SteamVR devices can be added before their serial is known
+    uint32_t gid = addDevice("SteamVR ID: 3 ", "");
+    ASSERT_NE(k_invalidTrackerID, gid);
+
+    EXPECT_EQ(TrackingPoolManager::TrackingPoolError::OK,
+        TrackingPoolManager::updateDeviceMetadata(gid, "SteamVR ID: 3 VIVE Tracker", "LHR-REINDEX"));
+    EXPECT_EQ(gid, TrackingPoolManager::locateGlobalDeviceID("LHR-REINDEX"));
+    EXPECT_EQ(k_invalidTrackerID, TrackingPoolManager::locateGlobalDeviceID(""));
+    EXPECT_EQ("SteamVR ID: 3 VIVE Tracker", TrackingPoolManager::getDeviceData(gid).deviceName);
+    EXPECT_EQ("LHR-REINDEX", TrackingPoolManager::getDeviceData(gid).serial);
+    EXPECT_EQ(gid, TrackingPoolManager::getDeviceData(gid).deviceId);
+
+    // Same serial, new model name - the index is left alone
+    TrackingPoolManager::updateDeviceMetadata(gid, "SteamVR ID: 3 VIVE Tracker Pro", "LHR-REINDEX");
+    EXPECT_EQ(gid, TrackingPoolManager::locateGlobalDeviceID("LHR-REINDEX"));
+    EXPECT_EQ("SteamVR ID: 3 VIVE Tracker Pro", TrackingPoolManager::getDeviceData(gid).deviceName);
+}
+
+TEST(TrackingPoolManager, OldSerialPassesToDeviceSharingIt) {
+    uint32_t first = addDevice("First", "SHARED_SERIAL");
+    uint32_t second = addDevice("Second", "SHARED_SERIAL");
+    ASSERT_EQ(first, TrackingPoolManager::locateGlobalDeviceID("SHARED_SERIAL"));
+
+    TrackingPoolManager::updateDeviceMetadata(first, "First", "FIRST_OWN_SERIAL");
+    EXPECT_EQ(second, TrackingPoolManager::locateGlobalDeviceID("SHARED_SERIAL"));
+    EXPECT_EQ(first, TrackingPoolManager::locateGlobalDeviceID("FIRST_OWN_SERIAL"));
+
+    // And a cleared device's serial is free again
+    TrackingPoolManager::clearDeviceInPool(first);
+    EXPECT_EQ(k_invalidTrackerID, TrackingPoolManager::locateGlobalDeviceID("FIRST_OWN_SERIAL"));
+}
+
+TEST(TrackingPoolManager, ClearedDeviceMetadataIsNotUpdated) {
+    uint32_t gid = addDevice("Cleared", "CLEARED_SERIAL");
+    TrackingPoolManager::clearDeviceInPool(gid);
+    EXPECT_EQ(TrackingPoolManager::TrackingPoolError::StaleHandle,
+        TrackingPoolManager::updateDeviceMetadata(gid, "Cleared", "CLEARED_NEW_SERIAL"));
+    EXPECT_EQ(k_invalidTrackerID, TrackingPoolManager::locateGlobalDeviceID("CLEARED_NEW_SERIAL"));
+    EXPECT_EQ(TrackingPoolManager::TrackingPoolError::StaleHandle,
+        TrackingPoolManager::updateDeviceMetadata(k_maxTrackingPoolDevices, "Missing", "MISSING_SERIAL"));
+}
@@ -0,0 +1,39 @@
+#include "FakeInputEmulator.h"
+
+namespace FakeInputEmulator {
+    namespace {
+        SentPose sentPoses[maxRecordedPoses];
+        uint64_t sentPoseTotal = 0;
+    }
+
+    void reset() {
+        sentPoseTotal = 0;
+    }
+    uint64_t sentPoseCount() {
+        return sentPoseTotal;
+    }
+    const SentPose & sentPose(uint64_t index) {
+        return sentPoses[index % maxRecordedPoses];
+    }
+}
+
+namespace vrinputemulator {
+    VRInputEmulator::VRInputEmulator(const std::string& driverQueue, const std::string& clientQueue)
+        : _ipcServerQueueName(driverQueue), _ipcClientQueueName(clientQueue) {
+    }
+    VRInputEmulator::~VRInputEmulator() {
+    }
+
+    void VRInputEmulator::setVirtualDevicePose(uint32_t virtualDeviceId, const vr::DriverPose_t& pose, bool modal) {
+        using namespace FakeInputEmulator;
+        if (sentPoseTotal < maxRecordedPoses)
+            sentPoses[sentPoseTotal] = SentPose{ this, virtualDeviceId, pose, modal };
+        ++sentPoseTotal;
+    }
+
+    // CalibrationTransform's offsets are still computed, just never sent
+    void VRInputEmulator::enableDeviceOffsets(uint32_t deviceId, bool enable, bool modal) {
+    }
+    void VRInputEmulator::setWorldFromDriverTranslationOffset(uint32_t deviceId, const vr::HmdVector3d_t& value, bool modal) {
+    }
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <cstdint>
+#include <vrinputemulator.h>
+
+// The tests link this in place of the InputEmulator client library. Nothing is sent anywhere -
+// setVirtualDevicePose is recorded, so a test can check what would have reached the driver
+namespace FakeInputEmulator {
+    struct SentPose {
+        const vrinputemulator::VRInputEmulator *inputEmulator;
+        uint32_t deviceId;
+        vr::DriverPose_t pose;
+        bool modal;
+    };
+
+    // Fixed size, so recording a send never allocates. Sends past this are counted, but not kept
+    const uint64_t maxRecordedPoses = 1024;
+
+    void reset();
+    // Every setVirtualDevicePose since the last reset(), oldest first
+    uint64_t sentPoseCount();
+    const SentPose & sentPose(uint64_t index);
+}
@@ -0,0 +1,23 @@
+#include "stdafx.h"
+#include "KinectSettings.h"
+
+// The settings the tracking pipeline reads, with KinectSettings.cpp's defaults.
+// The real file also loads and saves the config, which needs cereal and Windows
+namespace KinectSettings {
+    bool ignoreInferredPositions = false;
+    std::atomic<double> trackerPredictionLookAhead{ 0.04 };
+    double hipRoleHeightAdjust = 0.0;
+
+    vr::HmdVector3d_t hmdPosition = { 0,0,0 };
+    vr::HmdQuaternion_t hmdRotation = { 0,0,0,0 };
+    vr::HmdMatrix34_t hmdAbsoluteTracking = {};
+    vr::HmdMatrix34_t trackingOrigin = {};
+    vr::HmdVector3d_t trackingOriginPosition = { 0,0,0 };
+    vr::HmdVector3d_t secondaryTrackingOriginOffset = { 0 };
+    vr::HmdQuaternion_t kinectRepRotation{ 0,0,0,0 };
+    vr::HmdVector3d_t kinectRepPosition{ 0,0,0 };
+    bool sensorConfigChanged = true;
+
+    bool adjustingKinectRepresentationRot = false;
+    bool adjustingKinectRepresentationPos = false;
+}
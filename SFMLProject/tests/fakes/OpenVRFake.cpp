@@ -0,0 +1,7 @@
+#include <openvr.h>
+
+// There's no SteamVR runtime in the tests, so the code paths which need one are skipped as if it had failed to start
+namespace vr {
+    IVRSystem *VRSystem() { return nullptr; }
+    IVRSettings *VRSettings() { return nullptr; }
+}
@@ -0,0 +1,4 @@
+#include "stdafx.h"
+
+// easylogging's storage, once for every test executable
+INITIALIZE_EASYLOGGINGPP
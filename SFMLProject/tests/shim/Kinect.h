@@ -0,0 +1,75 @@
+#pragma once
+// The Kinect for Windows v2 SDK types the joint and bone orientation filters are written against.
+// Same layouts and values as the SDK's, so the filters compile unchanged
+#include "windows.h"
+
+#ifndef _Vector4_
+#define _Vector4_
+typedef struct _Vector4 {
+    float x;
+    float y;
+    float z;
+    float w;
+} Vector4;
+#endif
+
+typedef struct _CameraSpacePoint {
+    float X;
+    float Y;
+    float Z;
+} CameraSpacePoint;
+
+enum _JointType {
+    JointType_SpineBase = 0,
+    JointType_SpineMid = 1,
+    JointType_Neck = 2,
+    JointType_Head = 3,
+    JointType_ShoulderLeft = 4,
+    JointType_ElbowLeft = 5,
+    JointType_WristLeft = 6,
+    JointType_HandLeft = 7,
+    JointType_ShoulderRight = 8,
+    JointType_ElbowRight = 9,
+    JointType_WristRight = 10,
+    JointType_HandRight = 11,
+    JointType_HipLeft = 12,
+    JointType_KneeLeft = 13,
+    JointType_AnkleLeft = 14,
+    JointType_FootLeft = 15,
+    JointType_HipRight = 16,
+    JointType_KneeRight = 17,
+    JointType_AnkleRight = 18,
+    JointType_FootRight = 19,
+    JointType_SpineShoulder = 20,
+    JointType_HandTipLeft = 21,
+    JointType_ThumbLeft = 22,
+    JointType_HandTipRight = 23,
+    JointType_ThumbRight = 24,
+    JointType_Count = (JointType_ThumbRight + 1)
+};
+typedef enum _JointType JointType;
+
+enum _TrackingState {
+    TrackingState_NotTracked = 0,
+    TrackingState_Inferred = 1,
+    TrackingState_Tracked = 2
+};
+typedef enum _TrackingState TrackingState;
+
+typedef struct _Joint {
+    enum _JointType JointType;
+    CameraSpacePoint Position;
+    enum _TrackingState TrackingState;
+} Joint;
+
+typedef struct _JointOrientation {
+    enum _JointType JointType;
+    Vector4 Orientation;
+} JointOrientation;
+
+// Only what the filters call
+struct IBody {
+    virtual ~IBody() {}
+    virtual HRESULT GetJoints(UINT capacity, Joint *joints) = 0;
+    virtual HRESULT GetJointOrientations(UINT capacity, JointOrientation *jointOrientations) = 0;
+};
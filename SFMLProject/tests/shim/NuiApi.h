@@ -0,0 +1,58 @@
+#pragma once
+// The Kinect for Windows v1 SDK types the rotation smoothing filter is written against.
+// Same layouts and values as the SDK's, so the filter compiles unchanged
+#include "windows.h"
+
+#ifndef _Vector4_
+#define _Vector4_
+typedef struct _Vector4 {
+    float x;
+    float y;
+    float z;
+    float w;
+} Vector4;
+#endif
+
+typedef struct _Matrix4 {
+    float M11, M12, M13, M14;
+    float M21, M22, M23, M24;
+    float M31, M32, M33, M34;
+    float M41, M42, M43, M44;
+} Matrix4;
+
+enum _NUI_SKELETON_POSITION_INDEX {
+    NUI_SKELETON_POSITION_HIP_CENTER = 0,
+    NUI_SKELETON_POSITION_SPINE,
+    NUI_SKELETON_POSITION_SHOULDER_CENTER,
+    NUI_SKELETON_POSITION_HEAD,
+    NUI_SKELETON_POSITION_SHOULDER_LEFT,
+    NUI_SKELETON_POSITION_ELBOW_LEFT,
+    NUI_SKELETON_POSITION_WRIST_LEFT,
+    NUI_SKELETON_POSITION_HAND_LEFT,
+    NUI_SKELETON_POSITION_SHOULDER_RIGHT,
+    NUI_SKELETON_POSITION_ELBOW_RIGHT,
+    NUI_SKELETON_POSITION_WRIST_RIGHT,
+    NUI_SKELETON_POSITION_HAND_RIGHT,
+    NUI_SKELETON_POSITION_HIP_LEFT,
+    NUI_SKELETON_POSITION_KNEE_LEFT,
+    NUI_SKELETON_POSITION_ANKLE_LEFT,
+    NUI_SKELETON_POSITION_FOOT_LEFT,
+    NUI_SKELETON_POSITION_HIP_RIGHT,
+    NUI_SKELETON_POSITION_KNEE_RIGHT,
+    NUI_SKELETON_POSITION_ANKLE_RIGHT,
+    NUI_SKELETON_POSITION_FOOT_RIGHT,
+    NUI_SKELETON_POSITION_COUNT
+};
+typedef enum _NUI_SKELETON_POSITION_INDEX NUI_SKELETON_POSITION_INDEX;
+
+typedef struct _NUI_SKELETON_BONE_ROTATION {
+    Matrix4 rotationMatrix;
+    Vector4 rotationQuaternion;
+} NUI_SKELETON_BONE_ROTATION;
+
+typedef struct _NUI_SKELETON_BONE_ORIENTATION {
+    NUI_SKELETON_POSITION_INDEX endJoint;
+    NUI_SKELETON_POSITION_INDEX startJoint;
+    NUI_SKELETON_BONE_ROTATION hierarchicalRotation;
+    NUI_SKELETON_BONE_ROTATION absoluteRotation;
+} NUI_SKELETON_BONE_ORIENTATION;
@@ -0,0 +1,3 @@
+#pragma once
+// Everything the tests need from the v1 SDK is in NuiApi.h
+#include "NuiApi.h"
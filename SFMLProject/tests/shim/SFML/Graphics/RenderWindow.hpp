@@ -0,0 +1,21 @@
+#pragma once
+// Stand-in for sfml-graphics, see Texture.hpp
+#include <SFML/Graphics/Sprite.hpp>
+
+namespace sf {
+    class View {};
+
+    class RenderWindow {
+    public:
+        Vector2u getSize() const { return Vector2u(800, 600); }
+        const View& getDefaultView() const { return defaultView; }
+        void setView(const View&) {}
+        void pushGLStates() {}
+        void popGLStates() {}
+        void resetGLStates() {}
+        void draw(const Sprite&) {}
+
+    private:
+        View defaultView;
+    };
+}
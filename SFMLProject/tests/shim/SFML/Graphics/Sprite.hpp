@@ -0,0 +1,14 @@
+#pragma once
+// Stand-in for sfml-graphics, see Texture.hpp
+#include <SFML/Graphics/Texture.hpp>
+
+namespace sf {
+    class Sprite {
+    public:
+        void setTexture(const Texture& newTexture, bool = false) { texture = &newTexture; }
+        void setScale(float, float) {}
+
+    private:
+        const Texture* texture = nullptr;
+    };
+}
@@ -0,0 +1,24 @@
+#pragma once
+// Stand-in for sfml-graphics, which needs a window and GL context the tests don't have.
+// Only what the Kinect preview uses - the texture just remembers its size and how often it was written
+#include <SFML/Config.hpp>
+#include <SFML/System/Vector2.hpp>
+
+namespace sf {
+    class Texture {
+    public:
+        bool create(unsigned int width, unsigned int height) {
+            size = Vector2u(width, height);
+            return width && height;
+        }
+        void update(const Uint8*) {
+            ++updates;
+        }
+        Vector2u getSize() const { return size; }
+
+        unsigned int updates = 0;
+
+    private:
+        Vector2u size;
+    };
+}
@@ -0,0 +1,3 @@
+#pragma once
+// Same header, under the case the v1 includes use
+#include "windows.h"
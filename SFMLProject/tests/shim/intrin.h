@@ -0,0 +1,2 @@
+#pragma once
+// Stand-in for the MSVC intrinsics header. The code using it falls back to the GCC builtins when not on MSVC
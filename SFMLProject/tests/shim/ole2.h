@@ -0,0 +1,2 @@
+#pragma once
+// Nothing needed from it, the v1 includes just expect it before the SDK headers
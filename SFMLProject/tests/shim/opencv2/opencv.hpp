@@ -0,0 +1,6 @@
+#pragma once
+// Stand-in for OpenCV. The Kinect handlers keep their colour/depth frames in cv::Mats, which the tested code
+// carries around but never touches
+namespace cv {
+    class Mat {};
+}
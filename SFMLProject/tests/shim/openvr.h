@@ -0,0 +1,239 @@
+#pragma once
+// The parts of the OpenVR SDK's openvr.h the tracking pipeline uses, so it can be built and tested
+// without the SDK. Struct layouts match openvr.h - nothing here talks to SteamVR
+#include <cstdint>
+
+namespace vr {
+    struct HmdMatrix34_t { float m[3][4]; };
+    struct HmdMatrix44_t { float m[4][4]; };
+    struct HmdVector3_t { float v[3]; };
+    struct HmdVector4_t { float v[4]; };
+    struct HmdVector3d_t { double v[3]; };
+    struct HmdVector2_t { float v[2]; };
+    struct HmdQuaternion_t { double w, x, y, z; };
+
+    typedef uint32_t TrackedDeviceIndex_t;
+    static const uint32_t k_unTrackedDeviceIndex_Hmd = 0;
+    static const uint32_t k_unMaxTrackedDeviceCount = 64;
+    static const uint32_t k_unTrackedDeviceIndexOther = 0xFFFFFFFE;
+    static const uint32_t k_unTrackedDeviceIndexInvalid = 0xFFFFFFFF;
+
+    enum ETrackingResult {
+        TrackingResult_Uninitialized = 1,
+        TrackingResult_Calibrating_InProgress = 100,
+        TrackingResult_Calibrating_OutOfRange = 101,
+        TrackingResult_Running_OK = 200,
+        TrackingResult_Running_OutOfRange = 201,
+    };
+
+    struct TrackedDevicePose_t {
+        HmdMatrix34_t mDeviceToAbsoluteTracking;
+        HmdVector3_t vVelocity;
+        HmdVector3_t vAngularVelocity;
+        ETrackingResult eTrackingResult;
+        bool bPoseIsValid;
+        bool bDeviceIsConnected;
+    };
+
+    enum ETrackingUniverseOrigin {
+        TrackingUniverseSeated = 0,
+        TrackingUniverseStanding = 1,
+        TrackingUniverseRawAndUncalibrated = 2,
+    };
+
+    enum ETrackedDeviceClass {
+        TrackedDeviceClass_Invalid = 0,
+        TrackedDeviceClass_HMD = 1,
+        TrackedDeviceClass_Controller = 2,
+        TrackedDeviceClass_GenericTracker = 3,
+        TrackedDeviceClass_TrackingReference = 4,
+        TrackedDeviceClass_DisplayRedirect = 5,
+    };
+
+    enum ETrackedControllerRole {
+        TrackedControllerRole_Invalid = 0,
+        TrackedControllerRole_LeftHand = 1,
+        TrackedControllerRole_RightHand = 2,
+    };
+
+    enum ETrackedDeviceProperty {
+        Prop_Invalid = 0,
+        Prop_TrackingSystemName_String = 1000,
+        Prop_ModelNumber_String = 1001,
+        Prop_SerialNumber_String = 1002,
+        Prop_RenderModelName_String = 1003,
+        Prop_WillDriftInYaw_Bool = 1004,
+        Prop_ManufacturerName_String = 1005,
+        Prop_TrackingFirmwareVersion_String = 1006,
+        Prop_HardwareRevision_String = 1007,
+        Prop_AllWirelessDongleDescriptions_String = 1008,
+        Prop_ConnectedWirelessDongle_String = 1009,
+        Prop_DeviceIsWireless_Bool = 1010,
+        Prop_DeviceIsCharging_Bool = 1011,
+        Prop_DeviceBatteryPercentage_Float = 1012,
+        Prop_StatusDisplayTransform_Matrix34 = 1013,
+        Prop_Firmware_UpdateAvailable_Bool = 1014,
+        Prop_Firmware_ManualUpdate_Bool = 1015,
+        Prop_Firmware_ManualUpdateURL_String = 1016,
+        Prop_HardwareRevision_Uint64 = 1017,
+        Prop_FirmwareVersion_Uint64 = 1018,
+        Prop_FPGAVersion_Uint64 = 1019,
+        Prop_VRCVersion_Uint64 = 1020,
+        Prop_RadioVersion_Uint64 = 1021,
+        Prop_DongleVersion_Uint64 = 1022,
+        Prop_BlockServerShutdown_Bool = 1023,
+        Prop_CanUnifyCoordinateSystemWithHmd_Bool = 1024,
+        Prop_ContainsProximitySensor_Bool = 1025,
+        Prop_DeviceProvidesBatteryStatus_Bool = 1026,
+        Prop_DeviceCanPowerOff_Bool = 1027,
+        Prop_Firmware_ProgrammingTarget_String = 1028,
+        Prop_DeviceClass_Int32 = 1029,
+        Prop_HasCamera_Bool = 1030,
+        Prop_DriverVersion_String = 1031,
+        Prop_Firmware_ForceUpdateRequired_Bool = 1032,
+        Prop_ViveSystemButtonFixRequired_Bool = 1033,
+        Prop_ParentDriver_Uint64 = 1034,
+        Prop_ResourceRoot_String = 1035,
+        Prop_RegisteredDeviceType_String = 1036,
+        Prop_InputProfilePath_String = 1037,
+        Prop_NeverTracked_Bool = 1038,
+        Prop_NumCameras_Int32 = 1039,
+        Prop_CameraFrameLayout_Int32 = 1040,
+        Prop_CameraStreamFormat_Int32 = 1041,
+        Prop_AdditionalDeviceSettingsPath_String = 1042,
+        Prop_Identifiable_Bool = 1043,
+        Prop_BootloaderVersion_Uint64 = 1044,
+        Prop_AdditionalSystemReportData_String = 1045,
+        Prop_CompositeFirmwareVersion_String = 1046,
+        Prop_Firmware_RemindUpdate_Bool = 1047,
+        Prop_PeripheralApplicationVersion_Uint64 = 1048,
+        Prop_ManufacturerSerialNumber_String = 1049,
+        Prop_ComputedSerialNumber_String = 1050,
+        Prop_EstimatedDeviceFirstUseTime_Int32 = 1051,
+        Prop_AttachedDeviceId_String = 3000,
+        Prop_SupportedButtons_Uint64 = 3001,
+        Prop_Axis0Type_Int32 = 3002,
+        Prop_Axis1Type_Int32 = 3003,
+        Prop_Axis2Type_Int32 = 3004,
+        Prop_Axis3Type_Int32 = 3005,
+        Prop_Axis4Type_Int32 = 3006,
+        Prop_ControllerRoleHint_Int32 = 3007,
+        Prop_IconPathName_String = 5000,
+        Prop_NamedIconPathDeviceOff_String = 5001,
+        Prop_NamedIconPathDeviceSearching_String = 5002,
+        Prop_NamedIconPathDeviceSearchingAlert_String = 5003,
+        Prop_NamedIconPathDeviceReady_String = 5004,
+        Prop_NamedIconPathDeviceReadyAlert_String = 5005,
+        Prop_NamedIconPathDeviceNotReady_String = 5006,
+        Prop_NamedIconPathDeviceStandby_String = 5007,
+        Prop_NamedIconPathDeviceAlertLow_String = 5008,
+        Prop_ControllerType_String = 7000,
+        Prop_LegacyInputProfile_String = 7001,
+        Prop_ControllerHandSelectionPriority_Int32 = 7002,
+    };
+
+    enum EVRButtonId {
+        k_EButton_System = 0,
+        k_EButton_ApplicationMenu = 1,
+        k_EButton_Grip = 2,
+        k_EButton_DPad_Left = 3,
+        k_EButton_DPad_Up = 4,
+        k_EButton_DPad_Right = 5,
+        k_EButton_DPad_Down = 6,
+        k_EButton_A = 7,
+        k_EButton_ProximitySensor = 31,
+        k_EButton_Axis0 = 32,
+        k_EButton_Axis1 = 33,
+        k_EButton_Axis2 = 34,
+        k_EButton_Axis3 = 35,
+        k_EButton_Axis4 = 36,
+        k_EButton_SteamVR_Touchpad = k_EButton_Axis0,
+        k_EButton_SteamVR_Trigger = k_EButton_Axis1,
+        k_EButton_Max = 64
+    };
+
+    enum EVREventType {
+        VREvent_None = 0,
+        VREvent_TrackedDeviceActivated = 100,
+        VREvent_TrackedDeviceDeactivated = 101,
+        VREvent_TrackedDeviceUpdated = 102,
+        VREvent_PropertyChanged = 111,
+        VREvent_VendorSpecific_Reserved_Start = 10000,
+        VREvent_VendorSpecific_Reserved_End = 19999,
+    };
+
+    struct VREvent_Reserved_t { uint64_t reserved0; uint64_t reserved1; uint64_t reserved2; uint64_t reserved3; };
+    struct VREvent_Property_t { uint64_t container; ETrackedDeviceProperty prop; };
+    typedef union {
+        VREvent_Reserved_t reserved;
+        VREvent_Property_t property;
+    } VREvent_Data_t;
+
+    struct VREvent_t {
+        uint32_t eventType;
+        TrackedDeviceIndex_t trackedDeviceIndex;
+        float eventAgeSeconds;
+        VREvent_Data_t data;
+    };
+
+    struct VRControllerAxis_t { float x; float y; };
+    static const uint32_t k_unControllerStateAxisCount = 5;
+    struct VRControllerState001_t {
+        uint32_t unPacketNum;
+        uint64_t ulButtonPressed;
+        uint64_t ulButtonTouched;
+        VRControllerAxis_t rAxis[k_unControllerStateAxisCount];
+    };
+    typedef VRControllerState001_t VRControllerState_t;
+
+    typedef uint64_t VRActionHandle_t;
+    typedef uint64_t VRActionSetHandle_t;
+    typedef uint64_t VRInputValueHandle_t;
+    struct VRActiveActionSet_t {
+        VRActionSetHandle_t ulActionSet;
+        VRInputValueHandle_t ulRestrictedToDevice;
+        VRActionSetHandle_t ulSecondaryActionSet;
+        uint32_t unPadding;
+        int32_t nPriority;
+    };
+    struct InputDigitalActionData_t {
+        bool bActive;
+        VRInputValueHandle_t activeOrigin;
+        bool bState;
+        bool bChanged;
+        float fUpdateTime;
+    };
+    struct InputAnalogActionData_t {
+        bool bActive;
+        VRInputValueHandle_t activeOrigin;
+        float x, y, z;
+        float deltaX, deltaY, deltaZ;
+        float fUpdateTime;
+    };
+
+    enum EVRSettingsError {
+        VRSettingsError_None = 0,
+        VRSettingsError_IPCFailed = 1,
+        VRSettingsError_WriteFailed = 2,
+        VRSettingsError_ReadFailed = 3,
+    };
+    static const char * const k_pch_Trackers_Section = "trackers";
+
+    class IVRSystem {
+    public:
+        virtual void GetDeviceToAbsoluteTrackingPose(ETrackingUniverseOrigin eOrigin, float fPredictedSecondsToPhotonsFromNow,
+            TrackedDevicePose_t *pTrackedDevicePoseArray, uint32_t unTrackedDevicePoseArrayCount) = 0;
+        virtual HmdMatrix34_t GetRawZeroPoseToStandingAbsoluteTrackingPose() = 0;
+        virtual ETrackedDeviceClass GetTrackedDeviceClass(TrackedDeviceIndex_t unDeviceIndex) = 0;
+    };
+
+    class IVRSettings {
+    public:
+        virtual void SetString(const char *pchSection, const char *pchSettingsKey, const char *pchValue, EVRSettingsError *peError = nullptr) = 0;
+        virtual void RemoveKeyInSection(const char *pchSection, const char *pchSettingsKey, EVRSettingsError *peError = nullptr) = 0;
+    };
+
+    // No runtime in the tests - both of these are null (see fakes/OpenVRFake.cpp)
+    IVRSystem *VRSystem();
+    IVRSettings *VRSettings();
+}
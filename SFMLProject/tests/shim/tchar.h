@@ -0,0 +1,2 @@
+#pragma once
+// Stand-in for the MSVC header stdafx.h includes. Nothing in the tested code uses it
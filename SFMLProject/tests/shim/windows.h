@@ -0,0 +1,14 @@
+#pragma once
+// The few Win32 types the Kinect handler interfaces are declared with
+#include <cstdint>
+
+typedef long HRESULT;
+typedef uint8_t BYTE;
+typedef uint16_t UINT16;
+typedef uint32_t UINT;
+
+#define S_OK ((HRESULT)0L)
+#define E_NOTIMPL ((HRESULT)0x80004001L)
+#define E_FAIL ((HRESULT)0x80004005L)
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)